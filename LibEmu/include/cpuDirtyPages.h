@@ -0,0 +1,141 @@
+/*****************************************************************************/
+/* Dirty memory page bitmap (256 byte pages of the CPU address space)        */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __cpuDirtyPages_h
+#define __cpuDirtyPages_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define cpuDIRTY_PAGE_SHIFT 8
+#define cpuDIRTY_PAGE_SIZE (1u << cpuDIRTY_PAGE_SHIFT)
+#define cpuDIRTY_PAGE_COUNT (0x10000 >> cpuDIRTY_PAGE_SHIFT)
+#define cpuDIRTY_BITMAP_WORD_COUNT (cpuDIRTY_PAGE_COUNT / 32)
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// One bit for every 256 byte page of the 64k address space, the bit is set when the page is written
+typedef struct
+{
+	uint32_t Bits[cpuDIRTY_BITMAP_WORD_COUNT];
+} cpuDirtyPageBitmap;
+
+/*****************************************************************************/
+/* Inline functions                                                          */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Clears all bits of the bitmap
+/// @param in_bitmap Bitmap to clear
+static inline void cpuDirtyPagesClear(cpuDirtyPageBitmap* in_bitmap)
+{
+	uint8_t i;
+
+	for (i = 0; i < cpuDIRTY_BITMAP_WORD_COUNT; i++)
+		in_bitmap->Bits[i] = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Marks the page of the given address as written
+/// @param in_bitmap Dirty page bitmap
+/// @param in_address Written address
+static inline void cpuDirtyPagesMark(cpuDirtyPageBitmap* in_bitmap, uint16_t in_address)
+{
+	in_bitmap->Bits[in_address >> (cpuDIRTY_PAGE_SHIFT + 5)] |= 1u << ((in_address >> cpuDIRTY_PAGE_SHIFT) & 31);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Marks the pages of an address range as written
+/// @param in_bitmap Dirty page bitmap
+/// @param in_address First written address
+/// @param in_length Number of written bytes (the range must not wrap around the end of the address space)
+static inline void cpuDirtyPagesMarkRange(cpuDirtyPageBitmap* in_bitmap, uint16_t in_address, uint32_t in_length)
+{
+	uint32_t page;
+
+	if (in_length == 0)
+		return;
+
+	for (page = in_address >> cpuDIRTY_PAGE_SHIFT; page <= (in_address + in_length - 1) >> cpuDIRTY_PAGE_SHIFT; page++)
+		in_bitmap->Bits[page >> 5] |= 1u << (page & 31);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Checks if the page was written
+/// @param in_bitmap Dirty page bitmap
+/// @param in_page Page index (address / cpuDIRTY_PAGE_SIZE)
+/// @return True if the page is marked as written
+static inline bool cpuDirtyPagesTest(const cpuDirtyPageBitmap* in_bitmap, uint8_t in_page)
+{
+	return (in_bitmap->Bits[in_page >> 5] & (1u << (in_page & 31))) != 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds the written pages of the source bitmap to the destination bitmap
+/// @param in_destination Bitmap to update
+/// @param in_source Bitmap to add
+static inline void cpuDirtyPagesMerge(cpuDirtyPageBitmap* in_destination, const cpuDirtyPageBitmap* in_source)
+{
+	uint8_t i;
+
+	for (i = 0; i < cpuDIRTY_BITMAP_WORD_COUNT; i++)
+		in_destination->Bits[i] |= in_source->Bits[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Moves the bits of a mirrored address range to the range of the mirrored memory
+/// @param in_bitmap Dirty page bitmap
+/// @param in_mirror_address Start address of the mirror (page aligned)
+/// @param in_address Start address of the mirrored memory (page aligned)
+/// @param in_length Length of the range in bytes (multiple of the page size)
+static inline void cpuDirtyPagesFoldMirror(cpuDirtyPageBitmap* in_bitmap, uint16_t in_mirror_address, uint16_t in_address, uint32_t in_length)
+{
+	uint32_t page;
+	uint8_t mirror_page;
+
+	for (page = 0; page < (in_length >> cpuDIRTY_PAGE_SHIFT); page++)
+	{
+		mirror_page = (uint8_t)((in_mirror_address >> cpuDIRTY_PAGE_SHIFT) + page);
+
+		if (cpuDirtyPagesTest(in_bitmap, mirror_page))
+		{
+			in_bitmap->Bits[mirror_page >> 5] &= ~(1u << (mirror_page & 31));
+			cpuDirtyPagesMark(in_bitmap, (uint16_t)(in_address + (page << cpuDIRTY_PAGE_SHIFT)));
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Counts the written pages
+/// @param in_bitmap Dirty page bitmap
+/// @return Number of pages marked as written
+static inline uint32_t cpuDirtyPagesCount(const cpuDirtyPageBitmap* in_bitmap)
+{
+	uint32_t count = 0;
+	uint32_t bits;
+	uint8_t i;
+
+	for (i = 0; i < cpuDIRTY_BITMAP_WORD_COUNT; i++)
+	{
+		for (bits = in_bitmap->Bits[i]; bits != 0; bits &= bits - 1)
+			count++;
+	}
+
+	return count;
+}
+
+#endif
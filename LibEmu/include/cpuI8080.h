@@ -13,6 +13,18 @@
 ///////////////////////////////////////////////////////////////////////////////
 // Includes
 #include <stdint.h>
+#ifdef cpuI8080_PROFILER
+#include <cpuProfiler.h>
+#endif
+#ifdef cpuI8080_TRACE
+#include <cpuTrace.h>
+#endif
+#ifdef cpuI8080_SNAPSHOT
+#include <emuSnapshot.h>
+#endif
+#ifdef cpuI8080_DIRTY_PAGES
+#include <cpuDirtyPages.h>
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // Constants
@@ -27,6 +39,14 @@
 #define cpuI8080_RST6 6
 #define cpuI8080_RST7 7
 
+// Memory map page size (1k pages by default)
+#ifndef cpuI8080_PAGE_SHIFT
+#define cpuI8080_PAGE_SHIFT 10
+#endif
+#define cpuI8080_PAGE_SIZE (1u << cpuI8080_PAGE_SHIFT)
+#define cpuI8080_PAGE_MASK (cpuI8080_PAGE_SIZE - 1)
+#define cpuI8080_PAGE_COUNT (0x10000 >> cpuI8080_PAGE_SHIFT)
+
 // Flag bits
 #define cpuI8080_F_CARRY         0x01
 #define cpuI8080_F_UN1           0x02
@@ -37,7 +57,105 @@
 #define cpuI8080_F_ZERO          0x40
 #define cpuI8080_F_SIGN          0x80
 
-typedef struct {
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+// Maximum distance of a backward jump checked for idle loop (bytes)
+#ifndef cpuI8080_IDLE_LOOP_LENGTH
+#define cpuI8080_IDLE_LOOP_LENGTH 32
+#endif
+#endif
+
+#if defined(cpuI8080_PREDECODE) || defined(cpuI8080_BLOCK_CACHE)
+// Pre-decoded instruction (see cpuI8080PredecodeMemory and the block cache)
+typedef struct
+{
+	uint8_t opcode;			/* handler index */
+	uint8_t cycles;			/* cycle count */
+	uint8_t length;			/* instruction length in bytes */
+	uint16_t immediate;	/* 8 or 16 bit operand */
+} cpuI8080DecodedInstruction;
+#endif
+
+struct _cpuI8080State;
+
+#ifdef cpuI8080_BLOCK_CACHE
+// Block cache settings (blocks are executed by the interpreter from pre-decoded instructions, no host code is generated)
+#define cpuI8080_BLOCK_MAX_INSTRUCTION_COUNT 32
+#ifndef cpuI8080_BLOCK_CACHE_SIZE
+#define cpuI8080_BLOCK_CACHE_SIZE 1024	/* must be power of two */
+#endif
+#define cpuI8080_BLOCK_LOG_SIZE (cpuI8080_BLOCK_MAX_INSTRUCTION_COUNT * 2 + 2)
+#endif
+
+// Memory mapped I/O handlers (used for pages without direct memory pointer)
+typedef uint8_t (*cpuI8080MemoryReadHandler)(struct _cpuI8080State* R, uint16_t in_address);
+typedef void (*cpuI8080MemoryWriteHandler)(struct _cpuI8080State* R, uint16_t in_address, uint8_t in_value);
+
+// I/O port handlers (IN and OUT instructions)
+typedef uint8_t (*cpuI8080PortReadHandler)(struct _cpuI8080State* R, uint16_t in_port);
+typedef void (*cpuI8080PortWriteHandler)(struct _cpuI8080State* R, uint16_t in_port, uint8_t in_value);
+
+#ifdef cpuI8080_BLOCK_CACHE
+// Execution modes
+typedef enum
+{
+	cpuI8080_EXEC_INTERPRETER,		/* every instruction is interpreted (reference) */
+	cpuI8080_EXEC_BLOCK,					/* straight code is executed from the pre-decoded instructions of the block cache */
+	cpuI8080_EXEC_DIFFERENTIAL		/* every block is executed from the block cache and interpreted as well, the results are compared */
+} cpuI8080ExecMode;
+
+// Cached block (straight code up to the first jump, call, return or halt instruction)
+typedef struct
+{
+	uint16_t address;					/* start address of the block */
+	uint8_t instruction_count;
+	uint8_t valid;
+	uint8_t first_page;				/* pages of the code of the block */
+	uint8_t last_page;
+	int32_t cycles;						/* maximum number of cycles of the block */
+	cpuI8080DecodedInstruction instructions[cpuI8080_BLOCK_MAX_INSTRUCTION_COUNT];
+} cpuI8080Block;
+
+// Memory write or port access log entry (differential mode)
+typedef struct
+{
+	uint16_t address;
+	uint8_t value;
+	uint8_t old_value;
+} cpuI8080BlockLogEntry;
+
+// Block cache
+typedef struct
+{
+	cpuI8080Block blocks[cpuI8080_BLOCK_CACHE_SIZE];
+	uint8_t code_page[cpuI8080_PAGE_COUNT];					/* page contains cached code */
+	uint8_t write_detected;													/* code page was written by the current block */
+
+	/* statistics */
+	uint32_t cached_block_count;
+	uint32_t invalidated_page_count;
+	uint32_t compared_block_count;
+	uint32_t mismatch_count;
+	uint16_t mismatch_address;			/* address of the last block with different result */
+
+	/* differential mode (original memory write map and port handlers, access logs of the passes) */
+	uint8_t pass;										/* 0 - block cache, 1 - interpreted */
+	uint8_t* write_page[cpuI8080_PAGE_COUNT];
+	cpuI8080MemoryWriteHandler write_handler[cpuI8080_PAGE_COUNT];
+	cpuI8080PortReadHandler port_read;
+	cpuI8080PortWriteHandler port_write;
+	cpuI8080BlockLogEntry memory_log[2][cpuI8080_BLOCK_LOG_SIZE];
+	uint8_t memory_log_length[2];
+	cpuI8080BlockLogEntry port_read_log[cpuI8080_BLOCK_LOG_SIZE];
+	uint8_t port_read_log_length;
+	uint8_t port_read_log_index;
+	cpuI8080BlockLogEntry port_write_log[cpuI8080_BLOCK_LOG_SIZE];
+	uint8_t port_write_log_length;
+	uint8_t port_write_log_index;
+	uint8_t port_mismatch;
+} cpuI8080BlockCache;
+#endif
+
+typedef struct _cpuI8080State {
 
   union {
     struct {
@@ -59,18 +177,102 @@ typedef struct {
   uint8_t ipend;        /* pending int */
 	uint8_t ac;						/* auxilary carry */
 	uint8_t halted;
+
+	/* memory map: direct page pointers or handler when the pointer is null */
+	uint8_t* read_page[cpuI8080_PAGE_COUNT];
+	uint8_t* write_page[cpuI8080_PAGE_COUNT];
+	cpuI8080MemoryReadHandler read_handler[cpuI8080_PAGE_COUNT];
+	cpuI8080MemoryWriteHandler write_handler[cpuI8080_PAGE_COUNT];
+	uint8_t unmapped_read_page[cpuI8080_PAGE_SIZE];		/* read by the unmapped address ranges */
+	uint8_t discard_write_page[cpuI8080_PAGE_SIZE];		/* written by the unmapped address ranges */
+
+	/* I/O ports */
+	cpuI8080PortReadHandler port_read;
+	cpuI8080PortWriteHandler port_write;
+
+#ifdef cpuI8080_PREDECODE
+	/* pre-decoded read-only code range */
+	const cpuI8080DecodedInstruction* decoded;
+	uint16_t decoded_address;
+	uint16_t decoded_length;
+#endif
+
+#ifdef cpuI8080_BLOCK_CACHE
+	/* block cache */
+	cpuI8080BlockCache* block_cache;
+	cpuI8080ExecMode exec_mode;
+#endif
+
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+	/* idle loop detection (state at the last short backward jump) */
+	uint16_t idle_pc;							/* address of the jump */
+	uint8_t idle_saved;						/* registers are saved */
+	uint16_t idle_reg[6];					/* copy of reg */
+	uint16_t idle_result;
+	uint8_t idle_ac;
+	uint8_t idle_i;
+	uint8_t idle_ipend;
+	uint8_t idle_quiet;						/* no memory write or port access since the jump */
+	int32_t idle_cycles;					/* cycle counter at the jump */
+	uint32_t idle_skipped_cycles;	/* number of cycles skipped in idle loops (statistics) */
+#endif
+
+#ifdef cpuI8080_PROFILER
+	/* guest code profiler (null when not profiled) */
+	cpuProfilerState* profiler;
+#endif
+
+#ifdef cpuI8080_TRACE
+	/* instruction trace buffer (null when not traced) */
+	cpuTraceBuffer* trace;
+#endif
+
+#ifdef cpuI8080_DIRTY_PAGES
+	/* pages written since the last clear */
+	cpuDirtyPageBitmap dirty_pages;
+#endif
+
+	void* user;						/* user data (machine context) */
+#ifdef cpuI8080_INSTRUCTION_COUNTER
+	uint32_t instruction_count;	/* number of executed instructions (diagnostics) */
+#endif
 } cpuI8080State;
 
 void cpuI8080Reset(cpuI8080State* R);
 
+void cpuI8080MemoryMapReset(cpuI8080State* R);
+void cpuI8080MapMemory(cpuI8080State* R, uint16_t in_address, uint32_t in_length, const uint8_t* in_read, uint8_t* in_write);
+void cpuI8080MapHandler(cpuI8080State* R, uint16_t in_address, uint32_t in_length, cpuI8080MemoryReadHandler in_read, cpuI8080MemoryWriteHandler in_write);
+uint8_t cpuI8080ReadMemory(cpuI8080State* R, uint16_t in_address);
+void cpuI8080WriteMemory(cpuI8080State* R, uint16_t in_address, uint8_t in_value);
+#ifdef cpuI8080_PREDECODE
+void cpuI8080PredecodeMemory(cpuI8080State* R, uint16_t in_address, uint32_t in_length, cpuI8080DecodedInstruction* in_buffer);
+void cpuI8080AttachDecodedMemory(cpuI8080State* R, uint16_t in_address, uint32_t in_length, const cpuI8080DecodedInstruction* in_buffer);
+#endif
+void cpuI8080SetPortHandlers(cpuI8080State* R, cpuI8080PortReadHandler in_read, cpuI8080PortWriteHandler in_write);
+#ifdef cpuI8080_BLOCK_CACHE
+void cpuI8080SetExecMode(cpuI8080State* R, cpuI8080ExecMode in_mode, cpuI8080BlockCache* in_cache);
+void cpuI8080FlushBlockCache(cpuI8080State* R);
+#endif
+
 void cpuI8080INT(cpuI8080State* R, uint16_t vector);
 int cpuI8080Exec(cpuI8080State* R, int cycles);
 void cpuI8080UpdateFlags(cpuI8080State* R);
-
-void WrI8080(register uint16_t Addr,register uint8_t Value);
-uint8_t RdI8080(register uint16_t Addr);
-
-void OutI8080(register uint16_t Port,register uint8_t Value);
-uint8_t InI8080(register uint16_t Port);
+uint8_t cpuI8080Disassemble(const uint8_t* in_code, uint16_t in_address, char* out_text);
+#ifdef cpuI8080_PROFILER
+void cpuI8080AttachProfiler(cpuI8080State* R, cpuProfilerState* in_profiler);
+void cpuI8080ProfilerReport(cpuI8080State* R, FILE* in_file);
+#endif
+#ifdef cpuI8080_TRACE
+void cpuI8080AttachTrace(cpuI8080State* R, cpuTraceBuffer* in_buffer);
+#endif
+#ifdef cpuI8080_DIRTY_PAGES
+const cpuDirtyPageBitmap* cpuI8080GetDirtyPages(cpuI8080State* R);
+void cpuI8080ClearDirtyPages(cpuI8080State* R);
+#endif
+#ifdef cpuI8080_SNAPSHOT
+void cpuI8080SaveState(cpuI8080State* R, emuSnapshotWriter* in_writer);
+void cpuI8080LoadState(cpuI8080State* R, emuSnapshotReader* in_reader);
+#endif
 
 #endif
@@ -0,0 +1,358 @@
+/*****************************************************************************/
+/* Intel 8080 CPU Emulator                                                   */
+/*   instruction implementations                                             */
+/*                                                                           */
+/* Copyright (C) 2015 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+// This file is included from cpuI8080Exec. Every instruction starts with
+// OPCODE(x) and ends with NEXT which are either switch cases and break or
+// threaded dispatch labels and dispatch of the next instruction.
+
+	/* MOVE, LOAD, AND STORE */
+OPCODE(0x40) NEXT;                         // mov b,b
+OPCODE(0x41) B(R) = C(R); NEXT;            // mov b,c
+OPCODE(0x42) B(R) = D(R); NEXT;            // mov b,d
+OPCODE(0x43) B(R) = E(R); NEXT;            // mov b,e
+OPCODE(0x44) B(R) = H(R); NEXT;            // mov b,h
+OPCODE(0x45) B(R) = L(R); NEXT;            // mov b,l
+OPCODE(0x46) B(R) = Read8(R, HL(R)); NEXT;  // mov b,M
+OPCODE(0x47) B(R) = A(R); NEXT;            // mov b,a
+
+OPCODE(0x48) C(R) = B(R); NEXT;            // mov c,b
+OPCODE(0x49) NEXT;                         // mov c,c
+OPCODE(0x4a) C(R) = D(R); NEXT;            // mov c,d
+OPCODE(0x4b) C(R) = E(R); NEXT;            // mov c,e
+OPCODE(0x4c) C(R) = H(R); NEXT;            // mov c,h
+OPCODE(0x4d) C(R) = L(R); NEXT;            // mov c,l
+OPCODE(0x4e) C(R) = Read8(R, HL(R)); NEXT;  // mov c,M
+OPCODE(0x4f) C(R) = A(R); NEXT;            // mov c,a
+
+OPCODE(0x50) D(R) = B(R); NEXT;            // mov d,b
+OPCODE(0x51) D(R) = C(R); NEXT;            // mov d,c
+OPCODE(0x52) NEXT;                         // mov d,d
+OPCODE(0x53) D(R) = E(R); NEXT;            // mov d,e
+OPCODE(0x54) D(R) = H(R); NEXT;            // mov d,h
+OPCODE(0x55) D(R) = L(R); NEXT;            // mov d,l
+OPCODE(0x56) D(R) = Read8(R, HL(R)); NEXT;  // mov d,M
+OPCODE(0x57) D(R) = A(R); NEXT;            // mov d,a
+
+OPCODE(0x58) E(R) = B(R); NEXT;            // mov e,b
+OPCODE(0x59) E(R) = C(R); NEXT;            // mov e,c
+OPCODE(0x5a) E(R) = D(R); NEXT;            // mov e,d
+OPCODE(0x5b) NEXT;                         // mov e,e
+OPCODE(0x5c) E(R) = H(R); NEXT;						// mov e,h
+OPCODE(0x5d) E(R) = L(R); NEXT;            // mov e,l
+OPCODE(0x5e) E(R) = Read8(R, HL(R)); NEXT;  // mov e,M
+OPCODE(0x5f) E(R) = A(R); NEXT;            // mov e,a
+
+OPCODE(0x60) H(R) = B(R); NEXT;						// mov h,b
+OPCODE(0x61) H(R) = C(R); NEXT;						// mov h,c
+OPCODE(0x62) H(R) = D(R); NEXT;						// mov h,d
+OPCODE(0x63) H(R) = E(R); NEXT;						// mov h,e
+OPCODE(0x64) NEXT;													// mov h,h
+OPCODE(0x65) H(R) = L(R); NEXT;						// mov h,l
+OPCODE(0x66) H(R) = Read8(R, HL(R)); NEXT;  // mov h,M
+OPCODE(0x67) H(R) = A(R); NEXT;						// mov h,a
+
+OPCODE(0x68) L(R) = B(R); NEXT;						// mov l,b
+OPCODE(0x69) L(R) = C(R); NEXT;						// mov l,c
+OPCODE(0x6a) L(R) = D(R); NEXT;						// mov l,d
+OPCODE(0x6b) L(R) = E(R); NEXT;						// mov l,e
+OPCODE(0x6c) L(R) = H(R); NEXT;						// mov l,h
+OPCODE(0x6d) NEXT;													// mov l,l
+OPCODE(0x6e) L(R) = Read8(R, HL(R)); NEXT;  // mov l,M
+OPCODE(0x6f) L(R) = A(R); NEXT;						// mov l,a
+
+OPCODE(0x70) Write8(R, HL(R), B(R)); NEXT;   // mov M,b
+OPCODE(0x71) Write8(R, HL(R), C(R)); NEXT;   // mov M,c
+OPCODE(0x72) Write8(R, HL(R), D(R)); NEXT;   // mov M,d
+OPCODE(0x73) Write8(R, HL(R), E(R)); NEXT;   // mov M,e
+OPCODE(0x74) Write8(R, HL(R), H(R)); NEXT;   // mov M,h
+OPCODE(0x75) Write8(R, HL(R), L(R)); NEXT;   // mov M,l
+																					// HLT
+OPCODE(0x77) Write8(R, HL(R), A(R)); NEXT;   // mov M,a
+
+OPCODE(0x78) A(R) = B(R); NEXT;						// mov a,b
+OPCODE(0x79) A(R) = C(R); NEXT;						// mov a,c
+OPCODE(0x7a) A(R) = D(R); NEXT;						// mov a,d
+OPCODE(0x7b) A(R) = E(R); NEXT;						// mov a,e
+OPCODE(0x7c) A(R) = H(R); NEXT;						// mov a,h
+OPCODE(0x7d) A(R) = L(R); NEXT;						// mov a,l
+OPCODE(0x7e) A(R) = Read8(R, HL(R)); NEXT;  // mov a,M
+OPCODE(0x7f) NEXT;													// mov a,a
+
+	/* MVI */
+OPCODE(0x06) B(R) = IMM8(R); PC(R)++; NEXT;							// mvi b,#
+OPCODE(0x0e) C(R) = IMM8(R); PC(R)++; NEXT;							// mvi c,#
+OPCODE(0x16) D(R) = IMM8(R); PC(R)++; NEXT;							// mvi d,#
+OPCODE(0x1e) E(R) = IMM8(R); PC(R)++; NEXT;							// mvi e,#
+OPCODE(0x26) H(R) = IMM8(R); PC(R)++; NEXT;							// mvi h,#
+OPCODE(0x2e) L(R) = IMM8(R); PC(R)++; NEXT;							// mvi l,#
+OPCODE(0x36) Write8(R, HL(R), IMM8(R)); PC(R)++; NEXT;    // mvi M,#
+OPCODE(0x3e) A(R) = IMM8(R); PC(R)++; NEXT;							// mvi a,#
+
+OPCODE(0x01) BC(R) = IMM16(R); PC(R)+=2; NEXT;						// lxi b,#
+OPCODE(0x11) DE(R) = IMM16(R); PC(R)+=2; NEXT;						// lxi d,#
+OPCODE(0x21) HL(R) = IMM16(R); PC(R)+=2; NEXT;						// lxi h,#
+
+OPCODE(0x02) Write8(R, BC(R), A(R)); NEXT;												// stax b
+OPCODE(0x12) Write8(R, DE(R), A(R)); NEXT;												// stax d
+OPCODE(0x0a) A(R) = Read8(R, BC(R)); NEXT;											// ldax b
+OPCODE(0x1a) A(R) = Read8(R, DE(R)); NEXT;											// ldax d
+OPCODE(0x22) temp_word = IMM16(R); Write8(R, temp_word, L(R)); Write8(R, temp_word+1, H(R)); SKIP16(R); NEXT;		// shld
+OPCODE(0x2a) temp_word = IMM16(R); L(R) = Read8(R, temp_word); H(R) = Read8(R, temp_word+1); SKIP16(R); NEXT;	// lhld
+OPCODE(0x32) Write8(R, IMM16(R), A(R)); SKIP16(R); NEXT;		// sta $
+OPCODE(0x3a) A(R) = Read8(R, IMM16(R)); SKIP16(R); NEXT;   // lda $
+
+OPCODE(0xeb) temp_word=DE(R); DE(R)=HL(R); HL(R)=temp_word; NEXT; // xchg
+
+
+	/* STACK OPS */
+OPCODE(0xc5) Push16(R, BC(R)); NEXT;     // push b
+OPCODE(0xd5) Push16(R, DE(R)); NEXT;     // push d
+OPCODE(0xe5) Push16(R, HL(R)); NEXT;     // push h
+OPCODE(0xf5) cpuI8080UpdateFlags(R); Push16(R, PSW(R)); NEXT;  // push psw
+
+OPCODE(0xc1) BC(R) = Pop16(R); NEXT;     // pop b
+OPCODE(0xd1) DE(R) = Pop16(R); NEXT;     // pop d
+OPCODE(0xe1) HL(R) = Pop16(R); NEXT;     // pop h
+OPCODE(0xf1) PSW(R) = Pop16(R); RES(R) = (F(R)<<8&0x100); AUX(R) = F(R)&cpuI8080_F_AUXCARRY; NEXT;  // pop psw
+
+OPCODE(0xe3) temp_word = Read8(R, SP(R)); temp_word |= Read8(R, SP(R)+1) << 8; Write8(R, SP(R), L(R)); Write8(R, SP(R)+1, H(R)); HL(R)=temp_word; NEXT; // xthl
+
+OPCODE(0xf9) SP(R) = HL(R); NEXT;    // sphl
+
+OPCODE(0x31) SP(R) = IMM16(R); SKIP16(R); NEXT;    // lxi sp,#
+
+OPCODE(0x33) SP(R)++; NEXT;					// inx sp
+OPCODE(0x3b) SP(R)--; NEXT;					// dcx sp
+
+
+	/* JUMP */
+OPCODE(0xc3) JUMP(R); NEXT;					// jmp $
+
+OPCODE(0xc2) if (ISNOTZERO(R)) { JUMP(R); } else { SKIP16(R); } NEXT;  // jnz $
+OPCODE(0xca) if (ISZERO(R)) { JUMP(R); } else { SKIP16(R); } NEXT;			// jz $
+OPCODE(0xd2) if (ISNOTCARRY(R)) { JUMP(R); } else { SKIP16(R); } NEXT; // jnc $
+OPCODE(0xda) if (ISCARRY(R)) { JUMP(R); } else { SKIP16(R); } NEXT;		// jc $
+OPCODE(0xe2) if (ISPODD(R)) { JUMP(R); } else { SKIP16(R); } NEXT;			// jpo $
+OPCODE(0xea) if (ISPEVEN(R)) { JUMP(R); } else { SKIP16(R); } NEXT;		// jpe $
+OPCODE(0xf2) if (ISPLUS(R)) { JUMP(R); } else { SKIP16(R); } NEXT;			// jp $
+OPCODE(0xfa) if (ISMIN(R)) { JUMP(R); } else { SKIP16(R); } NEXT;			// jm $
+
+OPCODE(0xe9) PC(R) = HL(R); NEXT;    // pchl
+
+	/* CALL */
+OPCODE(0xcd) CALL(R); NEXT;					// call $
+
+OPCODE(0xc4) if (ISNOTZERO(R)) { CCON(R); } else { SKIP16(R); } NEXT;  // cnz $
+OPCODE(0xcc) if (ISZERO(R)) { CCON(R); } else { SKIP16(R); } NEXT;			// cz $
+OPCODE(0xd4) if (ISNOTCARRY(R)) { CCON(R); } else { SKIP16(R); } NEXT; // cnc $
+OPCODE(0xdc) if (ISCARRY(R)) { CCON(R); } else { SKIP16(R); } NEXT;		// cc $
+OPCODE(0xe4) if (ISPODD(R)) { CCON(R); } else { SKIP16(R); } NEXT;			// cpo $
+OPCODE(0xec) if (ISPEVEN(R)) { CCON(R); } else { SKIP16(R); } NEXT;		// cpe $
+OPCODE(0xf4) if (ISPLUS(R)) { CCON(R); } else { SKIP16(R); } NEXT;			// cp $
+OPCODE(0xfc) if (ISMIN(R)) { CCON(R); } else { SKIP16(R); } NEXT;			// cm $
+
+
+	/* RETURN */
+OPCODE(0xc9) RET(R); NEXT;														// ret 
+
+OPCODE(0xc0) if (ISNOTZERO(R)) { RCON(R); } NEXT;		// rnz
+OPCODE(0xc8) if (ISZERO(R)) { RCON(R); } NEXT;				// rz
+OPCODE(0xd0) if (ISNOTCARRY(R)) { RCON(R); } NEXT;		// rnc
+OPCODE(0xd8) if (ISCARRY(R)) { RCON(R); } NEXT;			// rc
+OPCODE(0xe0) if (ISPODD(R)) { RCON(R); } NEXT;				// rpo
+OPCODE(0xe8) if (ISPEVEN(R)) { RCON(R); } NEXT;			// rpe
+OPCODE(0xf0) if (ISPLUS(R)) { RCON(R); } NEXT;				// rp
+OPCODE(0xf8) if (ISMIN(R)) { RCON(R); } NEXT;				// rm
+
+
+	/* RESTART */
+OPCODE(0xc7) 
+OPCODE(0xcf) 
+OPCODE(0xd7) 
+OPCODE(0xdf) 
+OPCODE(0xe7) 
+OPCODE(0xef) 
+OPCODE(0xf7) 
+OPCODE(0xff)
+	RST(R, opcode>>3&7); NEXT;    // rst x
+
+
+	/* INCREMENT AND DECREMENT */
+OPCODE(0x04) INR(R, B(R)); NEXT;     // inr b
+OPCODE(0x0c) INR(R, C(R)); NEXT;     // inr c
+OPCODE(0x14) INR(R, D(R)); NEXT;     // inr d
+OPCODE(0x1c) INR(R, E(R)); NEXT;     // inr e
+OPCODE(0x24) INR(R, H(R)); NEXT;     // inr h
+OPCODE(0x2c) INR(R, L(R)); NEXT;     // inr l
+OPCODE(0x34) temp_byte = Read8(R, HL(R)) + 1; Write8(R, HL(R),temp_byte); AUX(R)=l_cpu_inr_aux[temp_byte&0x0f]; CHGSZP(R, temp_byte); NEXT; // inr M
+OPCODE(0x3c) INR(R, A(R)); NEXT;     // inr a
+
+OPCODE(0x05) DCR(R, B(R)); NEXT;     // dcr b
+OPCODE(0x0d) DCR(R, C(R)); NEXT;     // dcr c
+OPCODE(0x15) DCR(R, D(R)); NEXT;     // dcr d
+OPCODE(0x1d) DCR(R, E(R)); NEXT;     // dcr e
+OPCODE(0x25) DCR(R, H(R)); NEXT;     // dcr h
+OPCODE(0x2d) DCR(R, L(R)); NEXT;     // dcr l
+OPCODE(0x35) temp_byte = Read8(R, HL(R)) - 1; Write8(R, HL(R),temp_byte); AUX(R)=l_cpu_dcr_aux[temp_byte&0x0f]; CHGSZP(R, temp_byte); NEXT; // dcr M
+OPCODE(0x3d) DCR(R, A(R)); NEXT;     // dcr a
+
+OPCODE(0x03) BC(R)++; NEXT;       // inx b
+OPCODE(0x13) DE(R)++; NEXT;       // inx d
+OPCODE(0x23) HL(R)++; NEXT;       // inx h
+
+OPCODE(0x0b) BC(R)--; NEXT;       // dcx b
+OPCODE(0x1b) DE(R)--; NEXT;       // dcx d
+OPCODE(0x2b) HL(R)--; NEXT;       // dcx h
+
+
+	/* ADD */
+OPCODE(0x80) ADD(R, B(R)); NEXT;     // add b
+OPCODE(0x81) ADD(R, C(R)); NEXT;     // add c
+OPCODE(0x82) ADD(R, D(R)); NEXT;     // add d
+OPCODE(0x83) ADD(R, E(R)); NEXT;     // add e
+OPCODE(0x84) ADD(R, H(R)); NEXT;     // add h
+OPCODE(0x85) ADD(R, L(R)); NEXT;     // add l
+OPCODE(0x86) temp_byte = Read8(R, HL(R)); ADD(R, temp_byte); NEXT;      // add M
+OPCODE(0x87) ADD(R, A(R)); NEXT;     // add a
+
+OPCODE(0x88) ADC(R, B(R)); NEXT;     // adc b
+OPCODE(0x89) ADC(R, C(R)); NEXT;     // adc c
+OPCODE(0x8a) ADC(R, D(R)); NEXT;     // adc d
+OPCODE(0x8b) ADC(R, E(R)); NEXT;     // adc e
+OPCODE(0x8c) ADC(R, H(R)); NEXT;     // adc h
+OPCODE(0x8d) ADC(R, L(R)); NEXT;     // adc l
+OPCODE(0x8e) temp_byte = Read8(R, HL(R)); ADC(R, temp_byte); NEXT;      // adc M
+OPCODE(0x8f) ADC(R, A(R)); NEXT;     // adc a
+
+OPCODE(0xc6) temp_byte = IMM8(R); ADD(R, temp_byte); PC(R)++; NEXT;    // adi #
+OPCODE(0xce) temp_byte = IMM8(R); ADC(R, temp_byte); PC(R)++; NEXT;    // aci #
+
+OPCODE(0x09) DAD(R, BC(R)); NEXT;      // dad b
+OPCODE(0x19) DAD(R, DE(R)); NEXT;      // dad d
+OPCODE(0x29) DAD(R, HL(R)); NEXT;      // dad h
+OPCODE(0x39) DAD(R, SP(R)); NEXT;      // dad sp
+
+
+	/* SUBTRACT */
+OPCODE(0x90) SUB(R, B(R)); NEXT;     // sub b
+OPCODE(0x91) SUB(R, C(R)); NEXT;     // sub c
+OPCODE(0x92) SUB(R, D(R)); NEXT;     // sub d
+OPCODE(0x93) SUB(R, E(R)); NEXT;     // sub e
+OPCODE(0x94) SUB(R, H(R)); NEXT;     // sub h
+OPCODE(0x95) SUB(R, L(R)); NEXT;     // sub l
+OPCODE(0x96) temp_byte = Read8(R, HL(R)); SUB(R, temp_byte); NEXT;      // sub M
+OPCODE(0x97) SUB(R, A(R)); NEXT;     // sub a
+
+OPCODE(0x98) SBB(R, B(R)); NEXT;     // sbb b
+OPCODE(0x99) SBB(R, C(R)); NEXT;     // sbb c
+OPCODE(0x9a) SBB(R, D(R)); NEXT;     // sbb d
+OPCODE(0x9b) SBB(R, E(R)); NEXT;     // sbb e
+OPCODE(0x9c) SBB(R, H(R)); NEXT;     // sbb h
+OPCODE(0x9d) SBB(R, L(R)); NEXT;     // sbb l
+OPCODE(0x9e) temp_byte = Read8(R, HL(R)); SBB(R, temp_byte); NEXT;      // sbb M
+OPCODE(0x9f) SBB(R, A(R)); NEXT;     // sbb a
+
+OPCODE(0xd6) temp_byte = IMM8(R); SUB(R, temp_byte); PC(R)++; NEXT;    // sui #
+OPCODE(0xde) temp_byte = IMM8(R); SBB(R, temp_byte); PC(R)++; NEXT;    // sbi #
+
+
+	/* LOGICAL */
+OPCODE(0xa0) ANA(R, B(R)); NEXT;     // ana b
+OPCODE(0xa1) ANA(R, C(R)); NEXT;     // ana c
+OPCODE(0xa2) ANA(R, D(R)); NEXT;     // ana d
+OPCODE(0xa3) ANA(R, E(R)); NEXT;     // ana e
+OPCODE(0xa4) ANA(R, H(R)); NEXT;     // ana h
+OPCODE(0xa5) ANA(R, L(R)); NEXT;     // ana l
+OPCODE(0xa6) temp_byte = Read8(R, HL(R)); ANA(R, temp_byte); NEXT;      // ana M
+OPCODE(0xa7) ANA(R, A(R)); NEXT;     // ana a
+
+OPCODE(0xe6) temp_byte = IMM8(R); ANA(R, temp_byte); PC(R)++; NEXT;    // ani #
+
+OPCODE(0xa8) XRA(R, B(R)); NEXT;     // xra b
+OPCODE(0xa9) XRA(R, C(R)); NEXT;     // xra c
+OPCODE(0xaa) XRA(R, D(R)); NEXT;     // xra d
+OPCODE(0xab) XRA(R, E(R)); NEXT;     // xra e
+OPCODE(0xac) XRA(R, H(R)); NEXT;     // xra h
+OPCODE(0xad) XRA(R, L(R)); NEXT;     // xra l
+OPCODE(0xae) temp_byte = Read8(R, HL(R)); XRA(R, temp_byte); NEXT;      // xra M
+OPCODE(0xaf) XRA(R, A(R)); NEXT;     // xra a
+
+OPCODE(0xee) temp_byte = IMM8(R); XRA(R, temp_byte); PC(R)++; NEXT;    // xri #
+
+OPCODE(0xb0) ORA(R, B(R)); NEXT;     // ora b
+OPCODE(0xb1) ORA(R, C(R)); NEXT;     // ora c
+OPCODE(0xb2) ORA(R, D(R)); NEXT;     // ora d
+OPCODE(0xb3) ORA(R, E(R)); NEXT;     // ora e
+OPCODE(0xb4) ORA(R, H(R)); NEXT;     // ora h
+OPCODE(0xb5) ORA(R, L(R)); NEXT;     // ora l
+OPCODE(0xb6) temp_byte = Read8(R, HL(R)); ORA(R, temp_byte); NEXT;      // ora M
+OPCODE(0xb7) ORA(R, A(R)); NEXT;     // ora a
+
+OPCODE(0xf6) temp_byte = IMM8(R); ORA(R, temp_byte); PC(R)++; NEXT;    // ori #
+
+OPCODE(0xb8) CMP(R, B(R)); NEXT;     // cmp b
+OPCODE(0xb9) CMP(R, C(R)); NEXT;     // cmp c
+OPCODE(0xba) CMP(R, D(R)); NEXT;     // cmp d
+OPCODE(0xbb) CMP(R, E(R)); NEXT;     // cmp e
+OPCODE(0xbc) CMP(R, H(R)); NEXT;     // cmp h
+OPCODE(0xbd) CMP(R, L(R)); NEXT;     // cmp l
+OPCODE(0xbe) temp_byte = Read8(R, HL(R)); CMP(R, temp_byte); NEXT;      // cmp M
+OPCODE(0xbf) CMP(R, A(R)); NEXT;     // cmp a
+
+OPCODE(0xfe) temp_byte = IMM8(R); CMP(R, temp_byte); PC(R)++; NEXT;    // cpi #
+
+
+	/* ROTATE */
+OPCODE(0x07) RES(R)=(RES(R)&0xff)|(A(R)<<1&0x100); A(R) = (A(R)<<1&0xfe)|(RES(R)>>8&1); NEXT;													// rlc
+OPCODE(0x0f) RES(R)=(RES(R)&0xff)|(A(R)<<8&0x100); A(R) = (A(R)>>1&0x7f)|(RES(R)>>1&0x80); NEXT;												// rrc
+OPCODE(0x17) temp_word=((uint16_t)A(R))<<1&0x100; A(R)=A(R)<<1|(RES(R)>>8&1); RES(R)=(RES(R)&0xff)|temp_word; NEXT;		// ral
+OPCODE(0x1f) temp_word=((uint16_t)A(R))<<8&0x100; A(R)=A(R)>>1|(RES(R)>>1&0x80); RES(R)=(RES(R)&0xff)|temp_word; NEXT; // rar
+
+
+	/* SPECIALS */
+OPCODE(0x2f) A(R) = ~A(R); NEXT;				// cma
+OPCODE(0x37) RES(R) |= 0x100; NEXT;    // stc
+OPCODE(0x3f) RES(R) ^= 0x100; NEXT;    // cmc
+
+OPCODE(0x27)                            // daa
+	{
+		int c=RES(R);
+		uint8_t value_to_add = 0;
+		if (AUX(R)||((A(R)&0xf)>9))
+		{
+			value_to_add = 6; 
+		}
+		if ((c&0x100) || ((A(R)&0xf0)>0x90) || (((A(R)&0xf0)>=0x90) && (A(R) & 0x0f) > 9)) 
+		{
+			value_to_add |= 0x60;
+          c |= 0x100;
+        }
+		RES(R) = A(R) + value_to_add; 
+		AUX(R)=ADDAUX(R,value_to_add); // set aux carry
+		A(R)=RES(R)&0xff;								// store result in A
+		RES(R)=c;												// store carry
+		CHGSZP(R, A(R)); // set other flag bits (PZS)
+		NEXT;
+	}
+
+
+	/* INPUT/OUTPUT */
+OPCODE(0xd3) IDLE_BREAK(R); R->port_write(R, IMM8(R), A(R)); PC(R)++; NEXT;	// out p
+OPCODE(0xdb) IDLE_BREAK(R); A(R)=R->port_read(R, IMM8(R)); PC(R)++; NEXT;		// in p
+
+
+	/* CONTROL */
+OPCODE(0xf3) INT(R) = 0; NEXT;																												// di
+OPCODE(0xfb) INT(R) = 1; if (IPEND(R) & 0x80) cpuI8080INT(R, IPEND(R) & 0x7f); NEXT; // ei 
+OPCODE(0x00) NEXT;       // nop
+OPCODE(0x76) HALTED(R) = 1; PC(R)--; HALT(R); NEXT;	// hlt (mov M,M)
+
+OPCODE_ILLEGAL TRACE_ILLEGAL(R); NEXT;
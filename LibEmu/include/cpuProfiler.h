@@ -0,0 +1,129 @@
+/*****************************************************************************/
+/* Guest code profiler (opcode, address and subroutine statistics)           */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __cpuProfiler_h
+#define __cpuProfiler_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define cpuPROFILER_ADDRESS_COUNT 0x10000
+#define cpuPROFILER_CALL_STACK_DEPTH 64
+#define cpuPROFILER_REPORT_LINE_COUNT 32
+#define cpuPROFILER_MAX_INSTRUCTION_LENGTH 4
+#define cpuPROFILER_TEXT_LENGTH 32
+
+// Opcode tables (i8080 uses the main table only)
+typedef enum
+{
+	cpuPROFILER_OPCODES_MAIN,
+	cpuPROFILER_OPCODES_CB,
+	cpuPROFILER_OPCODES_ED,
+	cpuPROFILER_OPCODES_DD,
+	cpuPROFILER_OPCODES_FD,
+	cpuPROFILER_OPCODES_DDCB,
+	cpuPROFILER_OPCODES_FDCB,
+
+	cpuPROFILER_OPCODE_TABLE_COUNT
+} cpuProfilerOpcodeTable;
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// Disassembles one instruction into the text buffer (cpuPROFILER_TEXT_LENGTH bytes), returns the length of the instruction
+typedef uint8_t (*cpuProfilerDisassembler)(const uint8_t* in_code, uint16_t in_address, char* out_text);
+
+/// Reads guest memory without side effects (for disassembly)
+typedef uint8_t (*cpuProfilerMemoryRead)(void* in_cpu, uint16_t in_address);
+
+/// Called subroutine on the shadow call stack
+typedef struct
+{
+	uint16_t Address;				/* address of the subroutine */
+	uint16_t ReturnAddress;	/* address pushed by the call */
+	uint64_t StartCycles;		/* profiler cycle counter at the call */
+} cpuProfilerCallFrame;
+
+/// Collected statistics
+typedef struct
+{
+	uint64_t Cycles;
+	uint64_t InstructionCount;
+
+	// executions per opcode
+	uint64_t OpcodeCount[cpuPROFILER_OPCODE_TABLE_COUNT][256];
+
+	// executions and cycles per instruction address
+	uint32_t AddressCount[cpuPROFILER_ADDRESS_COUNT];
+	uint64_t AddressCycles[cpuPROFILER_ADDRESS_COUNT];
+
+	// calls and inclusive cycles per subroutine address
+	uint32_t CallCount[cpuPROFILER_ADDRESS_COUNT];
+	uint64_t CallCycles[cpuPROFILER_ADDRESS_COUNT];
+
+	// shadow call stack matching calls and returns
+	cpuProfilerCallFrame CallStack[cpuPROFILER_CALL_STACK_DEPTH];
+	uint32_t CallDepth;
+	uint32_t UnmatchedReturnCount;		/* return without call (e.g. computed jump through the stack) */
+	uint32_t CallStackOverflowCount;	/* call not recorded because the shadow stack is full */
+} cpuProfilerState;
+
+/// Profiled CPU description for the report
+typedef struct
+{
+	const char* Name;
+	void* CPU;
+	cpuProfilerMemoryRead ReadMemory;
+	cpuProfilerDisassembler Disassemble;
+	uint8_t OpcodeTableCount;
+} cpuProfilerTarget;
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+void cpuProfilerReset(cpuProfilerState* in_profiler);
+void cpuProfilerCall(cpuProfilerState* in_profiler, uint16_t in_address, uint16_t in_return_address);
+void cpuProfilerReturn(cpuProfilerState* in_profiler, uint16_t in_return_address);
+void cpuProfilerReport(cpuProfilerState* in_profiler, const cpuProfilerTarget* in_target, FILE* in_file);
+
+/*****************************************************************************/
+/* Inline functions                                                          */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Counts one executed opcode
+/// @param in_profiler Profiler state
+/// @param in_table Opcode table (prefix) of the opcode
+/// @param in_opcode Opcode
+static inline void cpuProfilerOpcode(cpuProfilerState* in_profiler, cpuProfilerOpcodeTable in_table, uint8_t in_opcode)
+{
+	in_profiler->OpcodeCount[in_table][in_opcode]++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Counts one executed instruction and its cycles
+/// @param in_profiler Profiler state
+/// @param in_address Address of the instruction
+/// @param in_cycles Cycles used by the instruction
+static inline void cpuProfilerInstruction(cpuProfilerState* in_profiler, uint16_t in_address, uint32_t in_cycles)
+{
+	in_profiler->Cycles += in_cycles;
+	in_profiler->InstructionCount++;
+	in_profiler->AddressCount[in_address]++;
+	in_profiler->AddressCycles[in_address] += in_cycles;
+}
+
+#endif
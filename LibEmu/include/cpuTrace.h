@@ -0,0 +1,153 @@
+/*****************************************************************************/
+/* Binary instruction trace ring buffer                                      */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __cpuTrace_h
+#define __cpuTrace_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define cpuTRACE_FILE_MAGIC 0x45435254		// "TRCE" in little endian byte order
+#define cpuTRACE_FILE_VERSION 1
+#define cpuTRACE_CODE_LENGTH 4
+#define cpuTRACE_NO_BREAKPOINT 0x10000		// breakpoint address which never matches
+
+// Traced CPU
+typedef enum
+{
+	cpuTRACE_CPU_UNKNOWN,
+	cpuTRACE_CPU_I8080,
+	cpuTRACE_CPU_Z80
+} cpuTraceCPUType;
+
+// State of the trace buffer
+typedef enum
+{
+	cpuTRACE_RECORDING,			// instructions are recorded
+	cpuTRACE_TRIGGERED			// recording is stopped by a trigger, content is kept for saving
+} cpuTraceState;
+
+// Reason of stopping the recording
+typedef enum
+{
+	cpuTRACE_TRIGGER_NONE,
+	cpuTRACE_TRIGGER_BREAKPOINT,				// breakpoint address is reached
+	cpuTRACE_TRIGGER_ILLEGAL_OPCODE,		// undefined opcode is executed
+	cpuTRACE_TRIGGER_USER								// requested by the user (e.g. key press)
+} cpuTraceTrigger;
+
+// Memory ordering between the recording CPU and the saving thread
+#if defined(__GNUC__)
+#define cpuTRACE_RELEASE_BARRIER() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define cpuTRACE_ACQUIRE_BARRIER() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#elif defined(_MSC_VER)
+#define cpuTRACE_RELEASE_BARRIER() _ReadWriteBarrier()
+#define cpuTRACE_ACQUIRE_BARRIER() _ReadWriteBarrier()
+#else
+#define cpuTRACE_RELEASE_BARRIER()
+#define cpuTRACE_ACQUIRE_BARRIER()
+#endif
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// One executed instruction (registers before the execution). Records are stored in the file in host byte order.
+typedef struct
+{
+	uint64_t Cycles;								/* CPU cycles since the start of the recording */
+	uint16_t PC;
+	uint16_t AF, BC, DE, HL, SP;
+	uint16_t IX, IY;								/* zero on i8080 */
+	uint8_t Code[cpuTRACE_CODE_LENGTH];		/* instruction bytes */
+	uint8_t InterruptEnable;				/* IFF (Z80) or interrupt enable bit (i8080) */
+	uint8_t Reserved[3];
+} cpuTraceRecord;
+
+/// Header of the trace file, followed by the records (oldest first) until the end of the file
+typedef struct
+{
+	uint32_t Magic;
+	uint16_t Version;
+	uint16_t RecordSize;
+	uint8_t CPUType;
+	uint8_t Trigger;
+	uint16_t TriggerAddress;
+	uint32_t Reserved;
+} cpuTraceFileHeader;
+
+/// Ring buffer of the last executed instructions. Single producer (the CPU) writes the records and publishes
+/// the record counter after every record, saving can be done from any thread without locking.
+typedef struct
+{
+	cpuTraceRecord* Records;
+	uint32_t Mask;									/* capacity - 1 (capacity is power of two) */
+	volatile uint32_t Head;					/* number of the written records */
+	volatile uint8_t State;					/* cpuTraceState */
+	uint8_t Trigger;								/* cpuTraceTrigger */
+	uint16_t TriggerAddress;				/* PC when the recording was stopped */
+	uint32_t BreakpointAddress;			/* recording stops when PC reaches this address (cpuTRACE_NO_BREAKPOINT: none) */
+	uint64_t CycleBase;							/* recorded CPU cycles before the current execution slice */
+	uint8_t CPUType;								/* cpuTraceCPUType (set by the CPU when attached) */
+} cpuTraceBuffer;
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+void cpuTraceInitialize(cpuTraceBuffer* in_buffer, cpuTraceRecord* in_records, uint32_t in_capacity);
+void cpuTraceReset(cpuTraceBuffer* in_buffer);
+void cpuTraceSetBreakpoint(cpuTraceBuffer* in_buffer, uint32_t in_address);
+void cpuTraceStop(cpuTraceBuffer* in_buffer, cpuTraceTrigger in_trigger, uint16_t in_address);
+bool cpuTraceSave(cpuTraceBuffer* in_buffer, const char* in_file_name);
+
+/*****************************************************************************/
+/* Inline functions                                                          */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Checks if recording is stopped by a trigger
+/// @param in_buffer Trace buffer
+/// @return True if the buffer is waiting for saving
+static inline bool cpuTraceIsTriggered(cpuTraceBuffer* in_buffer)
+{
+	return in_buffer->State == cpuTRACE_TRIGGERED;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets the next record to fill (overwrites the oldest one when the buffer is full)
+/// @param in_buffer Trace buffer
+/// @return Record to fill, must be followed by cpuTraceEndRecord
+static inline cpuTraceRecord* cpuTraceBeginRecord(cpuTraceBuffer* in_buffer)
+{
+	return &in_buffer->Records[in_buffer->Head & in_buffer->Mask];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Publishes the filled record and checks the breakpoint
+/// @param in_buffer Trace buffer
+/// @param in_pc Address of the recorded instruction
+static inline void cpuTraceEndRecord(cpuTraceBuffer* in_buffer, uint16_t in_pc)
+{
+	cpuTRACE_RELEASE_BARRIER();
+	in_buffer->Head = in_buffer->Head + 1;
+
+	if (in_pc == in_buffer->BreakpointAddress)
+		cpuTraceStop(in_buffer, cpuTRACE_TRIGGER_BREAKPOINT, in_pc);
+}
+
+#endif
@@ -14,6 +14,18 @@
 #define Z80_H
 
 #include <stdint.h>
+#ifdef cpuZ80_PROFILER
+#include <cpuProfiler.h>
+#endif
+#ifdef cpuZ80_TRACE
+#include <cpuTrace.h>
+#endif
+#ifdef cpuZ80_SNAPSHOT
+#include <emuSnapshot.h>
+#endif
+#ifdef cpuZ80_DIRTY_PAGES
+#include <cpuDirtyPages.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -58,6 +70,32 @@ extern "C" {
 #define IFF_EI      0x20       /* 1: EI pending              */
 #define IFF_HALT    0x80       /* 1: CPU HALTed              */
 
+/** Lazy flags ***********************************************/
+/** With cpuZ80_LAZY_FLAGS defined the 8-bit arithmetic and **/
+/** logic instructions only record their operands and the   **/
+/** F register is computed when an instruction reads it.    **/
+/** F is always up to date outside of cpuExecute() and when **/
+/** the patch and debug functions are called.               **/
+/*************************************************************/
+#define cpuZ80_FLAGS_NONE 0    /* F register is up to date   */
+#define cpuZ80_FLAGS_ADD  1    /* ADD, ADC                   */
+#define cpuZ80_FLAGS_SUB  2    /* SUB, SBC, CP, NEG          */
+#define cpuZ80_FLAGS_AND  3    /* AND                        */
+#define cpuZ80_FLAGS_OR   4    /* OR, XOR                    */
+#define cpuZ80_FLAGS_INC  5    /* INC r                      */
+#define cpuZ80_FLAGS_DEC  6    /* DEC r                      */
+
+/** Idle loops ***********************************************/
+/** With cpuZ80_IDLE_LOOP_SKIP defined short backward jumps **/
+/** are checked for loops waiting for a memory or an I/O    **/
+/** change. When such a loop repeats without memory write   **/
+/** or port access and with the same registers, it is       **/
+/** fast-forwarded to the end of the requested cycles.      **/
+/*************************************************************/
+#ifndef cpuZ80_IDLE_LOOP_LENGTH
+#define cpuZ80_IDLE_LOOP_LENGTH 32 /* Max. backward jump distance */
+#endif
+
 /** Simple Datatypes *****************************************/
 /** NOTICE: sizeof(byte)=1 and sizeof(word)=2               **/
 /*************************************************************/
@@ -71,6 +109,26 @@ typedef unsigned short uint16_t;
 #endif
 typedef signed char offset;
 
+/** Memory map ***********************************************/
+/** Memory is divided into pages (1k by default). Each page **/
+/** has a direct read and write pointer. Accesses to pages  **/
+/** with null pointer are routed to the page's handler.     **/
+/*************************************************************/
+#ifndef cpuZ80_PAGE_SHIFT
+#define cpuZ80_PAGE_SHIFT 10
+#endif
+#define cpuZ80_PAGE_SIZE  (1u << cpuZ80_PAGE_SHIFT)
+#define cpuZ80_PAGE_MASK  (cpuZ80_PAGE_SIZE - 1)
+#define cpuZ80_PAGE_COUNT (0x10000 >> cpuZ80_PAGE_SHIFT)
+
+struct _cpuZ80State;
+
+typedef uint8_t (*cpuZ80MemoryReadHandler)(struct _cpuZ80State *R, uint16_t in_address);
+typedef void (*cpuZ80MemoryWriteHandler)(struct _cpuZ80State *R, uint16_t in_address, uint8_t in_value);
+typedef void (*cpuZ80MemoryBlockWriteHandler)(struct _cpuZ80State *R, uint16_t in_address, const uint8_t *in_data, uint16_t in_length);
+typedef uint8_t (*cpuZ80PortReadHandler)(struct _cpuZ80State *R, uint16_t in_port);
+typedef void (*cpuZ80PortWriteHandler)(struct _cpuZ80State *R, uint16_t in_port, uint8_t in_value);
+
 /** Structured Datatypes *************************************/
 /** NOTICE: #define LSB_FIRST for machines where least      **/
 /**         signifcant byte goes first.                     **/
@@ -85,7 +143,7 @@ typedef union
   uint16_t W;
 } pair;
 
-typedef struct
+typedef struct _cpuZ80State
 {
   pair AF,BC,DE,HL,IX,IY,PC,SP;       /* Main registers      */
   pair AF1,BC1,DE1,HL1;               /* Shadow registers    */
@@ -101,6 +159,48 @@ typedef struct
   uint16_t Trap;          /* Set Trap to address to trace from   */
   uint8_t Trace;					/* Set Trace=1 to start tracing        */
   void *User;							/* Arbitrary user data (ID,RAM*,etc.)  */
+
+  uint8_t *ReadPage[cpuZ80_PAGE_COUNT];   /* Data read pointers (null: handler)  */
+  uint8_t *WritePage[cpuZ80_PAGE_COUNT];  /* Write pointers (null: handler)      */
+  uint8_t *FetchPage[cpuZ80_PAGE_COUNT];  /* Opcode/operand fetch pointers       */
+  cpuZ80MemoryReadHandler ReadHandler[cpuZ80_PAGE_COUNT];   /* MMIO read  */
+  cpuZ80MemoryWriteHandler WriteHandler[cpuZ80_PAGE_COUNT]; /* MMIO write */
+  cpuZ80MemoryBlockWriteHandler BlockWriteHandler[cpuZ80_PAGE_COUNT]; /* LDIR/LDDR */
+  uint8_t UnmappedReadPage[cpuZ80_PAGE_SIZE];  /* Read by unmapped pages     */
+  uint8_t DiscardWritePage[cpuZ80_PAGE_SIZE];  /* Written by unmapped pages  */
+  cpuZ80PortReadHandler PortRead;     /* IN instructions                */
+  cpuZ80PortWriteHandler PortWrite;   /* OUT instructions               */
+#ifdef cpuZ80_INSTRUCTION_COUNTER
+  uint32_t InstructionCount;	/* Number of executed instructions     */
+#endif
+#ifdef cpuZ80_LAZY_FLAGS
+  uint8_t FlagOp;         /* Pending flag operation (cpuZ80_FLAGS_*) */
+  uint8_t FlagA;          /* A register before the operation     */
+  uint8_t FlagOperand;    /* Second operand of the operation     */
+  uint8_t FlagResult;     /* 8-bit result of the operation       */
+  uint8_t FlagCarry;      /* Carry flag after the operation      */
+#endif
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+  uint16_t IdlePC;        /* Address of the checked jump         */
+  uint8_t IdleSaved;      /* 1: Registers at the jump are saved  */
+  uint8_t IdleQuiet;      /* 1: No memory write or port access   */
+  int IdleCount;          /* ICount at the jump                  */
+  uint32_t IdleCycles;    /* Cycles skipped in idle loops        */
+  pair IdleRegs[12];      /* AF..HL1 at the jump                 */
+  uint8_t IdleIFF,IdleI,IdleR;
+#ifdef cpuZ80_LAZY_FLAGS
+  uint8_t IdleFlags[5];   /* FlagOp..FlagCarry at the jump       */
+#endif
+#endif
+#ifdef cpuZ80_PROFILER
+  cpuProfilerState *Profiler; /* Attached profiler (null: none)  */
+#endif
+#ifdef cpuZ80_TRACE
+  cpuTraceBuffer *TraceBuffer; /* Instruction trace (null: none) */
+#endif
+#ifdef cpuZ80_DIRTY_PAGES
+  cpuDirtyPageBitmap DirtyPages; /* Pages written since clear    */
+#endif
 } cpuZ80State;
 
 /** ResetZ80() ***********************************************/
@@ -122,6 +222,14 @@ int cpuExecute(register cpuZ80State *R,register int in_cycles_requested);
 /*************************************************************/
 void cpuInt(register cpuZ80State *R,register uint16_t in_vector);
 
+/** cpuZ80EndExecute() ***************************************/
+/** Makes the running cpuExecute() return when the given    **/
+/** number of cycles is executed since it was called, if it **/
+/** would run longer. Called by the I/O handlers scheduling **/
+/** an event earlier than the end of the execution.         **/
+/*************************************************************/
+void cpuZ80EndExecute(register cpuZ80State *R,int in_cycles);
+
 /** RunZ80() *************************************************/
 /** This function will run Z80 code until an LoopZ80() call **/
 /** returns INT_QUIT. It will return the PC at which        **/
@@ -129,20 +237,105 @@ void cpuInt(register cpuZ80State *R,register uint16_t in_vector);
 /*************************************************************/
 uint16_t RunZ80(register cpuZ80State *R);
 
-/** RdZ80()/WrZ80() ******************************************/
-/** These functions are called when access to RAM occurs.   **/
-/** They allow to control memory access.                    **/
-/************************************ TO BE WRITTEN BY USER **/
-void cpuMemWrite(register uint16_t in_address, register uint8_t in_value);
-uint8_t cpuMemRead(register uint16_t in_address);
+/** cpuZ80MemoryMapReset() **********************************/
+/** Sets all pages and I/O ports to unmapped: reads return  **/
+/** 0xFF, writes are ignored.                               **/
+/*************************************************************/
+void cpuZ80MemoryMapReset(register cpuZ80State *R);
 
-/** InZ80()/OutZ80() *****************************************/
-/** Z80 emulation calls these functions to read/write from  **/
-/** I/O ports. There can be 65536 I/O ports, but only first **/
-/** 256 are usually used.                                   **/
-/************************************ TO BE WRITTEN BY USER **/
-void cpuOut(register uint16_t in_port,register uint8_t in_value);
-uint8_t cpuIn(register uint16_t in_port);
+/** cpuZ80MapMemory() ****************************************/
+/** Maps memory blocks directly to a page aligned address   **/
+/** range. Null read block makes the range unmapped, null   **/
+/** write block makes it read-only. Calling it again on the **/
+/** same range switches banks.                              **/
+/*************************************************************/
+void cpuZ80MapMemory(register cpuZ80State *R, uint16_t in_address, uint32_t in_length, const uint8_t *in_read, uint8_t *in_write);
+
+/** cpuZ80MapHandler() ***************************************/
+/** Routes reads and/or writes of a page aligned address    **/
+/** range to memory mapped I/O handlers. Opcodes fetched    **/
+/** from a range with read handler are read as 0xFF.        **/
+/*************************************************************/
+void cpuZ80MapHandler(register cpuZ80State *R, uint16_t in_address, uint32_t in_length, cpuZ80MemoryReadHandler in_read, cpuZ80MemoryWriteHandler in_write);
+
+/** cpuZ80MapBlockWriteHandler() *****************************/
+/** Sets the handler receiving the bytes of an LDIR/LDDR    **/
+/** transfer to a range with write handler at once. It must **/
+/** have the same effect as calling the write handler for   **/
+/** every byte in ascending address order. Mapping the      **/
+/** range again removes it.                                 **/
+/*************************************************************/
+void cpuZ80MapBlockWriteHandler(register cpuZ80State *R, uint16_t in_address, uint32_t in_length, cpuZ80MemoryBlockWriteHandler in_write);
+
+/** cpuZ80ReadMemory()/cpuZ80WriteMemory() *******************/
+/** Access memory through the memory map (for debuggers and **/
+/** memory mapped I/O handlers).                            **/
+/*************************************************************/
+uint8_t cpuZ80ReadMemory(register cpuZ80State *R, uint16_t in_address);
+void cpuZ80WriteMemory(register cpuZ80State *R, uint16_t in_address, uint8_t in_value);
+
+/** cpuZ80SetPortHandlers() *********************************/
+/** Sets the handlers called by the IN and OUT instructions **/
+/** of this CPU. There can be 65536 I/O ports, but only     **/
+/** first 256 are usually used. Null handler makes the      **/
+/** ports unmapped.                                         **/
+/*************************************************************/
+void cpuZ80SetPortHandlers(register cpuZ80State *R, cpuZ80PortReadHandler in_read, cpuZ80PortWriteHandler in_write);
+
+/** cpuZ80Disassemble() **************************************/
+/** Disassembles one instruction from the given 4 bytes of  **/
+/** code into the text buffer (at least 24 characters).     **/
+/** Returns the length of the instruction.                  **/
+/*************************************************************/
+uint8_t cpuZ80Disassemble(const uint8_t *in_code, uint16_t in_address, char *out_text);
+
+#ifdef cpuZ80_PROFILER
+/** cpuZ80AttachProfiler() ***********************************/
+/** Attaches profiler collecting opcode, address and        **/
+/** subroutine statistics of the CPU (null to detach).      **/
+/*************************************************************/
+void cpuZ80AttachProfiler(register cpuZ80State *R, cpuProfilerState *in_profiler);
+
+/** cpuZ80ProfilerReport() ***********************************/
+/** Writes report of the attached profiler.                 **/
+/*************************************************************/
+void cpuZ80ProfilerReport(register cpuZ80State *R, FILE *in_file);
+#endif
+
+#ifdef cpuZ80_TRACE
+/** cpuZ80AttachTrace() **************************************/
+/** Attaches trace buffer recording the executed            **/
+/** instructions (null to detach).                          **/
+/*************************************************************/
+void cpuZ80AttachTrace(register cpuZ80State *R, cpuTraceBuffer *in_buffer);
+#endif
+
+#ifdef cpuZ80_DIRTY_PAGES
+/** cpuZ80GetDirtyPages() ************************************/
+/** Returns the 256 byte pages written since the last call  **/
+/** of cpuZ80ClearDirtyPages().                             **/
+/*************************************************************/
+const cpuDirtyPageBitmap *cpuZ80GetDirtyPages(register cpuZ80State *R);
+
+/** cpuZ80ClearDirtyPages() **********************************/
+/** Clears the dirty page bitmap (e.g. at the end of frame). **/
+/*************************************************************/
+void cpuZ80ClearDirtyPages(register cpuZ80State *R);
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+/** cpuZ80SaveState() ****************************************/
+/** Saves registers and interrupt state into the snapshot.  **/
+/** Memory map and attached diagnostics are not saved.      **/
+/*************************************************************/
+void cpuZ80SaveState(register cpuZ80State *R, emuSnapshotWriter *in_writer);
+
+/** cpuZ80LoadState() ****************************************/
+/** Restores registers and interrupt state from the         **/
+/** snapshot.                                               **/
+/*************************************************************/
+void cpuZ80LoadState(register cpuZ80State *R, emuSnapshotReader *in_reader);
+#endif
 
 /** PatchZ80() ***********************************************/
 /** Z80 emulation calls this function when it encounters a  **/
@@ -12,7 +12,7 @@
 /*************************************************************/
 
 /** This is a special patch for emulating BIOS calls: ********/
-case DB_FE:     cpuZ80Patch(R);break;
+case DB_FE:     F_SYNC;cpuZ80Patch(R);break;
 /*************************************************************/
 
 case ADC_HL_BC: M_ADCW(BC);break;
@@ -76,6 +76,7 @@ case LD_SP_xWORDe:
   break;
 
 case RRD:
+  F_SYNC;
   I=cpuMemRead(R->HL.W);
   J.B.l=(I>>4)|(R->AF.B.h<<4);
   cpuMemWrite(R->HL.W,J.B.l);
@@ -83,6 +84,7 @@ case RRD:
   R->AF.B.l=PZSTable[R->AF.B.h]|(R->AF.B.l&C_FLAG);
   break;
 case RLD:
+  F_SYNC;
   I=cpuMemRead(R->HL.W);
   J.B.l=(I<<4)|(R->AF.B.h&0x0F);
   cpuMemWrite(R->HL.W,J.B.l);
@@ -91,11 +93,13 @@ case RLD:
   break;
 
 case LD_A_I:
+  F_SYNC;
   R->AF.B.h=R->I;
   R->AF.B.l=(R->AF.B.l&C_FLAG)|(R->IFF&IFF_2? P_FLAG:0)|ZSTable[R->AF.B.h];
   break;
 
 case LD_A_R:
+  F_SYNC;
   R->R++;
   R->AF.B.h=(uint8_t)(R->R+R->ICount);
   R->AF.B.l=(R->AF.B.l&C_FLAG)|(R->IFF&IFF_2? P_FLAG:0)|ZSTable[R->AF.B.h];
@@ -132,12 +136,14 @@ case OUT_xC_L: cpuOut(R->BC.W,R->HL.B.l);break;
 case OUT_xC_A: cpuOut(R->BC.W,R->AF.B.h);break;
 
 case INI:
+  F_DONE;
 	cpuMemWrite(R->HL.W++,cpuIn(R->BC.W));
   --R->BC.B.h;
   R->AF.B.l=N_FLAG|(R->BC.B.h? 0:Z_FLAG);
   break;
 
 case INIR:
+  F_DONE;
   do
   {
 		cpuMemWrite(R->HL.W++,cpuIn(R->BC.W));
@@ -149,12 +155,14 @@ case INIR:
   break;
 
 case IND:
+  F_DONE;
 	cpuMemWrite(R->HL.W--,cpuIn(R->BC.W));
   --R->BC.B.h;
   R->AF.B.l=N_FLAG|(R->BC.B.h? 0:Z_FLAG);
   break;
 
 case INDR:
+  F_DONE;
   do
   {
     cpuMemWrite(R->HL.W--,cpuIn(R->BC.W));
@@ -166,6 +174,7 @@ case INDR:
   break;
 
 case OUTI:
+  F_DONE;
   --R->BC.B.h;
   I=cpuMemRead(R->HL.W++);
   cpuOut(R->BC.W,I);
@@ -173,6 +182,7 @@ case OUTI:
   break;
 
 case OTIR:
+  F_DONE;
   do
   {
     --R->BC.B.h;
@@ -194,6 +204,7 @@ case OTIR:
   break;
 
 case OUTD:
+  F_DONE;
   --R->BC.B.h;
   I=cpuMemRead(R->HL.W--);
   cpuOut(R->BC.W,I);
@@ -201,6 +212,7 @@ case OUTD:
   break;
 
 case OTDR:
+  F_DONE;
   do
   {
     --R->BC.B.h;
@@ -222,42 +234,37 @@ case OTDR:
   break;
 
 case LDI:
+  F_SYNC;
   cpuMemWrite(R->DE.W++,cpuMemRead(R->HL.W++));
   --R->BC.W;
   R->AF.B.l=(R->AF.B.l&~(N_FLAG|H_FLAG|P_FLAG))|(R->BC.W? P_FLAG:0);
   break;
 
 case LDIR:
-  do
-  {
-    cpuMemWrite(R->DE.W++,cpuMemRead(R->HL.W++));
-    --R->BC.W;R->ICount+=21;
-  }
-  while(R->BC.W&&(R->ICount<R->ICyclesRequested));
+  F_SYNC;
+  cpuZ80BlockCopy(R,1);
   R->AF.B.l&=~(N_FLAG|H_FLAG|P_FLAG);
   if(R->BC.W) { R->AF.B.l|=N_FLAG;R->PC.W-=2; }
   else R->ICount-=5;
   break;
 
 case LDD:
+  F_SYNC;
   cpuMemWrite(R->DE.W--,cpuMemRead(R->HL.W--));
   --R->BC.W;
   R->AF.B.l=(R->AF.B.l&~(N_FLAG|H_FLAG|P_FLAG))|(R->BC.W? P_FLAG:0);
   break;
 
 case LDDR:
-  do
-  {
-    cpuMemWrite(R->DE.W--,cpuMemRead(R->HL.W--));
-    --R->BC.W;R->ICount+=21;
-  }
-  while(R->BC.W&&(R->ICount<R->ICyclesRequested));
+  F_SYNC;
+  cpuZ80BlockCopy(R,-1);
   R->AF.B.l&=~(N_FLAG|H_FLAG|P_FLAG);
   if(R->BC.W) { R->AF.B.l|=N_FLAG;R->PC.W-=2; }
   else R->ICount-=5;
   break;
 
 case CPI:
+  F_SYNC;
   I=cpuMemRead(R->HL.W++);
   J.B.l=R->AF.B.h-I;
   --R->BC.W;
@@ -267,13 +274,9 @@ case CPI:
   break;
 
 case CPIR:
-  do
-  {
-    I=cpuMemRead(R->HL.W++);
-    J.B.l=R->AF.B.h-I;
-    --R->BC.W;R->ICount+=21;
-  }  
-  while(R->BC.W&&J.B.l&&(R->ICount<R->ICyclesRequested));
+  F_SYNC;
+  I=cpuZ80BlockCompare(R);
+  J.B.l=R->AF.B.h-I;
   R->AF.B.l =
     N_FLAG|(R->AF.B.l&C_FLAG)|ZSTable[J.B.l]|
     ((R->AF.B.h^I^J.B.l)&H_FLAG)|(R->BC.W? P_FLAG:0);
@@ -281,6 +284,7 @@ case CPIR:
   break;  
 
 case CPD:
+  F_SYNC;
   I=cpuMemRead(R->HL.W--);
   J.B.l=R->AF.B.h-I;
   --R->BC.W;
@@ -290,6 +294,7 @@ case CPD:
   break;
 
 case CPDR:
+  F_SYNC;
   do
   {
     I=cpuMemRead(R->HL.W--);
@@ -11,37 +11,37 @@
 /**     changes to this file.                               **/
 /*************************************************************/
 
-case JR_NZ:   if(R->AF.B.l&Z_FLAG) R->PC.W++; else { R->ICount+=5;M_JR; } break;
-case JR_NC:   if(R->AF.B.l&C_FLAG) R->PC.W++; else { R->ICount+=5;M_JR; } break;
-case JR_Z:    if(R->AF.B.l&Z_FLAG) { R->ICount+=5;M_JR; } else R->PC.W++; break;
-case JR_C:    if(R->AF.B.l&C_FLAG) { R->ICount+=5;M_JR; } else R->PC.W++; break;
-
-case JP_NZ:   if(R->AF.B.l&Z_FLAG) R->PC.W+=2; else { M_JP; } break;
-case JP_NC:   if(R->AF.B.l&C_FLAG) R->PC.W+=2; else { M_JP; } break;
-case JP_PO:   if(R->AF.B.l&P_FLAG) R->PC.W+=2; else { M_JP; } break;
-case JP_P:    if(R->AF.B.l&S_FLAG) R->PC.W+=2; else { M_JP; } break;
-case JP_Z:    if(R->AF.B.l&Z_FLAG) { M_JP; } else R->PC.W+=2; break;
-case JP_C:    if(R->AF.B.l&C_FLAG) { M_JP; } else R->PC.W+=2; break;
-case JP_PE:   if(R->AF.B.l&P_FLAG) { M_JP; } else R->PC.W+=2; break;
-case JP_M:    if(R->AF.B.l&S_FLAG) { M_JP; } else R->PC.W+=2; break;
-
-case RET_NZ:  if(!(R->AF.B.l&Z_FLAG)) { R->ICount+=6;M_RET; } break;
-case RET_NC:  if(!(R->AF.B.l&C_FLAG)) { R->ICount+=6;M_RET; } break;
-case RET_PO:  if(!(R->AF.B.l&P_FLAG)) { R->ICount+=6;M_RET; } break;
-case RET_P:   if(!(R->AF.B.l&S_FLAG)) { R->ICount+=6;M_RET; } break;
-case RET_Z:   if(R->AF.B.l&Z_FLAG)    { R->ICount+=6;M_RET; } break;
-case RET_C:   if(R->AF.B.l&C_FLAG)    { R->ICount+=6;M_RET; } break;
-case RET_PE:  if(R->AF.B.l&P_FLAG)    { R->ICount+=6;M_RET; } break;
-case RET_M:   if(R->AF.B.l&S_FLAG)    { R->ICount+=6;M_RET; } break;
-
-case CALL_NZ: if(R->AF.B.l&Z_FLAG) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
-case CALL_NC: if(R->AF.B.l&C_FLAG) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
-case CALL_PO: if(R->AF.B.l&P_FLAG) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
-case CALL_P:  if(R->AF.B.l&S_FLAG) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
-case CALL_Z:  if(R->AF.B.l&Z_FLAG) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
-case CALL_C:  if(R->AF.B.l&C_FLAG) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
-case CALL_PE: if(R->AF.B.l&P_FLAG) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
-case CALL_M:  if(R->AF.B.l&S_FLAG) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
+case JR_NZ:   if(F_Z) R->PC.W++; else { R->ICount+=5;M_JR; } break;
+case JR_NC:   if(F_C) R->PC.W++; else { R->ICount+=5;M_JR; } break;
+case JR_Z:    if(F_Z) { R->ICount+=5;M_JR; } else R->PC.W++; break;
+case JR_C:    if(F_C) { R->ICount+=5;M_JR; } else R->PC.W++; break;
+
+case JP_NZ:   if(F_Z) R->PC.W+=2; else { M_JP; } break;
+case JP_NC:   if(F_C) R->PC.W+=2; else { M_JP; } break;
+case JP_PO:   if(F_P) R->PC.W+=2; else { M_JP; } break;
+case JP_P:    if(F_S) R->PC.W+=2; else { M_JP; } break;
+case JP_Z:    if(F_Z) { M_JP; } else R->PC.W+=2; break;
+case JP_C:    if(F_C) { M_JP; } else R->PC.W+=2; break;
+case JP_PE:   if(F_P) { M_JP; } else R->PC.W+=2; break;
+case JP_M:    if(F_S) { M_JP; } else R->PC.W+=2; break;
+
+case RET_NZ:  if(!F_Z) { R->ICount+=6;M_RET; } break;
+case RET_NC:  if(!F_C) { R->ICount+=6;M_RET; } break;
+case RET_PO:  if(!F_P) { R->ICount+=6;M_RET; } break;
+case RET_P:   if(!F_S) { R->ICount+=6;M_RET; } break;
+case RET_Z:   if(F_Z)  { R->ICount+=6;M_RET; } break;
+case RET_C:   if(F_C)  { R->ICount+=6;M_RET; } break;
+case RET_PE:  if(F_P)  { R->ICount+=6;M_RET; } break;
+case RET_M:   if(F_S)  { R->ICount+=6;M_RET; } break;
+
+case CALL_NZ: if(F_Z) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
+case CALL_NC: if(F_C) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
+case CALL_PO: if(F_P) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
+case CALL_P:  if(F_S) R->PC.W+=2; else { R->ICount+=7;M_CALL; } break;
+case CALL_Z:  if(F_Z) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
+case CALL_C:  if(F_C) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
+case CALL_PE: if(F_P) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
+case CALL_M:  if(F_S) { R->ICount+=7;M_CALL; } else R->PC.W+=2; break;
 
 case ADD_B:    M_ADD(R->BC.B.h);break;
 case ADD_C:    M_ADD(R->BC.B.l);break;
@@ -60,7 +60,7 @@ case SUB_D:    M_SUB(R->DE.B.h);break;
 case SUB_E:    M_SUB(R->DE.B.l);break;
 case SUB_H:    M_SUB(R->XX.B.h);break;
 case SUB_L:    M_SUB(R->XX.B.l);break;
-case SUB_A:    R->AF.B.h=0;R->AF.B.l=N_FLAG|Z_FLAG;break;
+case SUB_A:    R->AF.B.h=0;R->AF.B.l=N_FLAG|Z_FLAG;F_DONE;break;
 case SUB_xHL:  I=cpuMemRead(R->XX.W+(offset)OpZ80(R->PC.W++));
                M_SUB(I);break;
 case SUB_BYTE: I=OpZ80(R->PC.W++);M_SUB(I);break;
@@ -115,7 +115,7 @@ case XOR_D:    M_XOR(R->DE.B.h);break;
 case XOR_E:    M_XOR(R->DE.B.l);break;
 case XOR_H:    M_XOR(R->XX.B.h);break;
 case XOR_L:    M_XOR(R->XX.B.l);break;
-case XOR_A:    R->AF.B.h=0;R->AF.B.l=P_FLAG|Z_FLAG;break;
+case XOR_A:    R->AF.B.h=0;R->AF.B.l=P_FLAG|Z_FLAG;F_DONE;break;
 case XOR_xHL:  I=cpuMemRead(R->XX.W+(offset)OpZ80(R->PC.W++));
                M_XOR(I);break;
 case XOR_BYTE: I=OpZ80(R->PC.W++);M_XOR(I);break;
@@ -126,7 +126,7 @@ case CP_D:     M_CP(R->DE.B.h);break;
 case CP_E:     M_CP(R->DE.B.l);break;
 case CP_H:     M_CP(R->XX.B.h);break;
 case CP_L:     M_CP(R->XX.B.l);break;
-case CP_A:     R->AF.B.l=N_FLAG|Z_FLAG;break;
+case CP_A:     R->AF.B.l=N_FLAG|Z_FLAG;F_DONE;break;
 case CP_xHL:   I=cpuMemRead(R->XX.W+(offset)OpZ80(R->PC.W++));
                M_CP(I);break;
 case CP_BYTE:  I=OpZ80(R->PC.W++);M_CP(I);break;
@@ -179,21 +179,25 @@ case INC_xHL:  I=cpuMemRead(R->XX.W+(offset)cpuMemRead(R->PC.W));M_INC(I);
                break;
 
 case RLCA:
+  F_SYNC;
   I=(R->AF.B.h&0x80? C_FLAG:0);
   R->AF.B.h=(R->AF.B.h<<1)|I;
   R->AF.B.l=(R->AF.B.l&~(C_FLAG|N_FLAG|H_FLAG))|I;
   break;
 case RLA:
+  F_SYNC;
   I=(R->AF.B.h&0x80? C_FLAG:0);
   R->AF.B.h=(R->AF.B.h<<1)|(R->AF.B.l&C_FLAG);
   R->AF.B.l=(R->AF.B.l&~(C_FLAG|N_FLAG|H_FLAG))|I;
   break;
 case RRCA:
+  F_SYNC;
   I=R->AF.B.h&0x01;
   R->AF.B.h=(R->AF.B.h>>1)|(I? 0x80:0);
   R->AF.B.l=(R->AF.B.l&~(C_FLAG|N_FLAG|H_FLAG))|I;
   break;
 case RRA:
+  F_SYNC;
   I=R->AF.B.h&0x01;
   R->AF.B.h=(R->AF.B.h>>1)|(R->AF.B.l&C_FLAG? 0x80:0);
   R->AF.B.l=(R->AF.B.l&~(C_FLAG|N_FLAG|H_FLAG))|I;
@@ -211,20 +215,20 @@ case RST38:    M_RST(0x0038);break;
 case PUSH_BC:  M_PUSH(BC);break;
 case PUSH_DE:  M_PUSH(DE);break;
 case PUSH_HL:  M_PUSH(XX);break;
-case PUSH_AF:  M_PUSH(AF);break;
+case PUSH_AF:  F_SYNC;M_PUSH(AF);break;
 
 case POP_BC:   M_POP(BC);break;
 case POP_DE:   M_POP(DE);break;
 case POP_HL:   M_POP(XX);break;
-case POP_AF:   M_POP(AF);break;
+case POP_AF:   M_POP(AF);F_DONE;break;
 
 case DJNZ: if(--R->BC.B.h) { R->ICount+=5;M_JR; } else R->PC.W++;break;
 case JP:   M_JP;break;
 case JR:   M_JR;break;
 case CALL: M_CALL;break;
 case RET:  M_RET;break;
-case SCF:  S(C_FLAG);R(N_FLAG|H_FLAG);break;
-case CPL:  R->AF.B.h=~R->AF.B.h;S(N_FLAG|H_FLAG);break;
+case SCF:  F_SYNC;S(C_FLAG);R(N_FLAG|H_FLAG);break;
+case CPL:  R->AF.B.h=~R->AF.B.h;F_SYNC;S(N_FLAG|H_FLAG);break;
 case NOP:  break;
 case OUTA: I=OpZ80(R->PC.W++);cpuOut(I|(R->AF.W&0xFF00),R->AF.B.h);break;
 case INA:  I=OpZ80(R->PC.W++);R->AF.B.h=cpuIn(I|(R->AF.W&0xFF00));break;
@@ -232,7 +236,9 @@ case INA:  I=OpZ80(R->PC.W++);R->AF.B.h=cpuIn(I|(R->AF.W&0xFF00));break;
 case HALT:
   R->PC.W--;
   R->IFF|=IFF_HALT;
-  R->ICount-=4;
+  /* HALT is repeated until an interrupt, charge it at once */
+  if(R->ICount<R->ICyclesRequested)
+    R->ICount+=(R->ICyclesRequested-R->ICount+3)&~3;
   break;
 
 case DI:
@@ -247,6 +253,7 @@ case EI:
   break;
 
 case CCF:
+  F_SYNC;
   R->AF.B.l^=C_FLAG;R(N_FLAG|H_FLAG);
   R->AF.B.l|=R->AF.B.l&C_FLAG? 0:H_FLAG;
   break;
@@ -258,7 +265,7 @@ case EXX:
   break;
 
 case EX_DE_HL: J.W=R->DE.W;R->DE.W=R->HL.W;R->HL.W=J.W;break;
-case EX_AF_AF: J.W=R->AF.W;R->AF.W=R->AF1.W;R->AF1.W=J.W;break;  
+case EX_AF_AF: F_SYNC;J.W=R->AF.W;R->AF.W=R->AF1.W;R->AF1.W=J.W;break;  
   
 case LD_B_B:   R->BC.B.h=R->BC.B.h;break;
 case LD_C_B:   R->BC.B.l=R->BC.B.h;break;
@@ -384,6 +391,7 @@ case EX_HL_xSP:
   break;
 
 case DAA:
+  F_SYNC;
   J.W=R->AF.B.h;
   if(R->AF.B.l&C_FLAG) J.W|=256;
   if(R->AF.B.l&H_FLAG) J.W|=512;
@@ -0,0 +1,59 @@
+/*****************************************************************************/
+/* Batched multi-instance emulator stepping on a worker thread pool          */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __emuBatch_h
+#define __emuBatch_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <sysTypes.h>
+#include <pthread.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define emuBATCH_MAX_THREAD_COUNT 64
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// Steps one machine instance by the given number of frames (e.g. emuInvadersInstanceStep)
+typedef void (*emuBatchStepFunction)(void* in_instance, uint32_t in_frame_count);
+
+/// Thread pool and the current batch
+typedef struct
+{
+	// worker threads
+	pthread_t Threads[emuBATCH_MAX_THREAD_COUNT];
+	uint32_t ThreadCount;
+	pthread_mutex_t Lock;
+	pthread_cond_t StartCondition;
+	pthread_cond_t DoneCondition;
+	uint32_t Generation;
+	uint32_t BusyThreadCount;
+	bool Quit;
+
+	// current batch
+	void** Instances;
+	uint32_t InstanceCount;
+	uint32_t NextInstance;
+	uint32_t FrameCount;
+	emuBatchStepFunction Step;
+} emuBatchState;
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+bool emuBatchInitialize(emuBatchState* in_batch, uint32_t in_thread_count);
+void emuBatchRun(emuBatchState* in_batch, void** in_instances, uint32_t in_instance_count, uint32_t in_frame_count, emuBatchStepFunction in_step);
+void emuBatchCleanup(emuBatchState* in_batch);
+
+#endif
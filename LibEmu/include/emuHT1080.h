@@ -16,7 +16,13 @@
 /*****************************************************************************/
 #include <sysTypes.h>
 #include <sysUserInput.h>
+#include <fileStandardFunctions.h>
+#include <cpuZ80.h>
+#include <emuScheduler.h>
 #include "sysConfig.h"
+#if defined(cpuZ80_DIRTY_PAGES) && defined(cpuZ80_SNAPSHOT)
+#include <emuRewind.h>
+#endif
 
 /*****************************************************************************/
 /* Constants                                                                 */
@@ -41,6 +47,8 @@
 #define emuHT1080_KEYBOARD_START 0x3800
 #define emuHT1080_EXTENSION_ROM_START emuHT1080_ROM_SIZE
 
+#define emuHT1080_KEYBOARD_ROW_COUNT 8
+
 ////////////////////
 // Video definitions
 #define emuHT1080_SCREEN_WIDTH_IN_CHARACTER 64
@@ -52,6 +60,68 @@
 #define emuHT1080_SCREEN_WIDTH_IN_PIXEL (emuHT1080_SCREEN_WIDTH_IN_CHARACTER * emuHT1080_CHARACTER_WIDTH)
 #define emuHT1080_SCREEN_HEIGHT_IN_PIXEL (emuHT1080_SCREEN_HEIGHT_IN_CHARACTER * emuHT1080_CHARACTER_HEIGHT)
 
+// rewind history needs dirty page tracking and the state serialization of the CPU
+#if defined(cpuZ80_DIRTY_PAGES) && defined(cpuZ80_SNAPSHOT)
+#define emuHT1080_REWIND
+#endif
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// States of the cassette interface
+typedef enum
+{
+	emuCS_Idle,
+
+	// save states
+	emuCS_SaveStart,
+	emuCS_SaveWaitForMotorStart,
+	emuCS_SaveWaitForClock,
+	emuCS_SaveWaitForData,
+
+	// load states
+	emuCS_LoadStart,
+	emuCS_LoadClock,
+	emuCS_LoadData
+} emuCASState;
+
+/// State of one emulated computer
+typedef struct
+{
+	// CPU and memory
+	cpuZ80State cpu;
+	uint8_t ram[emuHT1080_RAM_SIZE];
+	uint8_t video_ram[emuHT1080_VIDEO_RAM_SIZE];
+	uint8_t keyboard_ram[emuHT1080_KEYBOARD_ROW_COUNT];
+
+	// port latches
+	uint8_t out_port_ff;
+	uint8_t in_port_ff;
+
+	// timing
+	uint32_t total_cpu_cycles;
+	int32_t current_cycles_per_frame;
+	uint32_t frame_count;
+	emuSchedulerState scheduler;				// screen end, vsync and cassette input events
+
+	// cassette interface
+	emuCASState cas_state;
+	uint8_t cas_buffer;
+	uint8_t cas_buffer_bit_count;
+	fileStream* cas_file;
+	uint32_t cas_clock_timestamp;
+	bool cas_motor_on;
+
+	// video RAM writes are rendered to the screen
+	bool display_enabled;
+
+#ifdef emuHT1080_REWIND
+	// history of the frames (null: no history)
+	emuRewindState* rewind;
+#endif
+} emuHT1080State;
+
 /*****************************************************************************/
 /* Function prototypes                                                       */
 /*****************************************************************************/
@@ -68,16 +138,27 @@ void emuEnableScreenRefresh(uint8_t in_left, uint8_t in_top, uint8_t in_right, u
 void emuHT1080StartScreenRefresh(void);
 void emuHT1080EndScreenrefresh(void);
 void emuHT1080RenderCharacter(uint16_t in_video_memory_address);
+void emuHT1080RenderDirtyCharacters(const uint64_t* in_dirty_rows);
 
 void emuUpdateStatistics(uint32_t in_measured_inteval_in_ms);
 void emuResetStatistics(void);
 
+void emuHT1080InstanceInitialize(emuHT1080State* in_state);
+void emuHT1080InstanceReset(emuHT1080State* in_state);
+void emuHT1080InstanceStep(emuHT1080State* in_state, uint32_t in_frame_count);
+void emuHT1080InstanceSetKeyboard(emuHT1080State* in_state, const uint8_t* in_keyboard_rows);
+const uint8_t* emuHT1080InstanceGetVideoRAM(emuHT1080State* in_state);
+
+#ifdef cpuZ80_SNAPSHOT
+bool emuHT1080InstanceSaveSnapshot(emuHT1080State* in_state, const char* in_file_name);
+bool emuHT1080InstanceLoadSnapshot(emuHT1080State* in_state, const char* in_file_name);
+#endif
+
 /*****************************************************************************/
 /* Variables for other modules                                               */
 /*****************************************************************************/
 
-extern uint8_t g_ram[];
-extern uint8_t g_video_ram[];
+extern emuHT1080State g_ht1080_state;
 extern uint8_t g_screen_no_refresh_area[];
 
 extern uint16_t g_emulation_speed_cpu_freq;
@@ -16,7 +16,14 @@
 /*****************************************************************************/
 #include <sysTypes.h>
 #include <sysUserInput.h>
+#include <sysHighresTimer.h>
+#include <cpuI8080.h>
+#include <waveMixer.h>
+#include <emuScheduler.h>
 #include "sysConfig.h"
+#if defined(cpuI8080_DIRTY_PAGES) && defined(cpuI8080_SNAPSHOT)
+#include <emuRewind.h>
+#endif
 
 /*****************************************************************************/
 /* Constants                                                                 */
@@ -28,6 +35,7 @@
 #define emuINVADERS_RAM_START emuINVADERS_ROM_SIZE
 #define emuINVADERS_VIDEO_RAM_START 0x2400
 #define emuINVADERS_RAM_MIRROR 0x4000
+#define emuINVADERS_VIDEO_RAM_SIZE (emuINVADERS_RAM_SIZE - (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START))
 
 // screen resolution
 #define emuINVADERS_SCREEN_WIDTH  224
@@ -36,26 +44,147 @@
 #define emuINVADERS_SCREEN_LEFT ((guiSCREEN_WIDTH - emuINVADERS_SCREEN_WIDTH) / 2)		// Display start position (x)
 #define emuINVADERS_SCREEN_TOP  ((guiSCREEN_HEIGHT - emuINVADERS_SCREEN_HEIGHT) / 2)	// Display start position (y)
 
+// one screen column is stored in 32 consecutive bytes of the video RAM (bottom to top)
+#define emuINVADERS_VIDEO_COLUMN_SIZE (emuINVADERS_SCREEN_HEIGHT / 8)
+
+// Size of the square tiles of the tiled renderer (8 or 16 pixels)
+#if defined(emuINVADERS_TILED_RENDERING) && !defined(emuINVADERS_TILE_SIZE)
+#define emuINVADERS_TILE_SIZE 16
+#endif
+
 // Timing constants
 #define emuINVADERS_CPU_CLOCK 2000000				// CPU clock in MHz
 #define emuINVADERS_FRAME_RATE 60						// frame rate 60Hz
 
+// Audio samples rendered per frame by the instance functions
+#define emuINVADERS_AUDIO_SAMPLES_PER_FRAME (halWAVEPLAYER_SAMPLE_RATE / emuINVADERS_FRAME_RATE)
+
+// Rewind history is available when the written pages are tracked and the CPU state can be serialized
+#if defined(cpuI8080_DIRTY_PAGES) && defined(cpuI8080_SNAPSHOT)
+#define emuINVADERS_REWIND
+#endif
+
+// Input port bits (port 1 and port 2)
+#define emuINVADERS_IN_COIN          0x01	// port 1 only
+#define emuINVADERS_IN_TWO_PLAYERS   0x02	// port 1 only
+#define emuINVADERS_IN_ONE_PLAYER    0x04	// port 1 only
+#define emuINVADERS_IN_FIRE          0x10
+#define emuINVADERS_IN_LEFT          0x20
+#define emuINVADERS_IN_RIGHT         0x40
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// State of one emulated machine
+typedef struct
+{
+	// CPU and memory
+	cpuI8080State cpu;
+	uint8_t ram[emuINVADERS_RAM_SIZE];
+
+	// I/O ports
+	volatile uint8_t port_in1;
+	volatile uint8_t port_in2;
+	uint8_t port_out2;
+	uint8_t port_out3;
+	uint8_t port_out4hi;
+	uint8_t port_out4lo;
+	uint8_t port_out5;
+
+	// timing
+	uint16_t current_scanline;
+	uint32_t cycles_per_frame;
+	uint32_t frame_count;
+	emuSchedulerState scheduler;						// midscreen and vsync interrupt events
+
+	// audio
+	waveMixerState wave_mixer;
+	uint8_t ufo_sound_channel;
+	halWavePlayerBufferType* audio_buffer;	// audio output of the instance functions (null: no audio)
+	uint32_t audio_buffer_length;						// length of the audio buffer in samples
+	uint32_t audio_sample_count;						// number of samples rendered by the last instance step
+
+	// video RAM writes are rendered to the screen
+	bool display_enabled;
+	uint32_t rendered_byte_count;						// number of video RAM bytes rendered to the screen (statistics)
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+	// video RAM bytes changed since the last rendering (one bit per byte, one word per screen column)
+	uint32_t dirty_video_columns[emuINVADERS_SCREEN_WIDTH];
+#endif
+
+#ifdef cpuI8080_DIRTY_PAGES
+	// RAM pages written during the last frame (writes of the mirror are folded into the RAM pages)
+	cpuDirtyPageBitmap dirty_pages;
+#endif
+
+#ifdef emuINVADERS_REWIND
+	// history of the frames (null: no history)
+	emuRewindState* rewind;
+#endif
+} emuInvadersState;
+
+/// Statistics of the audio clock synchronization (emuINVADERS_AUDIO_SYNC)
+typedef struct
+{
+	uint32_t dropped_frames;								// frames emulated without rendering to catch up with the audio clock
+	uint32_t buffer_fill;										// samples queued in the audio device at the last check
+} emuInvadersSyncStatistics;
+
 /*****************************************************************************/
 /* Global variables                                                          */
 /*****************************************************************************/
-extern uint8_t g_cpu_ram[];
+extern emuInvadersState g_invaders_state;
+#ifdef emuINVADERS_RUNTIME_ROM
+extern unsigned char g_cpu_rom[];				// ROM image is loaded at runtime
+#else
 extern const unsigned char g_cpu_rom[];
+#endif
 
 /*****************************************************************************/
 /* Function prototypes                                                       */
 /*****************************************************************************/
 void emuInvadersInitialize(void);
 bool emuInvadersTask(void);
+sysHighresTimestamp emuInvadersGetNextTaskTime(void);
+#ifdef emuINVADERS_AUDIO_SYNC
+void emuInvadersGetSyncStatistics(emuInvadersSyncStatistics* out_statistics);
+#endif
 void emuInvadersRenderScanLine(uint16_t in_line_index);
+void emuInvadersRender16bppScanLine(uint8_t* in_destination_buffer, int8_t in_destination_buffer_indecrement, uint16_t in_line_index);
 
 void emuInvadersRendererInitialize(void);
 void emuInvadersRenderPixels(uint16_t in_memory_address, uint8_t in_data);
-void emuDisplayStatistics(uint32_t in_cpu_clock, uint16_t in_frame_rate, uint16_t in_load);
+#ifdef emuINVADERS_VSYNC_RENDERING
+#ifdef emuINVADERS_TILED_RENDERING
+uint32_t emuInvadersRenderTiles(const uint8_t* in_video_ram, uint32_t* in_dirty_columns);
+#else
+uint8_t emuInvadersRenderColumn(uint16_t in_column, const uint8_t* in_column_data, uint32_t in_byte_mask);
+#endif
+#endif
+void emuDisplayStatistics(uint32_t in_cpu_clock, uint16_t in_frame_rate, uint16_t in_load, uint16_t in_rendered_bytes);
+
+#ifdef cpuI8080_INSTRUCTION_COUNTER
+uint32_t emuInvadersGetInstructionCount(void);
+#endif
+
+void emuInvadersInstanceInitialize(emuInvadersState* in_state);
+void emuInvadersInstanceStep(emuInvadersState* in_state, uint32_t in_frame_count);
+void emuInvadersInstanceSetInput(emuInvadersState* in_state, uint8_t in_port1, uint8_t in_port2);
+const uint8_t* emuInvadersInstanceGetVideoRAM(emuInvadersState* in_state);
+#ifdef cpuI8080_SNAPSHOT
+bool emuInvadersInstanceSaveSnapshot(emuInvadersState* in_state, const char* in_file_name);
+bool emuInvadersInstanceLoadSnapshot(emuInvadersState* in_state, const char* in_file_name);
+#endif
+#ifdef cpuI8080_DIRTY_PAGES
+const cpuDirtyPageBitmap* emuInvadersInstanceGetDirtyPages(emuInvadersState* in_state);
+#endif
+#ifdef emuINVADERS_REWIND
+bool emuInvadersInstanceAttachRewind(emuInvadersState* in_state, emuRewindState* in_rewind, uint8_t* in_buffer, uint32_t in_buffer_size);
+void emuInvadersInstanceResetRewind(emuInvadersState* in_state);
+bool emuInvadersInstanceStepBack(emuInvadersState* in_state);
+#endif
 
 void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategory in_event_category, sysUserInputEventType in_event_type, uint32_t in_event_param);
 
@@ -0,0 +1,75 @@
+/*****************************************************************************/
+/* Rewind history of delta snapshots (dirty memory pages of the frames)      */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __emuRewind_h
+#define __emuRewind_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <cpuDirtyPages.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define emuREWIND_MAX_REGION_COUNT 4
+
+// Maximum size of the machine state (CPU registers, devices) stored with each frame
+#ifndef emuREWIND_MAX_STATE_SIZE
+#define emuREWIND_MAX_STATE_SIZE 512
+#endif
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// Memory region tracked by the rewind history
+typedef struct
+{
+	uint16_t Address;					/* CPU address of the region (page aligned) */
+	uint32_t Length;					/* length in bytes (multiple of the page size) */
+	uint8_t* Memory;					/* content of the region */
+	uint8_t* Shadow;					/* copy of the content at the last frame boundary (in the history buffer) */
+} emuRewindRegion;
+
+/// Rewind history. Every record holds the machine state at the previous frame boundary and the previous
+/// content of the pages written during the frame, so only the dirty pages are stored. Records are kept in a ring,
+/// the oldest frames are dropped when the buffer is full.
+/// Record layout: uint16 state length, uint16 page count, state, (uint8 page index, page content) * page count, uint32 record length
+typedef struct
+{
+	emuRewindRegion Regions[emuREWIND_MAX_REGION_COUNT];
+	uint8_t RegionCount;
+
+	uint8_t* Ring;						/* record storage (history buffer after the shadow copies) */
+	uint32_t RingSize;
+	uint32_t Head;						/* offset of the next record */
+	uint32_t Tail;						/* offset of the oldest record */
+	uint32_t End;							/* end of the records at the end of the ring (when the records wrap around) */
+	uint32_t FrameCount;			/* number of stored records */
+
+	uint8_t State[emuREWIND_MAX_STATE_SIZE];	/* machine state at the last frame boundary */
+	uint16_t StateLength;
+
+	uint32_t LastRecordLength;	/* statistics */
+} emuRewindState;
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+void emuRewindInitialize(emuRewindState* in_rewind, uint8_t* in_buffer, uint32_t in_buffer_size);
+bool emuRewindAddRegion(emuRewindState* in_rewind, uint16_t in_address, uint32_t in_length, uint8_t* in_memory);
+void emuRewindReset(emuRewindState* in_rewind, const uint8_t* in_state, uint16_t in_state_length);
+bool emuRewindPushFrame(emuRewindState* in_rewind, const cpuDirtyPageBitmap* in_dirty_pages, const uint8_t* in_state, uint16_t in_state_length);
+bool emuRewindStepBack(emuRewindState* in_rewind, uint8_t* out_state, uint16_t* out_state_length, cpuDirtyPageBitmap* out_restored_pages);
+uint32_t emuRewindGetUsedBytes(emuRewindState* in_rewind);
+
+#endif
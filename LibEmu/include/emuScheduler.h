@@ -0,0 +1,66 @@
+/*****************************************************************************/
+/* Machine event scheduler (events are timed in CPU cycles)                  */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __emuScheduler_h
+#define __emuScheduler_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+// Maximum number of pending events (one event per event ID)
+#ifndef emuSCHEDULER_MAX_EVENT_COUNT
+#define emuSCHEDULER_MAX_EVENT_COUNT 8
+#endif
+
+// Returned as the event ID when there is no due event
+#define emuSCHEDULER_NO_EVENT 0xff
+
+// Returned as the number of cycles to the next event when there is no pending event
+#define emuSCHEDULER_NO_EVENT_CYCLES 0x7fffffff
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+/// Scheduled event. The event ID is defined by the machine.
+typedef struct
+{
+	uint32_t Time;						/* CPU cycle when the event is due */
+	uint8_t Id;
+} emuSchedulerEvent;
+
+/// Event scheduler. Pending events are stored in a binary min-heap ordered by the event time, so the next event
+/// is always the first one. Times are wrapping 32 bit cycle counters, events must be within 2^31 cycles.
+typedef struct
+{
+	emuSchedulerEvent Events[emuSCHEDULER_MAX_EVENT_COUNT];
+	uint8_t EventCount;
+	uint32_t Time;						/* current CPU cycle */
+} emuSchedulerState;
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+void emuSchedulerInitialize(emuSchedulerState* in_scheduler, uint32_t in_time);
+bool emuSchedulerAddEvent(emuSchedulerState* in_scheduler, uint8_t in_id, uint32_t in_delay);
+bool emuSchedulerAddEventAt(emuSchedulerState* in_scheduler, uint8_t in_id, uint32_t in_time);
+void emuSchedulerCancelEvent(emuSchedulerState* in_scheduler, uint8_t in_id);
+bool emuSchedulerIsEventPending(emuSchedulerState* in_scheduler, uint8_t in_id);
+int32_t emuSchedulerGetCyclesToNextEvent(emuSchedulerState* in_scheduler);
+void emuSchedulerAdvance(emuSchedulerState* in_scheduler, uint32_t in_cycles);
+uint8_t emuSchedulerGetDueEvent(emuSchedulerState* in_scheduler);
+
+#endif
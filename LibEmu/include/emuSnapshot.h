@@ -0,0 +1,92 @@
+/*****************************************************************************/
+/* Machine state snapshot file reader and writer                             */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __emuSnapshot_h
+#define __emuSnapshot_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define emuSNAPSHOT_FILE_MAGIC 0x50414e53		// "SNAP" in little endian byte order
+#define emuSNAPSHOT_FILE_VERSION 1
+#define emuSNAPSHOT_HEADER_SIZE 16
+
+// Snapshot owner machine
+typedef enum
+{
+	emuSNAPSHOT_MACHINE_INVADERS = 1,
+	emuSNAPSHOT_MACHINE_HT1080,
+	emuSNAPSHOT_MACHINE_HOMELAB
+} emuSnapshotMachine;
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+// File layout (all values are little endian):
+//   0: uint32 magic
+//   4: uint16 file format version
+//   6: uint8  machine (emuSnapshotMachine)
+//   7: uint8  machine state version (layout of the payload, defined by the machine)
+//   8: uint32 payload length
+//  12: uint32 payload checksum (FNV-1a)
+//  16: payload, fields are written one by one in the order defined by the machine
+
+/// Snapshot file writer. When the file is NULL the payload is written into a memory buffer (without header).
+typedef struct
+{
+	FILE* File;
+	uint8_t* Memory;						/* destination buffer of the memory snapshots */
+	uint32_t MemorySize;
+	uint8_t Machine;						/* emuSnapshotMachine */
+	uint8_t Version;						/* machine state version */
+	uint32_t Length;						/* number of payload bytes written */
+	uint32_t Checksum;
+	bool Error;
+} emuSnapshotWriter;
+
+/// Snapshot file reader. The file is memory mapped where it is supported, otherwise it is read into memory.
+/// Memory snapshots are read directly from the payload buffer.
+typedef struct
+{
+	const uint8_t* Data;				/* payload */
+	uint32_t Length;						/* payload length */
+	uint32_t Position;					/* read position within the payload */
+	bool Error;									/* read beyond the payload or invalid content */
+	void* Buffer;								/* mapped or allocated file content */
+	uint32_t BufferLength;
+} emuSnapshotReader;
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+bool emuSnapshotWriteBegin(emuSnapshotWriter* in_writer, const char* in_file_name, emuSnapshotMachine in_machine, uint8_t in_version);
+void emuSnapshotWriteByte(emuSnapshotWriter* in_writer, uint8_t in_value);
+void emuSnapshotWriteWord(emuSnapshotWriter* in_writer, uint16_t in_value);
+void emuSnapshotWriteDWord(emuSnapshotWriter* in_writer, uint32_t in_value);
+void emuSnapshotWriteBlock(emuSnapshotWriter* in_writer, const void* in_data, uint32_t in_length);
+bool emuSnapshotWriteEnd(emuSnapshotWriter* in_writer);
+void emuSnapshotWriteBeginMemory(emuSnapshotWriter* in_writer, uint8_t* in_buffer, uint32_t in_buffer_size);
+
+bool emuSnapshotReadBegin(emuSnapshotReader* in_reader, const char* in_file_name, emuSnapshotMachine in_machine, uint8_t in_version);
+uint8_t emuSnapshotReadByte(emuSnapshotReader* in_reader);
+uint16_t emuSnapshotReadWord(emuSnapshotReader* in_reader);
+uint32_t emuSnapshotReadDWord(emuSnapshotReader* in_reader);
+void emuSnapshotReadBlock(emuSnapshotReader* in_reader, void* out_data, uint32_t in_length);
+bool emuSnapshotReadEnd(emuSnapshotReader* in_reader);
+void emuSnapshotReadBeginMemory(emuSnapshotReader* in_reader, const uint8_t* in_data, uint32_t in_length);
+
+#endif
@@ -12,6 +12,10 @@
 /* Includes                                                                  */
 /*****************************************************************************/
 #include <cpuI8080.h>
+#include <stddef.h>
+#if defined(cpuI8080_IDLE_LOOP_SKIP) || defined(cpuI8080_TRACE)
+#include <string.h>
+#endif
 
 /*****************************************************************************/
 /* Tables                                                                    */
@@ -45,6 +49,27 @@ static uint8_t l_cpu_instruction_cycles[256]={
 /* Fx */	5, 10, 10,  4, 11, 11,  7, 11,  5,  5, 10,  4, 11,  0,  7, 11
 };
 
+// opcode length in bytes
+static const uint8_t l_cpu_instruction_length[256]={
+/*       x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xA  xB  xC  xD  xE  xF */
+/* 0x */	1,  3,  1,  1,  1,  1,  2,  1,  1,  1,  1,  1,  1,  1,  2,  1,
+/* 1x */	1,  3,  1,  1,  1,  1,  2,  1,  1,  1,  1,  1,  1,  1,  2,  1,
+/* 2x */	1,  3,  3,  1,  1,  1,  2,  1,  1,  1,  3,  1,  1,  1,  2,  1,
+/* 3x */	1,  3,  3,  1,  1,  1,  2,  1,  1,  1,  3,  1,  1,  1,  2,  1,
+/* 4x */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* 5x */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* 6x */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* 7x */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* 8x */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* 9x */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* Ax */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* Bx */	1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+/* Cx */	1,  1,  3,  3,  3,  1,  2,  1,  1,  1,  3,  1,  3,  3,  2,  1,
+/* Dx */	1,  1,  3,  2,  3,  1,  2,  1,  1,  1,  3,  2,  3,  1,  2,  1,
+/* Ex */	1,  1,  3,  1,  3,  1,  2,  1,  1,  1,  3,  1,  3,  1,  2,  1,
+/* Fx */	1,  1,  3,  1,  3,  1,  2,  1,  1,  1,  3,  1,  3,  1,  2,  1
+};
+
 // Sign, Zero, Parity flags look-up table
 static uint8_t l_cpu_szp_flags[256] = 
 {
@@ -71,16 +96,11 @@ static const uint8_t l_cpu_inr_aux[16]=	{	cpuI8080_F_AUXCARRY, 0, 0, 0, 0, 0, 0,
 static const uint8_t l_cpu_dcr_aux[16]= {	cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, 0 };
 static const uint8_t l_cpu_sub_aux[8] = { cpuI8080_F_AUXCARRY, 0, 0, 0, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, cpuI8080_F_AUXCARRY, 0 };
 
-#if PROFILE
-static unsigned int lut_profiler[0x100]; /* occurance of opcodes */
-#endif
-
-/* opcode mnemonics (debug) */
-//#if defined(CPU_DEBUG) | defined(PROFILE)
-/*static*/ const char* lut_mnemonic[0x100]={
+// opcode mnemonics (debug and disassembler), '#' and '$' is replaced by the 8 or 16 bit operand
+static const char* l_cpu_instruction_mnemonic[256]={
 	"nop",     "lxi b,#", "stax b",  "inx b",   "inr b",   "dcr b",   "mvi b,#", "rlc",     "ill",     "dad b",   "ldax b",  "dcx b",   "inr c",   "dcr c",   "mvi c,#", "rrc",
 	"ill",     "lxi d,#", "stax d",  "inx d",   "inr d",   "dcr d",   "mvi d,#", "ral",     "ill",     "dad d",   "ldax d",  "dcx d",   "inr e",   "dcr e",   "mvi e,#", "rar",
-	"ill",     "lxi h,#", "shld",    "inx h",   "inr h",   "dcr h",   "mvi h,#", "daa",     "ill",     "dad h",   "lhld",    "dcx h",   "inr l",   "dcr l",   "mvi l,#", "cma",
+	"ill",     "lxi h,#", "shld $",  "inx h",   "inr h",   "dcr h",   "mvi h,#", "daa",     "ill",     "dad h",   "lhld $",  "dcx h",   "inr l",   "dcr l",   "mvi l,#", "cma",
 	"ill",     "lxi sp,#","sta $",   "inx sp",  "inr M",   "dcr M",   "mvi M,#", "stc",     "ill",     "dad sp",  "lda $",   "dcx sp",  "inr a",   "dcr a",   "mvi a,#", "cmc",
 	"mov b,b", "mov b,c", "mov b,d", "mov b,e", "mov b,h", "mov b,l", "mov b,M", "mov b,a", "mov c,b", "mov c,c", "mov c,d", "mov c,e", "mov c,h", "mov c,l", "mov c,M", "mov c,a",
 	"mov d,b", "mov d,c", "mov d,d", "mov d,e", "mov d,h", "mov d,l", "mov d,M", "mov d,a", "mov e,b", "mov e,c", "mov e,d", "mov e,e", "mov e,h", "mov e,l", "mov e,M", "mov e,a",
@@ -91,11 +111,10 @@ static unsigned int lut_profiler[0x100]; /* occurance of opcodes */
 	"ana b",   "ana c",   "ana d",   "ana e",   "ana h",   "ana l",   "ana M",   "ana a",   "xra b",   "xra c",   "xra d",   "xra e",   "xra h",   "xra l",   "xra M",   "xra a",
 	"ora b",   "ora c",   "ora d",   "ora e",   "ora h",   "ora l",   "ora M",   "ora a",   "cmp b",   "cmp c",   "cmp d",   "cmp e",   "cmp h",   "cmp l",   "cmp M",   "cmp a",
 	"rnz",     "pop b",   "jnz $",   "jmp $",   "cnz $",   "push b",  "adi #",   "rst 0",   "rz",      "ret",     "jz $",    "ill",     "cz $",    "call $",  "aci #",   "rst 1",
-	"rnc",     "pop d",   "jnc $",   "out p",   "cnc $",   "push d",  "sui #",   "rst 2",   "rc",      "ill",     "jc $",    "in p",    "cc $",    "ill",     "sbi #",   "rst 3",
+	"rnc",     "pop d",   "jnc $",   "out #",   "cnc $",   "push d",  "sui #",   "rst 2",   "rc",      "ill",     "jc $",    "in #",    "cc $",    "ill",     "sbi #",   "rst 3",
 	"rpo",     "pop h",   "jpo $",   "xthl",    "cpo $",   "push h",  "ani #",   "rst 4",   "rpe",     "pchl",    "jpe $",   "xchg",    "cpe $",   "ill",     "xri #",   "rst 5",
 	"rp",      "pop psw", "jp $",    "di",      "cp $",    "push psw","ori #",   "rst 6",   "rm",      "sphl",    "jm $",    "ei",      "cm $",    "ill",     "cpi #",   "rst 7"
 };
-//#endif
 
 /*****************************************************************************/
 /* Register access maros                                                     */
@@ -143,13 +162,43 @@ static unsigned int lut_profiler[0x100]; /* occurance of opcodes */
 /* Instruction helper macros                                                 */
 /*****************************************************************************/
 
+#ifdef cpuI8080_PROFILER
+// subroutine calls and returns are recorded on the shadow call stack of the attached profiler
+#define PROFILING(R) (R->profiler != NULL)
+#define PROFILER_CALL(R, a, r) if (PROFILING(R)) cpuProfilerCall(R->profiler, a, r)
+#define PROFILER_RETURN(R) if (PROFILING(R)) cpuProfilerReturn(R->profiler, PC(R))
+#else
+#define PROFILING(R) 0
+#define PROFILER_CALL(R, a, r)
+#define PROFILER_RETURN(R)
+#endif
+
+#ifdef cpuI8080_TRACE
+// instructions are recorded into the attached trace buffer until the recording is stopped by a trigger
+#define TRACING(R) (R->trace != NULL && R->trace->State == cpuTRACE_RECORDING)
+#define TRACE_ILLEGAL(R) if (TRACING(R)) cpuTraceStop(R->trace, cpuTRACE_TRIGGER_ILLEGAL_OPCODE, PC(R) - 1)
+#else
+#define TRACING(R) 0
+#define TRACE_ILLEGAL(R)
+#endif
+
 #define SKIP16(R) PC(R) += 2
-#define JUMP(R)   PC(R) = Read16(PC(R))
-#define CALL(R)   Push16(R, PC(R)+2); JUMP(R)
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+// short backward jumps are checked for idle loop before jumping
+#define JUMP(R)   temp_word = IMM16(R); if ((uint16_t)(PC(R) - temp_word) <= cpuI8080_IDLE_LOOP_LENGTH) cpuI8080IdleLoop(R); PC(R) = temp_word
+#define IDLE_BREAK(R) R->idle_quiet = 0
+#else
+#define JUMP(R)   PC(R) = IMM16(R)
+#define IDLE_BREAK(R)
+#endif
+#define cpuI8080_HLT_CYCLES 7			/* l_cpu_instruction_cycles[0x76] */
+// halted CPU would repeat HLT until the end of the requested cycles, they are charged at once
+#define HALT(R)   if (CYCLES(R) > 0) CYCLES(R) -= ((CYCLES(R) + cpuI8080_HLT_CYCLES - 1) / cpuI8080_HLT_CYCLES) * cpuI8080_HLT_CYCLES
+#define CALL(R)   temp_word = IMM16(R); Push16(R, PC(R)+2); PROFILER_CALL(R, temp_word, PC(R)+2); PC(R) = temp_word
 #define CCON(R)   CYCLES(R)-=6; CALL(R)
-#define RET(R)    PC(R) = Pop16(R)
+#define RET(R)    PC(R) = Pop16(R); PROFILER_RETURN(R)
 #define RCON(R)   CYCLES(R)-=6; RET(R)
-#define RST(R, x) Push16(R, PC(R)); PC(R) = (x)<<3
+#define RST(R, x) Push16(R, PC(R)); PROFILER_CALL(R, (x)<<3, PC(R)); PC(R) = (x)<<3
 #define CHGSZP(R,r) F(R)=l_cpu_szp_flags[r]
 #define INR(R, r) r++; AUX(R)=l_cpu_inr_aux[(r)&0x0f]; CHGSZP(R, r)
 #define DCR(R, r) r--; AUX(R)=l_cpu_dcr_aux[(r)&0x0f]; CHGSZP(R, r)
@@ -165,13 +214,254 @@ static unsigned int lut_profiler[0x100]; /* occurance of opcodes */
 #define XRA(R,r)  RES(R)=A(R)=A(R)^r;AUX(R)=0; CHGSZP(R, A(R))
 #define ORA(R,r)  RES(R)=A(R)=A(R)|r;AUX(R)=0; CHGSZP(R, A(R))
 
+/*****************************************************************************/
+/* Instruction fetch                                                         */
+/*****************************************************************************/
+
+#if defined(cpuI8080_PREDECODE) || defined(cpuI8080_BLOCK_CACHE)
+// Fetches the pre-decoded instruction (pre-decoded ROM range and block cache)
+#define FETCH_DECODED(R, d) opcode = (d)->opcode; \
+                        immediate = (d)->immediate; \
+                        CYCLES(R) -= (d)->cycles; \
+                        PC(R)++
+#endif
+
+#ifdef cpuI8080_PREDECODE
+// Instructions of the pre-decoded range are taken from the decoded table,
+// otherwise operands are fetched together with the opcode
+#define FETCH(R)        if ((uint16_t)(PC(R) - R->decoded_address) < R->decoded_length) \
+                        { \
+                          decoded = &R->decoded[(uint16_t)(PC(R) - R->decoded_address)]; \
+                          FETCH_DECODED(R, decoded); \
+                        } \
+                        else \
+                        { \
+                          opcode = Read8(R, PC(R)); \
+                          PC(R)++; \
+                          immediate = ReadOperand(R, opcode); \
+                          CYCLES(R) -= l_cpu_instruction_cycles[opcode]; \
+                        }
+#define IMM8(R)         ((uint8_t)immediate)
+#define IMM16(R)        immediate
+#else
+#define FETCH(R)        opcode = Read8(R, PC(R)); \
+                        PC(R)++; \
+                        CYCLES(R) -= l_cpu_instruction_cycles[opcode]
+#define IMM8(R)         Read8(R, PC(R))
+#define IMM16(R)        Read16(R, PC(R))
+#endif
+
+/*****************************************************************************/
+/* Instruction dispatch                                                      */
+/*****************************************************************************/
+
+// Threaded dispatch uses the labels as values extension of GCC and Clang.
+// Debug and profiler builds always use the switch.
+#if defined(cpuI8080_THREADED_DISPATCH) && defined(__GNUC__) && !defined(CPU_DEBUG) && !defined(cpuI8080_PROFILER)
+#define cpuI8080_USE_THREADED_DISPATCH
+#endif
+
+#ifdef cpuI8080_INSTRUCTION_COUNTER
+#define COUNT_INSTRUCTION(R) R->instruction_count++
+#else
+#define COUNT_INSTRUCTION(R)
+#endif
+
+#ifdef cpuI8080_PROFILER
+// address and cycle counter are saved before the instruction, the opcode and the used cycles are counted after it
+#define PROFILER_BEGIN(R) profiler_address = PC(R); profiler_cycles = CYCLES(R)
+#define PROFILER_END(R)   if (PROFILING(R)) \
+                          { \
+                            cpuProfilerOpcode(R->profiler, cpuPROFILER_OPCODES_MAIN, opcode); \
+                            cpuProfilerInstruction(R->profiler, profiler_address, (uint32_t)(profiler_cycles - CYCLES(R))); \
+                          }
+#else
+#define PROFILER_BEGIN(R)
+#define PROFILER_END(R)
+#endif
+
+#ifdef cpuI8080_TRACE
+// registers are recorded before fetching the instruction
+#define TRACE_INSTRUCTION(R) if (TRACING(R)) cpuI8080TraceInstruction(R, trace_cycles)
+#else
+#define TRACE_INSTRUCTION(R)
+#endif
+
+#ifdef cpuI8080_USE_THREADED_DISPATCH
+// every instruction ends with fetching and jumping to the next one
+#define OPCODE(x)       op_##x:
+#define OPCODE_ILLEGAL  op_illegal:
+#define NEXT            if (CYCLES(R) <= 0) goto exec_end; \
+                        TRACE_INSTRUCTION(R); \
+                        FETCH(R); \
+                        COUNT_INSTRUCTION(R); \
+                        goto *l_cpu_dispatch_table[opcode]
+
+// handler addresses of the opcodes
+#define DISPATCH_TABLE \
+  /* 0x */ &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07, &&op_illegal, &&op_0x09, &&op_0x0a, &&op_0x0b, &&op_0x0c, &&op_0x0d, &&op_0x0e, &&op_0x0f, \
+  /* 1x */ &&op_illegal, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17, &&op_illegal, &&op_0x19, &&op_0x1a, &&op_0x1b, &&op_0x1c, &&op_0x1d, &&op_0x1e, &&op_0x1f, \
+  /* 2x */ &&op_illegal, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27, &&op_illegal, &&op_0x29, &&op_0x2a, &&op_0x2b, &&op_0x2c, &&op_0x2d, &&op_0x2e, &&op_0x2f, \
+  /* 3x */ &&op_illegal, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37, &&op_illegal, &&op_0x39, &&op_0x3a, &&op_0x3b, &&op_0x3c, &&op_0x3d, &&op_0x3e, &&op_0x3f, \
+  /* 4x */ &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47, &&op_0x48, &&op_0x49, &&op_0x4a, &&op_0x4b, &&op_0x4c, &&op_0x4d, &&op_0x4e, &&op_0x4f, \
+  /* 5x */ &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57, &&op_0x58, &&op_0x59, &&op_0x5a, &&op_0x5b, &&op_0x5c, &&op_0x5d, &&op_0x5e, &&op_0x5f, \
+  /* 6x */ &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67, &&op_0x68, &&op_0x69, &&op_0x6a, &&op_0x6b, &&op_0x6c, &&op_0x6d, &&op_0x6e, &&op_0x6f, \
+  /* 7x */ &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77, &&op_0x78, &&op_0x79, &&op_0x7a, &&op_0x7b, &&op_0x7c, &&op_0x7d, &&op_0x7e, &&op_0x7f, \
+  /* 8x */ &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87, &&op_0x88, &&op_0x89, &&op_0x8a, &&op_0x8b, &&op_0x8c, &&op_0x8d, &&op_0x8e, &&op_0x8f, \
+  /* 9x */ &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97, &&op_0x98, &&op_0x99, &&op_0x9a, &&op_0x9b, &&op_0x9c, &&op_0x9d, &&op_0x9e, &&op_0x9f, \
+  /* Ax */ &&op_0xa0, &&op_0xa1, &&op_0xa2, &&op_0xa3, &&op_0xa4, &&op_0xa5, &&op_0xa6, &&op_0xa7, &&op_0xa8, &&op_0xa9, &&op_0xaa, &&op_0xab, &&op_0xac, &&op_0xad, &&op_0xae, &&op_0xaf, \
+  /* Bx */ &&op_0xb0, &&op_0xb1, &&op_0xb2, &&op_0xb3, &&op_0xb4, &&op_0xb5, &&op_0xb6, &&op_0xb7, &&op_0xb8, &&op_0xb9, &&op_0xba, &&op_0xbb, &&op_0xbc, &&op_0xbd, &&op_0xbe, &&op_0xbf, \
+  /* Cx */ &&op_0xc0, &&op_0xc1, &&op_0xc2, &&op_0xc3, &&op_0xc4, &&op_0xc5, &&op_0xc6, &&op_0xc7, &&op_0xc8, &&op_0xc9, &&op_0xca, &&op_illegal, &&op_0xcc, &&op_0xcd, &&op_0xce, &&op_0xcf, \
+  /* Dx */ &&op_0xd0, &&op_0xd1, &&op_0xd2, &&op_0xd3, &&op_0xd4, &&op_0xd5, &&op_0xd6, &&op_0xd7, &&op_0xd8, &&op_illegal, &&op_0xda, &&op_0xdb, &&op_0xdc, &&op_illegal, &&op_0xde, &&op_0xdf, \
+  /* Ex */ &&op_0xe0, &&op_0xe1, &&op_0xe2, &&op_0xe3, &&op_0xe4, &&op_0xe5, &&op_0xe6, &&op_0xe7, &&op_0xe8, &&op_0xe9, &&op_0xea, &&op_0xeb, &&op_0xec, &&op_illegal, &&op_0xee, &&op_0xef, \
+  /* Fx */ &&op_0xf0, &&op_0xf1, &&op_0xf2, &&op_0xf3, &&op_0xf4, &&op_0xf5, &&op_0xf6, &&op_0xf7, &&op_0xf8, &&op_0xf9, &&op_0xfa, &&op_0xfb, &&op_0xfc, &&op_illegal, &&op_0xfe, &&op_0xff
+#else
+#define OPCODE(x)       case x:
+#define OPCODE_ILLEGAL  default:
+#define NEXT            break
+#endif
+
 /*****************************************************************************/
 /* Local functions                                                           */
 /*****************************************************************************/
 
 static void Push16(cpuI8080State* R, uint16_t Value);
 static uint16_t Pop16(cpuI8080State* R);
-static uint16_t Read16(uint16_t Address);
+static uint16_t Read16(cpuI8080State* R, uint16_t Address);
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+static void cpuI8080IdleLoop(cpuI8080State* R);
+#endif
+static uint8_t cpuI8080UnmappedPortRead(cpuI8080State* R, uint16_t in_port);
+static char* cpuI8080WriteHex(char* out_text, uint16_t in_value, uint8_t in_digit_count);
+#ifdef cpuI8080_PROFILER
+static uint8_t cpuI8080ProfilerReadMemory(void* in_cpu, uint16_t in_address);
+#endif
+#ifdef cpuI8080_TRACE
+static void cpuI8080TraceInstruction(cpuI8080State* R, int32_t in_cycles);
+#endif
+static void cpuI8080UnmappedPortWrite(cpuI8080State* R, uint16_t in_port, uint8_t in_value);
+#ifdef cpuI8080_BLOCK_CACHE
+static int cpuI8080ExecBlocks(cpuI8080State* R, int in_cycles);
+static void cpuI8080InvalidateCodePage(cpuI8080BlockCache* in_cache, uint8_t in_page);
+static void cpuI8080LogMemoryWrite(cpuI8080State* R, uint16_t in_address, uint8_t in_value);
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads one byte from the memory using the memory map
+/// @param R CPU registers and status information
+/// @param in_address Address to read
+/// @return Memory content
+static inline uint8_t Read8(cpuI8080State* R, uint16_t in_address)
+{
+	uint8_t* page = R->read_page[in_address >> cpuI8080_PAGE_SHIFT];
+
+	if (page != NULL)
+		return page[in_address & cpuI8080_PAGE_MASK];
+	else
+		return R->read_handler[in_address >> cpuI8080_PAGE_SHIFT](R, in_address);
+}
+
+#ifdef cpuI8080_BLOCK_CACHE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Invalidates the cached blocks of the page when the written address is on a cached code page
+/// @param R CPU registers and status information
+/// @param in_address Written address
+static inline void cpuI8080CodeWritten(cpuI8080State* R, uint16_t in_address)
+{
+	if (R->block_cache != NULL && R->block_cache->code_page[in_address >> cpuI8080_PAGE_SHIFT])
+		cpuI8080InvalidateCodePage(R->block_cache, (uint8_t)(in_address >> cpuI8080_PAGE_SHIFT));
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes one byte to the memory using the memory map
+/// @param R CPU registers and status information
+/// @param in_address Address to write
+/// @param in_value Value to write
+static inline void Write8(cpuI8080State* R, uint16_t in_address, uint8_t in_value)
+{
+	uint8_t* page = R->write_page[in_address >> cpuI8080_PAGE_SHIFT];
+
+	IDLE_BREAK(R);
+
+#ifdef cpuI8080_DIRTY_PAGES
+	cpuDirtyPagesMark(&R->dirty_pages, in_address);
+#endif
+
+	if (page != NULL)
+	{
+		page[in_address & cpuI8080_PAGE_MASK] = in_value;
+
+#ifdef cpuI8080_BLOCK_CACHE
+		// ignored writes (e.g. ROM) don't change the cached code
+		if (page != R->discard_write_page)
+			cpuI8080CodeWritten(R, in_address);
+#endif
+	}
+	else
+	{
+		R->write_handler[in_address >> cpuI8080_PAGE_SHIFT](R, in_address, in_value);
+
+#ifdef cpuI8080_BLOCK_CACHE
+		// handlers may store the value, the logging handler of the differential mode checks the original map
+		if (R->write_handler[in_address >> cpuI8080_PAGE_SHIFT] != cpuI8080LogMemoryWrite)
+			cpuI8080CodeWritten(R, in_address);
+#endif
+	}
+}
+
+#if defined(cpuI8080_PREDECODE) || defined(cpuI8080_BLOCK_CACHE)
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Decodes one instruction
+/// @param R CPU registers and status information
+/// @param in_address Address of the instruction
+/// @param out_instruction Decoded instruction
+static void cpuI8080DecodeInstruction(cpuI8080State* R, uint16_t in_address, cpuI8080DecodedInstruction* out_instruction)
+{
+	uint8_t opcode = Read8(R, in_address);
+
+	out_instruction->opcode = opcode;
+	out_instruction->cycles = l_cpu_instruction_cycles[opcode];
+	out_instruction->length = l_cpu_instruction_length[opcode];
+
+	switch (out_instruction->length)
+	{
+		case 2:
+			out_instruction->immediate = Read8(R, (uint16_t)(in_address + 1));
+			break;
+
+		case 3:
+			out_instruction->immediate = Read8(R, (uint16_t)(in_address + 1)) | (Read8(R, (uint16_t)(in_address + 2)) << 8);
+			break;
+
+		default:
+			out_instruction->immediate = 0;
+			break;
+	}
+}
+#endif
+
+#ifdef cpuI8080_PREDECODE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads the operand of the instruction (PC must point after the opcode)
+/// @param R CPU registers and status information
+/// @param in_opcode Opcode of the instruction
+/// @return Operand of the instruction or zero when the instruction has no operand
+static inline uint16_t ReadOperand(cpuI8080State* R, uint8_t in_opcode)
+{
+	switch (l_cpu_instruction_length[in_opcode])
+	{
+		case 2:
+			return Read8(R, PC(R));
+
+		case 3:
+			return Read16(R, PC(R));
+
+		default:
+			return 0;
+	}
+}
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Resets emulated I8080 CPU
@@ -192,7 +482,237 @@ void cpuI8080Reset(cpuI8080State *R)
 	AUX(R) = 0;        /* aux carry bit */
 	HALTED(R) = 0;
 	F(R)=cpuI8080_F_UN1;
+#ifdef cpuI8080_INSTRUCTION_COUNTER
+	R->instruction_count = 0;
+#endif
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+	R->idle_quiet = 0;
+	R->idle_skipped_cycles = 0;
+#endif
+#ifdef cpuI8080_DIRTY_PAGES
+	cpuDirtyPagesClear(&R->dirty_pages);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sets all memory pages and I/O ports to unmapped (reads 0xff, writes are ignored)
+/// @param R CPU registers and status information
+void cpuI8080MemoryMapReset(cpuI8080State* R)
+{
+	uint32_t i;
+
+	for (i = 0; i < cpuI8080_PAGE_SIZE; i++)
+		R->unmapped_read_page[i] = 0xff;
+
+	for (i = 0; i < cpuI8080_PAGE_COUNT; i++)
+	{
+		R->read_page[i] = R->unmapped_read_page;
+		R->write_page[i] = R->discard_write_page;
+		R->read_handler[i] = NULL;
+		R->write_handler[i] = NULL;
+	}
+
+	R->port_read = cpuI8080UnmappedPortRead;
+	R->port_write = cpuI8080UnmappedPortWrite;
+
+#ifdef cpuI8080_PREDECODE
+	R->decoded = NULL;
+	R->decoded_address = 0;
+	R->decoded_length = 0;
+#endif
+
+#ifdef cpuI8080_BLOCK_CACHE
+	R->block_cache = NULL;
+	R->exec_mode = cpuI8080_EXEC_INTERPRETER;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Maps memory block directly to the given address range. Address and length must be page aligned.
+/// @param R CPU registers and status information
+/// @param in_address Start address of the range
+/// @param in_length Length of the range in bytes
+/// @param in_read Memory block for reading (null if range is not readable)
+/// @param in_write Memory block for writing (null if writes are ignored)
+void cpuI8080MapMemory(cpuI8080State* R, uint16_t in_address, uint32_t in_length, const uint8_t* in_read, uint8_t* in_write)
+{
+	uint32_t page = in_address >> cpuI8080_PAGE_SHIFT;
+	uint32_t offset = 0;
+
+	while (offset < in_length && page < cpuI8080_PAGE_COUNT)
+	{
+		R->read_page[page] = (in_read == NULL) ? R->unmapped_read_page : (uint8_t*)in_read + offset;
+		R->write_page[page] = (in_write == NULL) ? R->discard_write_page : in_write + offset;
+		R->read_handler[page] = NULL;
+		R->write_handler[page] = NULL;
+
+		offset += cpuI8080_PAGE_SIZE;
+		page++;
+	}
+
+#ifdef cpuI8080_BLOCK_CACHE
+	if (R->block_cache != NULL)
+		cpuI8080FlushBlockCache(R);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Maps memory access handlers to the given address range. Address and length must be page aligned.
+/// Direct memory mapping of the pages is kept for the direction where the handler is null.
+/// @param R CPU registers and status information
+/// @param in_address Start address of the range
+/// @param in_length Length of the range in bytes
+/// @param in_read Read handler or null
+/// @param in_write Write handler or null
+void cpuI8080MapHandler(cpuI8080State* R, uint16_t in_address, uint32_t in_length, cpuI8080MemoryReadHandler in_read, cpuI8080MemoryWriteHandler in_write)
+{
+	uint32_t page = in_address >> cpuI8080_PAGE_SHIFT;
+	uint32_t offset = 0;
+
+	while (offset < in_length && page < cpuI8080_PAGE_COUNT)
+	{
+		if (in_read != NULL)
+		{
+			R->read_page[page] = NULL;
+			R->read_handler[page] = in_read;
+		}
+
+		if (in_write != NULL)
+		{
+			R->write_page[page] = NULL;
+			R->write_handler[page] = in_write;
+		}
+
+		offset += cpuI8080_PAGE_SIZE;
+		page++;
+	}
+
+#ifdef cpuI8080_BLOCK_CACHE
+	if (R->block_cache != NULL)
+		cpuI8080FlushBlockCache(R);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads memory through the memory map (for debuggers and memory handlers)
+/// @param R CPU registers and status information
+/// @param in_address Address to read
+/// @return Memory content
+uint8_t cpuI8080ReadMemory(cpuI8080State* R, uint16_t in_address)
+{
+	return Read8(R, in_address);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes memory through the memory map (for debuggers and memory handlers)
+/// @param R CPU registers and status information
+/// @param in_address Address to write
+/// @param in_value Value to write
+void cpuI8080WriteMemory(cpuI8080State* R, uint16_t in_address, uint8_t in_value)
+{
+	Write8(R, in_address, in_value);
+}
+
+#ifdef cpuI8080_PREDECODE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Decodes the instructions of a read-only code range (ROM) using the current memory map and
+/// attaches the decoded instructions to the CPU. Instructions starting in the range are executed from the
+/// decoded buffer, code outside of the range is interpreted. Every byte address of the range is decoded
+/// in order to handle jumps into the middle of the instructions. The content of the range must not change
+/// while the decoded instructions are attached (cpuI8080MemoryMapReset detaches them).
+/// @param R CPU registers and status information
+/// @param in_address Start address of the code range
+/// @param in_length Length of the code range in bytes
+/// @param in_buffer Buffer for the decoded instructions (in_length entries)
+void cpuI8080PredecodeMemory(cpuI8080State* R, uint16_t in_address, uint32_t in_length, cpuI8080DecodedInstruction* in_buffer)
+{
+	uint32_t i;
+
+	for (i = 0; i < in_length; i++)
+		cpuI8080DecodeInstruction(R, (uint16_t)(in_address + i), &in_buffer[i]);
+
+	cpuI8080AttachDecodedMemory(R, in_address, in_length, in_buffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Attaches already decoded instructions to the CPU (decoded buffer can be shared between CPUs
+/// running the same ROM). The last two bytes of the range are always interpreted as the operands of
+/// the instructions starting there are outside of the range.
+/// @param R CPU registers and status information
+/// @param in_address Start address of the decoded range
+/// @param in_length Length of the decoded range in bytes
+/// @param in_buffer Decoded instructions (see cpuI8080PredecodeMemory)
+void cpuI8080AttachDecodedMemory(cpuI8080State* R, uint16_t in_address, uint32_t in_length, const cpuI8080DecodedInstruction* in_buffer)
+{
+	R->decoded = in_buffer;
+	R->decoded_address = in_address;
+	R->decoded_length = (in_length > 2) ? (uint16_t)(in_length - 2) : 0;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sets I/O port handlers called by the IN and OUT instructions
+/// @param R CPU registers and status information
+/// @param in_read Port read handler (null if ports are not readable)
+/// @param in_write Port write handler (null if port writes are ignored)
+void cpuI8080SetPortHandlers(cpuI8080State* R, cpuI8080PortReadHandler in_read, cpuI8080PortWriteHandler in_write)
+{
+	R->port_read = (in_read == NULL) ? cpuI8080UnmappedPortRead : in_read;
+	R->port_write = (in_write == NULL) ? cpuI8080UnmappedPortWrite : in_write;
+}
+
+#ifdef cpuI8080_BLOCK_CACHE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Selects the execution mode. The interpreter is the reference implementation, blocks executed from
+/// the block cache give the same results (including cycle counts at exits). In differential mode every block is
+/// executed from the block cache and interpreted as well and the results are compared (see mismatch_count of the block cache).
+/// The block cache can be kept attached in interpreter mode in order to switch modes later.
+/// @param R CPU registers and status information
+/// @param in_mode Execution mode
+/// @param in_cache Block cache of the CPU (null to use the interpreter only)
+void cpuI8080SetExecMode(cpuI8080State* R, cpuI8080ExecMode in_mode, cpuI8080BlockCache* in_cache)
+{
+	if (in_cache != R->block_cache)
+	{
+		R->block_cache = in_cache;
+
+		if (in_cache != NULL)
+		{
+			in_cache->cached_block_count = 0;
+			in_cache->invalidated_page_count = 0;
+			in_cache->compared_block_count = 0;
+			in_cache->mismatch_count = 0;
+			in_cache->mismatch_address = 0;
+
+			cpuI8080FlushBlockCache(R);
+		}
+	}
+
+	R->exec_mode = (in_cache == NULL) ? cpuI8080_EXEC_INTERPRETER : in_mode;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Drops all cached blocks. Writes of the CPU invalidate the cached code automatically,
+/// it must be called only when the memory is modified bypassing the CPU (e.g. loading program into RAM).
+/// @param R CPU registers and status information
+void cpuI8080FlushBlockCache(cpuI8080State* R)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	uint32_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < cpuI8080_BLOCK_CACHE_SIZE; i++)
+		cache->blocks[i].valid = 0;
+
+	for (i = 0; i < cpuI8080_PAGE_COUNT; i++)
+		cache->code_page[i] = 0;
+
+	// the running block is stopped
+	cache->write_detected = 1;
 }
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Generates interrupt request
@@ -227,6 +747,171 @@ void cpuI8080UpdateFlags(cpuI8080State* R)
 	F(R) = (F(R) & (cpuI8080_F_SIGN|cpuI8080_F_ZERO|cpuI8080_F_PARITY)) | (RES(R)>>8&1) | AUX(R) | cpuI8080_F_UN1;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Disassembles one instruction
+/// @param in_code Instruction bytes (at least 3 bytes)
+/// @param in_address Address of the instruction
+/// @param out_text Buffer receiving the instruction text (at least 16 characters)
+/// @return Length of the instruction in bytes
+uint8_t cpuI8080Disassemble(const uint8_t* in_code, uint16_t in_address, char* out_text)
+{
+	const char* mnemonic = l_cpu_instruction_mnemonic[in_code[0]];
+	uint8_t length = l_cpu_instruction_length[in_code[0]];
+
+	(void)in_address;
+
+	while (*mnemonic != '\0')
+	{
+		// operand placeholder
+		if (*mnemonic == '#' || *mnemonic == '$')
+		{
+			if (length == 3)
+				out_text = cpuI8080WriteHex(out_text, in_code[1] | (in_code[2] << 8), 4);
+			else
+				out_text = cpuI8080WriteHex(out_text, in_code[1], 2);
+		}
+		else
+		{
+			*out_text++ = *mnemonic;
+		}
+
+		mnemonic++;
+	}
+
+	*out_text = '\0';
+
+	return length;
+}
+
+#ifdef cpuI8080_PROFILER
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Attaches profiler to the CPU. Profiled CPU is always interpreted (cached blocks are not used).
+/// @param R CPU registers and status information
+/// @param in_profiler Profiler collecting the statistics (null to stop profiling)
+void cpuI8080AttachProfiler(cpuI8080State* R, cpuProfilerState* in_profiler)
+{
+	R->profiler = in_profiler;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes report of the attached profiler
+/// @param R CPU registers and status information
+/// @param in_file File to write the report to
+void cpuI8080ProfilerReport(cpuI8080State* R, FILE* in_file)
+{
+	cpuProfilerTarget target;
+
+	if (R->profiler == NULL)
+		return;
+
+	target.Name = "i8080";
+	target.CPU = R;
+	target.ReadMemory = cpuI8080ProfilerReadMemory;
+	target.Disassemble = cpuI8080Disassemble;
+	target.OpcodeTableCount = 1;
+
+	cpuProfilerReport(R->profiler, &target, in_file);
+}
+#endif
+
+#ifdef cpuI8080_TRACE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Attaches instruction trace buffer to the CPU. Traced CPU is always interpreted while recording.
+/// @param R CPU registers and status information
+/// @param in_buffer Trace buffer receiving the executed instructions (null to stop tracing)
+void cpuI8080AttachTrace(cpuI8080State* R, cpuTraceBuffer* in_buffer)
+{
+	R->trace = in_buffer;
+
+	if (in_buffer != NULL)
+		in_buffer->CPUType = cpuTRACE_CPU_I8080;
+}
+#endif
+
+#ifdef cpuI8080_DIRTY_PAGES
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets the 256 byte pages written by the CPU (or by cpuI8080WriteMemory) since the last clear.
+/// Every write is marked, including writes of the memory handlers and ignored writes.
+/// @param R CPU registers and status information
+/// @return Dirty page bitmap of the CPU
+const cpuDirtyPageBitmap* cpuI8080GetDirtyPages(cpuI8080State* R)
+{
+	return &R->dirty_pages;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Clears the dirty page bitmap (usually called at the end of the frame)
+/// @param R CPU registers and status information
+void cpuI8080ClearDirtyPages(cpuI8080State* R)
+{
+	cpuDirtyPagesClear(&R->dirty_pages);
+}
+#endif
+
+#ifdef cpuI8080_SNAPSHOT
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves registers and execution state of the CPU into the snapshot. Memory map and attached
+/// diagnostics are not saved, they belong to the machine.
+/// @param R CPU registers and status information
+/// @param in_writer Snapshot writer
+void cpuI8080SaveState(cpuI8080State* R, emuSnapshotWriter* in_writer)
+{
+	emuSnapshotWriteWord(in_writer, PC(R));
+	emuSnapshotWriteWord(in_writer, SP(R));
+
+	// register pairs are stored by bytes (layout of the pairs depends on the host byte order)
+	emuSnapshotWriteByte(in_writer, A(R));
+	emuSnapshotWriteByte(in_writer, F(R));
+	emuSnapshotWriteByte(in_writer, B(R));
+	emuSnapshotWriteByte(in_writer, C(R));
+	emuSnapshotWriteByte(in_writer, D(R));
+	emuSnapshotWriteByte(in_writer, E(R));
+	emuSnapshotWriteByte(in_writer, H(R));
+	emuSnapshotWriteByte(in_writer, L(R));
+
+	emuSnapshotWriteDWord(in_writer, (uint32_t)CYCLES(R));
+	emuSnapshotWriteWord(in_writer, RES(R));
+	emuSnapshotWriteByte(in_writer, INT(R));
+	emuSnapshotWriteByte(in_writer, IPEND(R));
+	emuSnapshotWriteByte(in_writer, AUX(R));
+	emuSnapshotWriteByte(in_writer, HALTED(R));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores registers and execution state of the CPU from the snapshot. Cached blocks are dropped
+/// as the memory content is restored as well.
+/// @param R CPU registers and status information
+/// @param in_reader Snapshot reader
+void cpuI8080LoadState(cpuI8080State* R, emuSnapshotReader* in_reader)
+{
+	PC(R) = emuSnapshotReadWord(in_reader);
+	SP(R) = emuSnapshotReadWord(in_reader);
+	A(R) = emuSnapshotReadByte(in_reader);
+	F(R) = emuSnapshotReadByte(in_reader);
+	B(R) = emuSnapshotReadByte(in_reader);
+	C(R) = emuSnapshotReadByte(in_reader);
+	D(R) = emuSnapshotReadByte(in_reader);
+	E(R) = emuSnapshotReadByte(in_reader);
+	H(R) = emuSnapshotReadByte(in_reader);
+	L(R) = emuSnapshotReadByte(in_reader);
+	CYCLES(R) = (int32_t)emuSnapshotReadDWord(in_reader);
+	RES(R) = emuSnapshotReadWord(in_reader);
+	INT(R) = emuSnapshotReadByte(in_reader);
+	IPEND(R) = emuSnapshotReadByte(in_reader);
+	AUX(R) = emuSnapshotReadByte(in_reader);
+	HALTED(R) = emuSnapshotReadByte(in_reader);
+
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+	R->idle_saved = 0;
+	R->idle_quiet = 0;
+#endif
+
+#ifdef cpuI8080_BLOCK_CACHE
+	cpuI8080FlushBlockCache(R);
+#endif
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Executes instructions (runs processor)
 /// @param R CPU registers and status information
@@ -238,372 +923,73 @@ int cpuI8080Exec(cpuI8080State* R, int cycles)
 	uint8_t temp_byte;
 	uint16_t temp_word;
 	uint32_t temp_dword;
+#ifdef cpuI8080_PREDECODE
+	const cpuI8080DecodedInstruction* decoded;
+	uint16_t immediate;
+#endif
+#ifdef cpuI8080_USE_THREADED_DISPATCH
+	static const void* const l_cpu_dispatch_table[256] = { DISPATCH_TABLE };
+#endif
 
-	CYCLES(R) += cycles;
+#ifdef cpuI8080_PROFILER
+	uint16_t profiler_address;
+	int32_t profiler_cycles;
+#endif
+#ifdef cpuI8080_TRACE
+	int32_t trace_cycles;
+#endif
 
-	while (CYCLES(R)>0)
-	{
-		opcode = RdI8080(PC(R));
-		PC(R)++;
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+	// memory may have been changed since the last call, registers are saved again at the first arrival to the loop
+	R->idle_saved = 0;
+	R->idle_quiet = 1;
+#endif
 
-		CYCLES(R) -= l_cpu_instruction_cycles[opcode];
+#ifdef cpuI8080_BLOCK_CACHE
+	// profiled and traced CPU is always interpreted
+	if (R->exec_mode != cpuI8080_EXEC_INTERPRETER && !PROFILING(R) && !TRACING(R))
+		return cpuI8080ExecBlocks(R, cycles);
+#endif
 
-		switch (opcode)
-		{
-			/* MOVE, LOAD, AND STORE */
-		case 0x40: break;                         // mov b,b
-		case 0x41: B(R) = C(R); break;            // mov b,c
-		case 0x42: B(R) = D(R); break;            // mov b,d
-		case 0x43: B(R) = E(R); break;            // mov b,e
-		case 0x44: B(R) = H(R); break;            // mov b,h
-		case 0x45: B(R) = L(R); break;            // mov b,l
-		case 0x46: B(R) = RdI8080(HL(R)); break;  // mov b,M
-		case 0x47: B(R) = A(R); break;            // mov b,a
-
-		case 0x48: C(R) = B(R); break;            // mov c,b
-		case 0x49: break;                         // mov c,c
-		case 0x4a: C(R) = D(R); break;            // mov c,d
-		case 0x4b: C(R) = E(R); break;            // mov c,e
-		case 0x4c: C(R) = H(R); break;            // mov c,h
-		case 0x4d: C(R) = L(R); break;            // mov c,l
-		case 0x4e: C(R) = RdI8080(HL(R)); break;  // mov c,M
-		case 0x4f: C(R) = A(R); break;            // mov c,a
-
-		case 0x50: D(R) = B(R); break;            // mov d,b
-		case 0x51: D(R) = C(R); break;            // mov d,c
-		case 0x52: break;                         // mov d,d
-		case 0x53: D(R) = E(R); break;            // mov d,e
-		case 0x54: D(R) = H(R); break;            // mov d,h
-		case 0x55: D(R) = L(R); break;            // mov d,l
-		case 0x56: D(R) = RdI8080(HL(R)); break;  // mov d,M
-		case 0x57: D(R) = A(R); break;            // mov d,a
-
-		case 0x58: E(R) = B(R); break;            // mov e,b
-		case 0x59: E(R) = C(R); break;            // mov e,c
-		case 0x5a: E(R) = D(R); break;            // mov e,d
-		case 0x5b: break;                         // mov e,e
-		case 0x5c: E(R) = H(R); break;						// mov e,h
-		case 0x5d: E(R) = L(R); break;            // mov e,l
-		case 0x5e: E(R) = RdI8080(HL(R)); break;  // mov e,M
-		case 0x5f: E(R) = A(R); break;            // mov e,a
-
-		case 0x60: H(R) = B(R); break;						// mov h,b
-		case 0x61: H(R) = C(R); break;						// mov h,c
-		case 0x62: H(R) = D(R); break;						// mov h,d
-		case 0x63: H(R) = E(R); break;						// mov h,e
-		case 0x64: break;													// mov h,h
-		case 0x65: H(R) = L(R); break;						// mov h,l
-		case 0x66: H(R) = RdI8080(HL(R)); break;  // mov h,M
-		case 0x67: H(R) = A(R); break;						// mov h,a
-
-		case 0x68: L(R) = B(R); break;						// mov l,b
-		case 0x69: L(R) = C(R); break;						// mov l,c
-		case 0x6a: L(R) = D(R); break;						// mov l,d
-		case 0x6b: L(R) = E(R); break;						// mov l,e
-		case 0x6c: L(R) = H(R); break;						// mov l,h
-		case 0x6d: break;													// mov l,l
-		case 0x6e: L(R) = RdI8080(HL(R)); break;  // mov l,M
-		case 0x6f: L(R) = A(R); break;						// mov l,a
-
-		case 0x70: WrI8080(HL(R), B(R)); break;   // mov M,b
-		case 0x71: WrI8080(HL(R), C(R)); break;   // mov M,c
-		case 0x72: WrI8080(HL(R), D(R)); break;   // mov M,d
-		case 0x73: WrI8080(HL(R), E(R)); break;   // mov M,e
-		case 0x74: WrI8080(HL(R), H(R)); break;   // mov M,h
-		case 0x75: WrI8080(HL(R), L(R)); break;   // mov M,l
-																							// HLT
-		case 0x77: WrI8080(HL(R), A(R)); break;   // mov M,a
-
-		case 0x78: A(R) = B(R); break;						// mov a,b
-		case 0x79: A(R) = C(R); break;						// mov a,c
-		case 0x7a: A(R) = D(R); break;						// mov a,d
-		case 0x7b: A(R) = E(R); break;						// mov a,e
-		case 0x7c: A(R) = H(R); break;						// mov a,h
-		case 0x7d: A(R) = L(R); break;						// mov a,l
-		case 0x7e: A(R) = RdI8080(HL(R)); break;  // mov a,M
-		case 0x7f: break;													// mov a,a
-
-			/* MVI */
-		case 0x06: B(R) = RdI8080(PC(R)); PC(R)++; break;							// mvi b,#
-		case 0x0e: C(R) = RdI8080(PC(R)); PC(R)++; break;							// mvi c,#
-		case 0x16: D(R) = RdI8080(PC(R)); PC(R)++; break;							// mvi d,#
-		case 0x1e: E(R) = RdI8080(PC(R)); PC(R)++; break;							// mvi e,#
-		case 0x26: H(R) = RdI8080(PC(R)); PC(R)++; break;							// mvi h,#
-		case 0x2e: L(R) = RdI8080(PC(R)); PC(R)++; break;							// mvi l,#
-		case 0x36: WrI8080(HL(R), RdI8080(PC(R))); PC(R)++; break;    // mvi M,#
-		case 0x3e: A(R) = RdI8080(PC(R)); PC(R)++; break;							// mvi a,#
-
-		case 0x01: BC(R) = Read16(PC(R)); PC(R)+=2; break;						// lxi b,#
-		case 0x11: DE(R) = Read16(PC(R)); PC(R)+=2; break;						// lxi d,#
-		case 0x21: HL(R) = Read16(PC(R)); PC(R)+=2; break;						// lxi h,#
-
-		case 0x02: WrI8080(BC(R), A(R)); break;												// stax b
-		case 0x12: WrI8080(DE(R), A(R)); break;												// stax d
-		case 0x0a: A(R) = RdI8080(BC(R)); break;											// ldax b
-		case 0x1a: A(R) = RdI8080(DE(R)); break;											// ldax d
-		case 0x22: temp_word = Read16(PC(R)); WrI8080(temp_word, L(R)); WrI8080(temp_word+1, H(R)); SKIP16(R); break;		// shld
-		case 0x2a: temp_word = Read16(PC(R)); L(R) = RdI8080(temp_word); H(R) = RdI8080(temp_word+1); SKIP16(R); break;	// lhld
-		case 0x32: WrI8080(Read16(PC(R)), A(R)); SKIP16(R); break;		// sta $
-		case 0x3a: A(R) = RdI8080(Read16(PC(R))); SKIP16(R); break;   // lda $
-
-		case 0xeb: temp_word=DE(R); DE(R)=HL(R); HL(R)=temp_word; break; // xchg
-
-
-			/* STACK OPS */
-		case 0xc5: Push16(R, BC(R)); break;     // push b
-		case 0xd5: Push16(R, DE(R)); break;     // push d
-		case 0xe5: Push16(R, HL(R)); break;     // push h
-		case 0xf5: cpuI8080UpdateFlags(R); Push16(R, PSW(R)); break;  // push psw
-
-		case 0xc1: BC(R) = Pop16(R); break;     // pop b
-		case 0xd1: DE(R) = Pop16(R); break;     // pop d
-		case 0xe1: HL(R) = Pop16(R); break;     // pop h
-		case 0xf1: PSW(R) = Pop16(R); RES(R) = (F(R)<<8&0x100); AUX(R) = F(R)&cpuI8080_F_AUXCARRY; break;  // pop psw
-
-		case 0xe3: temp_word = RdI8080(SP(R)); temp_word |= RdI8080(SP(R)+1) << 8; WrI8080(SP(R), L(R)); WrI8080(SP(R)+1, H(R)); HL(R)=temp_word; break; // xthl
-
-		case 0xf9: SP(R) = HL(R); break;    // sphl
-
-		case 0x31: SP(R) = Read16(PC(R)); SKIP16(R); break;    // lxi sp,#
-
-		case 0x33: SP(R)++; break;					// inx sp
-		case 0x3b: SP(R)--; break;					// dcx sp
-
-
-			/* JUMP */
-		case 0xc3: JUMP(R); break;					// jmp $
-
-		case 0xc2: if (ISNOTZERO(R)) { JUMP(R); } else { SKIP16(R); } break;  // jnz $
-		case 0xca: if (ISZERO(R)) { JUMP(R); } else { SKIP16(R); } break;			// jz $
-		case 0xd2: if (ISNOTCARRY(R)) { JUMP(R); } else { SKIP16(R); } break; // jnc $
-		case 0xda: if (ISCARRY(R)) { JUMP(R); } else { SKIP16(R); } break;		// jc $
-		case 0xe2: if (ISPODD(R)) { JUMP(R); } else { SKIP16(R); } break;			// jpo $
-		case 0xea: if (ISPEVEN(R)) { JUMP(R); } else { SKIP16(R); } break;		// jpe $
-		case 0xf2: if (ISPLUS(R)) { JUMP(R); } else { SKIP16(R); } break;			// jp $
-		case 0xfa: if (ISMIN(R)) { JUMP(R); } else { SKIP16(R); } break;			// jm $
-
-		case 0xe9: PC(R) = HL(R); break;    // pchl
-
-			/* CALL */
-		case 0xcd: CALL(R); break;					// call $
-
-		case 0xc4: if (ISNOTZERO(R)) { CCON(R); } else { SKIP16(R); } break;  // cnz $
-		case 0xcc: if (ISZERO(R)) { CCON(R); } else { SKIP16(R); } break;			// cz $
-		case 0xd4: if (ISNOTCARRY(R)) { CCON(R); } else { SKIP16(R); } break; // cnc $
-		case 0xdc: if (ISCARRY(R)) { CCON(R); } else { SKIP16(R); } break;		// cc $
-		case 0xe4: if (ISPODD(R)) { CCON(R); } else { SKIP16(R); } break;			// cpo $
-		case 0xec: if (ISPEVEN(R)) { CCON(R); } else { SKIP16(R); } break;		// cpe $
-		case 0xf4: if (ISPLUS(R)) { CCON(R); } else { SKIP16(R); } break;			// cp $
-		case 0xfc: if (ISMIN(R)) { CCON(R); } else { SKIP16(R); } break;			// cm $
-
-
-			/* RETURN */
-		case 0xc9: RET(R); break;														// ret 
-
-		case 0xc0: if (ISNOTZERO(R)) { RCON(R); } break;		// rnz
-		case 0xc8: if (ISZERO(R)) { RCON(R); } break;				// rz
-		case 0xd0: if (ISNOTCARRY(R)) { RCON(R); } break;		// rnc
-		case 0xd8: if (ISCARRY(R)) { RCON(R); } break;			// rc
-		case 0xe0: if (ISPODD(R)) { RCON(R); } break;				// rpo
-		case 0xe8: if (ISPEVEN(R)) { RCON(R); } break;			// rpe
-		case 0xf0: if (ISPLUS(R)) { RCON(R); } break;				// rp
-		case 0xf8: if (ISMIN(R)) { RCON(R); } break;				// rm
-
-
-			/* RESTART */
-		case 0xc7: 
-		case 0xcf: 
-		case 0xd7: 
-		case 0xdf: 
-		case 0xe7: 
-		case 0xef: 
-		case 0xf7: 
-		case 0xff:
-			RST(R, opcode>>3&7); break;    // rst x
-
-
-			/* INCREMENT AND DECREMENT */
-		case 0x04: INR(R, B(R)); break;     // inr b
-		case 0x0c: INR(R, C(R)); break;     // inr c
-		case 0x14: INR(R, D(R)); break;     // inr d
-		case 0x1c: INR(R, E(R)); break;     // inr e
-		case 0x24: INR(R, H(R)); break;     // inr h
-		case 0x2c: INR(R, L(R)); break;     // inr l
-		case 0x34: temp_byte = RdI8080(HL(R)) + 1; WrI8080(HL(R),temp_byte); AUX(R)=l_cpu_inr_aux[temp_byte&0x0f]; CHGSZP(R, temp_byte); break; // inr M
-		case 0x3c: INR(R, A(R)); break;     // inr a
-
-		case 0x05: DCR(R, B(R)); break;     // dcr b
-		case 0x0d: DCR(R, C(R)); break;     // dcr c
-		case 0x15: DCR(R, D(R)); break;     // dcr d
-		case 0x1d: DCR(R, E(R)); break;     // dcr e
-		case 0x25: DCR(R, H(R)); break;     // dcr h
-		case 0x2d: DCR(R, L(R)); break;     // dcr l
-		case 0x35: temp_byte = RdI8080(HL(R)) - 1; WrI8080(HL(R),temp_byte); AUX(R)=l_cpu_dcr_aux[temp_byte&0x0f]; CHGSZP(R, temp_byte); break; // dcr M
-		case 0x3d: DCR(R, A(R)); break;     // dcr a
-
-		case 0x03: BC(R)++; break;       // inx b
-		case 0x13: DE(R)++; break;       // inx d
-		case 0x23: HL(R)++; break;       // inx h
-
-		case 0x0b: BC(R)--; break;       // dcx b
-		case 0x1b: DE(R)--; break;       // dcx d
-		case 0x2b: HL(R)--; break;       // dcx h
-
-
-			/* ADD */
-		case 0x80: ADD(R, B(R)); break;     // add b
-		case 0x81: ADD(R, C(R)); break;     // add c
-		case 0x82: ADD(R, D(R)); break;     // add d
-		case 0x83: ADD(R, E(R)); break;     // add e
-		case 0x84: ADD(R, H(R)); break;     // add h
-		case 0x85: ADD(R, L(R)); break;     // add l
-		case 0x86: temp_byte = RdI8080(HL(R)); ADD(R, temp_byte); break;      // add M
-		case 0x87: ADD(R, A(R)); break;     // add a
-
-		case 0x88: ADC(R, B(R)); break;     // adc b
-		case 0x89: ADC(R, C(R)); break;     // adc c
-		case 0x8a: ADC(R, D(R)); break;     // adc d
-		case 0x8b: ADC(R, E(R)); break;     // adc e
-		case 0x8c: ADC(R, H(R)); break;     // adc h
-		case 0x8d: ADC(R, L(R)); break;     // adc l
-		case 0x8e: temp_byte = RdI8080(HL(R)); ADC(R, temp_byte); break;      // adc M
-		case 0x8f: ADC(R, A(R)); break;     // adc a
-
-		case 0xc6: temp_byte = RdI8080(PC(R)); ADD(R, temp_byte); PC(R)++; break;    // adi #
-		case 0xce: temp_byte = RdI8080(PC(R)); ADC(R, temp_byte); PC(R)++; break;    // aci #
-
-		case 0x09: DAD(R, BC(R)); break;      // dad b
-		case 0x19: DAD(R, DE(R)); break;      // dad d
-		case 0x29: DAD(R, HL(R)); break;      // dad h
-		case 0x39: DAD(R, SP(R)); break;      // dad sp
-
-
-			/* SUBTRACT */
-		case 0x90: SUB(R, B(R)); break;     // sub b
-		case 0x91: SUB(R, C(R)); break;     // sub c
-		case 0x92: SUB(R, D(R)); break;     // sub d
-		case 0x93: SUB(R, E(R)); break;     // sub e
-		case 0x94: SUB(R, H(R)); break;     // sub h
-		case 0x95: SUB(R, L(R)); break;     // sub l
-		case 0x96: temp_byte = RdI8080(HL(R)); SUB(R, temp_byte); break;      // sub M
-		case 0x97: SUB(R, A(R)); break;     // sub a
-
-		case 0x98: SBB(R, B(R)); break;     // sbb b
-		case 0x99: SBB(R, C(R)); break;     // sbb c
-		case 0x9a: SBB(R, D(R)); break;     // sbb d
-		case 0x9b: SBB(R, E(R)); break;     // sbb e
-		case 0x9c: SBB(R, H(R)); break;     // sbb h
-		case 0x9d: SBB(R, L(R)); break;     // sbb l
-		case 0x9e: temp_byte = RdI8080(HL(R)); SBB(R, temp_byte); break;      // sbb M
-		case 0x9f: SBB(R, A(R)); break;     // sbb a
-
-		case 0xd6: temp_byte = RdI8080(PC(R)); SUB(R, temp_byte); PC(R)++; break;    // sui #
-		case 0xde: temp_byte = RdI8080(PC(R)); SBB(R, temp_byte); PC(R)++; break;    // sbi #
-
-
-			/* LOGICAL */
-		case 0xa0: ANA(R, B(R)); break;     // ana b
-		case 0xa1: ANA(R, C(R)); break;     // ana c
-		case 0xa2: ANA(R, D(R)); break;     // ana d
-		case 0xa3: ANA(R, E(R)); break;     // ana e
-		case 0xa4: ANA(R, H(R)); break;     // ana h
-		case 0xa5: ANA(R, L(R)); break;     // ana l
-		case 0xa6: temp_byte = RdI8080(HL(R)); ANA(R, temp_byte); break;      // ana M
-		case 0xa7: ANA(R, A(R)); break;     // ana a
-
-		case 0xe6: temp_byte = RdI8080(PC(R)); ANA(R, temp_byte); PC(R)++; break;    // ani #
-
-		case 0xa8: XRA(R, B(R)); break;     // xra b
-		case 0xa9: XRA(R, C(R)); break;     // xra c
-		case 0xaa: XRA(R, D(R)); break;     // xra d
-		case 0xab: XRA(R, E(R)); break;     // xra e
-		case 0xac: XRA(R, H(R)); break;     // xra h
-		case 0xad: XRA(R, L(R)); break;     // xra l
-		case 0xae: temp_byte = RdI8080(HL(R)); XRA(R, temp_byte); break;      // xra M
-		case 0xaf: XRA(R, A(R)); break;     // xra a
-
-		case 0xee: temp_byte = RdI8080(PC(R)); XRA(R, temp_byte); PC(R)++; break;    // xri #
-
-		case 0xb0: ORA(R, B(R)); break;     // ora b
-		case 0xb1: ORA(R, C(R)); break;     // ora c
-		case 0xb2: ORA(R, D(R)); break;     // ora d
-		case 0xb3: ORA(R, E(R)); break;     // ora e
-		case 0xb4: ORA(R, H(R)); break;     // ora h
-		case 0xb5: ORA(R, L(R)); break;     // ora l
-		case 0xb6: temp_byte = RdI8080(HL(R)); ORA(R, temp_byte); break;      // ora M
-		case 0xb7: ORA(R, A(R)); break;     // ora a
-
-		case 0xf6: temp_byte = RdI8080(PC(R)); ORA(R, temp_byte); PC(R)++; break;    // ori #
-
-		case 0xb8: CMP(R, B(R)); break;     // cmp b
-		case 0xb9: CMP(R, C(R)); break;     // cmp c
-		case 0xba: CMP(R, D(R)); break;     // cmp d
-		case 0xbb: CMP(R, E(R)); break;     // cmp e
-		case 0xbc: CMP(R, H(R)); break;     // cmp h
-		case 0xbd: CMP(R, L(R)); break;     // cmp l
-		case 0xbe: temp_byte = RdI8080(HL(R)); CMP(R, temp_byte); break;      // cmp M
-		case 0xbf: CMP(R, A(R)); break;     // cmp a
-
-		case 0xfe: temp_byte = RdI8080(PC(R)); CMP(R, temp_byte); PC(R)++; break;    // cpi #
-
-
-			/* ROTATE */
-		case 0x07: RES(R)=(RES(R)&0xff)|(A(R)<<1&0x100); A(R) = (A(R)<<1&0xfe)|(RES(R)>>8&1); break;													// rlc
-		case 0x0f: RES(R)=(RES(R)&0xff)|(A(R)<<8&0x100); A(R) = (A(R)>>1&0x7f)|(RES(R)>>1&0x80); break;												// rrc
-		case 0x17: temp_word=((uint16_t)A(R))<<1&0x100; A(R)=A(R)<<1|(RES(R)>>8&1); RES(R)=(RES(R)&0xff)|temp_word; break;		// ral
-		case 0x1f: temp_word=((uint16_t)A(R))<<8&0x100; A(R)=A(R)>>1|(RES(R)>>1&0x80); RES(R)=(RES(R)&0xff)|temp_word; break; // rar
-
-
-			/* SPECIALS */
-		case 0x2f: A(R) = ~A(R); break;				// cma
-		case 0x37: RES(R) |= 0x100; break;    // stc
-		case 0x3f: RES(R) ^= 0x100; break;    // cmc
-
-		case 0x27:                            // daa
-			{
-				int c=RES(R);
-				uint8_t value_to_add = 0;
-				if (AUX(R)||((A(R)&0xf)>9))
-				{
-					value_to_add = 6; 
-				}
-				if ((c&0x100) || ((A(R)&0xf0)>0x90) || (((A(R)&0xf0)>=0x90) && (A(R) & 0x0f) > 9)) 
-				{
-					value_to_add |= 0x60;
-          c |= 0x100;
-        }
-				RES(R) = A(R) + value_to_add; 
-				AUX(R)=ADDAUX(R,value_to_add); // set aux carry
-				A(R)=RES(R)&0xff;								// store result in A
-				RES(R)=c;												// store carry
-				CHGSZP(R, A(R)); // set other flag bits (PZS)
-				break;
-			}
+	CYCLES(R) += cycles;
 
+#ifdef cpuI8080_TRACE
+	// cycle stamps of the records are relative to the start of this execution
+	trace_cycles = CYCLES(R);
+#endif
 
-			/* INPUT/OUTPUT */
-		case 0xd3: OutI8080(RdI8080(PC(R)), A(R)); PC(R)++; break;	// out p
-		case 0xdb: A(R)=InI8080(RdI8080(PC(R))); PC(R)++; break;		// in p
+#ifdef cpuI8080_USE_THREADED_DISPATCH
+	// start executing the first instruction, every instruction dispatches the next one
+	NEXT;
 
+#include <cpuI8080Codes.h>
 
-			/* CONTROL */
-		case 0xf3: INT(R) = 0; break;																												// di
-		case 0xfb: INT(R) = 1; if (IPEND(R) & 0x80) cpuI8080INT(R, IPEND(R) & 0x7f); break; // ei 
-		case 0x00: break;       // nop
-		case 0x76: HALTED(R) = 1; PC(R)--; break;	// hlt (mov M,M)
+exec_end:
+#else
+	while (CYCLES(R)>0)
+	{
+		PROFILER_BEGIN(R);
+		TRACE_INSTRUCTION(R);
+		FETCH(R);
+		COUNT_INSTRUCTION(R);
 
-		default: break;
+		switch (opcode)
+		{
+#include <cpuI8080Codes.h>
 		}
 
+		PROFILER_END(R);
+
 #if defined(CPU_DEBUG)
-		printf("%04x:%10s a%02X f%02X b%02X c%02X d%02X e%02X h%02X l%02X sp%04X\n",PC(R),lut_mnemonic[opcode],A(R),F(R),B(R),C(R),D(R),E(R),H(R),L(R),SP(R));
+		printf("%04x:%10s a%02X f%02X b%02X c%02X d%02X e%02X h%02X l%02X sp%04X\n",PC(R),l_cpu_instruction_mnemonic[opcode],A(R),F(R),B(R),C(R),D(R),E(R),H(R),L(R),SP(R));
 #endif
-
-#if PROFILE
-		lut_profiler[opcode]++;
+	}
 #endif
 
-	}
+#ifdef cpuI8080_TRACE
+	if (TRACING(R))
+		R->trace->CycleBase += (uint32_t)(trace_cycles - CYCLES(R));
+#endif
 
 	return CYCLES(R);
 }
@@ -614,20 +1000,674 @@ int cpuI8080Exec(cpuI8080State* R, int cycles)
 static void Push16(cpuI8080State* R, uint16_t Value)
 {
 	SP(R) -= 2;
-	WrI8080(SP(R), Value & 0xff);
-	WrI8080(SP(R)+1, (Value >> 8) & 0xff );
+	Write8(R, SP(R), Value & 0xff);
+	Write8(R, SP(R)+1, (Value >> 8) & 0xff );
 }
 
 static uint16_t Pop16(cpuI8080State* R)
 {
-	uint16_t value = ((RdI8080(SP(R)+1)<<8) | RdI8080(SP(R)));
+	uint16_t value = ((Read8(R, SP(R)+1)<<8) | Read8(R, SP(R)));
 	SP(R) += 2;
 
 	return value;
 }
 
-static uint16_t Read16(uint16_t Address)
+static uint16_t Read16(cpuI8080State* R, uint16_t Address)
+{
+	return ((uint16_t)Read8(R, Address+1) << 8) + Read8(R, Address);
+}
+
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Checks for idle loop at a short backward jump. When the CPU arrives to the same jump again with the
+/// same registers and there was no memory write or port access in between, the loop would repeat the same way
+/// until the end of the requested cycles. In this case the whole iterations are skipped (their cycles are charged)
+/// and the last one is executed, so the state at the exit is the same as without skipping. Registers are saved
+/// only when the loop has been quiet once, loops writing memory cost only a few stores.
+/// Memory mapped read handlers are expected to return the same value within one cpuI8080Exec call.
+/// @param R CPU registers and status information
+static void cpuI8080IdleLoop(cpuI8080State* R)
+{
+	int32_t loop_cycles;
+	int32_t loop_count;
+
+#ifdef cpuI8080_BLOCK_CACHE
+	// both passes of the differential mode must execute the same instructions
+	if (R->exec_mode == cpuI8080_EXEC_DIFFERENTIAL)
+		return;
+#endif
+
+	if (R->idle_quiet && R->idle_pc == PC(R))
+	{
+		if (R->idle_saved && CYCLES(R) > 0 && memcmp(R->idle_reg, &R->reg, sizeof(R->idle_reg)) == 0 &&
+				R->idle_result == RES(R) && R->idle_ac == AUX(R) && R->idle_i == INT(R) && R->idle_ipend == IPEND(R))
+		{
+			loop_cycles = R->idle_cycles - CYCLES(R);
+			loop_count = (CYCLES(R) - 1) / loop_cycles;
+
+			CYCLES(R) -= loop_count * loop_cycles;
+			R->idle_skipped_cycles += loop_count * loop_cycles;
+		}
+
+		memcpy(R->idle_reg, &R->reg, sizeof(R->idle_reg));
+		R->idle_result = RES(R);
+		R->idle_ac = AUX(R);
+		R->idle_i = INT(R);
+		R->idle_ipend = IPEND(R);
+		R->idle_saved = 1;
+	}
+	else
+	{
+		R->idle_pc = PC(R);
+		R->idle_saved = 0;
+	}
+
+	R->idle_cycles = CYCLES(R);
+	R->idle_quiet = 1;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes hexadecimal number with 'h' suffix
+/// @param out_text Text buffer
+/// @param in_value Value to write
+/// @param in_digit_count Number of digits
+/// @return Position after the written number
+static char* cpuI8080WriteHex(char* out_text, uint16_t in_value, uint8_t in_digit_count)
+{
+	while (in_digit_count > 0)
+	{
+		in_digit_count--;
+		*out_text++ = "0123456789ABCDEF"[(in_value >> (in_digit_count * 4)) & 0x0f];
+	}
+
+	*out_text++ = 'h';
+
+	return out_text;
+}
+
+#ifdef cpuI8080_PROFILER
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads memory for the disassembler of the profiler report (memory mapped I/O handlers are not called)
+static uint8_t cpuI8080ProfilerReadMemory(void* in_cpu, uint16_t in_address)
+{
+	uint8_t* page = ((cpuI8080State*)in_cpu)->read_page[in_address >> cpuI8080_PAGE_SHIFT];
+
+	return (page != NULL) ? page[in_address & cpuI8080_PAGE_MASK] : 0xff;
+}
+#endif
+
+#ifdef cpuI8080_TRACE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Records the registers and the code of the next instruction into the trace buffer (memory mapped I/O
+/// handlers are not called)
+/// @param R CPU registers and status information
+/// @param in_cycles Cycle counter at the start of the execution
+static void cpuI8080TraceInstruction(cpuI8080State* R, int32_t in_cycles)
+{
+	cpuTraceRecord* record = cpuTraceBeginRecord(R->trace);
+	uint8_t* page;
+	uint16_t address;
+	uint8_t i;
+
+	record->Cycles = R->trace->CycleBase + (uint32_t)(in_cycles - CYCLES(R));
+	record->PC = PC(R);
+	record->AF = (A(R) << 8) | (F(R) & (cpuI8080_F_SIGN | cpuI8080_F_ZERO | cpuI8080_F_PARITY)) | (RES(R) >> 8 & 1) | AUX(R) | cpuI8080_F_UN1;
+	record->BC = BC(R);
+	record->DE = DE(R);
+	record->HL = HL(R);
+	record->SP = SP(R);
+	record->IX = 0;
+	record->IY = 0;
+	record->InterruptEnable = INT(R);
+
+	// code is copied at once when it doesn't cross page boundary
+	page = R->read_page[PC(R) >> cpuI8080_PAGE_SHIFT];
+	if (page != NULL && (PC(R) & cpuI8080_PAGE_MASK) <= cpuI8080_PAGE_SIZE - cpuTRACE_CODE_LENGTH)
+	{
+		memcpy(record->Code, &page[PC(R) & cpuI8080_PAGE_MASK], cpuTRACE_CODE_LENGTH);
+	}
+	else
+	{
+		for (i = 0; i < cpuTRACE_CODE_LENGTH; i++)
+		{
+			address = PC(R) + i;
+			page = R->read_page[address >> cpuI8080_PAGE_SHIFT];
+			record->Code[i] = (page != NULL) ? page[address & cpuI8080_PAGE_MASK] : 0xff;
+		}
+	}
+
+	cpuTraceEndRecord(R->trace, PC(R));
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Port read handler of the unmapped I/O ports
+static uint8_t cpuI8080UnmappedPortRead(cpuI8080State* R, uint16_t in_port)
+{
+	return 0xff;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Port write handler of the unmapped I/O ports
+static void cpuI8080UnmappedPortWrite(cpuI8080State* R, uint16_t in_port, uint8_t in_value)
+{
+}
+
+#ifdef cpuI8080_BLOCK_CACHE
+/*****************************************************************************/
+/* Block cache                                                               */
+/*****************************************************************************/
+
+// Straight code is collected into blocks of decoded instructions (the records of the pre-decoded range
+// are reused, other code is decoded by cpuI8080DecodeInstruction). No host code is generated, the blocks
+// are executed by the interpreter's instruction bodies without the per instruction fetch and decode.
+// Blocks are cached by the start address, a write into a page containing cached code invalidates all
+// blocks of the page
+// (writing code is rare, the lookup of the blocks is kept as simple as possible).
+// The instruction bodies are the same as the interpreter's, they are executed from the decoded block.
+#undef NEXT
+#undef IMM8
+#undef IMM16
+#define BLOCK_FETCH(R)  FETCH_DECODED(R, instruction); \
+                        COUNT_INSTRUCTION(R)
+#ifdef cpuI8080_USE_THREADED_DISPATCH
+#define NEXT            if (--count == 0 || cache->write_detected) goto block_end; \
+                        instruction++; \
+                        BLOCK_FETCH(R); \
+                        goto *l_cpu_dispatch_table[opcode]
+#else
+#define NEXT            break
+#endif
+#define IMM8(R)         ((uint8_t)immediate)
+#define IMM16(R)        immediate
+
+static cpuI8080Block* cpuI8080GetBlock(cpuI8080State* R, uint16_t in_address);
+static cpuI8080Block* cpuI8080BuildBlock(cpuI8080State* R, cpuI8080Block* in_block, uint16_t in_address);
+static uint8_t cpuI8080IsBlockEnd(uint8_t in_opcode);
+static void cpuI8080RunBlock(cpuI8080State* R, const cpuI8080Block* in_block);
+static void cpuI8080Interpret(cpuI8080State* R, int in_cycles);
+static void cpuI8080InterpretInstruction(cpuI8080State* R);
+static void cpuI8080CompareBlock(cpuI8080State* R, const cpuI8080Block* in_block);
+static void cpuI8080CopyRegisters(cpuI8080State* R, const cpuI8080State* in_source);
+static uint8_t cpuI8080CompareRegisters(const cpuI8080State* in_a, const cpuI8080State* in_b);
+static void cpuI8080WriteOriginal(cpuI8080State* R, uint16_t in_address, uint8_t in_value);
+static uint8_t cpuI8080LogPortRead(cpuI8080State* R, uint16_t in_port);
+static void cpuI8080LogPortWrite(cpuI8080State* R, uint16_t in_port, uint8_t in_value);
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Executes instructions using cached blocks. A block is executed only when the interpreter
+/// wouldn't stop inside of it (all cycles of the block fit into the remaining cycles), the last
+/// instructions are interpreted so the cycle count at the exit is the same as the interpreter's.
+/// @param R CPU registers and status information
+/// @param in_cycles Minimum number of CPU cycles to execute
+/// @return Difference of the executed cycles compared to the requested cycles
+static int cpuI8080ExecBlocks(cpuI8080State* R, int in_cycles)
+{
+	cpuI8080Block* block;
+
+	CYCLES(R) += in_cycles;
+
+	while (CYCLES(R) > 0)
+	{
+		block = cpuI8080GetBlock(R, PC(R));
+
+		if (block == NULL)
+		{
+			// code can't be cached (e.g. memory mapped I/O)
+			cpuI8080InterpretInstruction(R);
+		}
+		else
+		{
+			if (block->cycles >= CYCLES(R))
+				break;
+
+			if (R->exec_mode == cpuI8080_EXEC_DIFFERENTIAL)
+				cpuI8080CompareBlock(R, block);
+			else
+				cpuI8080RunBlock(R, block);
+		}
+	}
+
+	if (CYCLES(R) > 0)
+		cpuI8080Interpret(R, 0);
+
+	return CYCLES(R);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Finds the cached block of the address, builds the block when it is not in the cache
+/// @param R CPU registers and status information
+/// @param in_address Start address of the block
+/// @return Cached block or null if the code can't be cached
+static cpuI8080Block* cpuI8080GetBlock(cpuI8080State* R, uint16_t in_address)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	cpuI8080Block* block = &cache->blocks[in_address & (cpuI8080_BLOCK_CACHE_SIZE - 1)];
+
+	if (block->valid && block->address == in_address)
+		return block;
+
+	return cpuI8080BuildBlock(R, block, in_address);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Collects the decoded instructions of straight code into a block until the first instruction changing the program flow
+/// @param R CPU registers and status information
+/// @param in_block Block to fill
+/// @param in_address Start address of the code
+/// @return Cached block or null if the code can't be cached
+static cpuI8080Block* cpuI8080BuildBlock(cpuI8080State* R, cpuI8080Block* in_block, uint16_t in_address)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	cpuI8080DecodedInstruction* instruction;
+	uint32_t address = in_address;
+	uint8_t opcode;
+	uint8_t length;
+
+	in_block->valid = 0;
+	in_block->address = in_address;
+	in_block->instruction_count = 0;
+	in_block->cycles = 0;
+
+	while (in_block->instruction_count < cpuI8080_BLOCK_MAX_INSTRUCTION_COUNT)
+	{
+		// only the code of the directly mapped pages can be cached
+		if (R->read_page[address >> cpuI8080_PAGE_SHIFT] == NULL)
+			break;
+
+		instruction = &in_block->instructions[in_block->instruction_count];
+
+#ifdef cpuI8080_PREDECODE
+		// instructions of the pre-decoded range are not decoded again
+		if ((uint16_t)(address - R->decoded_address) < R->decoded_length)
+			*instruction = R->decoded[(uint16_t)(address - R->decoded_address)];
+		else
+#endif
+			cpuI8080DecodeInstruction(R, (uint16_t)address, instruction);
+
+		opcode = instruction->opcode;
+		length = instruction->length;
+
+		// illegal opcodes (zero cycles) are left to the interpreter, so every instruction of a block takes time
+		if (instruction->cycles == 0)
+			break;
+
+		if (address + length > 0x10000 || R->read_page[(address + length - 1) >> cpuI8080_PAGE_SHIFT] == NULL)
+			break;
+
+		in_block->instruction_count++;
+
+		// maximum cycles: taken conditional calls and returns are longer, EI can accept the pending interrupt
+		in_block->cycles += instruction->cycles;
+		if ((opcode & 0xc7) == 0xc0 || (opcode & 0xc7) == 0xc4)
+			in_block->cycles += 6;
+		if (opcode == 0xfb)
+			in_block->cycles += 11;
+
+		address += length;
+
+		if (cpuI8080IsBlockEnd(opcode))
+			break;
+	}
+
+	if (in_block->instruction_count == 0)
+		return NULL;
+
+	in_block->first_page = (uint8_t)(in_address >> cpuI8080_PAGE_SHIFT);
+	in_block->last_page = (uint8_t)((address - 1) >> cpuI8080_PAGE_SHIFT);
+	in_block->valid = 1;
+
+	cache->code_page[in_block->first_page] = 1;
+	cache->code_page[in_block->last_page] = 1;
+	cache->cached_block_count++;
+
+	return in_block;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Checks if the instruction changes the program flow (closes the block)
+/// @param in_opcode Opcode of the instruction
+/// @return Non zero if the instruction is the last one of a block
+static uint8_t cpuI8080IsBlockEnd(uint8_t in_opcode)
+{
+	switch (in_opcode & 0xc7)
+	{
+		case 0xc0:	// rcc
+		case 0xc2:	// jcc
+		case 0xc4:	// ccc
+		case 0xc7:	// rst
+			return 1;
+	}
+
+	switch (in_opcode)
+	{
+		case 0xc3:	// jmp
+		case 0xc9:	// ret
+		case 0xcd:	// call
+		case 0xe9:	// pchl
+		case 0x76:	// hlt
+		case 0xfb:	// ei (can start interrupt)
+			return 1;
+	}
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Executes a cached block. Execution stops early when a code page is written.
+/// @param R CPU registers and status information
+/// @param in_block Block to execute
+static void cpuI8080RunBlock(cpuI8080State* R, const cpuI8080Block* in_block)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	const cpuI8080DecodedInstruction* instruction = in_block->instructions;
+	uint8_t count = in_block->instruction_count;
+	uint8_t opcode;
+	uint8_t temp_byte;
+	uint16_t temp_word;
+	uint32_t temp_dword;
+	uint16_t immediate;
+#ifdef cpuI8080_USE_THREADED_DISPATCH
+	static const void* const l_cpu_dispatch_table[256] = { DISPATCH_TABLE };
+#endif
+
+	cache->write_detected = 0;
+
+#ifdef cpuI8080_USE_THREADED_DISPATCH
+	BLOCK_FETCH(R);
+	goto *l_cpu_dispatch_table[opcode];
+
+#include <cpuI8080Codes.h>
+
+block_end:
+	return;
+#else
+	do
+	{
+		BLOCK_FETCH(R);
+
+		switch (opcode)
+		{
+#include <cpuI8080Codes.h>
+		}
+
+		instruction++;
+		count--;
+	} while (count > 0 && !cache->write_detected);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Runs the interpreter
+/// @param R CPU registers and status information
+/// @param in_cycles Minimum number of CPU cycles to execute
+static void cpuI8080Interpret(cpuI8080State* R, int in_cycles)
+{
+	cpuI8080ExecMode mode = R->exec_mode;
+
+	R->exec_mode = cpuI8080_EXEC_INTERPRETER;
+	cpuI8080Exec(R, in_cycles);
+	R->exec_mode = mode;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Interprets one instruction
+/// @param R CPU registers and status information
+static void cpuI8080InterpretInstruction(cpuI8080State* R)
+{
+	int32_t cycles = CYCLES(R);
+
+	CYCLES(R) = 0;
+	cpuI8080Interpret(R, 1);
+	CYCLES(R) = cycles - (1 - CYCLES(R));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Executes the block from the block cache, then rolls back the memory writes and the registers and executes
+/// the same cycles interpreted. The interpreted result is kept, the difference is counted. Port reads of the
+/// interpreted pass return the values of the block pass, port writes are compared only.
+/// @param R CPU registers and status information
+/// @param in_block Block to execute
+static void cpuI8080CompareBlock(cpuI8080State* R, const cpuI8080Block* in_block)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	cpuI8080State start;
+	cpuI8080State cached;
+	cpuI8080BlockLogEntry* log;
+	int32_t cycles;
+	uint8_t match;
+	uint32_t i;
+
+	// route memory writes and port accesses through the logging handlers
+	for (i = 0; i < cpuI8080_PAGE_COUNT; i++)
+	{
+		cache->write_page[i] = R->write_page[i];
+		cache->write_handler[i] = R->write_handler[i];
+		R->write_page[i] = NULL;
+		R->write_handler[i] = cpuI8080LogMemoryWrite;
+	}
+
+	cache->port_read = R->port_read;
+	cache->port_write = R->port_write;
+	R->port_read = cpuI8080LogPortRead;
+	R->port_write = cpuI8080LogPortWrite;
+
+	cache->memory_log_length[0] = 0;
+	cache->memory_log_length[1] = 0;
+	cache->port_read_log_length = 0;
+	cache->port_read_log_index = 0;
+	cache->port_write_log_length = 0;
+	cache->port_write_log_index = 0;
+	cache->port_mismatch = 0;
+
+	// block pass
+	cpuI8080CopyRegisters(&start, R);
+	cache->pass = 0;
+	cpuI8080RunBlock(R, in_block);
+	cpuI8080CopyRegisters(&cached, R);
+
+	// roll back
+	for (i = cache->memory_log_length[0]; i > 0; i--)
+	{
+		log = &cache->memory_log[0][i - 1];
+		cpuI8080WriteOriginal(R, log->address, log->old_value);
+	}
+
+	cpuI8080CopyRegisters(R, &start);
+
+	// interpreted pass
+	cache->pass = 1;
+	cycles = start.cycles - cached.cycles;
+	CYCLES(R) = 0;
+	cpuI8080Interpret(R, cycles);
+	CYCLES(R) = start.cycles - (cycles - CYCLES(R));
+
+	// restore handlers
+	for (i = 0; i < cpuI8080_PAGE_COUNT; i++)
+	{
+		R->write_page[i] = cache->write_page[i];
+		R->write_handler[i] = cache->write_handler[i];
+	}
+
+	R->port_read = cache->port_read;
+	R->port_write = cache->port_write;
+
+	// compare
+	match = cpuI8080CompareRegisters(R, &cached) &&
+					cache->memory_log_length[0] == cache->memory_log_length[1] &&
+					cache->port_read_log_index == cache->port_read_log_length &&
+					cache->port_write_log_index == cache->port_write_log_length &&
+					!cache->port_mismatch;
+
+	for (i = 0; match && i < cache->memory_log_length[0]; i++)
+	{
+		if (cache->memory_log[0][i].address != cache->memory_log[1][i].address || cache->memory_log[0][i].value != cache->memory_log[1][i].value)
+			match = 0;
+	}
+
+	cache->compared_block_count++;
+
+	if (!match)
+	{
+		cache->mismatch_count++;
+		cache->mismatch_address = in_block->address;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Copies registers and execution status (memory map is not copied)
+/// @param R Destination
+/// @param in_source Source
+static void cpuI8080CopyRegisters(cpuI8080State* R, const cpuI8080State* in_source)
+{
+	R->reg = in_source->reg;
+	R->cycles = in_source->cycles;
+	R->result = in_source->result;
+	R->i = in_source->i;
+	R->ipend = in_source->ipend;
+	R->ac = in_source->ac;
+	R->halted = in_source->halted;
+#ifdef cpuI8080_INSTRUCTION_COUNTER
+	R->instruction_count = in_source->instruction_count;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Compares registers and execution status
+/// @param in_a First CPU
+/// @param in_b Second CPU
+/// @return Non zero if they are the same
+static uint8_t cpuI8080CompareRegisters(const cpuI8080State* in_a, const cpuI8080State* in_b)
+{
+	return in_a->reg.pc == in_b->reg.pc && in_a->reg.sp == in_b->reg.sp && in_a->reg.psw == in_b->reg.psw &&
+				 in_a->reg.bc == in_b->reg.bc && in_a->reg.de == in_b->reg.de && in_a->reg.hl == in_b->reg.hl &&
+				 in_a->cycles == in_b->cycles && in_a->result == in_b->result && in_a->i == in_b->i &&
+				 in_a->ipend == in_b->ipend && in_a->ac == in_b->ac && in_a->halted == in_b->halted
+#ifdef cpuI8080_INSTRUCTION_COUNTER
+				 && in_a->instruction_count == in_b->instruction_count
+#endif
+				 ;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes memory using the original memory map (differential mode)
+static void cpuI8080WriteOriginal(cpuI8080State* R, uint16_t in_address, uint8_t in_value)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	uint8_t* page = cache->write_page[in_address >> cpuI8080_PAGE_SHIFT];
+
+	if (page != NULL)
+	{
+		page[in_address & cpuI8080_PAGE_MASK] = in_value;
+
+		if (page != R->discard_write_page)
+			cpuI8080CodeWritten(R, in_address);
+	}
+	else
+	{
+		cache->write_handler[in_address >> cpuI8080_PAGE_SHIFT](R, in_address, in_value);
+		cpuI8080CodeWritten(R, in_address);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Memory write handler of the differential mode, logs and executes the write
+static void cpuI8080LogMemoryWrite(cpuI8080State* R, uint16_t in_address, uint8_t in_value)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	uint8_t* length = &cache->memory_log_length[cache->pass];
+	cpuI8080BlockLogEntry* log;
+
+	if (*length < cpuI8080_BLOCK_LOG_SIZE)
+	{
+		log = &cache->memory_log[cache->pass][*length];
+		log->address = in_address;
+		log->value = in_value;
+		log->old_value = Read8(R, in_address);
+		(*length)++;
+	}
+
+	cpuI8080WriteOriginal(R, in_address, in_value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Port read handler of the differential mode, the interpreted pass gets the values of the block pass
+static uint8_t cpuI8080LogPortRead(cpuI8080State* R, uint16_t in_port)
+{
+	cpuI8080BlockCache* cache = R->block_cache;
+	cpuI8080BlockLogEntry* log;
+	uint8_t value;
+
+	if (cache->pass == 0)
+	{
+		value = cache->port_read(R, in_port);
+
+		if (cache->port_read_log_length < cpuI8080_BLOCK_LOG_SIZE)
+		{
+			log = &cache->port_read_log[cache->port_read_log_length++];
+			log->address = in_port;
+			log->value = value;
+		}
+
+		return value;
+	}
+	else
+	{
+		if (cache->port_read_log_index < cache->port_read_log_length && cache->port_read_log[cache->port_read_log_index].address == in_port)
+			return cache->port_read_log[cache->port_read_log_index++].value;
+
+		cache->port_mismatch = 1;
+
+		return 0xff;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Port write handler of the differential mode, writes of the interpreted pass are compared only
+static void cpuI8080LogPortWrite(cpuI8080State* R, uint16_t in_port, uint8_t in_value)
 {
-	return ((uint16_t)RdI8080(Address+1) << 8) + RdI8080(Address);
+	cpuI8080BlockCache* cache = R->block_cache;
+	cpuI8080BlockLogEntry* log;
+
+	if (cache->pass == 0)
+	{
+		if (cache->port_write_log_length < cpuI8080_BLOCK_LOG_SIZE)
+		{
+			log = &cache->port_write_log[cache->port_write_log_length++];
+			log->address = in_port;
+			log->value = in_value;
+		}
+
+		cache->port_write(R, in_port, in_value);
+	}
+	else
+	{
+		log = &cache->port_write_log[cache->port_write_log_index];
+
+		if (cache->port_write_log_index < cache->port_write_log_length && log->address == in_port && log->value == in_value)
+			cache->port_write_log_index++;
+		else
+			cache->port_mismatch = 1;
+	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Invalidates all cached blocks of a page
+/// @param in_cache Block cache
+/// @param in_page Page index
+static void cpuI8080InvalidateCodePage(cpuI8080BlockCache* in_cache, uint8_t in_page)
+{
+	uint32_t i;
+
+	for (i = 0; i < cpuI8080_BLOCK_CACHE_SIZE; i++)
+	{
+		if (in_cache->blocks[i].first_page == in_page || in_cache->blocks[i].last_page == in_page)
+			in_cache->blocks[i].valid = 0;
+	}
+
+	in_cache->code_page[in_page] = 0;
+	in_cache->write_detected = 1;
+	in_cache->invalidated_page_count++;
+}
+#endif
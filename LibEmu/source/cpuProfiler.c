@@ -0,0 +1,232 @@
+/*****************************************************************************/
+/* Guest code profiler (opcode, address and subroutine statistics)           */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <cpuProfiler.h>
+#include <string.h>
+
+/*****************************************************************************/
+/* Module local variables                                                    */
+/*****************************************************************************/
+
+// Bytes preceding the opcode of the opcode tables (DDCB and FDCB have displacement before the opcode)
+static const uint8_t l_opcode_prefix_length[cpuPROFILER_OPCODE_TABLE_COUNT] = { 0, 1, 1, 1, 1, 3, 3 };
+static const uint8_t l_opcode_prefix[cpuPROFILER_OPCODE_TABLE_COUNT][3] =
+{
+	{ 0x00, 0x00, 0x00 },
+	{ 0xcb, 0x00, 0x00 },
+	{ 0xed, 0x00, 0x00 },
+	{ 0xdd, 0x00, 0x00 },
+	{ 0xfd, 0x00, 0x00 },
+	{ 0xdd, 0xcb, 0x00 },
+	{ 0xfd, 0xcb, 0x00 }
+};
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static uint32_t cpuProfilerSelectTop(const uint64_t* in_values, uint32_t in_value_count, uint32_t* out_indices);
+static double cpuProfilerPercent(uint64_t in_value, uint64_t in_total);
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Clears all statistics
+/// @param in_profiler Profiler state
+void cpuProfilerReset(cpuProfilerState* in_profiler)
+{
+	memset(in_profiler, 0, sizeof(cpuProfilerState));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Records subroutine call (CALL, RST or interrupt)
+/// @param in_profiler Profiler state
+/// @param in_address Address of the called subroutine
+/// @param in_return_address Address pushed to the stack
+void cpuProfilerCall(cpuProfilerState* in_profiler, uint16_t in_address, uint16_t in_return_address)
+{
+	cpuProfilerCallFrame* frame;
+
+	in_profiler->CallCount[in_address]++;
+
+	if (in_profiler->CallDepth >= cpuPROFILER_CALL_STACK_DEPTH)
+	{
+		in_profiler->CallStackOverflowCount++;
+		return;
+	}
+
+	frame = &in_profiler->CallStack[in_profiler->CallDepth++];
+	frame->Address = in_address;
+	frame->ReturnAddress = in_return_address;
+	frame->StartCycles = in_profiler->Cycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Records return from subroutine. The frame is matched by the return address, frames above the matching
+/// one (subroutines left without return) are closed as well.
+/// @param in_profiler Profiler state
+/// @param in_return_address Address popped from the stack
+void cpuProfilerReturn(cpuProfilerState* in_profiler, uint16_t in_return_address)
+{
+	cpuProfilerCallFrame* frame;
+	uint32_t depth = in_profiler->CallDepth;
+
+	// find matching call
+	while (depth > 0 && in_profiler->CallStack[depth - 1].ReturnAddress != in_return_address)
+		depth--;
+
+	if (depth == 0)
+	{
+		in_profiler->UnmatchedReturnCount++;
+		return;
+	}
+
+	// close frames including the matching one
+	while (in_profiler->CallDepth >= depth)
+	{
+		frame = &in_profiler->CallStack[--in_profiler->CallDepth];
+		in_profiler->CallCycles[frame->Address] += in_profiler->Cycles - frame->StartCycles;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes sorted report of the collected statistics
+/// @param in_profiler Profiler state
+/// @param in_target Profiled CPU (disassembler and memory access)
+/// @param in_file File to write the report to
+void cpuProfilerReport(cpuProfilerState* in_profiler, const cpuProfilerTarget* in_target, FILE* in_file)
+{
+	uint32_t indices[cpuPROFILER_REPORT_LINE_COUNT];
+	uint8_t code[cpuPROFILER_MAX_INSTRUCTION_LENGTH + 3];
+	char text[cpuPROFILER_TEXT_LENGTH];
+	uint32_t count;
+	uint32_t i;
+	uint8_t j;
+	uint8_t table;
+	uint8_t length;
+	uint16_t address;
+
+	fprintf(in_file, "Profiler report (%s)\n", in_target->Name);
+	fprintf(in_file, "  Instructions:       %llu\n", (unsigned long long)in_profiler->InstructionCount);
+	fprintf(in_file, "  Cycles:             %llu\n", (unsigned long long)in_profiler->Cycles);
+	fprintf(in_file, "  Unmatched returns:  %u\n", in_profiler->UnmatchedReturnCount);
+	fprintf(in_file, "  Call stack overflows: %u\n", in_profiler->CallStackOverflowCount);
+
+	// opcodes by execution count
+	count = cpuProfilerSelectTop(&in_profiler->OpcodeCount[0][0], in_target->OpcodeTableCount * 256, indices);
+
+	fprintf(in_file, "\nOpcodes by execution count\n");
+	fprintf(in_file, "  Opcode       Count           %%       Instruction\n");
+	for (i = 0; i < count; i++)
+	{
+		table = (uint8_t)(indices[i] / 256);
+
+		memset(code, 0, sizeof(code));
+		memcpy(code, l_opcode_prefix[table], l_opcode_prefix_length[table]);
+		code[l_opcode_prefix_length[table]] = (uint8_t)indices[i];
+		in_target->Disassemble(code, 0, text);
+
+		fprintf(in_file, "  ");
+		for (j = 0; j < l_opcode_prefix_length[table]; j++)
+			fprintf(in_file, (j == 2) ? ".. " : "%02X ", code[j]);
+		fprintf(in_file, "%02X%*s %-15llu %6.2f%%  %s\n", code[j], 3 * (3 - j), "", (unsigned long long)in_profiler->OpcodeCount[table][indices[i] % 256],
+			cpuProfilerPercent(in_profiler->OpcodeCount[table][indices[i] % 256], in_profiler->InstructionCount), text);
+	}
+
+	// instruction addresses by cycles
+	count = cpuProfilerSelectTop(in_profiler->AddressCycles, cpuPROFILER_ADDRESS_COUNT, indices);
+
+	fprintf(in_file, "\nHot spots by cycles\n");
+	fprintf(in_file, "  Address  Count       Cycles          %%       Code         Instruction\n");
+	for (i = 0; i < count; i++)
+	{
+		address = (uint16_t)indices[i];
+
+		for (j = 0; j < cpuPROFILER_MAX_INSTRUCTION_LENGTH; j++)
+			code[j] = in_target->ReadMemory(in_target->CPU, (uint16_t)(address + j));
+		length = in_target->Disassemble(code, address, text);
+
+		fprintf(in_file, "  %04X     %-11u %-15llu %6.2f%%  ", address, in_profiler->AddressCount[address], (unsigned long long)in_profiler->AddressCycles[address],
+			cpuProfilerPercent(in_profiler->AddressCycles[address], in_profiler->Cycles));
+		for (j = 0; j < cpuPROFILER_MAX_INSTRUCTION_LENGTH; j++)
+			fprintf(in_file, (j < length) ? "%02X " : "   ", code[j]);
+		fprintf(in_file, "%s\n", text);
+	}
+
+	// subroutines by inclusive cycles
+	count = cpuProfilerSelectTop(in_profiler->CallCycles, cpuPROFILER_ADDRESS_COUNT, indices);
+
+	fprintf(in_file, "\nSubroutines by inclusive cycles\n");
+	fprintf(in_file, "  Address  Calls       Cycles          %%       Cycles/call\n");
+	for (i = 0; i < count; i++)
+	{
+		address = (uint16_t)indices[i];
+
+		fprintf(in_file, "  %04X     %-11u %-15llu %6.2f%%  %.1f\n", address, in_profiler->CallCount[address], (unsigned long long)in_profiler->CallCycles[address],
+			cpuProfilerPercent(in_profiler->CallCycles[address], in_profiler->Cycles), (in_profiler->CallCount[address] > 0) ? (double)in_profiler->CallCycles[address] / in_profiler->CallCount[address] : 0.0);
+	}
+
+	fprintf(in_file, "\n");
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Selects indices of the largest non zero values in descending order
+/// @param in_values Values
+/// @param in_value_count Number of values
+/// @param out_indices Indices of the selected values (cpuPROFILER_REPORT_LINE_COUNT entries)
+/// @return Number of the selected values
+static uint32_t cpuProfilerSelectTop(const uint64_t* in_values, uint32_t in_value_count, uint32_t* out_indices)
+{
+	uint32_t count = 0;
+	uint32_t index;
+	uint32_t i;
+
+	for (index = 0; index < in_value_count; index++)
+	{
+		if (in_values[index] == 0)
+			continue;
+
+		if (count == cpuPROFILER_REPORT_LINE_COUNT && in_values[index] <= in_values[out_indices[count - 1]])
+			continue;
+
+		// insert into the sorted list
+		if (count < cpuPROFILER_REPORT_LINE_COUNT)
+			count++;
+
+		i = count - 1;
+		while (i > 0 && in_values[out_indices[i - 1]] < in_values[index])
+		{
+			out_indices[i] = out_indices[i - 1];
+			i--;
+		}
+
+		out_indices[i] = index;
+	}
+
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Calculates percentage
+/// @param in_value Value
+/// @param in_total Total (100%)
+/// @return Percentage of the value
+static double cpuProfilerPercent(uint64_t in_value, uint64_t in_total)
+{
+	return (in_total > 0) ? 100.0 * in_value / in_total : 0.0;
+}
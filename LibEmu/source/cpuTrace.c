@@ -0,0 +1,150 @@
+/*****************************************************************************/
+/* Binary instruction trace ring buffer                                      */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <cpuTrace.h>
+#include <stdio.h>
+#include <string.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define cpuTRACE_SAVE_CHUNK_SIZE 256		// number of records copied from the ring at once
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes trace buffer and starts recording
+/// @param in_buffer Trace buffer to initialize
+/// @param in_records Record storage
+/// @param in_capacity Number of records in the storage (must be power of two)
+void cpuTraceInitialize(cpuTraceBuffer* in_buffer, cpuTraceRecord* in_records, uint32_t in_capacity)
+{
+	memset(in_records, 0, in_capacity * sizeof(cpuTraceRecord));
+
+	in_buffer->Records = in_records;
+	in_buffer->Mask = in_capacity - 1;
+	in_buffer->BreakpointAddress = cpuTRACE_NO_BREAKPOINT;
+	in_buffer->CPUType = cpuTRACE_CPU_UNKNOWN;
+
+	cpuTraceReset(in_buffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Drops all records and restarts recording (breakpoint is kept)
+/// @param in_buffer Trace buffer
+void cpuTraceReset(cpuTraceBuffer* in_buffer)
+{
+	in_buffer->Head = 0;
+	in_buffer->CycleBase = 0;
+	in_buffer->Trigger = cpuTRACE_TRIGGER_NONE;
+	in_buffer->TriggerAddress = 0;
+
+	cpuTRACE_RELEASE_BARRIER();
+	in_buffer->State = cpuTRACE_RECORDING;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sets address where the recording is stopped
+/// @param in_buffer Trace buffer
+/// @param in_address Breakpoint address (cpuTRACE_NO_BREAKPOINT to clear the breakpoint)
+void cpuTraceSetBreakpoint(cpuTraceBuffer* in_buffer, uint32_t in_address)
+{
+	in_buffer->BreakpointAddress = in_address;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Stops recording, the content is kept until the buffer is reset. Only the first trigger is stored.
+/// @param in_buffer Trace buffer
+/// @param in_trigger Reason of the stop
+/// @param in_address Current PC of the CPU
+void cpuTraceStop(cpuTraceBuffer* in_buffer, cpuTraceTrigger in_trigger, uint16_t in_address)
+{
+	if (in_buffer->State != cpuTRACE_RECORDING)
+		return;
+
+	in_buffer->Trigger = (uint8_t)in_trigger;
+	in_buffer->TriggerAddress = in_address;
+
+	cpuTRACE_RELEASE_BARRIER();
+	in_buffer->State = cpuTRACE_TRIGGERED;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves records of the buffer into binary trace file (oldest first). When the CPU is still recording,
+/// records overwritten during the saving are left out.
+/// @param in_buffer Trace buffer
+/// @param in_file_name Name of the trace file
+/// @return True if the file is written
+bool cpuTraceSave(cpuTraceBuffer* in_buffer, const char* in_file_name)
+{
+	cpuTraceRecord chunk[cpuTRACE_SAVE_CHUNK_SIZE];
+	cpuTraceFileHeader header;
+	FILE* file;
+	uint32_t capacity = in_buffer->Mask + 1;
+	uint32_t head;
+	uint32_t index;
+	uint32_t oldest;
+	uint32_t count;
+	uint32_t skip;
+	uint32_t i;
+	bool success;
+
+	head = in_buffer->Head;
+	cpuTRACE_ACQUIRE_BARRIER();
+
+	file = fopen(in_file_name, "wb");
+	if (file == NULL)
+		return false;
+
+	memset(&header, 0, sizeof(header));
+	header.Magic = cpuTRACE_FILE_MAGIC;
+	header.Version = cpuTRACE_FILE_VERSION;
+	header.RecordSize = sizeof(cpuTraceRecord);
+	header.CPUType = in_buffer->CPUType;
+	header.Trigger = in_buffer->Trigger;
+	header.TriggerAddress = in_buffer->TriggerAddress;
+
+	success = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+	// the slot of the record being written by the CPU is not valid
+	index = (head >= capacity) ? head - capacity + 1 : 0;
+
+	while (success && index != head)
+	{
+		count = head - index;
+		if (count > cpuTRACE_SAVE_CHUNK_SIZE)
+			count = cpuTRACE_SAVE_CHUNK_SIZE;
+
+		for (i = 0; i < count; i++)
+			chunk[i] = in_buffer->Records[(index + i) & in_buffer->Mask];
+
+		// drop records overwritten while copying
+		cpuTRACE_ACQUIRE_BARRIER();
+		oldest = in_buffer->Head + 1 - capacity;
+		skip = ((int32_t)(oldest - index) > 0) ? oldest - index : 0;
+		if (skip > count)
+			skip = count;
+
+		if (count > skip)
+			success = (fwrite(&chunk[skip], sizeof(cpuTraceRecord), count - skip, file) == count - skip);
+
+		index += count;
+	}
+
+	if (fclose(file) != 0)
+		success = false;
+
+	return success;
+}
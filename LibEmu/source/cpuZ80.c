@@ -16,6 +16,7 @@
 #include <cpuZ80.h>
 #include <cpuZ80Tables.h>
 #include <stdio.h>
+#include <string.h>
 
 /** INLINE ***************************************************/
 /** C99 standard has "inline", but older compilers used     **/
@@ -57,6 +58,87 @@ extern byte *RAM[];
 INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
 #endif
 
+/** Memory map ***********************************************/
+/** Memory is accessed through the page table of the CPU.   **/
+/** Opcode and operand fetches use the fetch pointers only, **/
+/** data accesses call the page handler when the direct     **/
+/** pointer is null.                                        **/
+/*************************************************************/
+#if !defined(COLEM) && !defined(SPECCY) && !defined(MG) && !defined(FMSX)
+INLINE uint8_t cpuZ80MemRead(register cpuZ80State *R, uint16_t A)
+{
+  register uint8_t *P=R->ReadPage[A>>cpuZ80_PAGE_SHIFT];
+  if(P) return(P[A&cpuZ80_PAGE_MASK]);
+  return(R->ReadHandler[A>>cpuZ80_PAGE_SHIFT](R,A));
+}
+
+INLINE void cpuZ80MemWrite(register cpuZ80State *R, uint16_t A, uint8_t V)
+{
+  register uint8_t *P=R->WritePage[A>>cpuZ80_PAGE_SHIFT];
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+  R->IdleQuiet=0;
+#endif
+#ifdef cpuZ80_DIRTY_PAGES
+  cpuDirtyPagesMark(&R->DirtyPages,A);
+#endif
+  if(P) P[A&cpuZ80_PAGE_MASK]=V;
+  else R->WriteHandler[A>>cpuZ80_PAGE_SHIFT](R,A,V);
+}
+
+INLINE uint8_t cpuZ80OpRead(register cpuZ80State *R, uint16_t A)
+{
+  return(R->FetchPage[A>>cpuZ80_PAGE_SHIFT][A&cpuZ80_PAGE_MASK]);
+}
+
+#define FAST_RDOP
+#define OpZ80(A)          cpuZ80OpRead(R,A)
+#define cpuMemRead(A)     cpuZ80MemRead(R,A)
+#define cpuMemWrite(A,V)  cpuZ80MemWrite(R,A,V)
+#endif
+
+/** I/O ports ************************************************/
+/** Port accesses are routed to the handlers of the CPU.    **/
+/*************************************************************/
+static uint8_t cpuZ80UnmappedPortRead(register cpuZ80State *R, uint16_t in_port) { return(0xFF); }
+static void cpuZ80UnmappedPortWrite(register cpuZ80State *R, uint16_t in_port, uint8_t in_value) { }
+
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+#define cpuIn(P)          (R->IdleQuiet=0,R->PortRead(R,P))
+#define cpuOut(P,V)       (R->IdleQuiet=0,R->PortWrite(R,P,V))
+#else
+#define cpuIn(P)          R->PortRead(R,P)
+#define cpuOut(P,V)       R->PortWrite(R,P,V)
+#endif
+
+/** Profiler *************************************************/
+/** M_PROFILE_CALL()/M_PROFILE_RETURN record subroutine     **/
+/** calls and returns, M_PROFILE_OPCODE() counts prefixed   **/
+/** opcodes when a profiler is attached to the CPU.         **/
+/*************************************************************/
+#ifdef cpuZ80_PROFILER
+#define M_PROFILE_CALL(Ad,Ret) if(R->Profiler) cpuProfilerCall(R->Profiler,Ad,Ret)
+#define M_PROFILE_RETURN       if(R->Profiler) cpuProfilerReturn(R->Profiler,R->PC.W)
+#define M_PROFILE_OPCODE(T,Op) if(R->Profiler) cpuProfilerOpcode(R->Profiler,T,Op)
+#else
+#define M_PROFILE_CALL(Ad,Ret)
+#define M_PROFILE_RETURN
+#define M_PROFILE_OPCODE(T,Op)
+#endif
+
+/** Trace ****************************************************/
+/** M_TRACING is true while the attached trace buffer is    **/
+/** recording, M_TRACE_ILLEGAL() stops the recording at an  **/
+/** undefined opcode starting N bytes before PC.            **/
+/*************************************************************/
+#ifdef cpuZ80_TRACE
+static void cpuZ80TraceInstruction(register cpuZ80State *R);
+
+#define M_TRACING          (R->TraceBuffer&&(R->TraceBuffer->State==cpuTRACE_RECORDING))
+#define M_TRACE_ILLEGAL(N) if(M_TRACING) cpuTraceStop(R->TraceBuffer,cpuTRACE_TRIGGER_ILLEGAL_OPCODE,R->PC.W-(N))
+#else
+#define M_TRACE_ILLEGAL(N)
+#endif
+
 /** FAST_RDOP ************************************************/
 /** With this #define not present, cpuMemRead() should perform   **/
 /** the functions of OpZ80().                               **/
@@ -65,15 +147,48 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
 #define OpZ80(A) cpuMemRead(A)
 #endif
 
+/** Lazy flags ***********************************************/
+/** F_C/F_Z/F_S/F_P test a flag of F, F_SYNC brings F up to **/
+/** date before it is read or partially updated, F_DONE     **/
+/** marks F up to date after it is completely overwritten.  **/
+/** F_LAZY() records an arithmetic operation in place of    **/
+/** computing its flags. Without cpuZ80_LAZY_FLAGS F is     **/
+/** always up to date.                                      **/
+/*************************************************************/
+#ifdef cpuZ80_LAZY_FLAGS
+static uint8_t cpuZ80SyncFlags(register cpuZ80State *R);
+
+#define F_SYNC       if(R->FlagOp) cpuZ80SyncFlags(R)
+#define F_DONE       R->FlagOp=cpuZ80_FLAGS_NONE
+#define F_C          (R->FlagOp? R->FlagCarry:(R->AF.B.l&C_FLAG))
+#define F_Z          (R->FlagOp? !R->FlagResult:(R->AF.B.l&Z_FLAG))
+#define F_S          ((R->FlagOp? R->FlagResult:R->AF.B.l)&S_FLAG)
+#define F_P          ((R->FlagOp? cpuZ80SyncFlags(R):R->AF.B.l)&P_FLAG)
+
+#define F_RESULT(Op,Rs,Cy) \
+  R->FlagCarry=Cy;R->FlagResult=Rs;R->FlagOp=Op
+#define F_LAZY(Op,Rg,Rs) \
+  R->FlagA=R->AF.B.h;R->FlagOperand=Rg; \
+  F_RESULT(Op,Rs.B.l,Rs.B.h&C_FLAG)
+#else
+#define F_SYNC
+#define F_DONE
+#define F_C          (R->AF.B.l&C_FLAG)
+#define F_Z          (R->AF.B.l&Z_FLAG)
+#define F_S          (R->AF.B.l&S_FLAG)
+#define F_P          (R->AF.B.l&P_FLAG)
+#endif
+
 #define S(Fl)        R->AF.B.l|=Fl
 #define R(Fl)        R->AF.B.l&=~(Fl)
 #define FLAGS(Rg,Fl) R->AF.B.l=Fl|ZSTable[Rg]
 
 #define M_RLC(Rg)      \
-  R->AF.B.l=Rg>>7;Rg=(Rg<<1)|R->AF.B.l;R->AF.B.l|=PZSTable[Rg]
+  F_DONE;R->AF.B.l=Rg>>7;Rg=(Rg<<1)|R->AF.B.l;R->AF.B.l|=PZSTable[Rg]
 #define M_RRC(Rg)      \
-  R->AF.B.l=Rg&0x01;Rg=(Rg>>1)|(R->AF.B.l<<7);R->AF.B.l|=PZSTable[Rg]
+  F_DONE;R->AF.B.l=Rg&0x01;Rg=(Rg>>1)|(R->AF.B.l<<7);R->AF.B.l|=PZSTable[Rg]
 #define M_RL(Rg)       \
+  F_SYNC;              \
   if(Rg&0x80)          \
   {                    \
     Rg=(Rg<<1)|(R->AF.B.l&C_FLAG); \
@@ -85,6 +200,7 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
     R->AF.B.l=PZSTable[Rg];        \
   }
 #define M_RR(Rg)       \
+  F_SYNC;              \
   if(Rg&0x01)          \
   {                    \
     Rg=(Rg>>1)|(R->AF.B.l<<7);     \
@@ -97,42 +213,81 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
   }
   
 #define M_SLA(Rg)      \
-  R->AF.B.l=Rg>>7;Rg<<=1;R->AF.B.l|=PZSTable[Rg]
+  F_DONE;R->AF.B.l=Rg>>7;Rg<<=1;R->AF.B.l|=PZSTable[Rg]
 #define M_SRA(Rg)      \
-  R->AF.B.l=Rg&C_FLAG;Rg=(Rg>>1)|(Rg&0x80);R->AF.B.l|=PZSTable[Rg]
+  F_DONE;R->AF.B.l=Rg&C_FLAG;Rg=(Rg>>1)|(Rg&0x80);R->AF.B.l|=PZSTable[Rg]
 
 #define M_SLL(Rg)      \
-  R->AF.B.l=Rg>>7;Rg=(Rg<<1)|0x01;R->AF.B.l|=PZSTable[Rg]
+  F_DONE;R->AF.B.l=Rg>>7;Rg=(Rg<<1)|0x01;R->AF.B.l|=PZSTable[Rg]
 #define M_SRL(Rg)      \
-  R->AF.B.l=Rg&0x01;Rg>>=1;R->AF.B.l|=PZSTable[Rg]
+  F_DONE;R->AF.B.l=Rg&0x01;Rg>>=1;R->AF.B.l|=PZSTable[Rg]
 
 #define M_BIT(Bit,Rg)  \
-  R->AF.B.l=(R->AF.B.l&C_FLAG)|H_FLAG|PZSTable[Rg&(1<<Bit)]
+  R->AF.B.l=F_C|H_FLAG|PZSTable[Rg&(1<<Bit)];F_DONE
 
 #define M_SET(Bit,Rg) Rg|=1<<Bit
 #define M_RES(Bit,Rg) Rg&=~(1<<Bit)
 
 #define M_POP(Rg)      \
-  R->Rg.B.l=OpZ80(R->SP.W++);R->Rg.B.h=OpZ80(R->SP.W++)
+  R->Rg.B.l=cpuMemRead(R->SP.W++);R->Rg.B.h=cpuMemRead(R->SP.W++)
 #define M_PUSH(Rg)     \
   cpuMemWrite(--R->SP.W,R->Rg.B.h);cpuMemWrite(--R->SP.W,R->Rg.B.l)
 
 #define M_CALL         \
   J.B.l=OpZ80(R->PC.W++);J.B.h=OpZ80(R->PC.W++);         \
   cpuMemWrite(--R->SP.W,R->PC.B.h);cpuMemWrite(--R->SP.W,R->PC.B.l); \
+  M_PROFILE_CALL(J.W,R->PC.W); \
   R->PC.W=J.W; \
   JumpZ80(J.W)
 
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+static void cpuZ80IdleLoop(register cpuZ80State *R);
+
+#define M_IDLE(Ad)     \
+  if((uint16_t)(R->PC.W-(Ad))<=cpuZ80_IDLE_LOOP_LENGTH) cpuZ80IdleLoop(R)
+#define M_JP  J.B.l=OpZ80(R->PC.W++);J.B.h=OpZ80(R->PC.W);M_IDLE(J.W);R->PC.W=J.W;JumpZ80(J.W)
+#define M_JR  J.W=R->PC.W+(offset)OpZ80(R->PC.W)+1;M_IDLE(J.W);R->PC.W=J.W;JumpZ80(J.W)
+#else
 #define M_JP  J.B.l=OpZ80(R->PC.W++);J.B.h=OpZ80(R->PC.W);R->PC.W=J.W;JumpZ80(J.W)
 #define M_JR  R->PC.W+=(offset)OpZ80(R->PC.W)+1;JumpZ80(R->PC.W)
-#define M_RET R->PC.B.l=OpZ80(R->SP.W++);R->PC.B.h=OpZ80(R->SP.W++);JumpZ80(R->PC.W)
+#endif
+#define M_RET R->PC.B.l=cpuMemRead(R->SP.W++);R->PC.B.h=cpuMemRead(R->SP.W++);M_PROFILE_RETURN;JumpZ80(R->PC.W)
 
 #define M_RST(Ad)      \
-  cpuMemWrite(--R->SP.W,R->PC.B.h);cpuMemWrite(--R->SP.W,R->PC.B.l);R->PC.W=Ad;JumpZ80(Ad)
+  cpuMemWrite(--R->SP.W,R->PC.B.h);cpuMemWrite(--R->SP.W,R->PC.B.l);M_PROFILE_CALL(Ad,R->PC.W);R->PC.W=Ad;JumpZ80(Ad)
 
 #define M_LDWORD(Rg)   \
   R->Rg.B.l=OpZ80(R->PC.W++);R->Rg.B.h=OpZ80(R->PC.W++)
 
+#ifdef cpuZ80_LAZY_FLAGS
+#define M_ADD(Rg)      \
+  J.W=R->AF.B.h+Rg;    \
+  F_LAZY(cpuZ80_FLAGS_ADD,Rg,J); \
+  R->AF.B.h=J.B.l
+
+#define M_SUB(Rg)      \
+  J.W=R->AF.B.h-Rg;    \
+  F_LAZY(cpuZ80_FLAGS_SUB,Rg,J); \
+  R->AF.B.h=J.B.l
+
+#define M_ADC(Rg)      \
+  J.W=R->AF.B.h+Rg+F_C; \
+  F_LAZY(cpuZ80_FLAGS_ADD,Rg,J); \
+  R->AF.B.h=J.B.l
+
+#define M_SBC(Rg)      \
+  J.W=R->AF.B.h-Rg-F_C; \
+  F_LAZY(cpuZ80_FLAGS_SUB,Rg,J); \
+  R->AF.B.h=J.B.l
+
+#define M_CP(Rg)       \
+  J.W=R->AF.B.h-Rg;    \
+  F_LAZY(cpuZ80_FLAGS_SUB,Rg,J)
+
+#define M_AND(Rg) R->AF.B.h&=Rg;F_RESULT(cpuZ80_FLAGS_AND,R->AF.B.h,0)
+#define M_OR(Rg)  R->AF.B.h|=Rg;F_RESULT(cpuZ80_FLAGS_OR,R->AF.B.h,0)
+#define M_XOR(Rg) R->AF.B.h^=Rg;F_RESULT(cpuZ80_FLAGS_OR,R->AF.B.h,0)
+#else
 #define M_ADD(Rg)      \
   J.W=R->AF.B.h+Rg;    \
   R->AF.B.l=           \
@@ -175,11 +330,21 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
 #define M_AND(Rg) R->AF.B.h&=Rg;R->AF.B.l=H_FLAG|PZSTable[R->AF.B.h]
 #define M_OR(Rg)  R->AF.B.h|=Rg;R->AF.B.l=PZSTable[R->AF.B.h]
 #define M_XOR(Rg) R->AF.B.h^=Rg;R->AF.B.l=PZSTable[R->AF.B.h]
+#endif
 
 #define M_IN(Rg)        \
   Rg=cpuIn(R->BC.W);  \
-  R->AF.B.l=PZSTable[Rg]|(R->AF.B.l&C_FLAG)
+  R->AF.B.l=PZSTable[Rg]|F_C;F_DONE
 
+#ifdef cpuZ80_LAZY_FLAGS
+#define M_INC(Rg)       \
+  Rg++;                 \
+  F_RESULT(cpuZ80_FLAGS_INC,Rg,F_C)
+
+#define M_DEC(Rg)       \
+  Rg--;                 \
+  F_RESULT(cpuZ80_FLAGS_DEC,Rg,F_C)
+#else
 #define M_INC(Rg)       \
   Rg++;                 \
   R->AF.B.l=            \
@@ -191,8 +356,10 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
   R->AF.B.l=            \
     N_FLAG|(R->AF.B.l&C_FLAG)|ZSTable[Rg]| \
     (Rg==0x7F? V_FLAG:0)|((Rg&0x0F)==0x0F? H_FLAG:0)
+#endif
 
 #define M_ADDW(Rg1,Rg2) \
+  F_SYNC;                                                \
   J.W=(R->Rg1.W+R->Rg2.W)&0xFFFF;                        \
   R->AF.B.l=                                             \
     (R->AF.B.l&~(H_FLAG|N_FLAG|C_FLAG))|                 \
@@ -201,7 +368,7 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
   R->Rg1.W=J.W
 
 #define M_ADCW(Rg)      \
-  I=R->AF.B.l&C_FLAG;J.W=(R->HL.W+R->Rg.W+I)&0xFFFF;           \
+  I=F_C;F_DONE;J.W=(R->HL.W+R->Rg.W+I)&0xFFFF;                 \
   R->AF.B.l=                                                   \
     (((long)R->HL.W+(long)R->Rg.W+(long)I)&0x10000? C_FLAG:0)| \
     (~(R->HL.W^R->Rg.W)&(R->Rg.W^J.W)&0x8000? V_FLAG:0)|       \
@@ -210,7 +377,7 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
   R->HL.W=J.W
    
 #define M_SBCW(Rg)      \
-  I=R->AF.B.l&C_FLAG;J.W=(R->HL.W-R->Rg.W-I)&0xFFFF;           \
+  I=F_C;F_DONE;J.W=(R->HL.W-R->Rg.W-I)&0xFFFF;                 \
   R->AF.B.l=                                                   \
     N_FLAG|                                                    \
     (((long)R->HL.W-(long)R->Rg.W-(long)I)&0x10000? C_FLAG:0)| \
@@ -219,6 +386,246 @@ INLINE byte OpZ80(word A) { return(RAM[A>>13][A&0x1FFF]); }
     (J.W? 0:Z_FLAG)|(J.B.h&S_FLAG);                            \
   R->HL.W=J.W
 
+/** cpuZ80SyncFlags() ****************************************/
+/** Computes F from the operands of the pending arithmetic  **/
+/** operation the same way the non-lazy macros do. Returns  **/
+/** the up to date F register.                              **/
+/*************************************************************/
+#ifdef cpuZ80_LAZY_FLAGS
+static uint8_t cpuZ80SyncFlags(register cpuZ80State *R)
+{
+  register uint8_t A=R->FlagA,Op=R->FlagOperand,Rs=R->FlagResult;
+
+  switch(R->FlagOp)
+  {
+    case cpuZ80_FLAGS_ADD:
+      R->AF.B.l=
+        (~(A^Op)&(Op^Rs)&0x80? V_FLAG:0)|
+        R->FlagCarry|ZSTable[Rs]|((A^Op^Rs)&H_FLAG);
+      break;
+    case cpuZ80_FLAGS_SUB:
+      R->AF.B.l=
+        ((A^Op)&(A^Rs)&0x80? V_FLAG:0)|
+        N_FLAG|R->FlagCarry|ZSTable[Rs]|((A^Op^Rs)&H_FLAG);
+      break;
+    case cpuZ80_FLAGS_AND:
+      R->AF.B.l=H_FLAG|PZSTable[Rs];
+      break;
+    case cpuZ80_FLAGS_OR:
+      R->AF.B.l=PZSTable[Rs];
+      break;
+    case cpuZ80_FLAGS_INC:
+      R->AF.B.l=
+        R->FlagCarry|ZSTable[Rs]|
+        (Rs==0x80? V_FLAG:0)|(Rs&0x0F? 0:H_FLAG);
+      break;
+    case cpuZ80_FLAGS_DEC:
+      R->AF.B.l=
+        N_FLAG|R->FlagCarry|ZSTable[Rs]|
+        (Rs==0x7F? V_FLAG:0)|((Rs&0x0F)==0x0F? H_FLAG:0);
+      break;
+  }
+
+  R->FlagOp=cpuZ80_FLAGS_NONE;
+
+  return(R->AF.B.l);
+}
+#endif
+
+/** cpuZ80IdleLoop() *****************************************/
+/** Called before taking a short backward jump. When the    **/
+/** CPU arrives to the same jump with the same registers    **/
+/** and without memory write or port access in between, the **/
+/** loop would repeat until the end of the requested cycles.**/
+/** The whole iterations are skipped (their cycles are      **/
+/** charged), the last one is executed, so the registers    **/
+/** and ICount at the exit are the same as without skipping.**/
+/** Memory mapped read handlers must return the same value  **/
+/** during one cpuExecute() call.                           **/
+/*************************************************************/
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+static void cpuZ80IdleLoop(register cpuZ80State *R)
+{
+  int L,N;
+
+  if(R->IdleQuiet&&(R->IdlePC==R->PC.W))
+  {
+    if(R->IdleSaved&&(R->ICount<R->ICyclesRequested)&&
+       !memcmp(R->IdleRegs,&R->AF,sizeof(R->IdleRegs))&&
+       (R->IdleIFF==R->IFF)&&(R->IdleI==R->I)&&(R->IdleR==R->R)
+#ifdef cpuZ80_LAZY_FLAGS
+       &&!memcmp(R->IdleFlags,&R->FlagOp,sizeof(R->IdleFlags))
+#endif
+      )
+    {
+      L=R->ICount-R->IdleCount;
+      N=(R->ICyclesRequested-R->ICount-1)/L;
+      R->ICount+=N*L;
+      R->IdleCycles+=N*L;
+    }
+
+    memcpy(R->IdleRegs,&R->AF,sizeof(R->IdleRegs));
+    R->IdleIFF=R->IFF;R->IdleI=R->I;R->IdleR=R->R;
+#ifdef cpuZ80_LAZY_FLAGS
+    memcpy(R->IdleFlags,&R->FlagOp,sizeof(R->IdleFlags));
+#endif
+    R->IdleSaved=1;
+  }
+  else
+  {
+    R->IdlePC=R->PC.W;
+    R->IdleSaved=0;
+  }
+
+  R->IdleCount=R->ICount;
+  R->IdleQuiet=1;
+}
+#endif
+
+/** cpuZ80CopyBytes() ****************************************/
+/** Copies bytes upwards (D=1) or downwards (D=-1) with the **/
+/** result of copying them one by one: when the destination **/
+/** overlaps the source ahead of the copy, the overlapped   **/
+/** bytes are repeated (e.g. LDIR memory fill).             **/
+/*************************************************************/
+static void cpuZ80CopyBytes(uint8_t *T,const uint8_t *S,uint32_t L,int D)
+{
+  uint32_t i;
+
+  if((D>0)&&(T>S)&&(T<S+L))
+  {
+    if(T==S+1) memset(T,S[0],L);
+    else for(i=0;i<L;i++) T[i]=S[i];
+  }
+  else if((D<0)&&(T<S)&&(T+L>S))
+  {
+    if(T+1==S) memset(T,S[L-1],L);
+    else for(i=L;i>0;i--) T[i-1]=S[i-1];
+  }
+  else memmove(T,S,L);
+}
+
+/** cpuZ80BlockCount() ***************************************/
+/** Number of iterations of a repeated block instruction:   **/
+/** until BC becomes zero or the requested cycles are       **/
+/** executed (at least one).                                **/
+/*************************************************************/
+static uint32_t cpuZ80BlockCount(register cpuZ80State *R)
+{
+  uint32_t N,K;
+
+  N=R->BC.W? R->BC.W:0x10000;
+  if(R->ICount>=R->ICyclesRequested) return(1);
+  K=(R->ICyclesRequested-R->ICount+20)/21;
+  return(K<N? K:N);
+}
+
+#ifdef cpuZ80_DIRTY_PAGES
+#define DIRTY_RANGE(A,L)  cpuDirtyPagesMarkRange(&R->DirtyPages,(uint16_t)(A),L)
+#else
+#define DIRTY_RANGE(A,L)
+#endif
+
+/** cpuZ80BlockCopy() ****************************************/
+/** Executes the iterations of LDIR (D=1) or LDDR (D=-1)    **/
+/** which fit into the requested cycles. Ranges of directly **/
+/** mapped pages are copied at once, ranges written through **/
+/** a block write handler are passed in one call (when the  **/
+/** ascending order of the writes gives the same result),   **/
+/** the other bytes are copied one by one.                  **/
+/*************************************************************/
+static void cpuZ80BlockCopy(register cpuZ80State *R,int D)
+{
+  uint32_t N,L,S,T;
+  uint8_t *P,*Q;
+
+  N=cpuZ80BlockCount(R);
+  R->ICount+=21*N;
+  R->BC.W-=N;
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+  R->IdleQuiet=0;
+#endif
+
+  while(N)
+  {
+    /* Bytes up to the page boundaries, S and T are the lowest addresses */
+    if(D>0)
+    {
+      L=cpuZ80_PAGE_SIZE-(R->HL.W&cpuZ80_PAGE_MASK);
+      if(cpuZ80_PAGE_SIZE-(R->DE.W&cpuZ80_PAGE_MASK)<L) L=cpuZ80_PAGE_SIZE-(R->DE.W&cpuZ80_PAGE_MASK);
+      if(N<L) L=N;
+      S=R->HL.W;T=R->DE.W;
+    }
+    else
+    {
+      L=(R->HL.W&cpuZ80_PAGE_MASK)+1;
+      if((R->DE.W&cpuZ80_PAGE_MASK)+1<L) L=(R->DE.W&cpuZ80_PAGE_MASK)+1;
+      if(N<L) L=N;
+      S=R->HL.W-L+1;T=R->DE.W-L+1;
+    }
+
+    P=R->ReadPage[S>>cpuZ80_PAGE_SHIFT];
+    Q=R->WritePage[T>>cpuZ80_PAGE_SHIFT];
+
+    if(P&&Q)
+    {
+      cpuZ80CopyBytes(Q+(T&cpuZ80_PAGE_MASK),P+(S&cpuZ80_PAGE_MASK),L,D);
+      DIRTY_RANGE(T,L);
+    }
+    else if(P&&R->BlockWriteHandler[T>>cpuZ80_PAGE_SHIFT]&&((D>0? (T<=S):(T+L<=S))||(S+L<=T)))
+    {
+      R->BlockWriteHandler[T>>cpuZ80_PAGE_SHIFT](R,(uint16_t)T,P+(S&cpuZ80_PAGE_MASK),(uint16_t)L);
+      DIRTY_RANGE(T,L);
+    }
+    else
+    {
+      L=1;
+      cpuMemWrite(R->DE.W,cpuMemRead(R->HL.W));
+    }
+
+    R->HL.W+=D*(int)L;R->DE.W+=D*(int)L;N-=L;
+  }
+}
+
+/** cpuZ80BlockCompare() *************************************/
+/** Executes the iterations of CPIR which fit into the      **/
+/** requested cycles, directly mapped pages are searched at **/
+/** once. Returns the last byte read.                       **/
+/*************************************************************/
+static uint8_t cpuZ80BlockCompare(register cpuZ80State *R)
+{
+  uint32_t N,L;
+  uint8_t *P,*Q;
+  uint8_t I=0;
+
+  N=cpuZ80BlockCount(R);
+
+  while(N)
+  {
+    L=cpuZ80_PAGE_SIZE-(R->HL.W&cpuZ80_PAGE_MASK);
+    if(N<L) L=N;
+
+    P=R->ReadPage[R->HL.W>>cpuZ80_PAGE_SHIFT];
+    if(P)
+    {
+      P+=R->HL.W&cpuZ80_PAGE_MASK;
+      Q=memchr(P,R->AF.B.h,L);
+      if(Q) L=Q-P+1;
+      I=P[L-1];
+    }
+    else
+    {
+      L=1;
+      I=cpuMemRead(R->HL.W);
+    }
+
+    R->HL.W+=L;R->BC.W-=L;R->ICount+=21*L;N-=L;
+    if(I==R->AF.B.h) break;
+  }
+
+  return(I);
+}
+
 enum Codes
 {
   NOP,LD_BC_WORD,LD_xBC_A,INC_BC,INC_B,DEC_B,LD_B_BYTE,RLCA,
@@ -333,6 +740,7 @@ static void CodesCB(register cpuZ80State *R)
 
   I=OpZ80(R->PC.W++);
   R->ICount+=CyclesCB[I];
+  M_PROFILE_OPCODE(cpuPROFILER_OPCODES_CB,I);
   switch(I)
   {
 #include "cpuZ80CodesCB.h"
@@ -344,6 +752,7 @@ static void CodesCB(register cpuZ80State *R)
           "[Z80 %lX] Unrecognized instruction: CB %02X at PC=%04X\n",
           (long)(R->User),OpZ80(R->PC.W-1),R->PC.W-2
         );*/
+			M_TRACE_ILLEGAL(2);
 			break;
   }
 }
@@ -357,6 +766,7 @@ static void CodesDDCB(register cpuZ80State *R)
   J.W=R->XX.W+(offset)OpZ80(R->PC.W++);
   I=OpZ80(R->PC.W++);
   R->ICount+=CyclesXXCB[I];
+  M_PROFILE_OPCODE(cpuPROFILER_OPCODES_DDCB,I);
   switch(I)
   {
 #include "cpuZ80CodesXCB.h"
@@ -369,6 +779,7 @@ static void CodesDDCB(register cpuZ80State *R)
           "[Z80 %lX] Unrecognized instruction: DD CB %02X %02X at PC=%04X\n",
           (long)(R->User),OpZ80(R->PC.W-2),OpZ80(R->PC.W-1),R->PC.W-4
         );*/
+			M_TRACE_ILLEGAL(4);
 			break;
   }
 #undef XX
@@ -383,6 +794,7 @@ static void CodesFDCB(register cpuZ80State *R)
   J.W=R->XX.W+(offset)OpZ80(R->PC.W++);
   I=OpZ80(R->PC.W++);
   R->ICount+=CyclesXXCB[I];
+  M_PROFILE_OPCODE(cpuPROFILER_OPCODES_FDCB,I);
   switch(I)
   {
 #include "cpuZ80CodesXCB.h"
@@ -395,6 +807,7 @@ static void CodesFDCB(register cpuZ80State *R)
           "[Z80 %lX] Unrecognized instruction: FD CB %02X %02X at PC=%04X\n",
           (long)R->User,OpZ80(R->PC.W-2),OpZ80(R->PC.W-1),R->PC.W-4
         );*/
+			M_TRACE_ILLEGAL(4);
 			break;
   }
 #undef XX
@@ -407,6 +820,7 @@ static void CodesED(register cpuZ80State *R)
 
   I=OpZ80(R->PC.W++);
   R->ICount+=CyclesED[I];
+  M_PROFILE_OPCODE(cpuPROFILER_OPCODES_ED,I);
   switch(I)
   {
 #include "cpuZ80CodesED.h"
@@ -422,6 +836,7 @@ static void CodesED(register cpuZ80State *R)
           (long)R->User,OpZ80(R->PC.W-1),R->PC.W-2
         );
 				*/
+			M_TRACE_ILLEGAL(2);
 			break;
   }
 }
@@ -434,6 +849,8 @@ static void CodesDD(register cpuZ80State *R)
 #define XX IX
   I=OpZ80(R->PC.W++);
   R->ICount+=CyclesXX[I];
+  /* XXCB opcodes are counted by CodesDDCB() */
+  if(I!=PFX_CB) { M_PROFILE_OPCODE(cpuPROFILER_OPCODES_DD,I); }
   switch(I)
   {
 #include "cpuZ80CodesXX.h"
@@ -451,6 +868,7 @@ static void CodesDD(register cpuZ80State *R)
           "[Z80 %lX] Unrecognized instruction: DD %02X at PC=%04X\n",
           (long)R->User,OpZ80(R->PC.W-1),R->PC.W-2
         );*/
+			M_TRACE_ILLEGAL(2);
 			break;
   }
 #undef XX
@@ -464,6 +882,8 @@ static void CodesFD(register cpuZ80State *R)
 #define XX IY
   I=OpZ80(R->PC.W++);
   R->ICount+=CyclesXX[I];
+  /* XXCB opcodes are counted by CodesFDCB() */
+  if(I!=PFX_CB) { M_PROFILE_OPCODE(cpuPROFILER_OPCODES_FD,I); }
   switch(I)
   {
 #include "cpuZ80CodesXX.h"
@@ -481,11 +901,287 @@ static void CodesFD(register cpuZ80State *R)
           OpZ80(R->PC.W-1),R->PC.W-2
         );
 				*/
+			M_TRACE_ILLEGAL(2);
 			break;
   }
 #undef XX
 }
 
+/** cpuZ80MemoryMapReset() **********************************/
+/** Sets all pages and I/O ports to unmapped: reads return  **/
+/** 0xFF, writes are ignored.                               **/
+/*************************************************************/
+void cpuZ80MemoryMapReset(register cpuZ80State *R)
+{
+  uint32_t i;
+
+  for(i=0;i<cpuZ80_PAGE_SIZE;i++) R->UnmappedReadPage[i]=0xFF;
+
+  for(i=0;i<cpuZ80_PAGE_COUNT;i++)
+  {
+    R->ReadPage[i]     = R->UnmappedReadPage;
+    R->FetchPage[i]    = R->UnmappedReadPage;
+    R->WritePage[i]    = R->DiscardWritePage;
+    R->ReadHandler[i]  = 0;
+    R->WriteHandler[i] = 0;
+    R->BlockWriteHandler[i] = 0;
+  }
+
+  R->PortRead  = cpuZ80UnmappedPortRead;
+  R->PortWrite = cpuZ80UnmappedPortWrite;
+}
+
+/** cpuZ80MapMemory() ****************************************/
+/** Maps memory blocks directly to a page aligned address   **/
+/** range. Null read block makes the range unmapped, null   **/
+/** write block makes it read-only.                         **/
+/*************************************************************/
+void cpuZ80MapMemory(register cpuZ80State *R, uint16_t in_address, uint32_t in_length, const uint8_t *in_read, uint8_t *in_write)
+{
+  uint32_t page=in_address>>cpuZ80_PAGE_SHIFT;
+  uint32_t offset;
+
+  for(offset=0;offset<in_length && page<cpuZ80_PAGE_COUNT;offset+=cpuZ80_PAGE_SIZE,page++)
+  {
+    R->ReadPage[page]     = in_read? (uint8_t *)in_read+offset:R->UnmappedReadPage;
+    R->FetchPage[page]    = R->ReadPage[page];
+    R->WritePage[page]    = in_write? in_write+offset:R->DiscardWritePage;
+    R->ReadHandler[page]  = 0;
+    R->WriteHandler[page] = 0;
+    R->BlockWriteHandler[page] = 0;
+  }
+}
+
+/** cpuZ80MapHandler() ***************************************/
+/** Routes reads and/or writes of a page aligned address    **/
+/** range to memory mapped I/O handlers. Null handler keeps **/
+/** the current mapping of that direction.                  **/
+/*************************************************************/
+void cpuZ80MapHandler(register cpuZ80State *R, uint16_t in_address, uint32_t in_length, cpuZ80MemoryReadHandler in_read, cpuZ80MemoryWriteHandler in_write)
+{
+  uint32_t page=in_address>>cpuZ80_PAGE_SHIFT;
+  uint32_t offset;
+
+  for(offset=0;offset<in_length && page<cpuZ80_PAGE_COUNT;offset+=cpuZ80_PAGE_SIZE,page++)
+  {
+    if(in_read)
+    {
+      R->ReadPage[page]    = 0;
+      R->FetchPage[page]   = R->UnmappedReadPage;
+      R->ReadHandler[page] = in_read;
+    }
+
+    if(in_write)
+    {
+      R->WritePage[page]    = 0;
+      R->WriteHandler[page] = in_write;
+      R->BlockWriteHandler[page] = 0;
+    }
+  }
+}
+
+/** cpuZ80MapBlockWriteHandler() *****************************/
+/** Sets the block write handler of a page aligned address  **/
+/** range with write handler.                               **/
+/*************************************************************/
+void cpuZ80MapBlockWriteHandler(register cpuZ80State *R, uint16_t in_address, uint32_t in_length, cpuZ80MemoryBlockWriteHandler in_write)
+{
+  uint32_t page=in_address>>cpuZ80_PAGE_SHIFT;
+  uint32_t offset;
+
+  for(offset=0;offset<in_length && page<cpuZ80_PAGE_COUNT;offset+=cpuZ80_PAGE_SIZE,page++)
+    R->BlockWriteHandler[page] = in_write;
+}
+
+/** cpuZ80ReadMemory()/cpuZ80WriteMemory() *******************/
+/** Access memory through the memory map.                   **/
+/*************************************************************/
+uint8_t cpuZ80ReadMemory(register cpuZ80State *R, uint16_t in_address)
+{
+  return(cpuMemRead(in_address));
+}
+
+void cpuZ80WriteMemory(register cpuZ80State *R, uint16_t in_address, uint8_t in_value)
+{
+  cpuMemWrite(in_address,in_value);
+}
+
+/** cpuZ80SetPortHandlers() *********************************/
+/** Sets the handlers of the IN and OUT instructions.       **/
+/*************************************************************/
+void cpuZ80SetPortHandlers(register cpuZ80State *R, cpuZ80PortReadHandler in_read, cpuZ80PortWriteHandler in_write)
+{
+  R->PortRead  = in_read?  in_read:cpuZ80UnmappedPortRead;
+  R->PortWrite = in_write? in_write:cpuZ80UnmappedPortWrite;
+}
+
+#ifdef cpuZ80_PROFILER
+/** cpuZ80AttachProfiler() ***********************************/
+/** Attaches profiler collecting opcode, address and        **/
+/** subroutine statistics of the CPU (null to detach).      **/
+/*************************************************************/
+void cpuZ80AttachProfiler(register cpuZ80State *R, cpuProfilerState *in_profiler)
+{
+  R->Profiler=in_profiler;
+}
+
+/** cpuZ80ProfilerRead() *************************************/
+/** Reads code for the disassembler of the profiler report  **/
+/** the same way as the opcode fetch (no handler is called).**/
+/*************************************************************/
+static uint8_t cpuZ80ProfilerRead(void *in_cpu, uint16_t in_address)
+{
+  register cpuZ80State *R=(cpuZ80State *)in_cpu;
+
+  return(OpZ80(in_address));
+}
+
+/** cpuZ80ProfilerReport() ***********************************/
+/** Writes report of the attached profiler.                 **/
+/*************************************************************/
+void cpuZ80ProfilerReport(register cpuZ80State *R, FILE *in_file)
+{
+  cpuProfilerTarget Target;
+
+  if(!R->Profiler) return;
+
+  Target.Name             = "Z80";
+  Target.CPU              = R;
+  Target.ReadMemory       = cpuZ80ProfilerRead;
+  Target.Disassemble      = cpuZ80Disassemble;
+  Target.OpcodeTableCount = cpuPROFILER_OPCODE_TABLE_COUNT;
+
+  cpuProfilerReport(R->Profiler,&Target,in_file);
+}
+#endif
+
+#ifdef cpuZ80_TRACE
+/** cpuZ80AttachTrace() **************************************/
+/** Attaches trace buffer recording the executed            **/
+/** instructions (null to detach).                          **/
+/*************************************************************/
+void cpuZ80AttachTrace(register cpuZ80State *R, cpuTraceBuffer *in_buffer)
+{
+  R->TraceBuffer=in_buffer;
+  if(in_buffer) in_buffer->CPUType=cpuTRACE_CPU_Z80;
+}
+
+/** cpuZ80TraceInstruction() *********************************/
+/** Records registers and code of the next instruction.     **/
+/** Code is read from the opcode fetch pages.               **/
+/*************************************************************/
+static void cpuZ80TraceInstruction(register cpuZ80State *R)
+{
+  register cpuTraceRecord *Record=cpuTraceBeginRecord(R->TraceBuffer);
+  register uint16_t J;
+
+  /* Flags of the record must be up to date */
+  F_SYNC;
+
+  Record->Cycles=R->TraceBuffer->CycleBase+R->ICount;
+  Record->PC=R->PC.W;
+  Record->AF=R->AF.W;
+  Record->BC=R->BC.W;
+  Record->DE=R->DE.W;
+  Record->HL=R->HL.W;
+  Record->SP=R->SP.W;
+  Record->IX=R->IX.W;
+  Record->IY=R->IY.W;
+  Record->InterruptEnable=R->IFF;
+
+  /* Code is copied at once when it doesn't cross page boundary */
+  J=R->PC.W&cpuZ80_PAGE_MASK;
+  if(J<=cpuZ80_PAGE_SIZE-cpuTRACE_CODE_LENGTH)
+    memcpy(Record->Code,R->FetchPage[R->PC.W>>cpuZ80_PAGE_SHIFT]+J,cpuTRACE_CODE_LENGTH);
+  else
+    for(J=0;J<cpuTRACE_CODE_LENGTH;J++) Record->Code[J]=OpZ80((uint16_t)(R->PC.W+J));
+
+  cpuTraceEndRecord(R->TraceBuffer,R->PC.W);
+}
+#endif
+
+#ifdef cpuZ80_DIRTY_PAGES
+/** cpuZ80GetDirtyPages() ************************************/
+/** Returns the pages written by the CPU since the last     **/
+/** clear. Writes through handlers and ignored writes are   **/
+/** marked as well.                                         **/
+/*************************************************************/
+const cpuDirtyPageBitmap *cpuZ80GetDirtyPages(register cpuZ80State *R)
+{
+  return(&R->DirtyPages);
+}
+
+/** cpuZ80ClearDirtyPages() **********************************/
+/** Clears the dirty page bitmap.                           **/
+/*************************************************************/
+void cpuZ80ClearDirtyPages(register cpuZ80State *R)
+{
+  cpuDirtyPagesClear(&R->DirtyPages);
+}
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+/** cpuZ80SaveState() ****************************************/
+/** Saves registers and interrupt state into the snapshot.  **/
+/** Lazy flags are brought up to date before saving, so the **/
+/** snapshot does not depend on the build options.          **/
+/*************************************************************/
+void cpuZ80SaveState(register cpuZ80State *R, emuSnapshotWriter *in_writer)
+{
+  F_SYNC;
+
+  emuSnapshotWriteWord(in_writer,R->AF.W);
+  emuSnapshotWriteWord(in_writer,R->BC.W);
+  emuSnapshotWriteWord(in_writer,R->DE.W);
+  emuSnapshotWriteWord(in_writer,R->HL.W);
+  emuSnapshotWriteWord(in_writer,R->IX.W);
+  emuSnapshotWriteWord(in_writer,R->IY.W);
+  emuSnapshotWriteWord(in_writer,R->PC.W);
+  emuSnapshotWriteWord(in_writer,R->SP.W);
+  emuSnapshotWriteWord(in_writer,R->AF1.W);
+  emuSnapshotWriteWord(in_writer,R->BC1.W);
+  emuSnapshotWriteWord(in_writer,R->DE1.W);
+  emuSnapshotWriteWord(in_writer,R->HL1.W);
+  emuSnapshotWriteByte(in_writer,R->IFF);
+  emuSnapshotWriteByte(in_writer,R->I);
+  emuSnapshotWriteByte(in_writer,R->R);
+  emuSnapshotWriteWord(in_writer,R->IRequest);
+  emuSnapshotWriteByte(in_writer,R->IAutoReset);
+}
+
+/** cpuZ80LoadState() ****************************************/
+/** Restores registers and interrupt state from the         **/
+/** snapshot. Idle loop detection is restarted.             **/
+/*************************************************************/
+void cpuZ80LoadState(register cpuZ80State *R, emuSnapshotReader *in_reader)
+{
+  R->AF.W       = emuSnapshotReadWord(in_reader);
+  R->BC.W       = emuSnapshotReadWord(in_reader);
+  R->DE.W       = emuSnapshotReadWord(in_reader);
+  R->HL.W       = emuSnapshotReadWord(in_reader);
+  R->IX.W       = emuSnapshotReadWord(in_reader);
+  R->IY.W       = emuSnapshotReadWord(in_reader);
+  R->PC.W       = emuSnapshotReadWord(in_reader);
+  R->SP.W       = emuSnapshotReadWord(in_reader);
+  R->AF1.W      = emuSnapshotReadWord(in_reader);
+  R->BC1.W      = emuSnapshotReadWord(in_reader);
+  R->DE1.W      = emuSnapshotReadWord(in_reader);
+  R->HL1.W      = emuSnapshotReadWord(in_reader);
+  R->IFF        = emuSnapshotReadByte(in_reader);
+  R->I          = emuSnapshotReadByte(in_reader);
+  R->R          = emuSnapshotReadByte(in_reader);
+  R->IRequest   = emuSnapshotReadWord(in_reader);
+  R->IAutoReset = emuSnapshotReadByte(in_reader);
+#ifdef cpuZ80_LAZY_FLAGS
+  R->FlagOp     = cpuZ80_FLAGS_NONE;
+#endif
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+  R->IdleSaved  = 0;
+  R->IdleQuiet  = 0;
+#endif
+}
+#endif
+
 /** ResetZ80() ***********************************************/
 /** This function can be used to reset the register struct  **/
 /** before starting execution with Z80(). It sets the       **/
@@ -510,6 +1206,19 @@ void cpuReset(cpuZ80State *R)
   R->IFF      = 0x00;
   R->ICount   = 0;
   R->IRequest = INT_NONE;
+#ifdef cpuZ80_INSTRUCTION_COUNTER
+  R->InstructionCount = 0;
+#endif
+#ifdef cpuZ80_LAZY_FLAGS
+  R->FlagOp   = cpuZ80_FLAGS_NONE;
+#endif
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+  R->IdleQuiet  = 0;
+  R->IdleCycles = 0;
+#endif
+#ifdef cpuZ80_DIRTY_PAGES
+  cpuDirtyPagesClear(&R->DirtyPages);
+#endif
 
   JumpZ80(R->PC.W);
 }
@@ -524,33 +1233,44 @@ int cpuExecute(register cpuZ80State *R,register int in_cycles_requested)
   register uint8_t I;
   register pair J;
 	int cycles_executed;
+#ifdef cpuZ80_PROFILER
+  uint16_t ProfilePC;
+  int ProfileCount;
+#endif
 
 	R->ICount = 0;
 	R->ICyclesRequested = in_cycles_requested;
+#ifdef cpuZ80_IDLE_LOOP_SKIP
+	/* Memory may have changed since the last call, registers */
+	/* are saved again at the first arrival to the loop       */
+	R->IdleSaved = 0;
+	R->IdleQuiet = 1;
+#endif
 
-  while(R->ICount < in_cycles_requested)
+  while(R->ICount < R->ICyclesRequested)
   {
 #ifdef cpuZ80_DEBUG_ENABLED
     /* Turn tracing on when reached trap address */
     //if(R->PC.W==R->Trap) R->Trace=1;
     /* Call single-step debugger, exit if requested */
     if(R->Trace)
+    {
+      F_SYNC;
       if(!cpuZ80Debug(R)) return(R->ICount);
+    }
 #endif
 
+#ifdef cpuZ80_PROFILER
+		ProfilePC=R->PC.W;ProfileCount=R->ICount;
+#endif
+#ifdef cpuZ80_TRACE
+    if(M_TRACING) cpuZ80TraceInstruction(R);
+#endif
 		I=OpZ80(R->PC.W++);				// Read opcode
 		R->ICount+=Cycles[I];			// Count cycles
-
-		if (R->PC.W == 0x0244)
-		{
-			R->PC.W = 0x0244;
-			R->PC.W = 0x0244;
-		}
-
-		if (R->PC.W == 0x0260)
-		{
-			R->PC.W = 0x0260;
-		}
+#ifdef cpuZ80_INSTRUCTION_COUNTER
+		R->InstructionCount++;		// Count instructions (prefixed instructions are counted once)
+#endif
 
     // Interpret opcode
     switch(I)
@@ -561,12 +1281,29 @@ int cpuExecute(register cpuZ80State *R,register int in_cycles_requested)
       case PFX_FD: CodesFD(R);break;
       case PFX_DD: CodesDD(R);break;
     }
+
+#ifdef cpuZ80_PROFILER
+    /* Count opcode and cycles of the instruction, prefixed */
+    /* opcodes are counted by the Codes*() functions        */
+    if(R->Profiler)
+    {
+      if((I!=PFX_CB)&&(I!=PFX_ED)&&(I!=PFX_DD)&&(I!=PFX_FD))
+        cpuProfilerOpcode(R->Profiler,cpuPROFILER_OPCODES_MAIN,I);
+      cpuProfilerInstruction(R->Profiler,ProfilePC,R->ICount-ProfileCount);
+    }
+#endif
   }
 
+  /* Make F up to date for the caller */
+  F_SYNC;
+
   /* Unless we have come here after EI, exit */
 	if (!(R->IFF&IFF_EI))
 	{
 		cycles_executed = R->ICount;
+#ifdef cpuZ80_TRACE
+		if (M_TRACING) R->TraceBuffer->CycleBase += cycles_executed;
+#endif
 
 		R->ICount = 0;
 
@@ -585,17 +1322,33 @@ int cpuExecute(register cpuZ80State *R,register int in_cycles_requested)
   }
 
 	cycles_executed = R->ICount;
+#ifdef cpuZ80_TRACE
+	if (M_TRACING) R->TraceBuffer->CycleBase += cycles_executed;
+#endif
 
 	R->ICount = 0;
 
 	return cycles_executed;
 }
 
+/** cpuZ80EndExecute() ***************************************/
+/** Makes the running cpuExecute() return when the given    **/
+/** number of cycles is executed since it was called.       **/
+/*************************************************************/
+void cpuZ80EndExecute(register cpuZ80State *R,int in_cycles)
+{
+  if(in_cycles<R->ICyclesRequested) R->ICyclesRequested=in_cycles;
+}
+
 /** IntZ80() *************************************************/
 /** This function will generate interrupt of given vector.  **/
 /*************************************************************/
 void cpuInt(cpuZ80State *R,uint16_t in_vector)
 {
+#ifdef cpuZ80_PROFILER
+  uint16_t ReturnAddress;
+#endif
+
   /* If HALTed, take CPU off HALT instruction */
   if(R->IFF&IFF_HALT) 
 	{ 
@@ -606,6 +1359,9 @@ void cpuInt(cpuZ80State *R,uint16_t in_vector)
   if((R->IFF&IFF_1)||(in_vector==INT_NMI))
   {
     /* Save PC on stack */
+#ifdef cpuZ80_PROFILER
+    ReturnAddress=R->PC.W;
+#endif
     M_PUSH(PC);
 
     /* Automatically reset IRequest if needed */
@@ -619,6 +1375,7 @@ void cpuInt(cpuZ80State *R,uint16_t in_vector)
       R->IFF&=~(IFF_1|IFF_EI);
       /* Jump to hardwired NMI vector */
       R->PC.W=0x0066;
+      M_PROFILE_CALL(0x0066,ReturnAddress);
       JumpZ80(0x0066);
       /* Done */
       return;
@@ -635,13 +1392,14 @@ void cpuInt(cpuZ80State *R,uint16_t in_vector)
       /* Read the vector */
       R->PC.B.l=cpuMemRead(in_vector++);
       R->PC.B.h=cpuMemRead(in_vector);
+      M_PROFILE_CALL(R->PC.W,ReturnAddress);
       JumpZ80(R->PC.W);
       /* Done */
       return;
     }
 
     /* If in IM1 mode, just jump to hardwired IRQ vector */
-    if(R->IFF&IFF_IM1) { R->PC.W=0x0038;JumpZ80(0x0038);return; }
+    if(R->IFF&IFF_IM1) { R->PC.W=0x0038;M_PROFILE_CALL(0x0038,ReturnAddress);JumpZ80(0x0038);return; }
 
     /* If in IM0 mode... */
 
@@ -657,5 +1415,6 @@ void cpuInt(cpuZ80State *R,uint16_t in_vector)
       case INT_RST30: R->PC.W=0x0030;JumpZ80(0x0030);break;
       case INT_RST38: R->PC.W=0x0038;JumpZ80(0x0038);break;
     }
+    M_PROFILE_CALL(R->PC.W,ReturnAddress);
   }
 }
@@ -0,0 +1,587 @@
+/*****************************************************************************/
+/* Z80 disassembler                                                          */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <cpuZ80.h>
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+// State of the instruction being disassembled
+typedef struct
+{
+	const uint8_t* Code;
+	uint16_t Address;
+	uint8_t Length;					/* number of bytes processed */
+	uint8_t Index;					/* 0 - HL, 1 - IX, 2 - IY */
+	uint8_t MemoryOperand;	/* instruction has (IX+d) operand, H and L are not replaced by the index halves */
+	char* Text;
+} cpuZ80DisassemblerContext;
+
+/*****************************************************************************/
+/* Module local variables                                                    */
+/*****************************************************************************/
+
+// Opcode fields are decoded as x (bit 7-6), y (bit 5-3), z (bit 2-0), p (bit 5-4), q (bit 3)
+static const char* l_register_names[8] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+static const char* l_index_names[3] = { "HL", "IX", "IY" };
+static const char* l_register_pair_names[4] = { "BC", "DE", "HL", "SP" };
+static const char* l_register_pair_af_names[4] = { "BC", "DE", "HL", "AF" };
+static const char* l_condition_names[8] = { "NZ", "Z", "NC", "C", "PO", "PE", "P", "M" };
+static const char* l_alu_names[8] = { "ADD A,", "ADC A,", "SUB ", "SBC A,", "AND ", "XOR ", "OR ", "CP " };
+static const char* l_accumulator_names[8] = { "RLCA", "RRCA", "RLA", "RRA", "DAA", "CPL", "SCF", "CCF" };
+static const char* l_rotation_names[8] = { "RLC ", "RRC ", "RL ", "RR ", "SLA ", "SRA ", "SLL ", "SRL " };
+static const char* l_bit_names[4] = { "", "BIT ", "RES ", "SET " };
+static const char* l_interrupt_mode_names[8] = { "0", "0", "1", "2", "0", "0", "1", "2" };
+static const char* l_block_names[4][4] =
+{
+	{ "LDI",  "CPI",  "INI",  "OUTI" },
+	{ "LDD",  "CPD",  "IND",  "OUTD" },
+	{ "LDIR", "CPIR", "INIR", "OTIR" },
+	{ "LDDR", "CPDR", "INDR", "OTDR" }
+};
+static const char* l_ed_names[8] = { "LD I,A", "LD R,A", "LD A,I", "LD A,R", "RRD", "RLD", "NOP", "NOP" };
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static void cpuZ80DisassembleMain(cpuZ80DisassemblerContext* in_context, uint8_t in_opcode);
+static void cpuZ80DisassembleCB(cpuZ80DisassemblerContext* in_context);
+static void cpuZ80DisassembleED(cpuZ80DisassemblerContext* in_context);
+static uint8_t cpuZ80DisassemblerFetch(cpuZ80DisassemblerContext* in_context);
+static void cpuZ80DisassemblerPut(cpuZ80DisassemblerContext* in_context, const char* in_text);
+static void cpuZ80DisassemblerPutHex(cpuZ80DisassemblerContext* in_context, uint16_t in_value, uint8_t in_digit_count);
+static void cpuZ80DisassemblerPutByte(cpuZ80DisassemblerContext* in_context);
+static void cpuZ80DisassemblerPutWord(cpuZ80DisassemblerContext* in_context);
+static void cpuZ80DisassemblerPutRelative(cpuZ80DisassemblerContext* in_context);
+static void cpuZ80DisassemblerPutRegister(cpuZ80DisassemblerContext* in_context, uint8_t in_register);
+static void cpuZ80DisassemblerPutIndexed(cpuZ80DisassemblerContext* in_context, int8_t in_displacement);
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Disassembles one instruction
+/// @param in_code Instruction bytes (at least 4 bytes)
+/// @param in_address Address of the instruction (for relative jumps)
+/// @param out_text Buffer receiving the instruction text (at least 24 characters)
+/// @return Length of the instruction in bytes
+uint8_t cpuZ80Disassemble(const uint8_t* in_code, uint16_t in_address, char* out_text)
+{
+	cpuZ80DisassemblerContext context;
+	uint8_t opcode;
+
+	context.Code = in_code;
+	context.Address = in_address;
+	context.Length = 0;
+	context.Index = 0;
+	context.MemoryOperand = 0;
+	context.Text = out_text;
+
+	opcode = cpuZ80DisassemblerFetch(&context);
+
+	// index prefix
+	if (opcode == 0xdd || opcode == 0xfd)
+	{
+		context.Index = (opcode == 0xdd) ? 1 : 2;
+		opcode = cpuZ80DisassemblerFetch(&context);
+
+		// prefix followed by an other index prefix is ignored
+		if (opcode == 0xdd || opcode == 0xfd)
+		{
+			context.Length = 1;
+			cpuZ80DisassemblerPut(&context, "NOP");
+			*context.Text = '\0';
+			return context.Length;
+		}
+
+		// ED instructions don't use the index registers
+		if (opcode == 0xed)
+			context.Index = 0;
+	}
+
+	switch (opcode)
+	{
+		case 0xcb:
+			cpuZ80DisassembleCB(&context);
+			break;
+
+		case 0xed:
+			cpuZ80DisassembleED(&context);
+			break;
+
+		default:
+			cpuZ80DisassembleMain(&context, opcode);
+			break;
+	}
+
+	*context.Text = '\0';
+
+	return context.Length;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Disassembles unprefixed (or index prefixed) instruction
+/// @param in_context Disassembler state
+/// @param in_opcode Opcode
+static void cpuZ80DisassembleMain(cpuZ80DisassemblerContext* in_context, uint8_t in_opcode)
+{
+	uint8_t x = in_opcode >> 6;
+	uint8_t y = (in_opcode >> 3) & 7;
+	uint8_t z = in_opcode & 7;
+	uint8_t p = y >> 1;
+	uint8_t q = y & 1;
+	const char* pair_name = (p == 2) ? l_index_names[in_context->Index] : l_register_pair_names[p];
+	const char* pair_af_name = (p == 2) ? l_index_names[in_context->Index] : l_register_pair_af_names[p];
+	const char* index_name = l_index_names[in_context->Index];
+
+	switch (x)
+	{
+		case 0:
+			switch (z)
+			{
+				case 0:
+					if (y == 0)
+						cpuZ80DisassemblerPut(in_context, "NOP");
+					else if (y == 1)
+						cpuZ80DisassemblerPut(in_context, "EX AF,AF'");
+					else
+					{
+						cpuZ80DisassemblerPut(in_context, (y == 2) ? "DJNZ " : "JR ");
+						if (y >= 4)
+						{
+							cpuZ80DisassemblerPut(in_context, l_condition_names[y - 4]);
+							cpuZ80DisassemblerPut(in_context, ",");
+						}
+						cpuZ80DisassemblerPutRelative(in_context);
+					}
+					break;
+
+				case 1:
+					if (q == 0)
+					{
+						cpuZ80DisassemblerPut(in_context, "LD ");
+						cpuZ80DisassemblerPut(in_context, pair_name);
+						cpuZ80DisassemblerPut(in_context, ",");
+						cpuZ80DisassemblerPutWord(in_context);
+					}
+					else
+					{
+						cpuZ80DisassemblerPut(in_context, "ADD ");
+						cpuZ80DisassemblerPut(in_context, index_name);
+						cpuZ80DisassemblerPut(in_context, ",");
+						cpuZ80DisassemblerPut(in_context, pair_name);
+					}
+					break;
+
+				case 2:
+					cpuZ80DisassemblerPut(in_context, "LD ");
+					if (q == 1)
+						cpuZ80DisassemblerPut(in_context, (p == 2) ? index_name : "A");
+					if (q == 1)
+						cpuZ80DisassemblerPut(in_context, ",");
+					if (p == 0)
+						cpuZ80DisassemblerPut(in_context, "(BC)");
+					else if (p == 1)
+						cpuZ80DisassemblerPut(in_context, "(DE)");
+					else
+					{
+						cpuZ80DisassemblerPut(in_context, "(");
+						cpuZ80DisassemblerPutWord(in_context);
+						cpuZ80DisassemblerPut(in_context, ")");
+					}
+					if (q == 0)
+					{
+						cpuZ80DisassemblerPut(in_context, ",");
+						cpuZ80DisassemblerPut(in_context, (p == 2) ? index_name : "A");
+					}
+					break;
+
+				case 3:
+					cpuZ80DisassemblerPut(in_context, (q == 0) ? "INC " : "DEC ");
+					cpuZ80DisassemblerPut(in_context, pair_name);
+					break;
+
+				case 4:
+				case 5:
+					cpuZ80DisassemblerPut(in_context, (z == 4) ? "INC " : "DEC ");
+					cpuZ80DisassemblerPutRegister(in_context, y);
+					break;
+
+				case 6:
+					cpuZ80DisassemblerPut(in_context, "LD ");
+					cpuZ80DisassemblerPutRegister(in_context, y);
+					cpuZ80DisassemblerPut(in_context, ",");
+					cpuZ80DisassemblerPutByte(in_context);
+					break;
+
+				case 7:
+					cpuZ80DisassemblerPut(in_context, l_accumulator_names[y]);
+					break;
+			}
+			break;
+
+		case 1:
+			if (y == 6 && z == 6)
+			{
+				cpuZ80DisassemblerPut(in_context, "HALT");
+			}
+			else
+			{
+				in_context->MemoryOperand = (y == 6 || z == 6);
+				cpuZ80DisassemblerPut(in_context, "LD ");
+				cpuZ80DisassemblerPutRegister(in_context, y);
+				cpuZ80DisassemblerPut(in_context, ",");
+				cpuZ80DisassemblerPutRegister(in_context, z);
+			}
+			break;
+
+		case 2:
+			cpuZ80DisassemblerPut(in_context, l_alu_names[y]);
+			cpuZ80DisassemblerPutRegister(in_context, z);
+			break;
+
+		case 3:
+			switch (z)
+			{
+				case 0:
+					cpuZ80DisassemblerPut(in_context, "RET ");
+					cpuZ80DisassemblerPut(in_context, l_condition_names[y]);
+					break;
+
+				case 1:
+					if (q == 0)
+					{
+						cpuZ80DisassemblerPut(in_context, "POP ");
+						cpuZ80DisassemblerPut(in_context, pair_af_name);
+					}
+					else if (p == 0)
+						cpuZ80DisassemblerPut(in_context, "RET");
+					else if (p == 1)
+						cpuZ80DisassemblerPut(in_context, "EXX");
+					else if (p == 2)
+					{
+						cpuZ80DisassemblerPut(in_context, "JP (");
+						cpuZ80DisassemblerPut(in_context, index_name);
+						cpuZ80DisassemblerPut(in_context, ")");
+					}
+					else
+					{
+						cpuZ80DisassemblerPut(in_context, "LD SP,");
+						cpuZ80DisassemblerPut(in_context, index_name);
+					}
+					break;
+
+				case 2:
+				case 4:
+					cpuZ80DisassemblerPut(in_context, (z == 2) ? "JP " : "CALL ");
+					cpuZ80DisassemblerPut(in_context, l_condition_names[y]);
+					cpuZ80DisassemblerPut(in_context, ",");
+					cpuZ80DisassemblerPutWord(in_context);
+					break;
+
+				case 3:
+					switch (y)
+					{
+						case 0:
+							cpuZ80DisassemblerPut(in_context, "JP ");
+							cpuZ80DisassemblerPutWord(in_context);
+							break;
+
+						case 2:
+							cpuZ80DisassemblerPut(in_context, "OUT (");
+							cpuZ80DisassemblerPutByte(in_context);
+							cpuZ80DisassemblerPut(in_context, "),A");
+							break;
+
+						case 3:
+							cpuZ80DisassemblerPut(in_context, "IN A,(");
+							cpuZ80DisassemblerPutByte(in_context);
+							cpuZ80DisassemblerPut(in_context, ")");
+							break;
+
+						case 4:
+							cpuZ80DisassemblerPut(in_context, "EX (SP),");
+							cpuZ80DisassemblerPut(in_context, index_name);
+							break;
+
+						case 5:
+							cpuZ80DisassemblerPut(in_context, "EX DE,HL");
+							break;
+
+						case 6:
+							cpuZ80DisassemblerPut(in_context, "DI");
+							break;
+
+						case 7:
+							cpuZ80DisassemblerPut(in_context, "EI");
+							break;
+					}
+					break;
+
+				case 5:
+					if (q == 0)
+					{
+						cpuZ80DisassemblerPut(in_context, "PUSH ");
+						cpuZ80DisassemblerPut(in_context, pair_af_name);
+					}
+					else
+					{
+						cpuZ80DisassemblerPut(in_context, "CALL ");
+						cpuZ80DisassemblerPutWord(in_context);
+					}
+					break;
+
+				case 6:
+					cpuZ80DisassemblerPut(in_context, l_alu_names[y]);
+					cpuZ80DisassemblerPutByte(in_context);
+					break;
+
+				case 7:
+					cpuZ80DisassemblerPut(in_context, "RST ");
+					cpuZ80DisassemblerPutHex(in_context, y * 8, 2);
+					break;
+			}
+			break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Disassembles CB prefixed instruction (DD CB and FD CB have the displacement before the opcode)
+/// @param in_context Disassembler state
+static void cpuZ80DisassembleCB(cpuZ80DisassemblerContext* in_context)
+{
+	int8_t displacement = 0;
+	uint8_t opcode;
+	uint8_t x;
+	uint8_t y;
+
+	if (in_context->Index != 0)
+		displacement = (int8_t)cpuZ80DisassemblerFetch(in_context);
+
+	opcode = cpuZ80DisassemblerFetch(in_context);
+	x = opcode >> 6;
+	y = (opcode >> 3) & 7;
+
+	if (x == 0)
+		cpuZ80DisassemblerPut(in_context, l_rotation_names[y]);
+	else
+	{
+		cpuZ80DisassemblerPut(in_context, l_bit_names[x]);
+		cpuZ80DisassemblerPutHex(in_context, y, 0);
+		cpuZ80DisassemblerPut(in_context, ",");
+	}
+
+	if (in_context->Index != 0)
+		cpuZ80DisassemblerPutIndexed(in_context, displacement);
+	else
+		cpuZ80DisassemblerPutRegister(in_context, opcode & 7);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Disassembles ED prefixed instruction
+/// @param in_context Disassembler state
+static void cpuZ80DisassembleED(cpuZ80DisassemblerContext* in_context)
+{
+	uint8_t opcode = cpuZ80DisassemblerFetch(in_context);
+	uint8_t x = opcode >> 6;
+	uint8_t y = (opcode >> 3) & 7;
+	uint8_t z = opcode & 7;
+	uint8_t p = y >> 1;
+	uint8_t q = y & 1;
+
+	if (x == 2 && z <= 3 && y >= 4)
+	{
+		cpuZ80DisassemblerPut(in_context, l_block_names[y - 4][z]);
+		return;
+	}
+
+	if (x != 1)
+	{
+		cpuZ80DisassemblerPut(in_context, "NOP");
+		return;
+	}
+
+	switch (z)
+	{
+		case 0:
+			cpuZ80DisassemblerPut(in_context, "IN ");
+			if (y != 6)
+			{
+				cpuZ80DisassemblerPut(in_context, l_register_names[y]);
+				cpuZ80DisassemblerPut(in_context, ",");
+			}
+			cpuZ80DisassemblerPut(in_context, "(C)");
+			break;
+
+		case 1:
+			cpuZ80DisassemblerPut(in_context, "OUT (C),");
+			cpuZ80DisassemblerPut(in_context, (y == 6) ? "0" : l_register_names[y]);
+			break;
+
+		case 2:
+			cpuZ80DisassemblerPut(in_context, (q == 0) ? "SBC HL," : "ADC HL,");
+			cpuZ80DisassemblerPut(in_context, l_register_pair_names[p]);
+			break;
+
+		case 3:
+			cpuZ80DisassemblerPut(in_context, "LD ");
+			if (q == 1)
+			{
+				cpuZ80DisassemblerPut(in_context, l_register_pair_names[p]);
+				cpuZ80DisassemblerPut(in_context, ",");
+			}
+			cpuZ80DisassemblerPut(in_context, "(");
+			cpuZ80DisassemblerPutWord(in_context);
+			cpuZ80DisassemblerPut(in_context, ")");
+			if (q == 0)
+			{
+				cpuZ80DisassemblerPut(in_context, ",");
+				cpuZ80DisassemblerPut(in_context, l_register_pair_names[p]);
+			}
+			break;
+
+		case 4:
+			cpuZ80DisassemblerPut(in_context, "NEG");
+			break;
+
+		case 5:
+			cpuZ80DisassemblerPut(in_context, (y == 1) ? "RETI" : "RETN");
+			break;
+
+		case 6:
+			cpuZ80DisassemblerPut(in_context, "IM ");
+			cpuZ80DisassemblerPut(in_context, l_interrupt_mode_names[y]);
+			break;
+
+		case 7:
+			cpuZ80DisassemblerPut(in_context, l_ed_names[y]);
+			break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets the next byte of the instruction
+/// @param in_context Disassembler state
+/// @return Instruction byte
+static uint8_t cpuZ80DisassemblerFetch(cpuZ80DisassemblerContext* in_context)
+{
+	return in_context->Code[in_context->Length++];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Appends text to the instruction text
+/// @param in_context Disassembler state
+/// @param in_text Text to append
+static void cpuZ80DisassemblerPut(cpuZ80DisassemblerContext* in_context, const char* in_text)
+{
+	while (*in_text != '\0')
+		*in_context->Text++ = *in_text++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Appends hexadecimal number with 'h' suffix (or decimal digit when the digit count is zero)
+/// @param in_context Disassembler state
+/// @param in_value Value to append
+/// @param in_digit_count Number of hexadecimal digits
+static void cpuZ80DisassemblerPutHex(cpuZ80DisassemblerContext* in_context, uint16_t in_value, uint8_t in_digit_count)
+{
+	if (in_digit_count == 0)
+	{
+		*in_context->Text++ = (char)('0' + in_value);
+		return;
+	}
+
+	while (in_digit_count > 0)
+	{
+		in_digit_count--;
+		*in_context->Text++ = "0123456789ABCDEF"[(in_value >> (in_digit_count * 4)) & 0x0f];
+	}
+
+	*in_context->Text++ = 'h';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Appends 8 bit immediate operand
+/// @param in_context Disassembler state
+static void cpuZ80DisassemblerPutByte(cpuZ80DisassemblerContext* in_context)
+{
+	cpuZ80DisassemblerPutHex(in_context, cpuZ80DisassemblerFetch(in_context), 2);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Appends 16 bit immediate operand
+/// @param in_context Disassembler state
+static void cpuZ80DisassemblerPutWord(cpuZ80DisassemblerContext* in_context)
+{
+	uint16_t value;
+
+	value = cpuZ80DisassemblerFetch(in_context);
+	value |= (uint16_t)cpuZ80DisassemblerFetch(in_context) << 8;
+
+	cpuZ80DisassemblerPutHex(in_context, value, 4);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Appends target address of a relative jump
+/// @param in_context Disassembler state
+static void cpuZ80DisassemblerPutRelative(cpuZ80DisassemblerContext* in_context)
+{
+	int8_t displacement = (int8_t)cpuZ80DisassemblerFetch(in_context);
+
+	cpuZ80DisassemblerPutHex(in_context, (uint16_t)(in_context->Address + in_context->Length + displacement), 4);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Appends 8 bit register operand. Index prefixed instructions use (IX+d) instead of (HL) and
+/// IXH/IXL instead of H/L (when the instruction has no (IX+d) operand).
+/// @param in_context Disassembler state
+/// @param in_register Register index (z or y field of the opcode)
+static void cpuZ80DisassemblerPutRegister(cpuZ80DisassemblerContext* in_context, uint8_t in_register)
+{
+	if (in_context->Index != 0)
+	{
+		if (in_register == 6)
+		{
+			cpuZ80DisassemblerPutIndexed(in_context, (int8_t)cpuZ80DisassemblerFetch(in_context));
+			return;
+		}
+
+		if ((in_register == 4 || in_register == 5) && !in_context->MemoryOperand)
+		{
+			cpuZ80DisassemblerPut(in_context, l_index_names[in_context->Index]);
+			cpuZ80DisassemblerPut(in_context, (in_register == 4) ? "H" : "L");
+			return;
+		}
+	}
+
+	cpuZ80DisassemblerPut(in_context, l_register_names[in_register]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Appends (IX+d) or (IY+d) operand
+/// @param in_context Disassembler state
+/// @param in_displacement Displacement
+static void cpuZ80DisassemblerPutIndexed(cpuZ80DisassemblerContext* in_context, int8_t in_displacement)
+{
+	cpuZ80DisassemblerPut(in_context, "(");
+	cpuZ80DisassemblerPut(in_context, l_index_names[in_context->Index]);
+	cpuZ80DisassemblerPut(in_context, (in_displacement < 0) ? "-" : "+");
+	cpuZ80DisassemblerPutHex(in_context, (in_displacement < 0) ? -in_displacement : in_displacement, 2);
+	cpuZ80DisassemblerPut(in_context, ")");
+}
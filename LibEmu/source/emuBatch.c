@@ -0,0 +1,186 @@
+/*****************************************************************************/
+/* Batched multi-instance emulator stepping on a worker thread pool          */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <emuBatch.h>
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static void* emuBatchWorkerThread(void* in_batch);
+static void emuBatchProcessInstances(emuBatchState* in_batch);
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Starts worker threads of the batch. The calling thread also steps instances in emuBatchRun
+/// so the total number of threads working on a batch is in_thread_count + 1.
+/// @param in_batch Batch state to initialize
+/// @param in_thread_count Number of worker threads to start (0 - instances are stepped on the calling thread only)
+/// @return True if all threads are started
+bool emuBatchInitialize(emuBatchState* in_batch, uint32_t in_thread_count)
+{
+	if (in_thread_count > emuBATCH_MAX_THREAD_COUNT)
+		in_thread_count = emuBATCH_MAX_THREAD_COUNT;
+
+	in_batch->ThreadCount = 0;
+	in_batch->Generation = 0;
+	in_batch->BusyThreadCount = 0;
+	in_batch->Quit = false;
+	in_batch->Instances = sysNULL;
+	in_batch->InstanceCount = 0;
+	in_batch->NextInstance = 0;
+	in_batch->FrameCount = 0;
+	in_batch->Step = sysNULL;
+
+	pthread_mutex_init(&in_batch->Lock, sysNULL);
+	pthread_cond_init(&in_batch->StartCondition, sysNULL);
+	pthread_cond_init(&in_batch->DoneCondition, sysNULL);
+
+	while (in_batch->ThreadCount < in_thread_count)
+	{
+		if (pthread_create(&in_batch->Threads[in_batch->ThreadCount], sysNULL, emuBatchWorkerThread, in_batch) != 0)
+		{
+			emuBatchCleanup(in_batch);
+			return false;
+		}
+
+		in_batch->ThreadCount++;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Steps all instances by the given number of frames and waits until all of them are finished.
+/// Instances are distributed dynamically between the threads, each instance is stepped by one thread.
+/// @param in_batch Batch state
+/// @param in_instances Array of the instances to step
+/// @param in_instance_count Number of instances
+/// @param in_frame_count Number of frames to step every instance
+/// @param in_step Step function of the instances
+void emuBatchRun(emuBatchState* in_batch, void** in_instances, uint32_t in_instance_count, uint32_t in_frame_count, emuBatchStepFunction in_step)
+{
+	// start workers
+	pthread_mutex_lock(&in_batch->Lock);
+
+	in_batch->Instances = in_instances;
+	in_batch->InstanceCount = in_instance_count;
+	in_batch->NextInstance = 0;
+	in_batch->FrameCount = in_frame_count;
+	in_batch->Step = in_step;
+	in_batch->BusyThreadCount = in_batch->ThreadCount;
+	in_batch->Generation++;
+
+	pthread_cond_broadcast(&in_batch->StartCondition);
+	pthread_mutex_unlock(&in_batch->Lock);
+
+	// calling thread is working as well
+	emuBatchProcessInstances(in_batch);
+
+	// wait for workers
+	pthread_mutex_lock(&in_batch->Lock);
+
+	while (in_batch->BusyThreadCount > 0)
+		pthread_cond_wait(&in_batch->DoneCondition, &in_batch->Lock);
+
+	pthread_mutex_unlock(&in_batch->Lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Stops worker threads and releases resources of the batch
+/// @param in_batch Batch state
+void emuBatchCleanup(emuBatchState* in_batch)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&in_batch->Lock);
+	in_batch->Quit = true;
+	pthread_cond_broadcast(&in_batch->StartCondition);
+	pthread_mutex_unlock(&in_batch->Lock);
+
+	for (i = 0; i < in_batch->ThreadCount; i++)
+		pthread_join(in_batch->Threads[i], sysNULL);
+
+	in_batch->ThreadCount = 0;
+
+	pthread_cond_destroy(&in_batch->DoneCondition);
+	pthread_cond_destroy(&in_batch->StartCondition);
+	pthread_mutex_destroy(&in_batch->Lock);
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Worker thread function, processes instances of every started batch
+/// @param in_batch Batch state
+static void* emuBatchWorkerThread(void* in_batch)
+{
+	emuBatchState* batch = (emuBatchState*)in_batch;
+	uint32_t generation = 0;
+
+	pthread_mutex_lock(&batch->Lock);
+
+	while (true)
+	{
+		// wait for the next batch
+		while (batch->Generation == generation && !batch->Quit)
+			pthread_cond_wait(&batch->StartCondition, &batch->Lock);
+
+		if (batch->Quit)
+			break;
+
+		generation = batch->Generation;
+
+		pthread_mutex_unlock(&batch->Lock);
+
+		emuBatchProcessInstances(batch);
+
+		pthread_mutex_lock(&batch->Lock);
+
+		// signal when the last worker is finished
+		batch->BusyThreadCount--;
+		if (batch->BusyThreadCount == 0)
+			pthread_cond_signal(&batch->DoneCondition);
+	}
+
+	pthread_mutex_unlock(&batch->Lock);
+
+	return sysNULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Steps instances of the current batch until all instances are taken
+/// @param in_batch Batch state
+static void emuBatchProcessInstances(emuBatchState* in_batch)
+{
+	uint32_t instance_index;
+
+	while (true)
+	{
+		// take the next instance
+		pthread_mutex_lock(&in_batch->Lock);
+		instance_index = in_batch->NextInstance;
+		if (instance_index < in_batch->InstanceCount)
+			in_batch->NextInstance++;
+		pthread_mutex_unlock(&in_batch->Lock);
+
+		if (instance_index >= in_batch->InstanceCount)
+			break;
+
+		in_batch->Step(in_batch->Instances[instance_index], in_batch->FrameCount);
+	}
+}
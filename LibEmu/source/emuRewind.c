@@ -0,0 +1,371 @@
+/*****************************************************************************/
+/* Rewind history of delta snapshots (dirty memory pages of the frames)      */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <emuRewind.h>
+#include <string.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define emuREWIND_RECORD_HEADER_SIZE 4
+#define emuREWIND_RECORD_FOOTER_SIZE 4
+#define emuREWIND_PAGE_RECORD_SIZE (1 + cpuDIRTY_PAGE_SIZE)
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static void emuRewindClearHistory(emuRewindState* in_rewind);
+static uint8_t* emuRewindAllocateRecord(emuRewindState* in_rewind, uint32_t in_length);
+static void emuRewindDropOldest(emuRewindState* in_rewind);
+static uint32_t emuRewindGetRecordLength(const uint8_t* in_record);
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes rewind history. Memory regions must be added before the history is reset.
+/// @param in_rewind Rewind history
+/// @param in_buffer History buffer (holds the shadow copies of the regions and the records)
+/// @param in_buffer_size Size of the buffer in bytes
+void emuRewindInitialize(emuRewindState* in_rewind, uint8_t* in_buffer, uint32_t in_buffer_size)
+{
+	in_rewind->RegionCount = 0;
+	in_rewind->Ring = in_buffer;
+	in_rewind->RingSize = in_buffer_size;
+	in_rewind->StateLength = 0;
+	in_rewind->LastRecordLength = 0;
+
+	emuRewindClearHistory(in_rewind);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds memory region to the history. The shadow copy of the region is allocated from the history buffer.
+/// @param in_rewind Rewind history
+/// @param in_address CPU address of the region (page aligned, dirty pages are checked by this address)
+/// @param in_length Length of the region (multiple of the page size)
+/// @param in_memory Content of the region
+/// @return True if the region is added
+bool emuRewindAddRegion(emuRewindState* in_rewind, uint16_t in_address, uint32_t in_length, uint8_t* in_memory)
+{
+	emuRewindRegion* region;
+
+	if (in_rewind->RegionCount >= emuREWIND_MAX_REGION_COUNT || in_length > in_rewind->RingSize)
+		return false;
+
+	region = &in_rewind->Regions[in_rewind->RegionCount++];
+
+	region->Address = in_address;
+	region->Length = in_length;
+	region->Memory = in_memory;
+	region->Shadow = in_rewind->Ring;
+
+	in_rewind->Ring += in_length;
+	in_rewind->RingSize -= in_length;
+
+	emuRewindClearHistory(in_rewind);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Drops all records and stores the current memory content and machine state as the start of the history
+/// @param in_rewind Rewind history
+/// @param in_state Current machine state
+/// @param in_state_length Length of the machine state in bytes
+void emuRewindReset(emuRewindState* in_rewind, const uint8_t* in_state, uint16_t in_state_length)
+{
+	uint8_t i;
+
+	for (i = 0; i < in_rewind->RegionCount; i++)
+		memcpy(in_rewind->Regions[i].Shadow, in_rewind->Regions[i].Memory, in_rewind->Regions[i].Length);
+
+	if (in_state_length > emuREWIND_MAX_STATE_SIZE)
+		in_state_length = 0;
+
+	memcpy(in_rewind->State, in_state, in_state_length);
+	in_rewind->StateLength = in_state_length;
+
+	emuRewindClearHistory(in_rewind);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Stores one frame into the history (must be called at the frame boundary). The record holds the machine
+/// state at the previous boundary and the previous content of the pages written during the frame.
+/// @param in_rewind Rewind history
+/// @param in_dirty_pages Pages written since the previous frame boundary
+/// @param in_state Current machine state
+/// @param in_state_length Length of the machine state in bytes
+/// @return True if the frame is stored, false if the frame doesn't fit into the history (history is dropped)
+bool emuRewindPushFrame(emuRewindState* in_rewind, const cpuDirtyPageBitmap* in_dirty_pages, const uint8_t* in_state, uint16_t in_state_length)
+{
+	emuRewindRegion* region;
+	uint8_t* record;
+	uint8_t* pos;
+	uint32_t length;
+	uint16_t page_count;
+	uint32_t offset;
+	uint8_t page;
+	uint8_t i;
+
+	if (in_state_length > emuREWIND_MAX_STATE_SIZE)
+		return false;
+
+	// count dirty pages of the regions
+	page_count = 0;
+	for (i = 0; i < in_rewind->RegionCount; i++)
+	{
+		region = &in_rewind->Regions[i];
+		for (offset = 0; offset < region->Length; offset += cpuDIRTY_PAGE_SIZE)
+		{
+			if (cpuDirtyPagesTest(in_dirty_pages, (uint8_t)((region->Address + offset) >> cpuDIRTY_PAGE_SHIFT)))
+				page_count++;
+		}
+	}
+
+	length = emuREWIND_RECORD_HEADER_SIZE + in_rewind->StateLength + page_count * emuREWIND_PAGE_RECORD_SIZE + emuREWIND_RECORD_FOOTER_SIZE;
+
+	record = emuRewindAllocateRecord(in_rewind, length);
+
+	// store previous state and page content, update shadow copies
+	if (record != NULL)
+	{
+		record[0] = (uint8_t)in_rewind->StateLength;
+		record[1] = (uint8_t)(in_rewind->StateLength >> 8);
+		record[2] = (uint8_t)page_count;
+		record[3] = (uint8_t)(page_count >> 8);
+		pos = record + emuREWIND_RECORD_HEADER_SIZE;
+
+		memcpy(pos, in_rewind->State, in_rewind->StateLength);
+		pos += in_rewind->StateLength;
+	}
+	else
+	{
+		pos = NULL;
+	}
+
+	for (i = 0; i < in_rewind->RegionCount; i++)
+	{
+		region = &in_rewind->Regions[i];
+		for (offset = 0; offset < region->Length; offset += cpuDIRTY_PAGE_SIZE)
+		{
+			page = (uint8_t)((region->Address + offset) >> cpuDIRTY_PAGE_SHIFT);
+			if (cpuDirtyPagesTest(in_dirty_pages, page))
+			{
+				if (pos != NULL)
+				{
+					*pos++ = page;
+					memcpy(pos, &region->Shadow[offset], cpuDIRTY_PAGE_SIZE);
+					pos += cpuDIRTY_PAGE_SIZE;
+				}
+
+				memcpy(&region->Shadow[offset], &region->Memory[offset], cpuDIRTY_PAGE_SIZE);
+			}
+		}
+	}
+
+	if (pos != NULL)
+		memcpy(pos, &length, emuREWIND_RECORD_FOOTER_SIZE);
+
+	memcpy(in_rewind->State, in_state, in_state_length);
+	in_rewind->StateLength = in_state_length;
+	in_rewind->LastRecordLength = length;
+
+	return record != NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores memory and machine state of the previous frame boundary and drops the newest record
+/// @param in_rewind Rewind history
+/// @param out_state Buffer receiving the restored machine state (emuREWIND_MAX_STATE_SIZE bytes)
+/// @param out_state_length Length of the restored state
+/// @param out_restored_pages Pages changed by the restore are marked in this bitmap (can be null)
+/// @return True if the state is restored, false if the history is empty
+bool emuRewindStepBack(emuRewindState* in_rewind, uint8_t* out_state, uint16_t* out_state_length, cpuDirtyPageBitmap* out_restored_pages)
+{
+	emuRewindRegion* region;
+	const uint8_t* record;
+	const uint8_t* pos;
+	uint16_t state_length;
+	uint16_t page_count;
+	uint16_t address;
+	uint8_t i;
+
+	if (in_rewind->FrameCount == 0)
+		return false;
+
+	// newest record ends at the end of the ring when the last record of the ring start was dropped
+	if (in_rewind->Head == 0)
+	{
+		in_rewind->Head = in_rewind->End;
+		in_rewind->End = in_rewind->RingSize;
+	}
+
+	in_rewind->Head -= emuRewindGetRecordLength(&in_rewind->Ring[in_rewind->Head - emuREWIND_RECORD_FOOTER_SIZE]);
+	in_rewind->FrameCount--;
+
+	record = &in_rewind->Ring[in_rewind->Head];
+	state_length = (uint16_t)(record[0] | (record[1] << 8));
+	page_count = (uint16_t)(record[2] | (record[3] << 8));
+	pos = record + emuREWIND_RECORD_HEADER_SIZE;
+
+	// restore state
+	memcpy(in_rewind->State, pos, state_length);
+	in_rewind->StateLength = state_length;
+	memcpy(out_state, pos, state_length);
+	*out_state_length = state_length;
+	pos += state_length;
+
+	// restore pages
+	while (page_count > 0)
+	{
+		address = (uint16_t)(*pos++ << cpuDIRTY_PAGE_SHIFT);
+
+		for (i = 0; i < in_rewind->RegionCount; i++)
+		{
+			region = &in_rewind->Regions[i];
+			if (address >= region->Address && (uint32_t)(address - region->Address) < region->Length)
+			{
+				memcpy(&region->Memory[address - region->Address], pos, cpuDIRTY_PAGE_SIZE);
+				memcpy(&region->Shadow[address - region->Address], pos, cpuDIRTY_PAGE_SIZE);
+				break;
+			}
+		}
+
+		if (out_restored_pages != NULL)
+			cpuDirtyPagesMark(out_restored_pages, address);
+
+		pos += cpuDIRTY_PAGE_SIZE;
+		page_count--;
+	}
+
+	if (in_rewind->FrameCount == 0)
+		emuRewindClearHistory(in_rewind);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets the number of bytes used by the stored records
+/// @param in_rewind Rewind history
+/// @return Used bytes
+uint32_t emuRewindGetUsedBytes(emuRewindState* in_rewind)
+{
+	if (in_rewind->FrameCount == 0)
+		return 0;
+
+	if (in_rewind->Head > in_rewind->Tail)
+		return in_rewind->Head - in_rewind->Tail;
+	else
+		return in_rewind->End - in_rewind->Tail + in_rewind->Head;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Drops all records
+/// @param in_rewind Rewind history
+static void emuRewindClearHistory(emuRewindState* in_rewind)
+{
+	in_rewind->Head = 0;
+	in_rewind->Tail = 0;
+	in_rewind->End = in_rewind->RingSize;
+	in_rewind->FrameCount = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Allocates continuous space for a new record, the oldest records are dropped when the ring is full.
+/// Records are stored in [Tail, Head) or when wrapped around in [Tail, End) and [0, Head).
+/// @param in_rewind Rewind history
+/// @param in_length Length of the record
+/// @return Record storage or null if the record is larger than the ring (all records are dropped)
+static uint8_t* emuRewindAllocateRecord(emuRewindState* in_rewind, uint32_t in_length)
+{
+	uint8_t* record;
+
+	if (in_length > in_rewind->RingSize)
+	{
+		emuRewindClearHistory(in_rewind);
+		return NULL;
+	}
+
+	while (true)
+	{
+		if (in_rewind->FrameCount == 0 || in_rewind->Head > in_rewind->Tail)
+		{
+			// not wrapped: free space is at the end and before the oldest record
+			if (in_rewind->RingSize - in_rewind->Head >= in_length)
+				break;
+
+			in_rewind->End = in_rewind->Head;
+			in_rewind->Head = 0;
+
+			if (in_rewind->FrameCount == 0)
+				emuRewindClearHistory(in_rewind);
+		}
+		else
+		{
+			// wrapped: free space is between the newest and the oldest record
+			if (in_rewind->Tail - in_rewind->Head >= in_length)
+				break;
+
+			emuRewindDropOldest(in_rewind);
+		}
+	}
+
+	record = &in_rewind->Ring[in_rewind->Head];
+	in_rewind->Head += in_length;
+	in_rewind->FrameCount++;
+
+	return record;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Drops the oldest record
+/// @param in_rewind Rewind history
+static void emuRewindDropOldest(emuRewindState* in_rewind)
+{
+	const uint8_t* record = &in_rewind->Ring[in_rewind->Tail];
+
+	in_rewind->Tail += emuREWIND_RECORD_HEADER_SIZE + (record[0] | (record[1] << 8)) + (record[2] | (record[3] << 8)) * emuREWIND_PAGE_RECORD_SIZE + emuREWIND_RECORD_FOOTER_SIZE;
+	in_rewind->FrameCount--;
+
+	if (in_rewind->FrameCount == 0)
+	{
+		emuRewindClearHistory(in_rewind);
+	}
+	else
+	{
+		if (in_rewind->Tail == in_rewind->End)
+		{
+			// records continue at the ring start
+			in_rewind->Tail = 0;
+			in_rewind->End = in_rewind->RingSize;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets record length from the record footer
+/// @param in_footer Footer of the record
+/// @return Record length in bytes
+static uint32_t emuRewindGetRecordLength(const uint8_t* in_footer)
+{
+	uint32_t length;
+
+	memcpy(&length, in_footer, sizeof(length));
+
+	return length;
+}
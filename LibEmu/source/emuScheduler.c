@@ -0,0 +1,221 @@
+/*****************************************************************************/
+/* Machine event scheduler (events are timed in CPU cycles)                  */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <emuScheduler.h>
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static bool emuSchedulerIsEarlier(const emuSchedulerEvent* in_event1, const emuSchedulerEvent* in_event2);
+static void emuSchedulerSiftUp(emuSchedulerState* in_scheduler, uint8_t in_index);
+static void emuSchedulerSiftDown(emuSchedulerState* in_scheduler, uint8_t in_index);
+static void emuSchedulerRemove(emuSchedulerState* in_scheduler, uint8_t in_index);
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes scheduler, all pending events are removed
+/// @param in_scheduler Scheduler
+/// @param in_time Current CPU cycle
+void emuSchedulerInitialize(emuSchedulerState* in_scheduler, uint32_t in_time)
+{
+	in_scheduler->EventCount = 0;
+	in_scheduler->Time = in_time;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Schedules event relative to the current time. The pending event with the same ID is rescheduled.
+/// @param in_scheduler Scheduler
+/// @param in_id Event ID
+/// @param in_delay Number of CPU cycles until the event
+/// @return True if the event is scheduled, false if there is no free event slot
+bool emuSchedulerAddEvent(emuSchedulerState* in_scheduler, uint8_t in_id, uint32_t in_delay)
+{
+	return emuSchedulerAddEventAt(in_scheduler, in_id, in_scheduler->Time + in_delay);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Schedules event at the given CPU cycle. The pending event with the same ID is rescheduled.
+/// @param in_scheduler Scheduler
+/// @param in_id Event ID
+/// @param in_time CPU cycle of the event (events in the past are due immediately)
+/// @return True if the event is scheduled, false if there is no free event slot
+bool emuSchedulerAddEventAt(emuSchedulerState* in_scheduler, uint8_t in_id, uint32_t in_time)
+{
+	emuSchedulerCancelEvent(in_scheduler, in_id);
+
+	if (in_scheduler->EventCount >= emuSCHEDULER_MAX_EVENT_COUNT)
+		return false;
+
+	in_scheduler->Events[in_scheduler->EventCount].Time = in_time;
+	in_scheduler->Events[in_scheduler->EventCount].Id = in_id;
+	in_scheduler->EventCount++;
+
+	emuSchedulerSiftUp(in_scheduler, in_scheduler->EventCount - 1);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Removes pending event
+/// @param in_scheduler Scheduler
+/// @param in_id Event ID
+void emuSchedulerCancelEvent(emuSchedulerState* in_scheduler, uint8_t in_id)
+{
+	uint8_t i;
+
+	for (i = 0; i < in_scheduler->EventCount; i++)
+	{
+		if (in_scheduler->Events[i].Id == in_id)
+		{
+			emuSchedulerRemove(in_scheduler, i);
+			return;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Checks if the event is scheduled
+/// @param in_scheduler Scheduler
+/// @param in_id Event ID
+/// @return True if the event is pending
+bool emuSchedulerIsEventPending(emuSchedulerState* in_scheduler, uint8_t in_id)
+{
+	uint8_t i;
+
+	for (i = 0; i < in_scheduler->EventCount; i++)
+	{
+		if (in_scheduler->Events[i].Id == in_id)
+			return true;
+	}
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of CPU cycles to execute until the next event
+/// @param in_scheduler Scheduler
+/// @return Cycles until the next event (zero or negative if the event is due), emuSCHEDULER_NO_EVENT_CYCLES if
+/// there is no pending event
+int32_t emuSchedulerGetCyclesToNextEvent(emuSchedulerState* in_scheduler)
+{
+	if (in_scheduler->EventCount == 0)
+		return emuSCHEDULER_NO_EVENT_CYCLES;
+
+	return (int32_t)(in_scheduler->Events[0].Time - in_scheduler->Time);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Advances the current time by the executed CPU cycles
+/// @param in_scheduler Scheduler
+/// @param in_cycles Number of executed cycles
+void emuSchedulerAdvance(emuSchedulerState* in_scheduler, uint32_t in_cycles)
+{
+	in_scheduler->Time += in_cycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Removes the next event if it is due. Due events are returned in the order of their time.
+/// @param in_scheduler Scheduler
+/// @return ID of the due event, emuSCHEDULER_NO_EVENT if no event is due
+uint8_t emuSchedulerGetDueEvent(emuSchedulerState* in_scheduler)
+{
+	uint8_t id;
+
+	if (in_scheduler->EventCount == 0 || (int32_t)(in_scheduler->Events[0].Time - in_scheduler->Time) > 0)
+		return emuSCHEDULER_NO_EVENT;
+
+	id = in_scheduler->Events[0].Id;
+
+	emuSchedulerRemove(in_scheduler, 0);
+
+	return id;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Compares time of two events (events are within 2^31 cycles)
+/// @param in_event1 First event
+/// @param in_event2 Second event
+/// @return True if the first event is earlier than the second
+static bool emuSchedulerIsEarlier(const emuSchedulerEvent* in_event1, const emuSchedulerEvent* in_event2)
+{
+	return (int32_t)(in_event1->Time - in_event2->Time) < 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Moves event towards the root of the heap until its parent is earlier
+/// @param in_scheduler Scheduler
+/// @param in_index Index of the event
+static void emuSchedulerSiftUp(emuSchedulerState* in_scheduler, uint8_t in_index)
+{
+	emuSchedulerEvent event = in_scheduler->Events[in_index];
+	uint8_t parent;
+
+	while (in_index > 0)
+	{
+		parent = (in_index - 1) / 2;
+
+		if (!emuSchedulerIsEarlier(&event, &in_scheduler->Events[parent]))
+			break;
+
+		in_scheduler->Events[in_index] = in_scheduler->Events[parent];
+		in_index = parent;
+	}
+
+	in_scheduler->Events[in_index] = event;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Moves event towards the leaves of the heap until its children are later
+/// @param in_scheduler Scheduler
+/// @param in_index Index of the event
+static void emuSchedulerSiftDown(emuSchedulerState* in_scheduler, uint8_t in_index)
+{
+	emuSchedulerEvent event = in_scheduler->Events[in_index];
+	uint8_t child;
+
+	while ((child = in_index * 2 + 1) < in_scheduler->EventCount)
+	{
+		// earlier child
+		if (child + 1 < in_scheduler->EventCount && emuSchedulerIsEarlier(&in_scheduler->Events[child + 1], &in_scheduler->Events[child]))
+			child++;
+
+		if (!emuSchedulerIsEarlier(&in_scheduler->Events[child], &event))
+			break;
+
+		in_scheduler->Events[in_index] = in_scheduler->Events[child];
+		in_index = child;
+	}
+
+	in_scheduler->Events[in_index] = event;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Removes event from the heap
+/// @param in_scheduler Scheduler
+/// @param in_index Index of the event to remove
+static void emuSchedulerRemove(emuSchedulerState* in_scheduler, uint8_t in_index)
+{
+	in_scheduler->EventCount--;
+
+	if (in_index == in_scheduler->EventCount)
+		return;
+
+	// the last event takes the place of the removed one
+	in_scheduler->Events[in_index] = in_scheduler->Events[in_scheduler->EventCount];
+
+	emuSchedulerSiftUp(in_scheduler, in_index);
+	emuSchedulerSiftDown(in_scheduler, in_index);
+}
@@ -0,0 +1,469 @@
+/*****************************************************************************/
+/* Machine state snapshot file reader and writer                             */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <emuSnapshot.h>
+#include <string.h>
+
+// snapshot files are memory mapped on POSIX systems
+#if !defined(emuSNAPSHOT_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define emuSNAPSHOT_MMAP
+#endif
+
+#ifdef emuSNAPSHOT_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <stdlib.h>
+#endif
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define emuSNAPSHOT_CHECKSUM_OFFSET 2166136261u
+#define emuSNAPSHOT_CHECKSUM_PRIME 16777619u
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static uint32_t emuSnapshotUpdateChecksum(uint32_t in_checksum, const uint8_t* in_data, uint32_t in_length);
+static uint32_t emuSnapshotGetDWord(const uint8_t* in_data);
+static void emuSnapshotSetDWord(uint8_t* out_data, uint32_t in_value);
+static bool emuSnapshotLoadFile(emuSnapshotReader* in_reader, const char* in_file_name);
+static void emuSnapshotFreeFile(emuSnapshotReader* in_reader);
+
+/*****************************************************************************/
+/* Function implementation - Writer                                          */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Creates snapshot file. Header is written when the writing is finished by emuSnapshotWriteEnd.
+/// @param in_writer Writer to initialize
+/// @param in_file_name Name of the snapshot file
+/// @param in_machine Machine which state is saved
+/// @param in_version Version of the payload layout of the machine
+/// @return True if the file is created
+bool emuSnapshotWriteBegin(emuSnapshotWriter* in_writer, const char* in_file_name, emuSnapshotMachine in_machine, uint8_t in_version)
+{
+	uint8_t header[emuSNAPSHOT_HEADER_SIZE];
+
+	in_writer->Machine = (uint8_t)in_machine;
+	in_writer->Version = in_version;
+	in_writer->Length = 0;
+	in_writer->Checksum = emuSNAPSHOT_CHECKSUM_OFFSET;
+	in_writer->Error = false;
+	in_writer->Memory = NULL;
+	in_writer->MemorySize = 0;
+
+	in_writer->File = fopen(in_file_name, "wb");
+	if (in_writer->File == NULL)
+		return false;
+
+	// placeholder of the header, payload length and checksum is not known yet
+	memset(header, 0, sizeof(header));
+	if (fwrite(header, sizeof(header), 1, in_writer->File) != 1)
+		in_writer->Error = true;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes one byte into the snapshot
+/// @param in_writer Snapshot writer
+/// @param in_value Value to write
+void emuSnapshotWriteByte(emuSnapshotWriter* in_writer, uint8_t in_value)
+{
+	emuSnapshotWriteBlock(in_writer, &in_value, sizeof(in_value));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes 16 bit value into the snapshot (little endian)
+/// @param in_writer Snapshot writer
+/// @param in_value Value to write
+void emuSnapshotWriteWord(emuSnapshotWriter* in_writer, uint16_t in_value)
+{
+	uint8_t data[2];
+
+	data[0] = (uint8_t)in_value;
+	data[1] = (uint8_t)(in_value >> 8);
+
+	emuSnapshotWriteBlock(in_writer, data, sizeof(data));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes 32 bit value into the snapshot (little endian)
+/// @param in_writer Snapshot writer
+/// @param in_value Value to write
+void emuSnapshotWriteDWord(emuSnapshotWriter* in_writer, uint32_t in_value)
+{
+	uint8_t data[4];
+
+	emuSnapshotSetDWord(data, in_value);
+
+	emuSnapshotWriteBlock(in_writer, data, sizeof(data));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes byte array (e.g. memory content) into the snapshot
+/// @param in_writer Snapshot writer
+/// @param in_data Data to write
+/// @param in_length Number of bytes to write
+void emuSnapshotWriteBlock(emuSnapshotWriter* in_writer, const void* in_data, uint32_t in_length)
+{
+	if (in_writer->Error)
+		return;
+
+	// memory snapshot
+	if (in_writer->File == NULL)
+	{
+		if (in_length > in_writer->MemorySize - in_writer->Length)
+		{
+			in_writer->Error = true;
+			return;
+		}
+
+		memcpy(&in_writer->Memory[in_writer->Length], in_data, in_length);
+		in_writer->Length += in_length;
+		return;
+	}
+
+	if (fwrite(in_data, 1, in_length, in_writer->File) != in_length)
+	{
+		in_writer->Error = true;
+		return;
+	}
+
+	in_writer->Checksum = emuSnapshotUpdateChecksum(in_writer->Checksum, (const uint8_t*)in_data, in_length);
+	in_writer->Length += in_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Finishes snapshot writing: updates the header and closes the file
+/// @param in_writer Snapshot writer
+/// @return True if the whole snapshot is written
+bool emuSnapshotWriteEnd(emuSnapshotWriter* in_writer)
+{
+	uint8_t header[emuSNAPSHOT_HEADER_SIZE];
+	bool success = !in_writer->Error;
+
+	// memory snapshot has no header
+	if (in_writer->File == NULL)
+		return success;
+
+	emuSnapshotSetDWord(&header[0], emuSNAPSHOT_FILE_MAGIC);
+	header[4] = (uint8_t)emuSNAPSHOT_FILE_VERSION;
+	header[5] = (uint8_t)(emuSNAPSHOT_FILE_VERSION >> 8);
+	header[6] = in_writer->Machine;
+	header[7] = in_writer->Version;
+	emuSnapshotSetDWord(&header[8], in_writer->Length);
+	emuSnapshotSetDWord(&header[12], in_writer->Checksum);
+
+	if (success)
+		success = (fseek(in_writer->File, 0, SEEK_SET) == 0 && fwrite(header, sizeof(header), 1, in_writer->File) == 1);
+
+	if (fclose(in_writer->File) != 0)
+		success = false;
+
+	in_writer->File = NULL;
+
+	return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Starts writing snapshot payload into memory buffer (e.g. rewind history). No header is written,
+/// the number of bytes stored is available in the Length member of the writer.
+/// @param in_writer Writer to initialize
+/// @param in_buffer Destination buffer
+/// @param in_buffer_size Size of the buffer in bytes
+void emuSnapshotWriteBeginMemory(emuSnapshotWriter* in_writer, uint8_t* in_buffer, uint32_t in_buffer_size)
+{
+	in_writer->File = NULL;
+	in_writer->Memory = in_buffer;
+	in_writer->MemorySize = in_buffer_size;
+	in_writer->Machine = 0;
+	in_writer->Version = 0;
+	in_writer->Length = 0;
+	in_writer->Checksum = emuSNAPSHOT_CHECKSUM_OFFSET;
+	in_writer->Error = false;
+}
+
+/*****************************************************************************/
+/* Function implementation - Reader                                          */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Opens snapshot file and checks its header and payload checksum
+/// @param in_reader Reader to initialize
+/// @param in_file_name Name of the snapshot file
+/// @param in_machine Expected machine
+/// @param in_version Expected payload layout version of the machine
+/// @return True if the file is a valid snapshot of the machine, payload can be read
+bool emuSnapshotReadBegin(emuSnapshotReader* in_reader, const char* in_file_name, emuSnapshotMachine in_machine, uint8_t in_version)
+{
+	const uint8_t* header;
+
+	in_reader->Data = NULL;
+	in_reader->Length = 0;
+	in_reader->Position = 0;
+	in_reader->Error = false;
+
+	if (!emuSnapshotLoadFile(in_reader, in_file_name))
+		return false;
+
+	header = (const uint8_t*)in_reader->Buffer;
+
+	if (in_reader->BufferLength < emuSNAPSHOT_HEADER_SIZE ||
+			emuSnapshotGetDWord(&header[0]) != emuSNAPSHOT_FILE_MAGIC ||
+			(header[4] | (header[5] << 8)) != emuSNAPSHOT_FILE_VERSION ||
+			header[6] != (uint8_t)in_machine || header[7] != in_version ||
+			emuSnapshotGetDWord(&header[8]) != in_reader->BufferLength - emuSNAPSHOT_HEADER_SIZE ||
+			emuSnapshotGetDWord(&header[12]) != emuSnapshotUpdateChecksum(emuSNAPSHOT_CHECKSUM_OFFSET, &header[emuSNAPSHOT_HEADER_SIZE], in_reader->BufferLength - emuSNAPSHOT_HEADER_SIZE))
+	{
+		emuSnapshotFreeFile(in_reader);
+		return false;
+	}
+
+	in_reader->Data = &header[emuSNAPSHOT_HEADER_SIZE];
+	in_reader->Length = in_reader->BufferLength - emuSNAPSHOT_HEADER_SIZE;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads one byte from the snapshot
+/// @param in_reader Snapshot reader
+/// @return Value read (zero when reading beyond the payload)
+uint8_t emuSnapshotReadByte(emuSnapshotReader* in_reader)
+{
+	uint8_t value = 0;
+
+	emuSnapshotReadBlock(in_reader, &value, sizeof(value));
+
+	return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads 16 bit value from the snapshot (little endian)
+/// @param in_reader Snapshot reader
+/// @return Value read (zero when reading beyond the payload)
+uint16_t emuSnapshotReadWord(emuSnapshotReader* in_reader)
+{
+	uint8_t data[2] = { 0, 0 };
+
+	emuSnapshotReadBlock(in_reader, data, sizeof(data));
+
+	return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads 32 bit value from the snapshot (little endian)
+/// @param in_reader Snapshot reader
+/// @return Value read (zero when reading beyond the payload)
+uint32_t emuSnapshotReadDWord(emuSnapshotReader* in_reader)
+{
+	uint8_t data[4] = { 0, 0, 0, 0 };
+
+	emuSnapshotReadBlock(in_reader, data, sizeof(data));
+
+	return emuSnapshotGetDWord(data);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads byte array (e.g. memory content) from the snapshot
+/// @param in_reader Snapshot reader
+/// @param out_data Buffer receiving the data (unchanged when reading beyond the payload)
+/// @param in_length Number of bytes to read
+void emuSnapshotReadBlock(emuSnapshotReader* in_reader, void* out_data, uint32_t in_length)
+{
+	if (in_reader->Error || in_length > in_reader->Length - in_reader->Position)
+	{
+		in_reader->Error = true;
+		return;
+	}
+
+	memcpy(out_data, &in_reader->Data[in_reader->Position], in_length);
+	in_reader->Position += in_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Finishes snapshot reading and releases the file
+/// @param in_reader Snapshot reader
+/// @return True if the whole payload is read without error
+bool emuSnapshotReadEnd(emuSnapshotReader* in_reader)
+{
+	bool success = !in_reader->Error && in_reader->Position == in_reader->Length;
+
+	emuSnapshotFreeFile(in_reader);
+
+	in_reader->Data = NULL;
+	in_reader->Length = 0;
+
+	return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Starts reading snapshot payload stored in memory by a memory snapshot writer
+/// @param in_reader Reader to initialize
+/// @param in_data Payload
+/// @param in_length Payload length in bytes
+void emuSnapshotReadBeginMemory(emuSnapshotReader* in_reader, const uint8_t* in_data, uint32_t in_length)
+{
+	in_reader->Data = in_data;
+	in_reader->Length = in_length;
+	in_reader->Position = 0;
+	in_reader->Error = false;
+	in_reader->Buffer = NULL;
+	in_reader->BufferLength = 0;
+}
+
+/*****************************************************************************/
+/* Local functions                                                           */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Updates checksum (32 bit FNV-1a hash) with the given bytes
+/// @param in_checksum Checksum of the previous bytes
+/// @param in_data Bytes to add
+/// @param in_length Number of bytes
+/// @return Updated checksum
+static uint32_t emuSnapshotUpdateChecksum(uint32_t in_checksum, const uint8_t* in_data, uint32_t in_length)
+{
+	while (in_length > 0)
+	{
+		in_checksum = (in_checksum ^ *in_data++) * emuSNAPSHOT_CHECKSUM_PRIME;
+		in_length--;
+	}
+
+	return in_checksum;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets little endian 32 bit value
+static uint32_t emuSnapshotGetDWord(const uint8_t* in_data)
+{
+	return (uint32_t)in_data[0] | ((uint32_t)in_data[1] << 8) | ((uint32_t)in_data[2] << 16) | ((uint32_t)in_data[3] << 24);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Stores 32 bit value in little endian byte order
+static void emuSnapshotSetDWord(uint8_t* out_data, uint32_t in_value)
+{
+	out_data[0] = (uint8_t)in_value;
+	out_data[1] = (uint8_t)(in_value >> 8);
+	out_data[2] = (uint8_t)(in_value >> 16);
+	out_data[3] = (uint8_t)(in_value >> 24);
+}
+
+#ifdef emuSNAPSHOT_MMAP
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Maps the whole snapshot file into the memory (read only)
+/// @param in_reader Snapshot reader receiving the mapped content
+/// @param in_file_name Name of the snapshot file
+/// @return True if the file is mapped
+static bool emuSnapshotLoadFile(emuSnapshotReader* in_reader, const char* in_file_name)
+{
+	struct stat file_status;
+	void* buffer;
+	int file;
+
+	in_reader->Buffer = NULL;
+	in_reader->BufferLength = 0;
+
+	file = open(in_file_name, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	if (fstat(file, &file_status) != 0 || file_status.st_size < emuSNAPSHOT_HEADER_SIZE || file_status.st_size > INT32_MAX)
+	{
+		close(file);
+		return false;
+	}
+
+	buffer = mmap(NULL, (size_t)file_status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+	// mapping is kept after the file is closed
+	close(file);
+
+	if (buffer == MAP_FAILED)
+		return false;
+
+	in_reader->Buffer = buffer;
+	in_reader->BufferLength = (uint32_t)file_status.st_size;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Unmaps the snapshot file
+/// @param in_reader Snapshot reader
+static void emuSnapshotFreeFile(emuSnapshotReader* in_reader)
+{
+	if (in_reader->Buffer != NULL)
+		munmap(in_reader->Buffer, in_reader->BufferLength);
+
+	in_reader->Buffer = NULL;
+	in_reader->BufferLength = 0;
+}
+
+#else
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads the whole snapshot file into an allocated buffer
+/// @param in_reader Snapshot reader receiving the file content
+/// @param in_file_name Name of the snapshot file
+/// @return True if the file is read
+static bool emuSnapshotLoadFile(emuSnapshotReader* in_reader, const char* in_file_name)
+{
+	FILE* file;
+	long length;
+
+	in_reader->Buffer = NULL;
+	in_reader->BufferLength = 0;
+
+	file = fopen(in_file_name, "rb");
+	if (file == NULL)
+		return false;
+
+	if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < emuSNAPSHOT_HEADER_SIZE || fseek(file, 0, SEEK_SET) != 0)
+	{
+		fclose(file);
+		return false;
+	}
+
+	in_reader->Buffer = malloc((size_t)length);
+	if (in_reader->Buffer != NULL && fread(in_reader->Buffer, (size_t)length, 1, file) == 1)
+	{
+		in_reader->BufferLength = (uint32_t)length;
+	}
+	else
+	{
+		free(in_reader->Buffer);
+		in_reader->Buffer = NULL;
+	}
+
+	fclose(file);
+
+	return in_reader->Buffer != NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Releases the buffer of the snapshot file
+/// @param in_reader Snapshot reader
+static void emuSnapshotFreeFile(emuSnapshotReader* in_reader)
+{
+	free(in_reader->Buffer);
+
+	in_reader->Buffer = NULL;
+	in_reader->BufferLength = 0;
+}
+#endif
@@ -17,7 +17,7 @@
 #include <sysVirtualKeyboardCodes.h>
 #include <cpuZ80.h>
 #include <emuHT1080.h>
-#include <sysHighResTimer.h>
+#include <sysHighresTimer.h>
 #include <sysConfig.h>
 #include <sysTimer.h>
 #include <appSettings.h>
@@ -25,13 +25,22 @@
 #include <fbFileBrowser.h>
 #include <guiBlackAndWhiteGraphics.h>
 #include <fbRenderer.h>
+#ifdef cpuZ80_PROFILER
+#include <stdio.h>
+#endif
+#include <emuScheduler.h>
+#ifdef emuHT1080_REWIND
+#include <emuRewind.h>
+#endif
 
 /*****************************************************************************/
 /* Constants                                                                 */
 /*****************************************************************************/
 #define emuHT1080_MAX_CYCLES_PER_SCANLINE ((emuHT1080_CPU_CLK + emuHT1080_HSYNC_FREQ - 1)/ emuHT1080_HSYNC_FREQ) // rounded up
-#define emuHT1080_KEYBOARD_ROW_COUNT 8
 #define emuHT1080_SCANLINE_IN_US (1000000 / emuHT1080_HSYNC_FREQ)
+#define emuHT1080_CYCLES_PER_FRAME ((emuHT1080_CPU_CLK * emuHT1080_TOTAL_SCANLINE_COUNT) / emuHT1080_HSYNC_FREQ)
+#define emuHT1080_SCREEN_END_CYCLES ((emuHT1080_CPU_CLK * (emuHT1080_SCREEN_HEIGHT_IN_PIXEL + 1)) / emuHT1080_HSYNC_FREQ) // CPU cycles from the frame start to the end of the displayed area
+#define emuHT1080_CYCLES_TO_US(x) ((x) * 1000 / (emuHT1080_CPU_CLK / 1000))
 
 #define emuPORT_FF_MOTOR_ON_MASK (1<<2)
 #define emuPORT_FF_SIGNAL_MASK (3)
@@ -40,54 +49,104 @@
 
 #define emuCAS_CLOCK_PERIOD_MAX 2500 // max clock period length in us for cassette signal analysis
 #define emuCAS_CLOCK_PERIOD_MIN 1500 // min clock period length in us for cassette signal analysis
+#define emuCAS_LOAD_DATA_DELAY 1300 // data bit is sent after this time (in us) from the clock pulse
+#define emuCAS_LOAD_CLOCK_DELAY 2000 // next clock pulse is sent after this time (in us) from the clock pulse
+#define emuCAS_DELAY_TO_CYCLES(x) ((((x) + 1) * (emuHT1080_CPU_CLK / 1000) + 999) / 1000) // CPU cycles when the elapsed time exceeds the delay
+
+#define emuHT1080_PROFILER_REPORT_FILE_NAME "HT1080Profile.txt"
+#define emuHT1080_TRACE_FILE_NAME "HT1080Trace.bin"
+#ifndef emuHT1080_TRACE_RECORD_COUNT
+#define emuHT1080_TRACE_RECORD_COUNT 65536 // must be power of two
+#endif
+#define emuHT1080_SNAPSHOT_FILE_NAME "HT1080Snapshot.bin"
+#define emuHT1080_SNAPSHOT_VERSION 1 // must be incremented when the snapshot content is changed
+
+#ifndef emuHT1080_REWIND_BUFFER_SIZE
+#define emuHT1080_REWIND_BUFFER_SIZE (256 * 1024) // rewind history in bytes
+#endif
+#define emuHT1080_FRAME_TIME (1000000 * emuHT1080_TOTAL_SCANLINE_COUNT / emuHT1080_HSYNC_FREQ) // frame time in us
 
 /*****************************************************************************/
 /* Types                                                                     */
 /*****************************************************************************/
+
+// scheduler event IDs
 typedef enum
 {
-	emuCS_Idle,
-
-	// save states
-	emuCS_SaveStart,
-	emuCS_SaveWaitForMotorStart,
-	emuCS_SaveWaitForClock,
-	emuCS_SaveWaitForData,
-
-	// load states
-	emuCS_LoadStart,
-	emuCS_LoadClock,
-	emuCS_LoadData
-} emuCASState;
+	emuEVENT_SCREEN_END,
+	emuEVENT_VSYNC,
+	emuEVENT_CAS_INPUT
+} emuEventId;
 
 /*****************************************************************************/
 /* Local functions                                                           */
 /*****************************************************************************/
-static uint32_t cpuGetEllapsedTimeSince(uint32_t in_timestamp);
-static uint32_t cpuGetEllapsedTimeSinceInMicrosec(uint32_t in_timestamp);
-static uint32_t cpuGetTimestamp(void);
+static uint32_t cpuGetEllapsedTimeSince(emuHT1080State* in_state, uint32_t in_timestamp);
+static uint32_t cpuGetEllapsedTimeSinceInMicrosec(emuHT1080State* in_state, uint32_t in_timestamp);
+static uint32_t cpuGetTimestamp(emuHT1080State* in_state);
 
 static uint8_t emuPixelToCharacterX(guiCoordinate in_coord);
 static uint8_t emuPixelToCharacterY(guiCoordinate in_coord);
 
 
-static void emuCASMotorOn(void);
-static void emuCASMotorOff(void);
-static void emuCASOut(uint8_t in_pulse);
-static void emuCASIn(void);
+static void emuMapMemory(emuHT1080State* in_state);
+static uint8_t emuPortRead(cpuZ80State* R, uint16_t in_port);
+static void emuPortWrite(cpuZ80State* R, uint16_t in_port, uint8_t in_value);
+
+static void emuCASMotorOn(emuHT1080State* in_state);
+static void emuCASMotorOff(emuHT1080State* in_state);
+static void emuCASOut(emuHT1080State* in_state, uint8_t in_pulse);
+static void emuCASIn(emuHT1080State* in_state);
+static void emuCASScheduleInput(emuHT1080State* in_state);
+
+static void emuRunToNextEvent(emuHT1080State* in_state);
+static void emuHandleEvent(emuHT1080State* in_state, uint8_t in_event);
+static void emuScheduleEvents(emuHT1080State* in_state);
+static void emuScheduleFrame(emuHT1080State* in_state);
+
+#ifdef cpuZ80_PROFILER
+static void emuWriteProfilerReport(void);
+#endif
+#ifdef cpuZ80_TRACE
+static void emuSaveTrace(void);
+#endif
+#ifdef cpuZ80_SNAPSHOT
+static void emuSaveDevices(emuHT1080State* in_state, emuSnapshotWriter* in_writer);
+static void emuLoadDevices(emuHT1080State* in_state, emuSnapshotReader* in_reader);
+static void emuCASAbort(emuHT1080State* in_state);
+#endif
+#ifdef emuHT1080_REWIND
+static uint16_t emuSaveRewindState(emuHT1080State* in_state, uint8_t* out_buffer);
+static void emuResetRewind(emuHT1080State* in_state);
+static void emuPushRewindFrame(emuHT1080State* in_state);
+static bool emuStepBack(emuHT1080State* in_state);
+#endif
 
 
 /*****************************************************************************/
 /* Module variables                                                          */
 /*****************************************************************************/
 
-// RAM
-uint8_t g_ram[emuHT1080_RAM_SIZE];
-uint8_t g_video_ram[emuHT1080_VIDEO_RAM_SIZE];
-uint8_t g_keyboard_ram[emuHT1080_KEYBOARD_ROW_COUNT];
+// state of the displayed computer
+emuHT1080State g_ht1080_state;
 
-// CPU
-cpuZ80State l_cpu;
+#ifdef cpuZ80_PROFILER
+// guest code profiler
+static cpuProfilerState l_profiler;
+#endif
+
+#ifdef cpuZ80_TRACE
+// instruction trace
+static cpuTraceBuffer l_trace;
+static cpuTraceRecord l_trace_records[emuHT1080_TRACE_RECORD_COUNT];
+#endif
+
+#ifdef emuHT1080_REWIND
+// rewind history
+static emuRewindState l_rewind;
+static uint8_t l_rewind_buffer[emuHT1080_REWIND_BUFFER_SIZE];
+static bool l_rewind_requested = false;
+#endif
 
 // external ROM file reference
 extern const unsigned char ht_s1_basic_rom[];
@@ -95,25 +154,8 @@ extern const unsigned char ht_s1_basicexpansion_rom[];
 extern const unsigned char MODEL1_rom[];
 extern const unsigned char level1_rom[];
 
-// timing variables
-static uint32_t l_total_cpu_cycles;
-static int32_t l_current_cycles_per_frame;
-static int l_current_scanline;
-
+// real time synchronization of the displayed computer
 static sysHighresTimestamp l_frame_start_timestamp;
-static uint32_t l_current_scanline_time;
-
-// port mirror variables
-static uint8_t l_out_port_ff = 0;
-static uint8_t l_in_port_ff = 0;
-
-// cassette save variables
-static emuCASState l_cas_state = emuCS_LoadStart;
-static uint8_t l_cas_buffer;
-static uint8_t l_cas_buffer_bit_count = 0;
-static fileStream* l_cas_file = sysNULL;
-static uint32_t l_cas_clock_timestamp;
-static bool l_cas_motor_on = false;
 
 // emulation speed variables
 static uint32_t l_emulation_speed_cpu_cycles;
@@ -137,186 +179,537 @@ uint8_t g_screen_no_refresh_area[emuHT1080_VIDEO_RAM_SIZE];
 /// @brief Initializes HT1080Z Computer
 void emuInitialize(void)
 {
+	emuHT1080InstanceInitialize(&g_ht1080_state);
+	g_ht1080_state.display_enabled = true;
+
 	emuReset();
+
+#ifdef cpuZ80_PROFILER
+	cpuProfilerReset(&l_profiler);
+	cpuZ80AttachProfiler(&g_ht1080_state.cpu, &l_profiler);
+#endif
+
+#ifdef cpuZ80_TRACE
+	cpuTraceInitialize(&l_trace, l_trace_records, emuHT1080_TRACE_RECORD_COUNT);
+	cpuZ80AttachTrace(&g_ht1080_state.cpu, &l_trace);
+#endif
+
+#ifdef emuHT1080_REWIND
+	emuRewindInitialize(&l_rewind, l_rewind_buffer, emuHT1080_REWIND_BUFFER_SIZE);
+	emuRewindAddRegion(&l_rewind, emuHT1080_VIDEO_RAM_START, emuHT1080_VIDEO_RAM_SIZE, g_ht1080_state.video_ram);
+	emuRewindAddRegion(&l_rewind, emuHT1080_RAM_START, emuHT1080_RAM_SIZE, g_ht1080_state.ram);
+	g_ht1080_state.rewind = &l_rewind;
+	emuResetRewind(&g_ht1080_state);
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+	// start from the saved state when it is available
+	emuHT1080InstanceLoadSnapshot(&g_ht1080_state, emuHT1080_SNAPSHOT_FILE_NAME);
+#endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Main emulation task
+/// @brief Main emulation task. The CPU runs directly to the next scheduled event (end of the displayed area,
+/// VSYNC or cassette input change), the code of the events is executed when its real time is reached.
 void emuTask(void)
 {
-	uint16_t cycles_to_execute;
-	uint16_t cycles_executed;
-	int32_t expected_cycle_per_frame;
-	bool full_speed = g_application_settings.FullSpeed || (l_cas_motor_on && g_application_settings.FastCassetteOperation);
-
- 	if (sysHighresTimerGetTimeSince(l_frame_start_timestamp) >= l_current_scanline_time || full_speed)
+	emuHT1080State* state = &g_ht1080_state;
+	uint32_t total_cpu_cycles;
+	uint8_t event;
+	bool full_speed = g_application_settings.FullSpeed || (state->cas_motor_on && g_application_settings.FastCassetteOperation);
+
+#ifdef emuHT1080_REWIND
+	// the computer is rewound instead of emulated while the rewind key is held (one frame in every frame time)
+	if (l_rewind_requested && state->current_cycles_per_frame == 0)
 	{
-		// calculate cycles to execute
-		expected_cycle_per_frame = (emuHT1080_CPU_CLK * (l_current_scanline + 1)) / emuHT1080_HSYNC_FREQ;
-		cycles_to_execute = (uint16_t)(expected_cycle_per_frame - l_current_cycles_per_frame);
-
-		// run CPU
-		cycles_executed = cpuExecute(&l_cpu, cycles_to_execute);
-		l_current_cycles_per_frame += cycles_executed;
-		l_total_cpu_cycles += cycles_executed;
-		l_emulation_speed_cpu_cycles += cycles_executed;
-
-		// render scanline
-		if (l_current_scanline == emuHT1080_SCREEN_HEIGHT_IN_PIXEL)
+		if (sysHighresTimerGetTimeSince(l_frame_start_timestamp) >= emuHT1080_FRAME_TIME)
 		{
-			emuHT1080EndScreenrefresh();
-		}
-
-		// next scanline
-		l_current_scanline++;
-		if (l_current_scanline >= emuHT1080_TOTAL_SCANLINE_COUNT)
-		{
-			// VSYNC -> restart screen rendering
-			l_current_scanline = 0;
-			l_current_cycles_per_frame = 0;
-			l_emulation_speed_vsync_cycles++;
-			emuHT1080StartScreenRefresh();
+			emuStepBack(state);
 			l_frame_start_timestamp = sysHighresTimerGetTimestamp();
-			l_current_scanline_time = 0;
 		}
-
-		// update time
-		l_current_scanline_time = l_current_scanline * 1000000 / emuHT1080_HSYNC_FREQ;
-
-		// handle cas input
-		if (l_cas_state >= emuCS_LoadStart)
-			emuCASIn();
+		return;
 	}
+#endif
 
-#if 0
-	uint8_t free_wave_buffer_index;
-
-	// check if half frame time is ellapsed
-	if(sysHighresTimerGetTimeSince(l_half_frame_timestamp) >= emuINVADERS_FRAME_TIME / 2)
+ 	if (sysHighresTimerGetTimeSince(l_frame_start_timestamp) >= emuHT1080_CYCLES_TO_US(state->current_cycles_per_frame) || full_speed)
 	{
-		l_half_frame_timestamp = sysHighresTimerGetTimestamp();
+		// run CPU until the next event
+		total_cpu_cycles = state->total_cpu_cycles;
+		emuRunToNextEvent(state);
+		l_emulation_speed_cpu_cycles += state->total_cpu_cycles - total_cpu_cycles;
+
+#ifdef cpuZ80_TRACE
+		// trace stopped by breakpoint or illegal opcode
+		if (cpuTraceIsTriggered(&l_trace))
+			emuSaveTrace();
+#endif
 
-		if(l_current_scanline == 0)
+		// handle due events
+		while ((event = emuSchedulerGetDueEvent(&state->scheduler)) != emuSCHEDULER_NO_EVENT)
 		{
-			// reset cycle counter
-			l_cycles_per_frame = 0;
+			emuHandleEvent(state, event);
 
-			// render the first half of the screen
-			while(l_current_scanline  < emuINVADERS_SCREEN_WIDTH / 2)
+			if (event == emuEVENT_VSYNC)
 			{
-				// execute code
-				l_cycles_per_frame += emuINVADERS_CYCLES_PER_LINE;
-				l_cycles_per_frame -= cpuI8080Exec(&l_invaders_cpu, emuINVADERS_CYCLES_PER_LINE);
-
-				// render scanline
-				if(frame == 0)
-					emuInvadersRenderScanLine(l_current_scanline);
+				l_emulation_speed_vsync_cycles++;
+				l_frame_start_timestamp = sysHighresTimerGetTimestamp();
 
-				// next scanline
-				l_current_scanline++;
+#ifdef emuHT1080_REWIND
+				emuPushRewindFrame(state);
+#endif
 			}
-
-			// midscreeninterrupt
-			cpuI8080INT(&l_invaders_cpu, cpuI8080_RST1);
 		}
-		else
-		{
-			// render the second half of the screen
-			while(l_current_scanline  < emuINVADERS_SCREEN_WIDTH)
-			{
-				// execute code
-				l_cycles_per_frame += emuINVADERS_CYCLES_PER_LINE;
-				l_cycles_per_frame -= cpuI8080Exec(&l_invaders_cpu, emuINVADERS_CYCLES_PER_LINE);
+	}
+}
 
-				// render scanline
-				if(frame == 0)
-					emuInvadersRenderScanLine(l_current_scanline);
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reset the computer (cold start)
+void emuReset(void)
+{
+	uint16_t i;
 
-				// next scanline
-				l_current_scanline++;
-			}
+	for (i = 0; i < emuHT1080_VIDEO_RAM_SIZE; i++)
+		g_screen_no_refresh_area[i] = 0;
 
-			if(frame == 2)
-			{
-				frame = 0;
-			}
-			else
-			{
-	//			frame++;
-			}
+	emuHT1080InstanceReset(&g_ht1080_state);
 
+	// init emulation speed variables
+	l_emulation_speed_cpu_cycles = 0;
+	l_emulation_speed_vsync_cycles = 0;
+	g_emulation_speed_cpu_freq = 0;
+	g_emulation_speed_vsync_freq = 0;
+}
 
-			// vsync interrupt
-			cpuI8080INT(&l_invaders_cpu, cpuI8080_RST2);
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Issues NMI (warm reset)
+void emuNMI(void)
+{
+	cpuInt(&g_ht1080_state.cpu, INT_NMI);
+}
 
-			// execure code for the vsync
-			if(l_cycles_per_frame < emuINVADERS_CYCLES_PER_FRAME)
-			{
-				cpuI8080Exec(&l_invaders_cpu, emuINVADERS_CYCLES_PER_FRAME - l_cycles_per_frame);
-			}
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes one emulated computer. The computer is not displayed and it is not bound to the real time.
+/// @param in_state Computer state to initialize
+void emuHT1080InstanceInitialize(emuHT1080State* in_state)
+{
+	uint8_t i;
 
-			// first scanline
-			l_current_scanline = 0;
+	// init ports and keyboard
+	in_state->out_port_ff = 0;
+	in_state->in_port_ff = 0;
+	for (i = 0; i < emuHT1080_KEYBOARD_ROW_COUNT; i++)
+		in_state->keyboard_ram[i] = 0;
 
-			// refresh content of the screen
-			guiRefreshScreen();
-		}
-	}
+	// init cassette interface
+	in_state->cas_state = emuCS_LoadStart;
+	in_state->cas_buffer = 0;
+	in_state->cas_buffer_bit_count = 0;
+	in_state->cas_file = sysNULL;
+	in_state->cas_clock_timestamp = 0;
 
-	// render audio stream
-	free_wave_buffer_index = drvWavePlayerGetFreeBufferIndex();
-	if(free_wave_buffer_index != waveMIXER_INVALID_CHANNEL)
-	{
-		waveMixerRenderStream(l_wave_mixer_info, drvWaveGetBuffer(free_wave_buffer_index), drvWAVEPLAYER_BUFFER_LENGTH);
-		drvWavePlayerPlayBuffer(free_wave_buffer_index);
-	}
+	in_state->display_enabled = false;
+
+#ifdef emuHT1080_REWIND
+	in_state->rewind = sysNULL;
 #endif
+
+	emuHT1080InstanceReset(in_state);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Reset the computer (cold start)
-void emuReset(void)
+/// @brief Cold start of one emulated computer (CPU, RAM, video RAM, timing and cassette file)
+/// @param in_state Computer state
+void emuHT1080InstanceReset(emuHT1080State* in_state)
 {
 	uint16_t i;
 
 	// Reset CPU
-	cpuReset(&l_cpu);
+	cpuReset(&in_state->cpu);
+	in_state->cpu.User = in_state;
+	emuMapMemory(in_state);
 
 	// Clears RAM
 	for (i = 0; i < emuHT1080_RAM_SIZE; i++)
-		g_ram[i] = 0;
+		in_state->ram[i] = 0;
 
 	for (i = 0; i < emuHT1080_VIDEO_RAM_SIZE; i++)
+		in_state->video_ram[i] = 32;
+
+	if (in_state->display_enabled)
 	{
-		g_video_ram[i] = 32;
-		g_screen_no_refresh_area[i] = 0;
-		emuHT1080RenderCharacter(i);
+		for (i = 0; i < emuHT1080_VIDEO_RAM_SIZE; i++)
+			emuHT1080RenderCharacter(i);
 	}
 
 	// init emulation variables
-	l_cas_motor_on = false;
-	l_total_cpu_cycles = 0;
-	l_current_cycles_per_frame = 0;
-	l_current_scanline = 0;
-	l_emulation_speed_cpu_cycles = 0;
-	l_emulation_speed_vsync_cycles = 0;
-	g_emulation_speed_cpu_freq = 0;
-	g_emulation_speed_vsync_freq = 0;
+	in_state->cas_motor_on = false;
+	in_state->total_cpu_cycles = 0;
+	in_state->current_cycles_per_frame = 0;
+	in_state->frame_count = 0;
+	emuScheduleEvents(in_state);
 
-	if (l_cas_file != sysNULL)
+	if (in_state->cas_file != sysNULL)
 	{
-		fileClose(l_cas_file);
-		l_cas_file = sysNULL;
+		fileClose(in_state->cas_file);
+		in_state->cas_file = sysNULL;
 	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Issues NMI (warm reset)
-void emuNMI(void)
+/// @brief Runs one emulated computer for the given number of frames as fast as possible.
+/// Instances are independent, different instances can be stepped from different threads.
+/// @param in_state Computer state
+/// @param in_frame_count Number of frames to emulate
+void emuHT1080InstanceStep(emuHT1080State* in_state, uint32_t in_frame_count)
 {
-	cpuInt(&l_cpu, INT_NMI);
+	uint32_t last_frame = in_state->frame_count + in_frame_count;
+	uint8_t event;
+
+	while (in_state->frame_count != last_frame)
+	{
+		emuRunToNextEvent(in_state);
+
+		while ((event = emuSchedulerGetDueEvent(&in_state->scheduler)) != emuSCHEDULER_NO_EVENT)
+			emuHandleEvent(in_state, event);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sets the pressed keys of the computer
+/// @param in_state Computer state
+/// @param in_keyboard_rows Key bits of the keyboard matrix rows (emuHT1080_KEYBOARD_ROW_COUNT bytes, see the keyboard matrix)
+void emuHT1080InstanceSetKeyboard(emuHT1080State* in_state, const uint8_t* in_keyboard_rows)
+{
+	uint8_t i;
+
+	for (i = 0; i < emuHT1080_KEYBOARD_ROW_COUNT; i++)
+		in_state->keyboard_ram[i] = in_keyboard_rows[i];
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets frame buffer of the computer. It is the character video RAM, 64 bytes per character row.
+/// @param in_state Computer state
+/// @return Pointer to the first byte of the video RAM
+const uint8_t* emuHT1080InstanceGetVideoRAM(emuHT1080State* in_state)
+{
+	return in_state->video_ram;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Runs the CPU of the computer until the next scheduled event
+/// @param in_state Computer state
+static void emuRunToNextEvent(emuHT1080State* in_state)
+{
+	int32_t cycles_to_execute;
+	int cycles_executed;
+
+	cycles_to_execute = emuSchedulerGetCyclesToNextEvent(&in_state->scheduler);
+	if (cycles_to_execute > 0)
+	{
+		cycles_executed = cpuExecute(&in_state->cpu, cycles_to_execute);
+		in_state->current_cycles_per_frame += cycles_executed;
+		in_state->total_cpu_cycles += cycles_executed;
+		emuSchedulerAdvance(&in_state->scheduler, cycles_executed);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Executes a due scheduler event of the computer
+/// @param in_state Computer state
+/// @param in_event Event ID (emuEventId)
+static void emuHandleEvent(emuHT1080State* in_state, uint8_t in_event)
+{
+	switch (in_event)
+	{
+		case emuEVENT_SCREEN_END:
+			if (in_state->display_enabled)
+				emuHT1080EndScreenrefresh();
+			break;
+
+		case emuEVENT_VSYNC:
+			// VSYNC -> restart screen rendering
+			in_state->current_cycles_per_frame = 0;
+			in_state->frame_count++;
+			if (in_state->display_enabled)
+				emuHT1080StartScreenRefresh();
+			emuScheduleFrame(in_state);
+			break;
+
+		case emuEVENT_CAS_INPUT:
+			emuCASIn(in_state);
+			emuCASScheduleInput(in_state);
+			break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reschedules all events after the timing state is changed (reset, snapshot load)
+/// @param in_state Computer state
+static void emuScheduleEvents(emuHT1080State* in_state)
+{
+	emuSchedulerInitialize(&in_state->scheduler, in_state->total_cpu_cycles);
+	emuScheduleFrame(in_state);
+	emuCASScheduleInput(in_state);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Schedules the video events of the rest of the current frame
+/// @param in_state Computer state
+static void emuScheduleFrame(emuHT1080State* in_state)
+{
+	if (in_state->current_cycles_per_frame < emuHT1080_SCREEN_END_CYCLES)
+		emuSchedulerAddEvent(&in_state->scheduler, emuEVENT_SCREEN_END, emuHT1080_SCREEN_END_CYCLES - in_state->current_cycles_per_frame);
+
+	emuSchedulerAddEvent(&in_state->scheduler, emuEVENT_VSYNC, emuHT1080_CYCLES_PER_FRAME - in_state->current_cycles_per_frame);
+}
+
+#ifdef cpuZ80_PROFILER
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes profiler report of the CPU into the report file
+static void emuWriteProfilerReport(void)
+{
+	FILE* file = fopen(emuHT1080_PROFILER_REPORT_FILE_NAME, "w");
+
+	if (file == sysNULL)
+		return;
+
+	cpuZ80ProfilerReport(&g_ht1080_state.cpu, file);
+
+	fclose(file);
+}
+#endif
+
+#ifdef cpuZ80_TRACE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves instruction trace into the trace file and restarts recording
+static void emuSaveTrace(void)
+{
+	cpuTraceSave(&l_trace, emuHT1080_TRACE_FILE_NAME);
+	cpuTraceReset(&l_trace);
+}
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves state of the computer (CPU, RAM, video RAM, port latches, timing and cassette interface) into the snapshot file
+/// @param in_state Computer state
+/// @param in_file_name Name of the snapshot file
+/// @return True if the snapshot is saved
+bool emuHT1080InstanceSaveSnapshot(emuHT1080State* in_state, const char* in_file_name)
+{
+	emuSnapshotWriter writer;
+
+	if (!emuSnapshotWriteBegin(&writer, in_file_name, emuSNAPSHOT_MACHINE_HT1080, emuHT1080_SNAPSHOT_VERSION))
+		return false;
+
+	// CPU and memory
+	cpuZ80SaveState(&in_state->cpu, &writer);
+	emuSnapshotWriteBlock(&writer, in_state->ram, emuHT1080_RAM_SIZE);
+	emuSnapshotWriteBlock(&writer, in_state->video_ram, emuHT1080_VIDEO_RAM_SIZE);
+
+	// port latches, timing and cassette interface
+	emuSaveDevices(in_state, &writer);
+
+	return emuSnapshotWriteEnd(&writer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores state of the computer from the snapshot file. Cassette file position is not stored, transfer in
+/// progress is aborted.
+/// @param in_state Computer state
+/// @param in_file_name Name of the snapshot file
+/// @return True if the state is restored. The state is unchanged when the file is missing or it is not a valid
+/// snapshot, the computer is reset when the snapshot content is inconsistent.
+bool emuHT1080InstanceLoadSnapshot(emuHT1080State* in_state, const char* in_file_name)
+{
+	emuSnapshotReader reader;
+
+	if (!emuSnapshotReadBegin(&reader, in_file_name, emuSNAPSHOT_MACHINE_HT1080, emuHT1080_SNAPSHOT_VERSION))
+		return false;
+
+	// CPU and memory
+	cpuZ80LoadState(&in_state->cpu, &reader);
+	emuSnapshotReadBlock(&reader, in_state->ram, emuHT1080_RAM_SIZE);
+	emuSnapshotReadBlock(&reader, in_state->video_ram, emuHT1080_VIDEO_RAM_SIZE);
+
+	// port latches, timing and cassette interface
+	emuLoadDevices(in_state, &reader);
+
+	if (!emuSnapshotReadEnd(&reader) || in_state->current_cycles_per_frame < 0 || in_state->current_cycles_per_frame >= emuHT1080_CYCLES_PER_FRAME)
+	{
+		emuHT1080InstanceReset(in_state);
+#ifdef emuHT1080_REWIND
+		emuResetRewind(in_state);
+#endif
+		return false;
+	}
+
+	emuCASAbort(in_state);
+	emuScheduleEvents(in_state);
+
+	if (in_state->display_enabled)
+		emuRefreshScreen();
+
+#ifdef emuHT1080_REWIND
+	// history of the replaced state is not valid
+	emuResetRewind(in_state);
+#endif
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves state of the devices (port latches, timing and cassette interface)
+/// @param in_state Computer state
+/// @param in_writer Snapshot writer
+static void emuSaveDevices(emuHT1080State* in_state, emuSnapshotWriter* in_writer)
+{
+	// port latches
+	emuSnapshotWriteByte(in_writer, in_state->out_port_ff);
+	emuSnapshotWriteByte(in_writer, in_state->in_port_ff);
+
+	// timing
+	emuSnapshotWriteDWord(in_writer, in_state->total_cpu_cycles);
+	emuSnapshotWriteDWord(in_writer, (uint32_t)in_state->current_cycles_per_frame);
+	emuSnapshotWriteWord(in_writer, (uint16_t)(in_state->current_cycles_per_frame * emuHT1080_HSYNC_FREQ / emuHT1080_CPU_CLK)); // scanline
+
+	// cassette interface
+	emuSnapshotWriteByte(in_writer, (uint8_t)in_state->cas_state);
+	emuSnapshotWriteByte(in_writer, in_state->cas_buffer);
+	emuSnapshotWriteByte(in_writer, in_state->cas_buffer_bit_count);
+	emuSnapshotWriteByte(in_writer, in_state->cas_motor_on ? 1 : 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores state of the devices
+/// @param in_state Computer state
+/// @param in_reader Snapshot reader
+static void emuLoadDevices(emuHT1080State* in_state, emuSnapshotReader* in_reader)
+{
+	// port latches
+	in_state->out_port_ff = emuSnapshotReadByte(in_reader);
+	in_state->in_port_ff = emuSnapshotReadByte(in_reader);
+
+	// timing
+	in_state->total_cpu_cycles = emuSnapshotReadDWord(in_reader);
+	in_state->current_cycles_per_frame = (int32_t)emuSnapshotReadDWord(in_reader);
+	emuSnapshotReadWord(in_reader); // scanline (events are scheduled by the cycle counter)
+
+	// cassette interface
+	in_state->cas_state = (emuCASState)emuSnapshotReadByte(in_reader);
+	in_state->cas_buffer = emuSnapshotReadByte(in_reader);
+	in_state->cas_buffer_bit_count = emuSnapshotReadByte(in_reader);
+	in_state->cas_motor_on = (emuSnapshotReadByte(in_reader) != 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Aborts cassette transfer of a restored state (cassette file position is not stored)
+/// @param in_state Computer state
+static void emuCASAbort(emuHT1080State* in_state)
+{
+	if (in_state->cas_file != sysNULL)
+	{
+		fileClose(in_state->cas_file);
+		in_state->cas_file = sysNULL;
+	}
+
+	if (in_state->cas_state != emuCS_Idle && in_state->cas_state != emuCS_LoadStart)
+		in_state->cas_state = emuCS_Idle;
+}
+#endif
+
+#ifdef emuHT1080_REWIND
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves CPU and device state (everything except the memory) for the rewind history
+/// @param in_state Computer state
+/// @param out_buffer Buffer receiving the state (emuREWIND_MAX_STATE_SIZE bytes)
+/// @return Length of the state in bytes
+static uint16_t emuSaveRewindState(emuHT1080State* in_state, uint8_t* out_buffer)
+{
+	emuSnapshotWriter writer;
+
+	emuSnapshotWriteBeginMemory(&writer, out_buffer, emuREWIND_MAX_STATE_SIZE);
+
+	cpuZ80SaveState(&in_state->cpu, &writer);
+	emuSaveDevices(in_state, &writer);
+
+	emuSnapshotWriteEnd(&writer);
+
+	return (uint16_t)writer.Length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Drops the rewind history, the current state becomes the oldest state
+/// @param in_state Computer state
+static void emuResetRewind(emuHT1080State* in_state)
+{
+	uint8_t rewind_state[emuREWIND_MAX_STATE_SIZE];
+
+	if (in_state->rewind == sysNULL)
+		return;
+
+	cpuZ80ClearDirtyPages(&in_state->cpu);
+	emuRewindReset(in_state->rewind, rewind_state, emuSaveRewindState(in_state, rewind_state));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Stores the finished frame (pages written during the frame) in the rewind history
+/// @param in_state Computer state
+static void emuPushRewindFrame(emuHT1080State* in_state)
+{
+	uint8_t rewind_state[emuREWIND_MAX_STATE_SIZE];
+
+	if (in_state->rewind == sysNULL)
+		return;
+
+	emuRewindPushFrame(in_state->rewind, cpuZ80GetDirtyPages(&in_state->cpu), rewind_state, emuSaveRewindState(in_state, rewind_state));
+	cpuZ80ClearDirtyPages(&in_state->cpu);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores the state of the previous frame from the rewind history. Run-ahead is also possible by
+/// emulating some frames and stepping them back.
+/// @param in_state Computer state
+/// @return True if the state is restored, false if the history is empty
+static bool emuStepBack(emuHT1080State* in_state)
+{
+	uint8_t rewind_state[emuREWIND_MAX_STATE_SIZE];
+	uint16_t rewind_state_length;
+	cpuDirtyPageBitmap restored_pages;
+	emuSnapshotReader reader;
+	uint16_t address;
+
+	if (in_state->rewind == sysNULL)
+		return false;
+
+	cpuDirtyPagesClear(&restored_pages);
+
+	if (!emuRewindStepBack(in_state->rewind, rewind_state, &rewind_state_length, &restored_pages))
+		return false;
+
+	emuSnapshotReadBeginMemory(&reader, rewind_state, rewind_state_length);
+	cpuZ80LoadState(&in_state->cpu, &reader);
+	emuLoadDevices(in_state, &reader);
+	emuCASAbort(in_state);
+	emuScheduleEvents(in_state);
+
+	// redraw the screen when the video RAM is restored
+	if (in_state->display_enabled)
+	{
+		for (address = emuHT1080_VIDEO_RAM_START; address < emuHT1080_VIDEO_RAM_START + emuHT1080_VIDEO_RAM_SIZE; address += cpuDIRTY_PAGE_SIZE)
+		{
+			if (cpuDirtyPagesTest(&restored_pages, (uint8_t)(address >> cpuDIRTY_PAGE_SHIFT)))
+			{
+				emuRefreshScreen();
+				break;
+			}
+		}
+	}
+
+	return emuSnapshotReadEnd(&reader);
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Defines an area where emulation screen refresh is prohibited
 /// @param in_left Left character coorindate of the area (inclusive)
@@ -473,92 +866,122 @@ void emuRefreshScreen(void)
 ****************************************************************************/
 
 //--------------------------------------------------------------
-// Memory write
+// Converts the value written to the video RAM to the stored
+// character code (bit 6 is not implemented in the video RAM)
 //--------------------------------------------------------------
-void cpuMemWrite(register uint16_t in_address, register uint8_t in_value)
+static uint8_t emuVideoRAMCharacter(uint8_t in_value)
 {
-	// write RAM
-	if (in_address >= emuHT1080_RAM_START)
+	// character display
+	if ((in_value & 0x40) == 0)
 	{
-		g_ram[in_address - emuHT1080_RAM_START] = in_value;
-		if (in_address == 27686)
-			in_address = 27686;
-		return;
+		if ((in_value & 0xa0) == 0)
+			in_value |= 0x40;
 	}
 
-	// write video ram
-	if (in_address >= emuHT1080_VIDEO_RAM_START)
+	return in_value;
+}
+
+//--------------------------------------------------------------
+// Video RAM write (memory mapped I/O handler)
+//--------------------------------------------------------------
+static void emuVideoRAMWrite(cpuZ80State* R, uint16_t in_address, uint8_t in_value)
+{
+	emuHT1080State* state = (emuHT1080State*)R->User;
+
+	in_address -= emuHT1080_VIDEO_RAM_START;
+	in_value = emuVideoRAMCharacter(in_value);
+
+	if(state->video_ram[in_address] != in_value)
 	{
-		// character display
-		//if ((in_value & 0xa0) != 0)
-		//	in_value &= 0xbf;
-		//else
-		//	in_value |= 0x40;
-		
-		//if (in_value < 32)
-		//	in_value |= 0x40;
-
-		if ((in_value & 0x40) == 0)
-		{
-			if ((in_value & 0xa0) == 0)
-				in_value |= 0x40;
-		}
+		state->video_ram[in_address] = in_value;
+		if (state->display_enabled)
+			emuHT1080RenderCharacter(in_address);
+	}
+}
+
+//--------------------------------------------------------------
+// Video RAM block write (LDIR/LDDR to the video RAM). The block
+// is stored first and the changed characters are collected,
+// then they are rendered in one pass.
+//--------------------------------------------------------------
+static void emuVideoRAMBlockWrite(cpuZ80State* R, uint16_t in_address, const uint8_t* in_data, uint16_t in_length)
+{
+	emuHT1080State* state = (emuHT1080State*)R->User;
+	uint64_t dirty_rows[emuHT1080_SCREEN_HEIGHT_IN_CHARACTER];
+	bool dirty = false;
+	uint8_t value;
+	uint16_t i;
+
+	for (i = 0; i < emuHT1080_SCREEN_HEIGHT_IN_CHARACTER; i++)
+		dirty_rows[i] = 0;
+
+	in_address -= emuHT1080_VIDEO_RAM_START;
+
+	for (i = 0; i < in_length; i++, in_address++)
+	{
+		value = emuVideoRAMCharacter(in_data[i]);
 
-		if(g_video_ram[in_address - emuHT1080_VIDEO_RAM_START] != in_value)
+		if (state->video_ram[in_address] != value)
 		{
-			g_video_ram[in_address - emuHT1080_VIDEO_RAM_START] = in_value;
-			emuHT1080RenderCharacter(in_address - emuHT1080_VIDEO_RAM_START);
+			state->video_ram[in_address] = value;
+			dirty_rows[in_address / emuHT1080_SCREEN_WIDTH_IN_CHARACTER] |= (uint64_t)1 << (in_address % emuHT1080_SCREEN_WIDTH_IN_CHARACTER);
+			dirty = true;
 		}
-		return;
 	}
 
-	// write to other area (e.g. ROM) is useless
+	if (dirty && state->display_enabled)
+		emuHT1080RenderDirtyCharacters(dirty_rows);
 }
 
 //--------------------------------------------------------------
-// Memory read
+// Keyboard read (memory mapped I/O handler)
 //--------------------------------------------------------------
-uint8_t cpuMemRead(register uint16_t in_address)
+static uint8_t emuKeyboardRead(cpuZ80State* R, uint16_t in_address)
 {
+	emuHT1080State* state = (emuHT1080State*)R->User;
 	uint8_t data;
 	uint8_t i;
 
-	// read RAM
-	if (in_address >= emuHT1080_RAM_START)
-		return g_ram[in_address - emuHT1080_RAM_START];
-
-	// read ROM
-	if (in_address < emuHT1080_ROM_SIZE)
-		return  ht_s1_basic_rom[in_address];//MODEL1_rom[in_address]; //level1_rom[in_address];  ht_s1_basic_rom[in_address];
+	data = 0;
 
-	if (in_address >= emuHT1080_KEYBOARD_START)
+	//  emulate wired or of keyboard rows
+	for (i = 0; i < emuHT1080_KEYBOARD_ROW_COUNT; i++)
 	{
-		if (in_address >= emuHT1080_VIDEO_RAM_START)
+		if ((in_address & (1 << i)) != 0)
 		{
-			// video RAM
-			return g_video_ram[in_address - emuHT1080_VIDEO_RAM_START];
+			data |= state->keyboard_ram[i];
 		}
-		else
-		{
-			data = 0;
+	}
 
-			//  emulate wired or of keyboard rows
-			for (i = 0; i < 8; i++)
-			{
-				if ((in_address & (1 << i)) != 0)
-				{
-					data |= g_keyboard_ram[i];
-				}
-			}
+	return data;
+}
 
-			return data;
-		}
-	}
-	else
-	{
-		// expansion ROM
-		return ht_s1_basicexpansion_rom[in_address - emuHT1080_EXTENSION_ROM_START];
-	}
+//--------------------------------------------------------------
+// Sets up CPU memory map
+//--------------------------------------------------------------
+static void emuMapMemory(emuHT1080State* in_state)
+{
+	cpuZ80State* R = &in_state->cpu;
+
+	cpuZ80MemoryMapReset(R);
+
+	// ROMs (writes are ignored)
+	cpuZ80MapMemory(R, 0, emuHT1080_ROM_SIZE, ht_s1_basic_rom, sysNULL);
+	cpuZ80MapMemory(R, emuHT1080_EXTENSION_ROM_START, emuHT1080_EXTENSION_ROM_SIZE, ht_s1_basicexpansion_rom, sysNULL);
+
+	// keyboard
+	cpuZ80MapHandler(R, emuHT1080_KEYBOARD_START, emuHT1080_VIDEO_RAM_START - emuHT1080_KEYBOARD_START, emuKeyboardRead, sysNULL);
+
+	// video RAM: direct read, writes are routed to the renderer
+	cpuZ80MapMemory(R, emuHT1080_VIDEO_RAM_START, emuHT1080_VIDEO_RAM_SIZE, in_state->video_ram, sysNULL);
+	cpuZ80MapHandler(R, emuHT1080_VIDEO_RAM_START, emuHT1080_VIDEO_RAM_SIZE, sysNULL, emuVideoRAMWrite);
+	cpuZ80MapBlockWriteHandler(R, emuHT1080_VIDEO_RAM_START, emuHT1080_VIDEO_RAM_SIZE, emuVideoRAMBlockWrite);
+
+	// RAM
+	cpuZ80MapMemory(R, emuHT1080_RAM_START, emuHT1080_RAM_SIZE, in_state->ram, in_state->ram);
+
+	// I/O ports
+	cpuZ80SetPortHandlers(R, emuPortRead, emuPortWrite);
 }
 #pragma endregion
 
@@ -570,14 +993,15 @@ uint8_t cpuMemRead(register uint16_t in_address)
 //--------------------------------------------------------------
 // Port read
 //--------------------------------------------------------------
-uint8_t cpuIn(register uint16_t in_port)
+static uint8_t emuPortRead(cpuZ80State* R, uint16_t in_port)
 {
+  emuHT1080State* state = (emuHT1080State*)R->User;
   uint8_t retval = 0xff;
 
   switch(in_port & 0xff)
   {
     case 0xff:
-      retval = l_in_port_ff;
+      retval = state->in_port_ff;
       break;
   }
 
@@ -587,31 +1011,33 @@ uint8_t cpuIn(register uint16_t in_port)
 //--------------------------------------------------------------
 // Port write
 //--------------------------------------------------------------
-void cpuOut(register uint16_t in_port, register uint8_t in_value)
+static void emuPortWrite(cpuZ80State* R, uint16_t in_port, uint8_t in_value)
 {
+	emuHT1080State* state = (emuHT1080State*)R->User;
+
 	switch (in_port & 0xff)
 	{
 		case 0xff:
 			// check for motor state change
-			if (((l_out_port_ff ^ in_value) & emuPORT_FF_MOTOR_ON_MASK) != 0)
+			if (((state->out_port_ff ^ in_value) & emuPORT_FF_MOTOR_ON_MASK) != 0)
 			{
 				// motor status changed, check new status
 				if ((in_value & emuPORT_FF_MOTOR_ON_MASK) != 0)
 				{
-					emuCASMotorOn();
+					emuCASMotorOn(state);
 				}
 				else
 				{
-					emuCASMotorOff();
+					emuCASMotorOff(state);
 				}
 			}
 
 			// check signal value
-			if (((l_out_port_ff ^ in_value) & emuPORT_FF_SIGNAL_MASK) != 0)
+			if (((state->out_port_ff ^ in_value) & emuPORT_FF_SIGNAL_MASK) != 0)
 			{
 				if ((in_value & emuPORT_FF_MOTOR_ON_MASK) != 0)
 				{
-					emuCASOut(in_value & emuPORT_FF_SIGNAL_MASK);
+					emuCASOut(state, in_value & emuPORT_FF_SIGNAL_MASK);
 				}
 				else
 				{
@@ -619,10 +1045,10 @@ void cpuOut(register uint16_t in_port, register uint8_t in_value)
 			}
 
 			// port write clears input value
-			l_in_port_ff &= ~emuPORT_FF_INPUT_MASK;
+			state->in_port_ff &= ~emuPORT_FF_INPUT_MASK;
 
 			// store port value
-			l_out_port_ff = in_value;
+			state->out_port_ff = in_value;
 		break;
 
 		case 0xfe:
@@ -854,14 +1280,54 @@ void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategor
 				case sysVKC_SPECIAL_KEY_FLAG | sysVKC_END:
 					keyboard_table_entry = KTE(6, 1, KTE_NO_MOD);
 					break;
+
+#ifdef cpuZ80_PROFILER
+				// write profiler report
+				case sysVKC_F12:
+					if (pressed)
+						emuWriteProfilerReport();
+					break;
+#endif
+
+#ifdef emuHT1080_REWIND
+				// rewind while the key is held
+				case sysVKC_F8:
+					l_rewind_requested = pressed;
+					break;
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+				// save computer state
+				case sysVKC_F9:
+					if (pressed)
+						emuHT1080InstanceSaveSnapshot(&g_ht1080_state, emuHT1080_SNAPSHOT_FILE_NAME);
+					break;
+
+				// restore computer state
+				case sysVKC_F10:
+					if (pressed)
+						emuHT1080InstanceLoadSnapshot(&g_ht1080_state, emuHT1080_SNAPSHOT_FILE_NAME);
+					break;
+#endif
+
+#ifdef cpuZ80_TRACE
+				// save instruction trace
+				case sysVKC_F11:
+					if (pressed)
+					{
+						cpuTraceStop(&l_trace, cpuTRACE_TRIGGER_USER, g_ht1080_state.cpu.PC.W);
+						emuSaveTrace();
+					}
+					break;
+#endif
 			}
 		}
 
 		// set actual modifier state
 		if ((current_modifiers & sysMS_SHIFT) == 0)
-			g_keyboard_ram[7] &= ~1;
+			g_ht1080_state.keyboard_ram[7] &= ~1;
 		else
-			g_keyboard_ram[7] |= 1;
+			g_ht1080_state.keyboard_ram[7] |= 1;
 
 		// process entry
 		modifier = GET_MOD(keyboard_table_entry);
@@ -883,21 +1349,21 @@ void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategor
 
 						// force shift on
 					case KTE_SHIFT_ON:
-						g_keyboard_ram[7] |= 1;
+						g_ht1080_state.keyboard_ram[7] |= 1;
 						break;
 
 						// force shift off
 					case KTE_SHIFT_OFF:
-						g_keyboard_ram[7] &= ~1;
+						g_ht1080_state.keyboard_ram[7] &= ~1;
 						break;
 				}
 
 				// store key data
-				g_keyboard_ram[row] |= (1 << bit);
+				g_ht1080_state.keyboard_ram[row] |= (1 << bit);
 			}
 			else
 			{
-				g_keyboard_ram[row] &= ~(1 << bit);
+				g_ht1080_state.keyboard_ram[row] &= ~(1 << bit);
 			}
 		}
 	}
@@ -912,30 +1378,33 @@ void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategor
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Gets current CPU timestamp in cycle count
-static uint32_t cpuGetTimestamp(void)
+/// @param in_state Computer state
+static uint32_t cpuGetTimestamp(emuHT1080State* in_state)
 {
-	return l_total_cpu_cycles + l_cpu.ICount;
+	return in_state->total_cpu_cycles + in_state->cpu.ICount;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Gets elapsed CPU time since the given timestamp
+/// @param in_state Computer state
 /// @param in_timestamp CPU cycle timestamp to calculate time from
 /// @return Elapsed cycle count
-static uint32_t cpuGetEllapsedTimeSince(uint32_t in_timestamp)
+static uint32_t cpuGetEllapsedTimeSince(emuHT1080State* in_state, uint32_t in_timestamp)
 {
-	uint32_t total_cpu_cycles = l_total_cpu_cycles + l_cpu.ICount;
+	uint32_t total_cpu_cycles = in_state->total_cpu_cycles + in_state->cpu.ICount;
 
 	return total_cpu_cycles - in_timestamp;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Gets elapsed CPU time since the given timestamp in microsec (ellapsed time should be less than 4sec for the correct operation)
+/// @param in_state Computer state
 /// @param in_timestamp CPU cycle timestamp to calculate time from
 /// @return Elapsed time in microsec
-static uint32_t cpuGetEllapsedTimeSinceInMicrosec(uint32_t in_timestamp)
+static uint32_t cpuGetEllapsedTimeSinceInMicrosec(emuHT1080State* in_state, uint32_t in_timestamp)
 {
-	uint32_t ellapsed_cycles = l_total_cpu_cycles + l_cpu.ICount - in_timestamp;
+	uint32_t ellapsed_cycles = in_state->total_cpu_cycles + in_state->cpu.ICount - in_timestamp;
 
 	return ellapsed_cycles * 1000 / (emuHT1080_CPU_CLK / 1000);
 }
@@ -949,133 +1418,142 @@ static uint32_t cpuGetEllapsedTimeSinceInMicrosec(uint32_t in_timestamp)
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Handles cassette motor on operation
-static void emuCASMotorOn(void)
+/// @param in_state Computer state
+static void emuCASMotorOn(emuHT1080State* in_state)
 {
-	switch (l_cas_state)
+	switch (in_state->cas_state)
 	{
 		case emuCS_Idle:
 		case emuCS_LoadStart:
 			// open cas file if it is not opened
-			if(l_cas_file == sysNULL)
-				l_cas_file = fileOpen(g_application_settings.CassetteFileName, "rb");
+			if(in_state->cas_file == sysNULL)
+				in_state->cas_file = fileOpen(g_application_settings.CassetteFileName, "rb");
 
-			if (l_cas_file != sysNULL)
+			if (in_state->cas_file != sysNULL)
 			{
 				// read first byte and initialize loading
-				fileRead(&l_cas_buffer, sizeof(l_cas_buffer), 1, l_cas_file);
-				l_cas_clock_timestamp = cpuGetTimestamp();
-				l_in_port_ff &= ~emuPORT_FF_INPUT_MASK; // clock pulse
-				l_cas_buffer_bit_count = 8;
-				l_cas_state = emuCS_LoadData;
+				fileRead(&in_state->cas_buffer, sizeof(in_state->cas_buffer), 1, in_state->cas_file);
+				in_state->cas_clock_timestamp = cpuGetTimestamp(in_state);
+				in_state->in_port_ff &= ~emuPORT_FF_INPUT_MASK; // clock pulse
+				in_state->cas_buffer_bit_count = 8;
+				in_state->cas_state = emuCS_LoadData;
 			}
 			else
 			{
-				l_cas_state = emuCS_Idle;
+				in_state->cas_state = emuCS_Idle;
 			}
 			break;
 
 		case emuCS_SaveStart:
 			// create file
-			l_cas_file = fileOpen("test.cas", "wb");
+			in_state->cas_file = fileOpen("test.cas", "wb");
 
 			// start data decoding
-			l_cas_state = emuCS_SaveWaitForClock;
-			l_cas_buffer_bit_count = 0;
-			l_cas_buffer = 0;
+			in_state->cas_state = emuCS_SaveWaitForClock;
+			in_state->cas_buffer_bit_count = 0;
+			in_state->cas_buffer = 0;
 
 			break;
 	}
 
 	// handle fast cassette operation
-	if (g_application_settings.FastCassetteOperation)
+	if (in_state->display_enabled && g_application_settings.FastCassetteOperation)
 	{
 		emuWaitIndicatorShow();
 	}
 
-	l_cas_motor_on = true;
+	in_state->cas_motor_on = true;
+
+	emuCASScheduleInput(in_state);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Handles motor off operaton of casette operation
-static void emuCASMotorOff(void)
+/// @param in_state Computer state
+static void emuCASMotorOff(emuHT1080State* in_state)
 {
-	switch (l_cas_state)
+	switch (in_state->cas_state)
 	{
 		case emuCS_SaveWaitForData:
-			if (l_cas_buffer_bit_count > 0)
+			if (in_state->cas_buffer_bit_count > 0)
 			{
-				l_cas_buffer <<= 8 - l_cas_buffer_bit_count;
-				fileWrite(&l_cas_buffer, sizeof(l_cas_buffer), 1, l_cas_file);
+				in_state->cas_buffer <<= 8 - in_state->cas_buffer_bit_count;
+				fileWrite(&in_state->cas_buffer, sizeof(in_state->cas_buffer), 1, in_state->cas_file);
 			}
 
-			fileClose(l_cas_file);
-			l_cas_file = sysNULL;
+			fileClose(in_state->cas_file);
+			in_state->cas_file = sysNULL;
 			break;
 	}
 
-	l_cas_motor_on = false;
-	l_cas_state = emuCS_Idle;
+	in_state->cas_motor_on = false;
+	in_state->cas_state = emuCS_Idle;
+	emuCASScheduleInput(in_state);
 
-	emuWaitIndicatorHide();
-	emuRefreshScreen();
+	if (in_state->display_enabled)
+	{
+		emuWaitIndicatorHide();
+		emuRefreshScreen();
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Handles cassette output pulse (save)
+/// @param in_state Computer state
 /// @param in_pulse Pulse state 0 - zero, 2 - minus, 1,3 - plus pulse level
-static void emuCASOut(uint8_t in_pulse)
+static void emuCASOut(emuHT1080State* in_state, uint8_t in_pulse)
 {
 	// do nothing when cas interface is idle
-	if (l_cas_state == emuCS_Idle)
+	if (in_state->cas_state == emuCS_Idle)
 		return;
 
 	// handle only positive pulse
 	if (in_pulse == 1)
 	{
-		uint32_t pulse_length = cpuGetEllapsedTimeSinceInMicrosec(l_cas_clock_timestamp);
+		uint32_t pulse_length = cpuGetEllapsedTimeSinceInMicrosec(in_state, in_state->cas_clock_timestamp);
 
 		if (pulse_length < emuCAS_CLOCK_PERIOD_MAX)
 		{
 			// valid pulse detected
-			if (l_cas_state == emuCS_SaveWaitForData)
+			if (in_state->cas_state == emuCS_SaveWaitForData)
 			{
 				// insert new bit into the save buffer
-				l_cas_buffer <<= 1;
+				in_state->cas_buffer <<= 1;
 
 				// check for data/clock pulse
 				if (pulse_length < emuCAS_CLOCK_PERIOD_MIN)
 				{
 					// data pulse received
-					l_cas_buffer |= 1;
-					l_cas_state = emuCS_SaveWaitForClock;
+					in_state->cas_buffer |= 1;
+					in_state->cas_state = emuCS_SaveWaitForClock;
 				}
 				else
 				{
 					// there was no data pulse, this is the next clock pulse
-					l_cas_state = emuCS_SaveWaitForData;
-					l_cas_clock_timestamp = cpuGetTimestamp();
+					in_state->cas_state = emuCS_SaveWaitForData;
+					in_state->cas_clock_timestamp = cpuGetTimestamp(in_state);
 				}
 
 				// increment bit count and handle when all bits of byte is received
-				l_cas_buffer_bit_count++;
-				if (l_cas_buffer_bit_count >= 8)
+				in_state->cas_buffer_bit_count++;
+				if (in_state->cas_buffer_bit_count >= 8)
 				{
-					fileWrite(&l_cas_buffer, sizeof(l_cas_buffer), 1, l_cas_file);
-					l_cas_buffer_bit_count = 0;
+					fileWrite(&in_state->cas_buffer, sizeof(in_state->cas_buffer), 1, in_state->cas_file);
+					in_state->cas_buffer_bit_count = 0;
 				}
 			}
 			else
 			{
 				// clock detected wait for data
-				l_cas_state = emuCS_SaveWaitForData;
-				l_cas_clock_timestamp = cpuGetTimestamp();
+				in_state->cas_state = emuCS_SaveWaitForData;
+				in_state->cas_clock_timestamp = cpuGetTimestamp(in_state);
 			}
 		}
 		else
 		{
 			// first clock pulse received 
-			l_cas_clock_timestamp = cpuGetTimestamp();
-			l_cas_state = emuCS_SaveWaitForData;
+			in_state->cas_clock_timestamp = cpuGetTimestamp(in_state);
+			in_state->cas_state = emuCS_SaveWaitForData;
 		}
 	}
 }
@@ -1083,58 +1561,86 @@ static void emuCASOut(uint8_t in_pulse)
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Handles cassette input pulse (load)
-static void emuCASIn(void)
+/// @param in_state Computer state
+static void emuCASIn(emuHT1080State* in_state)
 {
 	uint32_t ellapsed_time_since_clock;
 
-	if (l_cas_state <= emuCS_LoadStart)
+	if (in_state->cas_state <= emuCS_LoadStart)
 		return;
 
 	// update busy indicator
-	if(g_application_settings.FastCassetteOperation)
+	if(in_state->display_enabled && g_application_settings.FastCassetteOperation)
 		fbWaitIndicatorUpdate();
 
 	// time since clock pulse
-	ellapsed_time_since_clock = cpuGetEllapsedTimeSinceInMicrosec(l_cas_clock_timestamp);
+	ellapsed_time_since_clock = cpuGetEllapsedTimeSinceInMicrosec(in_state, in_state->cas_clock_timestamp);
 
-	switch (l_cas_state)
+	switch (in_state->cas_state)
 	{
 		case emuCS_LoadClock:
 			// handle data
-			if (ellapsed_time_since_clock > 1300)
+			if (ellapsed_time_since_clock > emuCAS_LOAD_DATA_DELAY)
 			{
-				if ((l_cas_buffer & 0x80) != 0)
-					l_in_port_ff |= emuPORT_FF_INPUT_MASK;
+				if ((in_state->cas_buffer & 0x80) != 0)
+					in_state->in_port_ff |= emuPORT_FF_INPUT_MASK;
 
-				l_cas_buffer <<= 1;
-				l_cas_buffer_bit_count--;
-				if (l_cas_buffer_bit_count == 0)
+				in_state->cas_buffer <<= 1;
+				in_state->cas_buffer_bit_count--;
+				if (in_state->cas_buffer_bit_count == 0)
 				{
-					if (l_cas_file != sysNULL)
+					if (in_state->cas_file != sysNULL)
 					{
-						if (fileRead(&l_cas_buffer, sizeof(l_cas_buffer), 1, l_cas_file) != 1)
+						if (fileRead(&in_state->cas_buffer, sizeof(in_state->cas_buffer), 1, in_state->cas_file) != 1)
 						{
-							l_cas_buffer = 0;
-							fileClose(l_cas_file);
-							l_cas_file = sysNULL;
+							in_state->cas_buffer = 0;
+							fileClose(in_state->cas_file);
+							in_state->cas_file = sysNULL;
 						}
 					}
-					l_cas_buffer_bit_count = 8;
+					in_state->cas_buffer_bit_count = 8;
 				}
 
-				l_cas_state = emuCS_LoadData;
+				in_state->cas_state = emuCS_LoadData;
 			}
 			break;
 
 		case emuCS_LoadData:
 			// data loaded -> handle clock
-			if (ellapsed_time_since_clock > 2000)
+			if (ellapsed_time_since_clock > emuCAS_LOAD_CLOCK_DELAY)
 			{
-				l_cas_clock_timestamp = cpuGetTimestamp();
-				l_in_port_ff |= emuPORT_FF_INPUT_MASK;
-				l_cas_state = emuCS_LoadClock;
+				in_state->cas_clock_timestamp = cpuGetTimestamp(in_state);
+				in_state->in_port_ff |= emuPORT_FF_INPUT_MASK;
+				in_state->cas_state = emuCS_LoadClock;
 			}
 			break;
 	}
 }
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Schedules the next change of the cassette input signal while loading is in progress. The running CPU
+/// execution is stopped at the event when it is called from an I/O handler.
+/// @param in_state Computer state
+static void emuCASScheduleInput(emuHT1080State* in_state)
+{
+	uint32_t event_time;
+
+	switch (in_state->cas_state)
+	{
+		case emuCS_LoadClock:
+			event_time = in_state->cas_clock_timestamp + emuCAS_DELAY_TO_CYCLES(emuCAS_LOAD_DATA_DELAY);
+			break;
+
+		case emuCS_LoadData:
+			event_time = in_state->cas_clock_timestamp + emuCAS_DELAY_TO_CYCLES(emuCAS_LOAD_CLOCK_DELAY);
+			break;
+
+		default:
+			emuSchedulerCancelEvent(&in_state->scheduler, emuEVENT_CAS_INPUT);
+			return;
+	}
+
+	emuSchedulerAddEventAt(&in_state->scheduler, emuEVENT_CAS_INPUT, event_time);
+	cpuZ80EndExecute(&in_state->cpu, (int32_t)(event_time - in_state->total_cpu_cycles));
+}
 #pragma endregion
@@ -16,24 +16,35 @@
 #include <sysUserInput.h>
 #include <sysVirtualKeyboardCodes.h>
 #include <cpuZ80.h>
-#include <emuHomelab.h>
-#include <sysHighResTimer.h>
+#include <emuHomeLab.h>
+#include <sysHighresTimer.h>
 #include <sysConfig.h>
 #include <appSettings.h>
 #include <cpCodePages.h>
+#include <emuScheduler.h>
 
 #include <fbFileBrowser.h>
+#ifdef cpuZ80_PROFILER
+#include <stdio.h>
+#endif
 
 /*****************************************************************************/
 /* Constants                                                                 */
 /*****************************************************************************/
 #define emuHomelab_MAX_CYCLES_PER_SCANLINE ((emuHomelab_CPU_CLK + emuHomelab_HSYNC_FREQ - 1)/ emuHomelab_HSYNC_FREQ) // rounded up
 #define emuHomelab_SCANLINE_IN_US (1000000 / emuHomelab_HSYNC_FREQ)
+#define emuHomelab_CYCLES_PER_FRAME ((emuHomelab_CPU_CLK * emuHomelab_TOTAL_SCANLINE_COUNT) / emuHomelab_HSYNC_FREQ)
+#define emuHomelab_VSYNC_START_CYCLES ((emuHomelab_CPU_CLK * (emuHomelab_SCREEN_HEIGHT_IN_PIXEL + 1)) / emuHomelab_HSYNC_FREQ) // CPU cycles from the frame start to the VSYNC signal
+#define emuHomelab_CYCLES_TO_US(x) ((x) * 1000 / (emuHomelab_CPU_CLK / 1000))
 
 #define emuHomelab_KEYBOARD_ROW_COUNT 32	// 16 row but it is used as lower/upper nibble
 #define emuHomelab_VSYNC_INDEX 2					// vsync byte index wihthin keyboard RAM
 #define emuHomelab_VSYNC_BIT_INDEX 0			// vsync bit index within keyboiard ram byte
 
+#define emuHomelab_RAM_D_STORAGE 0x0000		// RAM D is stored in the part of g_ram shadowed by the ROM
+#define emuHomelab_EXTENSION_ROM_ADDRESS 0xD000
+#define emuHomelab_KEYBOARD_AREA_SIZE 0x1000
+
 #define emuPORT_FF_MOTOR_ON_MASK (1<<2)
 #define emuPORT_FF_SIGNAL_MASK (3)
 
@@ -42,6 +53,14 @@
 #define emuCAS_CLOCK_PERIOD_MAX 2500 // max clock period length in us for cassette signal analysis
 #define emuCAS_CLOCK_PERIOD_MIN 1500 // min clock period length in us for cassette signal analysis
 
+#define emuHomelab_PROFILER_REPORT_FILE_NAME "HomeLabProfile.txt"
+#define emuHomelab_TRACE_FILE_NAME "HomeLabTrace.bin"
+#ifndef emuHomelab_TRACE_RECORD_COUNT
+#define emuHomelab_TRACE_RECORD_COUNT 65536 // must be power of two
+#endif
+#define emuHomelab_SNAPSHOT_FILE_NAME "HomeLabSnapshot.bin"
+#define emuHomelab_SNAPSHOT_VERSION 1 // must be incremented when the snapshot content is changed
+
 /*****************************************************************************/
 /* Types                                                                     */
 /*****************************************************************************/
@@ -61,12 +80,34 @@ typedef enum
 	emuCS_LoadData
 } emuCASState;
 
+// scheduler event IDs
+typedef enum
+{
+	emuEVENT_VSYNC_START,
+	emuEVENT_FRAME_END
+} emuEventId;
+
 /*****************************************************************************/
 /* Local functions                                                           */
 /*****************************************************************************/
 static uint32_t cpuGetEllapsedTimeSince(uint32_t in_timestamp);
 static uint32_t cpuGetEllapsedTimeSinceInMicrosec(uint32_t in_timestamp);
 static uint32_t cpuGetTimestamp(void);
+static void emuHomelabMapMemory(cpuZ80State* R, uint8_t in_page_index);
+static uint8_t emuHomelabPortRead(cpuZ80State* R, uint16_t in_port);
+static void emuHomelabPortWrite(cpuZ80State* R, uint16_t in_port, uint8_t in_value);
+#ifdef cpuZ80_PROFILER
+static void emuHomelabWriteProfilerReport(void);
+#endif
+#ifdef cpuZ80_TRACE
+static void emuHomelabSaveTrace(void);
+#endif
+static void emuHomelabReset(void);
+static void emuHomelabScheduleEvents(void);
+#ifdef cpuZ80_SNAPSHOT
+static bool emuHomelabSaveSnapshot(void);
+static bool emuHomelabLoadSnapshot(void);
+#endif
 
 /*****************************************************************************/
 /* Module variables                                                          */
@@ -75,6 +116,17 @@ static uint32_t cpuGetTimestamp(void);
 // CPU
 cpuZ80State l_cpu;
 
+#ifdef cpuZ80_PROFILER
+// guest code profiler
+static cpuProfilerState l_profiler;
+#endif
+
+#ifdef cpuZ80_TRACE
+// instruction trace
+static cpuTraceBuffer l_trace;
+static cpuTraceRecord l_trace_records[emuHomelab_TRACE_RECORD_COUNT];
+#endif
+
 // RAM
 uint8_t g_keyboard_ram[emuHomelab_KEYBOARD_ROW_COUNT];
 uint8_t g_video_ram[emuHomelab_VIDEO_RAM_SIZE];
@@ -87,9 +139,9 @@ extern uint8_t g_rom_bin[];
 // timing variables
 static uint32_t l_total_cpu_cycles;
 static int32_t l_current_cycles_per_frame;
-static int l_current_scanline;
+static emuSchedulerState l_scheduler;
 
-static sysHighresTimestamp l_current_timestamp;
+static sysHighresTimestamp l_frame_start_timestamp;
 
 // port mirror variables
 static uint8_t l_out_port_ff = 0;
@@ -113,11 +165,34 @@ cpKeyboardState g_keyboard_state;
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Initializes Homelab III Computer
 void emuHomelabInitialize(void)
+{
+	emuHomelabReset();
+
+#ifdef cpuZ80_PROFILER
+	cpuProfilerReset(&l_profiler);
+	cpuZ80AttachProfiler(&l_cpu, &l_profiler);
+#endif
+
+#ifdef cpuZ80_TRACE
+	cpuTraceInitialize(&l_trace, l_trace_records, emuHomelab_TRACE_RECORD_COUNT);
+	cpuZ80AttachTrace(&l_cpu, &l_trace);
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+	// start from the saved state when it is available
+	emuHomelabLoadSnapshot();
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Resets the computer (cold start)
+static void emuHomelabReset(void)
 {
 	uint32_t i;
 
   // Reset CPU
 	cpuReset(&l_cpu);
+	emuHomelabMapMemory(&l_cpu, 0);
   
   // Clears RAM
   for(i = 0; i < emuHomelab_RAM_SIZE; i++)
@@ -132,56 +207,176 @@ void emuHomelabInitialize(void)
 	// init emulation variables
 	l_total_cpu_cycles = 0;
 	l_current_cycles_per_frame = 0;
-	l_current_scanline = 0;
-	l_current_timestamp = sysHighresTimerGetTimestamp();
+	l_frame_start_timestamp = sysHighresTimerGetTimestamp();
 	g_memory_page_index = 0;
+	emuHomelabScheduleEvents();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Main emulation task
+/// @brief Main emulation task. The CPU runs directly to the next scheduled event (VSYNC start or frame end), the
+/// code of the events is executed when its real time is reached.
 void emuHomelabTask(void)
 {
-	uint16_t cycles_to_execute;
-	uint16_t cycles_executed;
-	int32_t expected_cycle_per_frame;
+	int32_t cycles_to_execute;
+	int cycles_executed;
+	uint8_t event;
 
-	if (sysHighresTimerGetTimeSince(l_current_timestamp) >= emuHomelab_SCANLINE_IN_US || l_full_speed_emulation)
+	if (sysHighresTimerGetTimeSince(l_frame_start_timestamp) >= emuHomelab_CYCLES_TO_US(l_current_cycles_per_frame) || l_full_speed_emulation)
 	{
-		l_current_timestamp = sysHighresTimerGetTimestamp();
-
-		// calculate cycles to execute
-		expected_cycle_per_frame = (emuHomelab_CPU_CLK * (l_current_scanline + 1)) / emuHomelab_HSYNC_FREQ;
-		cycles_to_execute = (uint16_t)(expected_cycle_per_frame - l_current_cycles_per_frame);
-
-		// run CPU
-		cycles_executed = cpuExecute(&l_cpu, cycles_to_execute);
-		l_current_cycles_per_frame += cycles_executed;
-		l_total_cpu_cycles += cycles_executed;
-
-		// render scanline
-//		if (l_current_scanline < emuHomelab_SCREEN_HEIGHT_IN_PIXEL && !l_screen_refresh_disabled)
-//			emuHomelabRenderScanLine(l_current_scanline);
-
-		// handle VSYNC
-		if (l_current_scanline >= emuHomelab_SCREEN_HEIGHT_IN_PIXEL)
+		// run CPU until the next event
+		cycles_to_execute = emuSchedulerGetCyclesToNextEvent(&l_scheduler);
+		if (cycles_to_execute > 0)
 		{
-			g_keyboard_ram[2] |= BV(emuHomelab_VSYNC_BIT_INDEX); // VSYNC bit = 1
-			emuHomelabEndScreenrefresh();
+			cycles_executed = cpuExecute(&l_cpu, cycles_to_execute);
+			l_current_cycles_per_frame += cycles_executed;
+			l_total_cpu_cycles += cycles_executed;
+			emuSchedulerAdvance(&l_scheduler, cycles_executed);
 		}
 
-		// next scanline
-		l_current_scanline++;
-		if (l_current_scanline >= emuHomelab_TOTAL_SCANLINE_COUNT)
+#ifdef cpuZ80_TRACE
+		// trace stopped by breakpoint or illegal opcode
+		if (cpuTraceIsTriggered(&l_trace))
+			emuHomelabSaveTrace();
+#endif
+
+		// handle due events
+		while ((event = emuSchedulerGetDueEvent(&l_scheduler)) != emuSCHEDULER_NO_EVENT)
 		{
-			// VSYNC -> restart screen rendering
-			l_current_scanline = 0;
-			l_current_cycles_per_frame = 0;
-			g_keyboard_ram[2] &= ~BV(emuHomelab_VSYNC_BIT_INDEX); // VSYNC bit = 0
-			emuHomelabStartScreenRefresh();
+			switch (event)
+			{
+				case emuEVENT_VSYNC_START:
+					g_keyboard_ram[2] |= BV(emuHomelab_VSYNC_BIT_INDEX); // VSYNC bit = 1
+					emuHomelabEndScreenrefresh();
+					break;
+
+				case emuEVENT_FRAME_END:
+					// VSYNC -> restart screen rendering
+					l_current_cycles_per_frame = 0;
+					g_keyboard_ram[2] &= ~BV(emuHomelab_VSYNC_BIT_INDEX); // VSYNC bit = 0
+					emuHomelabStartScreenRefresh();
+					l_frame_start_timestamp = sysHighresTimerGetTimestamp();
+					emuHomelabScheduleEvents();
+					break;
+			}
 		}
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Schedules the video events of the rest of the current frame
+static void emuHomelabScheduleEvents(void)
+{
+	emuSchedulerInitialize(&l_scheduler, l_total_cpu_cycles);
+
+	if (l_current_cycles_per_frame < emuHomelab_VSYNC_START_CYCLES)
+		emuSchedulerAddEvent(&l_scheduler, emuEVENT_VSYNC_START, emuHomelab_VSYNC_START_CYCLES - l_current_cycles_per_frame);
+
+	emuSchedulerAddEvent(&l_scheduler, emuEVENT_FRAME_END, emuHomelab_CYCLES_PER_FRAME - l_current_cycles_per_frame);
+}
+
+#ifdef cpuZ80_PROFILER
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes profiler report of the CPU into the report file
+static void emuHomelabWriteProfilerReport(void)
+{
+	FILE* file = fopen(emuHomelab_PROFILER_REPORT_FILE_NAME, "w");
+
+	if (file == sysNULL)
+		return;
+
+	cpuZ80ProfilerReport(&l_cpu, file);
+
+	fclose(file);
+}
+#endif
+
+#ifdef cpuZ80_TRACE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves instruction trace into the trace file and restarts recording
+static void emuHomelabSaveTrace(void)
+{
+	cpuTraceSave(&l_trace, emuHomelab_TRACE_FILE_NAME);
+	cpuTraceReset(&l_trace);
+}
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves state of the computer (CPU, RAM, video RAM, memory page, port latches and timing) into the snapshot file
+/// @return True if the snapshot is saved
+static bool emuHomelabSaveSnapshot(void)
+{
+	emuSnapshotWriter writer;
+
+	if (!emuSnapshotWriteBegin(&writer, emuHomelab_SNAPSHOT_FILE_NAME, emuSNAPSHOT_MACHINE_HOMELAB, emuHomelab_SNAPSHOT_VERSION))
+		return false;
+
+	// CPU and memory
+	cpuZ80SaveState(&l_cpu, &writer);
+	emuSnapshotWriteBlock(&writer, g_ram, emuHomelab_RAM_SIZE);
+	emuSnapshotWriteBlock(&writer, g_video_ram, emuHomelab_VIDEO_RAM_SIZE);
+	emuSnapshotWriteByte(&writer, g_memory_page_index);
+
+	// port latches and VSYNC bit (keyboard rows belong to the host)
+	emuSnapshotWriteByte(&writer, l_out_port_ff);
+	emuSnapshotWriteByte(&writer, l_in_port_ff);
+	emuSnapshotWriteByte(&writer, g_keyboard_ram[emuHomelab_VSYNC_INDEX] & BV(emuHomelab_VSYNC_BIT_INDEX));
+
+	// timing
+	emuSnapshotWriteDWord(&writer, l_total_cpu_cycles);
+	emuSnapshotWriteDWord(&writer, (uint32_t)l_current_cycles_per_frame);
+	emuSnapshotWriteWord(&writer, (uint16_t)(l_current_cycles_per_frame * emuHomelab_HSYNC_FREQ / emuHomelab_CPU_CLK)); // scanline
+
+	return emuSnapshotWriteEnd(&writer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores state of the computer from the snapshot file
+/// @return True if the state is restored. The state is unchanged when the file is missing or it is not a valid
+/// snapshot, the computer is reset when the snapshot content is inconsistent.
+static bool emuHomelabLoadSnapshot(void)
+{
+	emuSnapshotReader reader;
+	uint16_t i;
+
+	if (!emuSnapshotReadBegin(&reader, emuHomelab_SNAPSHOT_FILE_NAME, emuSNAPSHOT_MACHINE_HOMELAB, emuHomelab_SNAPSHOT_VERSION))
+		return false;
+
+	// CPU and memory
+	cpuZ80LoadState(&l_cpu, &reader);
+	emuSnapshotReadBlock(&reader, g_ram, emuHomelab_RAM_SIZE);
+	emuSnapshotReadBlock(&reader, g_video_ram, emuHomelab_VIDEO_RAM_SIZE);
+	g_memory_page_index = emuSnapshotReadByte(&reader);
+
+	// port latches and VSYNC bit
+	l_out_port_ff = emuSnapshotReadByte(&reader);
+	l_in_port_ff = emuSnapshotReadByte(&reader);
+	g_keyboard_ram[emuHomelab_VSYNC_INDEX] = (g_keyboard_ram[emuHomelab_VSYNC_INDEX] & ~BV(emuHomelab_VSYNC_BIT_INDEX)) | (emuSnapshotReadByte(&reader) & BV(emuHomelab_VSYNC_BIT_INDEX));
+
+	// timing
+	l_total_cpu_cycles = emuSnapshotReadDWord(&reader);
+	l_current_cycles_per_frame = (int32_t)emuSnapshotReadDWord(&reader);
+	emuSnapshotReadWord(&reader); // scanline (events are scheduled by the cycle counter)
+
+	if (!emuSnapshotReadEnd(&reader) || g_memory_page_index > 1 || l_current_cycles_per_frame < 0 || l_current_cycles_per_frame >= emuHomelab_CYCLES_PER_FRAME)
+	{
+		emuHomelabReset();
+		return false;
+	}
+
+	emuHomelabMapMemory(&l_cpu, g_memory_page_index);
+	emuHomelabScheduleEvents();
+
+	// redraw screen
+	emuHomelabStartScreenRefresh();
+	for (i = 0; i < emuHomelab_VIDEO_RAM_SIZE; i++)
+		emuHomelabRenderCharacter(i);
+	emuHomelabEndScreenrefresh();
+
+	return true;
+}
+#endif
+
 // <editor-fold desc="- Memory handling -">
 #pragma region - Memory handling -
 /****************************************************************************
@@ -207,39 +402,42 @@ void emuHomelabTask(void)
 ****************************************************************************/
 
 //--------------------------------------------------------------
-// Memory write
+// Keyboard read (memory mapped I/O handler)
 //--------------------------------------------------------------
-void cpuMemWrite(register uint16_t in_address, register uint8_t in_value)
+static uint8_t emuHomelabKeyboardRead(cpuZ80State* R, uint16_t in_address)
 {
-	uint16_t address;
-
-	if (in_address >= 12288)
-	{
-		g_ram[in_address - 12288] = in_value;
-
-		if(in_address > 3)
-		{
-			if( g_ram[in_address-1] == '.' && g_ram[in_address-2] == '1')
-			{
-				in_address = 5;
-			}
-		}
-	}
+	return g_keyboard_ram[in_address & (emuHomelab_KEYBOARD_SIZE - 1)];
 }
 
 //--------------------------------------------------------------
-// Memory read
+// Sets up CPU memory map for the given memory page
 //--------------------------------------------------------------
-
-uint8_t cpuMemRead(register uint16_t in_address)
+static void emuHomelabMapMemory(cpuZ80State* R, uint8_t in_page_index)
 {
-	if (in_address < emuHomelab_MEMORY_MIDDLE)
+	// common part: ROM, RAM A
+	cpuZ80MemoryMapReset(R);
+	cpuZ80SetPortHandlers(R, emuHomelabPortRead, emuHomelabPortWrite);
+	cpuZ80MapMemory(R, 0, emuHomelab_ROM_SIZE, g_rom_bin, sysNULL);
+	cpuZ80MapMemory(R, emuHomelab_ROM_SIZE, emuHomelab_MEMORY_MIDDLE - emuHomelab_ROM_SIZE, &g_ram[emuHomelab_ROM_SIZE], &g_ram[emuHomelab_ROM_SIZE]);
+
+	if (in_page_index == 0)
 	{
-		return g_rom_bin[in_address];
+		// RAM B, RAM C
+		cpuZ80MapMemory(R, emuHomelab_MEMORY_MIDDLE, emuHomelab_RAM_SIZE - emuHomelab_MEMORY_MIDDLE, &g_ram[emuHomelab_MEMORY_MIDDLE], &g_ram[emuHomelab_MEMORY_MIDDLE]);
 	}
 	else
 	{
-		return g_ram[in_address - 12288];
+		// RAM D
+		cpuZ80MapMemory(R, emuHomelab_MEMORY_MIDDLE, emuHomelab_RAM_D_SIZE, &g_ram[emuHomelab_RAM_D_STORAGE], &g_ram[emuHomelab_RAM_D_STORAGE]);
+
+		// extension ROM is not available (unmapped)
+
+		// keyboard
+		cpuZ80MapHandler(R, emuHomelab_KEYBOARD_START, emuHomelab_KEYBOARD_AREA_SIZE, emuHomelabKeyboardRead, sysNULL);
+
+		// video RAM (twice)
+		cpuZ80MapMemory(R, emuHomelab_VIDEO_RAM_START, emuHomelab_VIDEO_RAM_SIZE, g_video_ram, g_video_ram);
+		cpuZ80MapMemory(R, emuHomelab_VIDEO_RAM_START + emuHomelab_VIDEO_RAM_SIZE, emuHomelab_VIDEO_RAM_SIZE, g_video_ram, g_video_ram);
 	}
 }
 
@@ -254,7 +452,7 @@ uint8_t cpuMemRead(register uint16_t in_address)
 //--------------------------------------------------------------
 // Port read
 //--------------------------------------------------------------
-uint8_t cpuIn(register uint16_t in_port)
+static uint8_t emuHomelabPortRead(cpuZ80State* R, uint16_t in_port)
 {
   uint8_t retval = 0xff;
 
@@ -270,9 +468,16 @@ uint8_t cpuIn(register uint16_t in_port)
 //--------------------------------------------------------------
 // Port write
 //--------------------------------------------------------------
-void cpuOut(register uint16_t in_port, register uint8_t in_value)
+static void emuHomelabPortWrite(cpuZ80State* R, uint16_t in_port, uint8_t in_value)
 {
-	g_memory_page_index = (uint8_t)((in_port >> 7) & 0x01);
+	uint8_t page_index = (uint8_t)((in_port >> 7) & 0x01);
+
+	// bank switching
+	if (page_index != g_memory_page_index)
+	{
+		g_memory_page_index = page_index;
+		emuHomelabMapMemory(R, page_index);
+	}
 
 	switch (in_port & 0xff)
 	{
@@ -700,6 +905,39 @@ void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategor
 				case sysVKC_CAPITAL:
 					keyboard_table_index = 7;
 					break;
+
+#ifdef cpuZ80_PROFILER
+				// write profiler report
+				case sysVKC_F12:
+					if (pressed)
+						emuHomelabWriteProfilerReport();
+					break;
+#endif
+
+#ifdef cpuZ80_SNAPSHOT
+				// save computer state
+				case sysVKC_F9:
+					if (pressed)
+						emuHomelabSaveSnapshot();
+					break;
+
+				// restore computer state
+				case sysVKC_F10:
+					if (pressed)
+						emuHomelabLoadSnapshot();
+					break;
+#endif
+
+#ifdef cpuZ80_TRACE
+				// save instruction trace
+				case sysVKC_F11:
+					if (pressed)
+					{
+						cpuTraceStop(&l_trace, cpuTRACE_TRIGGER_USER, l_cpu.PC.W);
+						emuHomelabSaveTrace();
+					}
+					break;
+#endif
 			}
 		}
 
@@ -17,33 +17,143 @@
 #include <emuInvaders.h>
 #include <emuInvadersResource.h>
 #include <waveMixer.h>
-#include <sysHighResTimer.h>
+#include <sysHighresTimer.h>
 #include "sysConfig.h"
+#ifdef cpuI8080_PROFILER
+#include <stdio.h>
+#endif
 
 /*****************************************************************************/
 /* Constants                                                                 */
 /*****************************************************************************/
 #define emuINVADERS_FRAME_TIME (1000000 / emuINVADERS_FRAME_RATE) // frame time in us
 #define emuINVADERS_CYCLES_PER_FRAME (emuINVADERS_CPU_CLOCK / emuINVADERS_FRAME_RATE) // number of CPU clock cycles per frame
+#define emuINVADERS_MIDSCREEN_CYCLES ((emuINVADERS_SCREEN_WIDTH / 2) * emuINVADERS_CYCLES_PER_FRAME / emuINVADERS_SCREEN_WIDTH) // CPU cycles from the frame start to the midscreen interrupt
+
+// scheduler event IDs
+#define emuINVADERS_EVENT_MIDSCREEN 0
+#define emuINVADERS_EVENT_VSYNC 1
+
+#define emuINVADERS_PROFILER_REPORT_FILE_NAME "InvadersProfile.txt"
+#define emuINVADERS_TRACE_FILE_NAME "InvadersTrace.bin"
+#ifndef emuINVADERS_TRACE_RECORD_COUNT
+#define emuINVADERS_TRACE_RECORD_COUNT 65536 // must be power of two
+#endif
+#define emuINVADERS_SNAPSHOT_FILE_NAME "InvadersSnapshot.bin"
+#define emuINVADERS_SNAPSHOT_VERSION 2 // must be incremented when the snapshot content is changed
+#ifndef emuINVADERS_REWIND_BUFFER_SIZE
+#define emuINVADERS_REWIND_BUFFER_SIZE (256 * 1024) // rewind history of the displayed machine in bytes
+#endif
+
+// audio clock synchronization (the lag is measured in 1/emuINVADERS_AUDIO_SYNC_SCALE samples, a half frame is exactly
+// halWAVEPLAYER_SAMPLE_RATE units)
+#define emuINVADERS_AUDIO_SYNC_SCALE (2 * emuINVADERS_FRAME_RATE)
+#ifndef emuINVADERS_AUDIO_SYNC_MAX_CATCH_UP
+#define emuINVADERS_AUDIO_SYNC_MAX_CATCH_UP 4 // maximum lag behind the audio clock in frames, older lag is discarded
+#endif
+#define emuINVADERS_AUDIO_SYNC_MAX_LAG (emuINVADERS_AUDIO_SYNC_MAX_CATCH_UP * 2 * halWAVEPLAYER_SAMPLE_RATE)
+#ifndef emuINVADERS_AUDIO_SYNC_MAX_FRAME_SKIP
+#define emuINVADERS_AUDIO_SYNC_MAX_FRAME_SKIP 3 // maximum number of consecutive frames without rendering
+#endif
+#ifndef emuINVADERS_AUDIO_SYNC_MAX_EXTRAPOLATION
+#define emuINVADERS_AUDIO_SYNC_MAX_EXTRAPOLATION halWAVEPLAYER_BUFFER_LENGTH // audio clock is extrapolated between device position updates (in samples)
+#endif
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static void emuInvadersMapMemory(emuInvadersState* in_state);
+static void emuInvadersResetMachine(emuInvadersState* in_state);
+static uint32_t emuInvadersRunHalfFrame(emuInvadersState* in_state);
+static void emuInvadersScheduleFrame(emuInvadersState* in_state);
+#if defined(cpuI8080_SNAPSHOT) || defined(emuINVADERS_AUDIO_SYNC)
+static void emuInvadersRenderVideoRAM(emuInvadersState* in_state);
+#endif
+#ifdef emuINVADERS_VSYNC_RENDERING
+static void emuInvadersRenderDirtyVideoRAM(emuInvadersState* in_state);
+#endif
+static uint8_t emuInvadersPortRead(cpuI8080State* R, uint16_t in_port);
+static void emuInvadersPortWrite(cpuI8080State* R, uint16_t in_port, uint8_t in_value);
+#ifdef cpuI8080_PROFILER
+static void emuInvadersWriteProfilerReport(void);
+#endif
+#ifdef cpuI8080_TRACE
+static void emuInvadersSaveTrace(void);
+#endif
+#ifdef cpuI8080_SNAPSHOT
+static void emuInvadersSaveWaveMixer(waveMixerState* in_mixer, emuSnapshotWriter* in_writer);
+static void emuInvadersLoadWaveMixer(waveMixerState* in_mixer, emuSnapshotReader* in_reader);
+static void emuInvadersSaveDevices(emuInvadersState* in_state, emuSnapshotWriter* in_writer);
+static void emuInvadersLoadDevices(emuInvadersState* in_state, emuSnapshotReader* in_reader);
+#endif
+#ifdef cpuI8080_DIRTY_PAGES
+static void emuInvadersEndFrame(emuInvadersState* in_state);
+#endif
+#ifdef emuINVADERS_REWIND
+static uint16_t emuInvadersSaveRewindState(emuInvadersState* in_state, uint8_t* out_buffer);
+static void emuInvadersRewindHalfFrame(void);
+#endif
+#ifdef emuINVADERS_AUDIO_SYNC
+static void emuInvadersAudioSyncInitialize(void);
+static bool emuInvadersAudioSyncIsHalfFrameDue(void);
+static void emuInvadersAudioSyncBeginFrame(bool in_rendering_skip_allowed);
+#endif
 
 /*****************************************************************************/
 /* Global variables                                                          */
 /*****************************************************************************/
 
-// RAM memory
-uint8_t g_cpu_ram[emuINVADERS_RAM_SIZE];  // 8k RAM
+// State of the displayed machine
+emuInvadersState g_invaders_state;
 
 /*****************************************************************************/
 /* Module local variables                                                    */
 /*****************************************************************************/
 
-// CPU variables
-static cpuI8080State l_invaders_cpu;
-
 // timing variables
-static uint16_t l_current_scanline = 0;
 static sysHighresTimestamp l_half_frame_timestamp;
-static uint32_t l_cycles_per_frame;
+
+#ifdef emuINVADERS_AUDIO_SYNC
+// audio clock synchronization
+static uint32_t l_sync_reported_sample_count;					// played sample count reported by the audio device
+static sysHighresTimestamp l_sync_reported_timestamp;	// time when the reported count was changed
+static uint32_t l_sync_sample_position;								// estimated position of the audio clock in samples
+static int32_t l_sync_lag;														// emulation lag behind the audio clock (1/emuINVADERS_AUDIO_SYNC_SCALE samples)
+static sysHighresTimestamp l_sync_next_task_time;
+static uint8_t l_sync_skipped_frame_count;						// number of consecutive frames without rendering
+static bool l_sync_screen_invalid;										// screen is not rendered since the last skipped frame
+static emuInvadersSyncStatistics l_sync_statistics;
+#endif
+
+#ifdef emuINVADERS_REWIND
+// rewind history of the displayed machine
+static emuRewindState l_rewind;
+static uint8_t l_rewind_buffer[emuINVADERS_REWIND_BUFFER_SIZE];
+static bool l_rewind_requested = false;
+static bool l_rewind_half_frame = false;
+#endif
+
+#ifdef cpuI8080_PROFILER
+// guest code profiler of the displayed machine
+static cpuProfilerState l_profiler;
+#endif
+
+#ifdef cpuI8080_TRACE
+// instruction trace of the displayed machine
+static cpuTraceBuffer l_trace;
+static cpuTraceRecord l_trace_records[emuINVADERS_TRACE_RECORD_COUNT];
+#endif
+
+#ifdef waveMIXER_WAVE_CACHE
+// sounds converted at initialization
+static const sysResourceAddress l_wave_resources[] = { REF_WAV_BASE_HIT, REF_WAV_INV_HIT, REF_WAV_SHOT, REF_WAV_UFO, REF_WAV_UFO_HIT, REF_WAV_WALK1, REF_WAV_WALK2, REF_WAV_WALK3, REF_WAV_WALK4 };
+#endif
+
+// pre-decoded ROM code (shared between the instances)
+#ifdef cpuI8080_PREDECODE
+static cpuI8080DecodedInstruction l_rom_decoded[emuINVADERS_ROM_SIZE];
+static bool l_rom_decoded_valid = false;
+#endif
 
 // diagnostics variables
 #ifdef emuDIAG_DISPLAY_STATISTICS
@@ -55,12 +165,9 @@ static uint32_t l_cpu_frequency;
 static uint16_t l_cpu_load;
 static uint32_t l_cpu_load_sum;
 static uint16_t l_cpu_load_count;
+static uint32_t l_rendered_byte_count;						// bytes rendered until the start of the statistics period
 #endif
 
-// audio variables
-static waveMixerState	l_wave_mixer_state;
-static uint8_t l_ufo_sound_channel = waveMIXER_INVALID_CHANNEL;
-
 /*****************************************************************************/
 /* Function implementation                                                   */
 /*****************************************************************************/
@@ -69,28 +176,54 @@ static uint8_t l_ufo_sound_channel = waveMIXER_INVALID_CHANNEL;
 /// @brief Initializes emulator
 void emuInvadersInitialize(void)
 {
-	uint16_t i;
+#ifdef waveMIXER_WAVE_CACHE
+	uint8_t i;
+#endif
 
-  // Reset CPU
-  cpuI8080Reset(&l_invaders_cpu);
-  
-  // Clears Invaders RAM
-  for(i = 0; i < emuINVADERS_RAM_SIZE; i++)
-		g_cpu_ram[i] = 0;
+	// audio device is initialized once, the instances have their own mixer
+	halWavePlayerInitialize();
+
+	emuInvadersInstanceInitialize(&g_invaders_state);
+	g_invaders_state.display_enabled = true;
+
+#ifdef cpuI8080_PROFILER
+	cpuProfilerReset(&l_profiler);
+	cpuI8080AttachProfiler(&g_invaders_state.cpu, &l_profiler);
+#endif
+
+#ifdef cpuI8080_TRACE
+	cpuTraceInitialize(&l_trace, l_trace_records, emuINVADERS_TRACE_RECORD_COUNT);
+	cpuI8080AttachTrace(&g_invaders_state.cpu, &l_trace);
+#endif
 
 	// init screen
 	guiDrawBitmapFromResource(0, 0, REF_BMP_BACKGROUND);
 	emuInvadersRendererInitialize();
 
-	guiRefreshScreen();
+#ifdef waveMIXER_WAVE_CACHE
+	// convert all sounds to the output sample rate
+	for (i = 0; i < sizeof(l_wave_resources) / sizeof(l_wave_resources[0]); i++)
+		waveMixerWaveCacheAdd(l_wave_resources[i]);
+#endif
+
+#ifdef cpuI8080_SNAPSHOT
+	// start from the saved state when it is available (the machine is reset if the snapshot is invalid)
+	emuInvadersInstanceLoadSnapshot(&g_invaders_state, emuINVADERS_SNAPSHOT_FILE_NAME);
+#endif
 
-	// init wave
-	waveMixerInitialize(&l_wave_mixer_state);
+#ifdef emuINVADERS_REWIND
+	emuInvadersInstanceAttachRewind(&g_invaders_state, &l_rewind, l_rewind_buffer, emuINVADERS_REWIND_BUFFER_SIZE);
+#endif
+
+	guiRefreshScreen();
 
 	// init variables
-	l_current_scanline = 0;
 	l_half_frame_timestamp = sysHighresTimerGetTimestamp();
 
+#ifdef emuINVADERS_AUDIO_SYNC
+	emuInvadersAudioSyncInitialize();
+#endif
+
 #ifdef emuDIAG_DISPLAY_STATISTICS
 	l_statistics_timestamp = sysHighresTimerGetTimestamp();
 	l_frame_counter = 0;
@@ -100,6 +233,7 @@ void emuInvadersInitialize(void)
 	l_cpu_load = 0;
 	l_cpu_load_sum = 0;
 	l_cpu_load_count = 0;
+	l_rendered_byte_count = g_invaders_state.rendered_byte_count;
 #endif
 }
 
@@ -108,72 +242,85 @@ void emuInvadersInitialize(void)
 bool emuInvadersTask(void)
 {
 	uint8_t free_wave_buffer_index;
-	int expected_cycle_per_frame;
-	int cycles_left;
+	uint32_t cycles;
 	bool busy = false;
 #ifdef emuDIAG_DISPLAY_STATISTICS
 	uint32_t ellapsed_statistics_time;
+	uint32_t rendered_bytes;
 #endif
 
+#ifdef emuINVADERS_AUDIO_SYNC
+	// check if the audio clock is ahead of the emulation by a half frame
+	if (emuInvadersAudioSyncIsHalfFrameDue())
+	{
+		l_half_frame_timestamp = sysHighresTimerGetTimestamp();
+#else
 	// check if half frame time is elapsed
 	if( sysHighresTimerGetTimeSince(l_half_frame_timestamp) >= emuINVADERS_FRAME_TIME / 2)
 	{
 		sysHighresTimerAddToTimestamp(&l_half_frame_timestamp, emuINVADERS_FRAME_TIME / 2);
+#endif
 
 		busy = true;
 
-		if(l_current_scanline == 0)
+#ifdef emuINVADERS_REWIND
+		// the machine is rewound instead of emulated while the rewind key is held (at frame boundaries only)
+		if (l_rewind_requested && g_invaders_state.current_scanline == 0)
 		{
-			// reset cycle counter
-			l_cycles_per_frame = 0;
-
-			// render the first half of the screen
-			while(l_current_scanline  < emuINVADERS_SCREEN_WIDTH / 2)
-			{
-				// execute code
-				expected_cycle_per_frame = (int)(l_current_scanline + 1) * emuINVADERS_CYCLES_PER_FRAME / emuINVADERS_SCREEN_WIDTH;
-				cycles_left = cpuI8080Exec(&l_invaders_cpu, expected_cycle_per_frame - l_cycles_per_frame);
-#ifdef emuDIAG_DISPLAY_STATISTICS
-				l_cpu_cycles += expected_cycle_per_frame - l_cycles_per_frame - cycles_left;
+#ifdef emuINVADERS_AUDIO_SYNC
+			emuInvadersAudioSyncBeginFrame(false);
 #endif
-				l_cycles_per_frame += expected_cycle_per_frame - l_cycles_per_frame - cycles_left;
-
-				// next scanline
-				l_current_scanline++;
-			}
-
-			// midscreen interrupt
-			cpuI8080INT(&l_invaders_cpu, cpuI8080_RST1);
+			emuInvadersRewindHalfFrame();
+			return busy;
 		}
-		else
-		{
-			// render the second half of the screen
-			while(l_current_scanline < emuINVADERS_SCREEN_WIDTH)
-			{
-				// execute code
-				expected_cycle_per_frame = (int)(l_current_scanline + 1) * emuINVADERS_CYCLES_PER_FRAME / emuINVADERS_SCREEN_WIDTH;
-				cycles_left = cpuI8080Exec(&l_invaders_cpu, expected_cycle_per_frame - l_cycles_per_frame);
-#ifdef emuDIAG_DISPLAY_STATISTICS
-				l_cpu_cycles += expected_cycle_per_frame - l_cycles_per_frame - cycles_left;
 #endif
-				l_cycles_per_frame += expected_cycle_per_frame - l_cycles_per_frame - cycles_left;
 
-				// next scanline
-				l_current_scanline++;
-			}
+#ifdef emuINVADERS_AUDIO_SYNC
+		// rendering of the whole frame is skipped when the emulation is behind the audio clock
+		if (g_invaders_state.current_scanline == 0)
+			emuInvadersAudioSyncBeginFrame(true);
+#endif
+
+		cycles = emuInvadersRunHalfFrame(&g_invaders_state);
 
-			// vsync interrupt
-			cpuI8080INT(&l_invaders_cpu, cpuI8080_RST2);
+#ifdef cpuI8080_TRACE
+		// trace stopped by breakpoint or illegal opcode
+		if (cpuTraceIsTriggered(&l_trace))
+			emuInvadersSaveTrace();
+#endif
 
-			// first scanline
-			l_current_scanline = 0;
+#ifdef emuDIAG_DISPLAY_STATISTICS
+		l_cpu_cycles += cycles;
+#else
+		(void)cycles;
+#endif
 
+		if(g_invaders_state.current_scanline == 0)
+		{
 #ifdef emuDIAG_DISPLAY_STATISTICS
 			l_frame_counter++;
 #endif
 
+#ifdef cpuI8080_DIRTY_PAGES
+			emuInvadersEndFrame(&g_invaders_state);
+#endif
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+			// video RAM changes of the frame are rendered at vsync
+			if (g_invaders_state.display_enabled)
+				emuInvadersRenderDirtyVideoRAM(&g_invaders_state);
+#endif
+
+#ifdef emuINVADERS_AUDIO_SYNC
+			// the content of the skipped frame is rendered with the next displayed frame
+			if (!g_invaders_state.display_enabled)
+				g_invaders_state.display_enabled = true;
+			else
+				guiRefreshScreen();
+#else
 			// refresh content of the screen
 			guiRefreshScreen();
+#endif
 		}
 
 #ifdef emuDIAG_DISPLAY_STATISTICS
@@ -196,12 +343,18 @@ bool emuInvadersTask(void)
 		else
 			l_cpu_load = 0;
 
-		emuDisplayStatistics(l_cpu_frequency, l_frame_rate, l_cpu_load);
+		if(l_frame_counter > 0)
+			rendered_bytes = (g_invaders_state.rendered_byte_count - l_rendered_byte_count) / l_frame_counter;
+		else
+			rendered_bytes = 0;
+
+		emuDisplayStatistics(l_cpu_frequency, l_frame_rate, l_cpu_load, (uint16_t)rendered_bytes);
 
 		l_cpu_cycles = 0;
 		l_frame_counter = 0;
 		l_cpu_load_sum = 0;
 		l_cpu_load_count = 0;
+		l_rendered_byte_count = g_invaders_state.rendered_byte_count;
 
 		l_statistics_timestamp = sysHighresTimerGetTimestamp();
 	}
@@ -212,13 +365,431 @@ bool emuInvadersTask(void)
 	if(free_wave_buffer_index != waveMIXER_INVALID_CHANNEL)
 	{
 		busy = true;
-		waveMixerRenderStream(&l_wave_mixer_state, halWaveGetBuffer(free_wave_buffer_index), halWAVEPLAYER_BUFFER_LENGTH);
+		waveMixerRenderStream(&g_invaders_state.wave_mixer, halWaveGetBuffer(free_wave_buffer_index), halWAVEPLAYER_BUFFER_LENGTH);
 		halWavePlayerPlayBuffer(free_wave_buffer_index);
 	}
 
 	return busy;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets the time of the next half frame. The emulator task has nothing to do until this time when it
+/// returns not busy (the host may sleep).
+/// @return Timestamp of the next half frame
+sysHighresTimestamp emuInvadersGetNextTaskTime(void)
+{
+#ifdef emuINVADERS_AUDIO_SYNC
+	return l_sync_next_task_time;
+#else
+	sysHighresTimestamp next_task_time = l_half_frame_timestamp;
+
+	sysHighresTimerAddToTimestamp(&next_task_time, emuINVADERS_FRAME_TIME / 2);
+
+	return next_task_time;
+#endif
+}
+
+#ifdef emuINVADERS_AUDIO_SYNC
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets statistics of the audio clock synchronization of the displayed machine
+/// @param out_statistics Statistics
+void emuInvadersGetSyncStatistics(emuInvadersSyncStatistics* out_statistics)
+{
+	*out_statistics = l_sync_statistics;
+}
+#endif
+
+#ifdef cpuI8080_INSTRUCTION_COUNTER
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the CPU instructions executed since the last reset
+/// @return Number of executed instructions
+uint32_t emuInvadersGetInstructionCount(void)
+{
+	return g_invaders_state.cpu.instruction_count;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes one emulated machine. The machine is not displayed and it is not bound to the real time.
+/// @param in_state Machine state to initialize
+void emuInvadersInstanceInitialize(emuInvadersState* in_state)
+{
+	emuInvadersResetMachine(in_state);
+
+	// init audio output
+	in_state->audio_buffer = sysNULL;
+	in_state->audio_buffer_length = 0;
+	in_state->audio_sample_count = 0;
+
+	in_state->display_enabled = false;
+	in_state->rendered_byte_count = 0;
+
+#ifdef emuINVADERS_REWIND
+	in_state->rewind = sysNULL;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Cold start of the emulated hardware (CPU, RAM, port latches, timing and sound channels). The display,
+/// audio output and rewind history bindings of the machine are not changed, the audio device is not touched.
+/// @param in_state Machine state
+static void emuInvadersResetMachine(emuInvadersState* in_state)
+{
+	uint16_t i;
+
+	// Reset CPU
+	cpuI8080Reset(&in_state->cpu);
+	in_state->cpu.user = in_state;
+	emuInvadersMapMemory(in_state);
+
+	// Clears Invaders RAM
+	for(i = 0; i < emuINVADERS_RAM_SIZE; i++)
+		in_state->ram[i] = 0;
+
+	// init ports
+	in_state->port_in1 = 0x08;
+	in_state->port_in2 = 0x00;
+	in_state->port_out2 = 0;
+	in_state->port_out3 = 0;
+	in_state->port_out4hi = 0;
+	in_state->port_out4lo = 0;
+	in_state->port_out5 = 0;
+
+	// init timing
+	in_state->current_scanline = 0;
+	in_state->cycles_per_frame = 0;
+	in_state->frame_count = 0;
+	emuInvadersScheduleFrame(in_state);
+
+	// stop sound channels
+	waveMixerInitialize(&in_state->wave_mixer);
+	in_state->ufo_sound_channel = waveMIXER_INVALID_CHANNEL;
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+	for (i = 0; i < emuINVADERS_SCREEN_WIDTH; i++)
+		in_state->dirty_video_columns[i] = 0;
+#endif
+
+#ifdef cpuI8080_DIRTY_PAGES
+	cpuDirtyPagesClear(&in_state->dirty_pages);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Runs one emulated machine for the given number of frames as fast as possible.
+/// Audio of the frames is rendered into the audio buffer of the machine (as much as fits).
+/// Instances are independent, different instances can be stepped from different threads.
+/// @param in_state Machine state
+/// @param in_frame_count Number of frames to emulate
+void emuInvadersInstanceStep(emuInvadersState* in_state, uint32_t in_frame_count)
+{
+	uint32_t sample_count;
+
+	in_state->audio_sample_count = 0;
+
+	while(in_frame_count > 0)
+	{
+		// both halves of the frame
+		emuInvadersRunHalfFrame(in_state);
+		emuInvadersRunHalfFrame(in_state);
+
+		// audio of the frame
+		if(in_state->audio_buffer != sysNULL)
+		{
+			sample_count = in_state->audio_buffer_length - in_state->audio_sample_count;
+			if(sample_count > emuINVADERS_AUDIO_SAMPLES_PER_FRAME)
+				sample_count = emuINVADERS_AUDIO_SAMPLES_PER_FRAME;
+
+			if(sample_count > 0)
+			{
+				waveMixerRenderStream(&in_state->wave_mixer, in_state->audio_buffer + in_state->audio_sample_count, sample_count);
+				in_state->audio_sample_count += sample_count;
+			}
+		}
+
+#ifdef cpuI8080_DIRTY_PAGES
+		emuInvadersEndFrame(in_state);
+#endif
+
+		in_frame_count--;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sets input port content of the machine (see emuINVADERS_IN_xxx bits)
+/// @param in_state Machine state
+/// @param in_port1 Port 1 input bits (coin, start buttons, player one controls)
+/// @param in_port2 Port 2 input bits (player two controls)
+void emuInvadersInstanceSetInput(emuInvadersState* in_state, uint8_t in_port1, uint8_t in_port2)
+{
+	in_state->port_in1 = in_port1 | 0x08;
+	in_state->port_in2 = in_port2;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets frame buffer of the machine. It is the 1bpp video RAM, 32 bytes per column (rotated screen).
+/// @param in_state Machine state
+/// @return Pointer to the first byte of the video RAM
+const uint8_t* emuInvadersInstanceGetVideoRAM(emuInvadersState* in_state)
+{
+	return &in_state->ram[emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START];
+}
+
+#ifdef cpuI8080_SNAPSHOT
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves state of the machine (CPU, RAM, port latches, timing and sound channels) into snapshot file
+/// @param in_state Machine state
+/// @param in_file_name Name of the snapshot file
+/// @return True if the snapshot is saved
+bool emuInvadersInstanceSaveSnapshot(emuInvadersState* in_state, const char* in_file_name)
+{
+	emuSnapshotWriter writer;
+
+	if (!emuSnapshotWriteBegin(&writer, in_file_name, emuSNAPSHOT_MACHINE_INVADERS, emuINVADERS_SNAPSHOT_VERSION))
+		return false;
+
+	// CPU and memory
+	cpuI8080SaveState(&in_state->cpu, &writer);
+	emuSnapshotWriteBlock(&writer, in_state->ram, emuINVADERS_RAM_SIZE);
+
+	// ports, timing and audio
+	emuInvadersSaveDevices(in_state, &writer);
+
+	return emuSnapshotWriteEnd(&writer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores state of the machine from snapshot file. The screen is redrawn when the machine is displayed.
+/// @param in_state Machine state (must be initialized)
+/// @param in_file_name Name of the snapshot file
+/// @return True if the state is restored. The state is unchanged when the file is missing or it is not a valid
+/// snapshot, the machine is reset when the snapshot content is inconsistent (the CPU execution mode is kept).
+bool emuInvadersInstanceLoadSnapshot(emuInvadersState* in_state, const char* in_file_name)
+{
+	emuSnapshotReader reader;
+#ifdef cpuI8080_BLOCK_CACHE
+	cpuI8080ExecMode exec_mode;
+	cpuI8080BlockCache* block_cache;
+#endif
+
+	if (!emuSnapshotReadBegin(&reader, in_file_name, emuSNAPSHOT_MACHINE_INVADERS, emuINVADERS_SNAPSHOT_VERSION))
+		return false;
+
+	// CPU and memory
+	cpuI8080LoadState(&in_state->cpu, &reader);
+	emuSnapshotReadBlock(&reader, in_state->ram, emuINVADERS_RAM_SIZE);
+
+	// ports, timing and audio
+	emuInvadersLoadDevices(in_state, &reader);
+
+	if (!emuSnapshotReadEnd(&reader))
+	{
+#ifdef cpuI8080_BLOCK_CACHE
+		exec_mode = in_state->cpu.exec_mode;
+		block_cache = in_state->cpu.block_cache;
+#endif
+
+		// only the machine is reset, the display and audio output of the instance are kept
+		emuInvadersResetMachine(in_state);
+
+#ifdef cpuI8080_BLOCK_CACHE
+		// the memory map reset detaches the block cache, the blocks of the old memory content are dropped
+		in_state->cpu.block_cache = block_cache;
+		in_state->cpu.exec_mode = exec_mode;
+		cpuI8080FlushBlockCache(&in_state->cpu);
+#endif
+
+		if (in_state->display_enabled)
+			emuInvadersRenderVideoRAM(in_state);
+
+#ifdef emuINVADERS_REWIND
+		emuInvadersInstanceResetRewind(in_state);
+#endif
+		return false;
+	}
+
+	if (in_state->display_enabled)
+		emuInvadersRenderVideoRAM(in_state);
+
+#ifdef emuINVADERS_REWIND
+	// history of the replaced state is not valid
+	emuInvadersInstanceResetRewind(in_state);
+#endif
+
+	return true;
+}
+#endif
+
+#ifdef cpuI8080_DIRTY_PAGES
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets the pages written during the last emulated frame. Writes of the RAM mirror are reported on the
+/// pages of the RAM. It can be used to update only the changed parts of the screen or recordings.
+/// @param in_state Machine state
+/// @return Dirty page bitmap of the last frame
+const cpuDirtyPageBitmap* emuInvadersInstanceGetDirtyPages(emuInvadersState* in_state)
+{
+	return &in_state->dirty_pages;
+}
+#endif
+
+#ifdef emuINVADERS_REWIND
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Attaches rewind history to the machine. Every emulated frame is stored in the history, only the pages
+/// written during the frame are saved. The oldest frames are dropped when the buffer is full.
+/// @param in_state Machine state (must be at frame boundary)
+/// @param in_rewind Rewind history (null to detach the history)
+/// @param in_buffer History buffer
+/// @param in_buffer_size Size of the history buffer in bytes (must be larger than the RAM size)
+/// @return True if the history is attached
+bool emuInvadersInstanceAttachRewind(emuInvadersState* in_state, emuRewindState* in_rewind, uint8_t* in_buffer, uint32_t in_buffer_size)
+{
+	in_state->rewind = sysNULL;
+
+	if (in_rewind == sysNULL)
+		return true;
+
+	emuRewindInitialize(in_rewind, in_buffer, in_buffer_size);
+	if (!emuRewindAddRegion(in_rewind, emuINVADERS_RAM_START, emuINVADERS_RAM_SIZE, in_state->ram))
+		return false;
+
+	in_state->rewind = in_rewind;
+	emuInvadersInstanceResetRewind(in_state);
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Drops the rewind history, the current state becomes the oldest state. It must be called when
+/// the machine state is changed outside of the emulation (e.g. snapshot is loaded).
+/// @param in_state Machine state (must be at frame boundary)
+void emuInvadersInstanceResetRewind(emuInvadersState* in_state)
+{
+	uint8_t rewind_state[emuREWIND_MAX_STATE_SIZE];
+
+	if (in_state->rewind == sysNULL)
+		return;
+
+	cpuI8080ClearDirtyPages(&in_state->cpu);
+	emuRewindReset(in_state->rewind, rewind_state, emuInvadersSaveRewindState(in_state, rewind_state));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores the state of the previous frame boundary from the rewind history. Restored pages are
+/// reported as dirty pages of the frame and the restored video RAM pages are redrawn when the machine is displayed.
+/// Rewinding some frames and emulating them again (e.g. with different input) gives run-ahead.
+/// @param in_state Machine state (must be at frame boundary)
+/// @return True if the state is restored, false if the history is empty
+bool emuInvadersInstanceStepBack(emuInvadersState* in_state)
+{
+	uint8_t rewind_state[emuREWIND_MAX_STATE_SIZE];
+	uint16_t rewind_state_length;
+	emuSnapshotReader reader;
+	uint32_t address;
+	uint32_t i;
+
+	if (in_state->rewind == sysNULL)
+		return false;
+
+	cpuDirtyPagesClear(&in_state->dirty_pages);
+
+	if (!emuRewindStepBack(in_state->rewind, rewind_state, &rewind_state_length, &in_state->dirty_pages))
+		return false;
+
+	emuSnapshotReadBeginMemory(&reader, rewind_state, rewind_state_length);
+	cpuI8080LoadState(&in_state->cpu, &reader);
+	emuInvadersLoadDevices(in_state, &reader);
+
+	// redraw restored video RAM pages
+	if (in_state->display_enabled)
+	{
+		for (address = emuINVADERS_VIDEO_RAM_START; address < emuINVADERS_RAM_START + emuINVADERS_RAM_SIZE; address += cpuDIRTY_PAGE_SIZE)
+		{
+			if (cpuDirtyPagesTest(&in_state->dirty_pages, (uint8_t)(address >> cpuDIRTY_PAGE_SHIFT)))
+			{
+#ifdef emuINVADERS_VSYNC_RENDERING
+				for (i = address; i < address + cpuDIRTY_PAGE_SIZE; i += emuINVADERS_VIDEO_COLUMN_SIZE)
+					in_state->dirty_video_columns[(i - emuINVADERS_VIDEO_RAM_START) / emuINVADERS_VIDEO_COLUMN_SIZE] = 0xffffffff;
+#else
+				for (i = address; i < address + cpuDIRTY_PAGE_SIZE; i++)
+					emuInvadersRenderPixels((uint16_t)(i - emuINVADERS_VIDEO_RAM_START), in_state->ram[i - emuINVADERS_RAM_START]);
+
+				in_state->rendered_byte_count += cpuDIRTY_PAGE_SIZE;
+#endif
+			}
+		}
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+		emuInvadersRenderDirtyVideoRAM(in_state);
+#endif
+	}
+
+	return emuSnapshotReadEnd(&reader);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Executes CPU code of the next half frame and generates the midscreen or vsync interrupt. The CPU runs
+/// directly to the next scheduled event.
+/// @param in_state Machine state
+/// @return Number of executed CPU cycles
+static uint32_t emuInvadersRunHalfFrame(emuInvadersState* in_state)
+{
+	int32_t cycles_to_execute;
+	uint32_t cycles = 0;
+	bool half_frame_finished = false;
+
+	while(!half_frame_finished)
+	{
+		// execute code until the next event (the CPU carries the overrun of the last instruction to the next execution)
+		cycles_to_execute = emuSchedulerGetCyclesToNextEvent(&in_state->scheduler);
+		if(cycles_to_execute > 0)
+		{
+			cpuI8080Exec(&in_state->cpu, cycles_to_execute);
+			cycles += cycles_to_execute;
+			in_state->cycles_per_frame += cycles_to_execute;
+			emuSchedulerAdvance(&in_state->scheduler, cycles_to_execute);
+		}
+
+		switch(emuSchedulerGetDueEvent(&in_state->scheduler))
+		{
+			case emuINVADERS_EVENT_MIDSCREEN:
+				// midscreen interrupt
+				cpuI8080INT(&in_state->cpu, cpuI8080_RST1);
+				in_state->current_scanline = emuINVADERS_SCREEN_WIDTH / 2;
+				half_frame_finished = true;
+				break;
+
+			case emuINVADERS_EVENT_VSYNC:
+				// vsync interrupt
+				cpuI8080INT(&in_state->cpu, cpuI8080_RST2);
+
+				// first scanline
+				in_state->current_scanline = 0;
+				in_state->cycles_per_frame = 0;
+				in_state->frame_count++;
+				emuInvadersScheduleFrame(in_state);
+				half_frame_finished = true;
+				break;
+		}
+	}
+
+	return cycles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Schedules the interrupt events of the rest of the current frame (cycles executed in the frame are
+/// already counted)
+/// @param in_state Machine state
+static void emuInvadersScheduleFrame(emuInvadersState* in_state)
+{
+	emuSchedulerInitialize(&in_state->scheduler, in_state->cycles_per_frame);
+
+	if(in_state->current_scanline < emuINVADERS_SCREEN_WIDTH / 2)
+		emuSchedulerAddEventAt(&in_state->scheduler, emuINVADERS_EVENT_MIDSCREEN, emuINVADERS_MIDSCREEN_CYCLES);
+
+	emuSchedulerAddEventAt(&in_state->scheduler, emuINVADERS_EVENT_VSYNC, emuINVADERS_CYCLES_PER_FRAME);
+}
+
 /*****************************************************************************/
 /* Emulator details                                                          */
 /*****************************************************************************/
@@ -246,54 +817,76 @@ bool emuInvadersTask(void)
 ****************************************************************************/
 
 //--------------------------------------------------------------
-// Memory write
+// Video RAM write (memory mapped I/O handler)
 //--------------------------------------------------------------
-void WrI8080(register uint16_t in_address, register uint8_t in_value)
+static void emuInvadersVideoRAMWrite(cpuI8080State* R, uint16_t in_address, uint8_t in_value)
 {
-  //check range
-  if (in_address < emuINVADERS_RAM_START || in_address > emuINVADERS_RAM_MIRROR + emuINVADERS_RAM_SIZE)
-    return;
+  emuInvadersState* state = (emuInvadersState*)R->user;
 
-  // write RAM
-  if(in_address > emuINVADERS_RAM_MIRROR)
-  	in_address -= emuINVADERS_RAM_MIRROR;
-  else
-  	in_address -= emuINVADERS_RAM_START;
+  // RAM and its mirror are both 8k aligned
+  in_address &= (emuINVADERS_RAM_SIZE - 1);
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+  // changed bytes are marked and rendered at vsync
+  if(state->ram[in_address] != in_value)
+  {
+    state->ram[in_address] = in_value;
 
-  // write RAM
-  g_cpu_ram[in_address] = in_value;
+    in_address -= (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START);
+    state->dirty_video_columns[in_address / emuINVADERS_VIDEO_COLUMN_SIZE] |= 1ul << (in_address % emuINVADERS_VIDEO_COLUMN_SIZE);
+  }
+#else
+  state->ram[in_address] = in_value;
 
-  if(in_address >= (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START) )
+  if(state->display_enabled)
   {
-  	emuInvadersRenderPixels(in_address - (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START), in_value);
+    emuInvadersRenderPixels(in_address - (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START), in_value);
+    state->rendered_byte_count++;
   }
+#endif
 }
 
 //--------------------------------------------------------------
-// Memory read
+// Sets up CPU memory map
 //--------------------------------------------------------------
-uint8_t RdI8080(register uint16_t in_address)
+static void emuInvadersMapMemory(emuInvadersState* in_state)
 {
-  // read ROM
-  if (in_address < emuINVADERS_RAM_START)
-    return g_cpu_rom[in_address];
+  cpuI8080State* R = &in_state->cpu;
 
-  // read RAM
-  if(in_address < emuINVADERS_RAM_MIRROR)
-    return g_cpu_ram[in_address - emuINVADERS_RAM_START];
+  cpuI8080MemoryMapReset(R);
+
+  // ROM
+  cpuI8080MapMemory(R, 0, emuINVADERS_ROM_SIZE, g_cpu_rom, sysNULL);
+
+  // RAM and its mirror, video RAM writes are routed to the renderer
+  cpuI8080MapMemory(R, emuINVADERS_RAM_START, emuINVADERS_RAM_SIZE, in_state->ram, in_state->ram);
+  cpuI8080MapMemory(R, emuINVADERS_RAM_MIRROR, emuINVADERS_RAM_SIZE, in_state->ram, in_state->ram);
+  cpuI8080MapHandler(R, emuINVADERS_VIDEO_RAM_START, emuINVADERS_RAM_SIZE - (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START), sysNULL, emuInvadersVideoRAMWrite);
+  cpuI8080MapHandler(R, emuINVADERS_RAM_MIRROR + (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START), emuINVADERS_RAM_SIZE - (emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START), sysNULL, emuInvadersVideoRAMWrite);
+
+  // I/O ports
+  cpuI8080SetPortHandlers(R, emuInvadersPortRead, emuInvadersPortWrite);
+
+#ifdef cpuI8080_PREDECODE
+  // ROM is decoded by the first instance, the others use the same decoded code (instances must be initialized from one thread)
+  if (!l_rom_decoded_valid)
+  {
+    cpuI8080PredecodeMemory(R, 0, emuINVADERS_ROM_SIZE, l_rom_decoded);
+    l_rom_decoded_valid = true;
+  }
   else
   {
-    if(in_address - emuINVADERS_RAM_MIRROR < emuINVADERS_RAM_SIZE)
-      return g_cpu_ram[in_address - emuINVADERS_RAM_MIRROR];
-    else
-      return 0xff;
+    cpuI8080AttachDecodedMemory(R, 0, emuINVADERS_ROM_SIZE, l_rom_decoded);
   }
+#endif
 }
 
 /******************************************************************************
 * P O R T S
 ******************************************************************************/
 
+// Port values are stored in the machine state (emuInvadersState)
+
 // Port 1 (input) - Bit Description
 // 0 - Coin slot (1=coin inserted, automatically resetted after port read?)
 // 1 - Two players button
@@ -303,7 +896,6 @@ uint8_t RdI8080(register uint16_t in_address)
 // 5 - Player one - Left button
 // 6 - Player one - Right button
 // 7 - n/a
-static volatile uint8_t l_port_in1 = 0x08;
 
 // Port 2 (input) - Bit Description
 // 0, 1 - DIP3, DIP5 00 = 3 ships 01 = 4 ships  10 = 5 ships 11 = 6 ships
@@ -313,12 +905,9 @@ static volatile uint8_t l_port_in1 = 0x08;
 // 5    - Player two - Left button
 // 6    - Player two - Right button
 // 7    - DIP switch: show/hide coin info (0=ON)
-static volatile uint8_t l_port_in2 = 0x00;
 
-// Ports used for hardware bit shifting
-static uint8_t l_port_out2 = 0;
-static uint8_t l_port_out4hi = 0;
-static uint8_t l_port_out4lo = 0;
+// Port 2 (output) - Shift amount of the hardware bit shifter
+// Port 4 (output) - Shift data of the hardware bit shifter
 
 // Port 3 (output) - Bit  Description
 // 0 - Spaceship (looped) sound
@@ -329,7 +918,6 @@ static uint8_t l_port_out4lo = 0;
 // 5 - n/a
 // 6 - n/a
 // 7 - n/a
-static uint8_t l_port_out3 = 0;
 
 // Port 5 (output) - Bit  Description
 // 0 - Invaders walk 1 sound
@@ -340,7 +928,6 @@ static uint8_t l_port_out3 = 0;
 // 5 - Amplifier enabled/disabled
 // 6 - n/a
 // 7 - n/a
-static uint8_t l_port_out5 = 0;
 
 /****************************************************************************
 * I N P U T  /  O U T P U T   P O R T S
@@ -349,8 +936,9 @@ static uint8_t l_port_out5 = 0;
 //--------------------------------------------------------------
 // Port read
 //--------------------------------------------------------------
-uint8_t InI8080(register uint16_t in_port)
+static uint8_t emuInvadersPortRead(cpuI8080State* R, uint16_t in_port)
 {
+  emuInvadersState* state = (emuInvadersState*)R->user;
   uint8_t retval = 0xff;
 
   switch(in_port & 0xff)
@@ -360,16 +948,16 @@ uint8_t InI8080(register uint16_t in_port)
       break;
 
     case 1:
-      retval = l_port_in1;  // port 1 input in_value
+      retval = state->port_in1;  // port 1 input in_value
       break;
 
     case 2:
-      retval = l_port_in2;
+      retval = state->port_in2;
       retval = 0;
       break;
 
     case 3:
-      retval = (uint8_t)(((((uint32_t)l_port_out4hi << 8) | l_port_out4lo) << l_port_out2) >> 8);
+      retval = (uint8_t)(((((uint32_t)state->port_out4hi << 8) | state->port_out4lo) << state->port_out2) >> 8);
       break;
   }
 
@@ -379,50 +967,395 @@ uint8_t InI8080(register uint16_t in_port)
 //--------------------------------------------------------------
 // Port write
 //--------------------------------------------------------------
-void OutI8080(register uint16_t in_port,register uint8_t in_value)
+static void emuInvadersPortWrite(cpuI8080State* R, uint16_t in_port, uint8_t in_value)
 {
+  emuInvadersState* state = (emuInvadersState*)R->user;
+
   switch(in_port & 0xff)
   {
     case 2:
-      l_port_out2 = in_value;
+      state->port_out2 = in_value;
       break;
 
     case 3:
       // Port 3 controls some sounds
-      if((in_value & 0x01) && !(l_port_out3 & 0x01))
+      if((in_value & 0x01) && !(state->port_out3 & 0x01))
       {
-				l_ufo_sound_channel = waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_UFO, waveMIXER_CS_LOOP_ENABLED);
+				state->ufo_sound_channel = waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_UFO, waveMIXER_CS_LOOP_ENABLED);
       }
 
-      if(!(in_value & 0x01) && (l_port_out3 & 0x01))
+      if(!(in_value & 0x01) && (state->port_out3 & 0x01))
       {
-        waveMixerStopWave(&l_wave_mixer_state, l_ufo_sound_channel);
-        l_ufo_sound_channel = waveMIXER_INVALID_CHANNEL;
+        waveMixerStopWave(&state->wave_mixer, state->ufo_sound_channel);
+        state->ufo_sound_channel = waveMIXER_INVALID_CHANNEL;
       }
 
-      if( (in_value & 0x02) && !(l_port_out3 & 0x02) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_SHOT, 0);
-      if( (in_value & 0x04) && !(l_port_out3 & 0x04) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_BASE_HIT, 0);
-      if( (in_value & 0x08) && !(l_port_out3 & 0x08) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_INV_HIT, 0);
-      l_port_out3 = in_value;
+      if( (in_value & 0x02) && !(state->port_out3 & 0x02) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_SHOT, 0);
+      if( (in_value & 0x04) && !(state->port_out3 & 0x04) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_BASE_HIT, 0);
+      if( (in_value & 0x08) && !(state->port_out3 & 0x08) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_INV_HIT, 0);
+      state->port_out3 = in_value;
       break;
 
     case 4:
-      l_port_out4lo = l_port_out4hi;
-      l_port_out4hi = in_value;
+      state->port_out4lo = state->port_out4hi;
+      state->port_out4hi = in_value;
       break;
 
     case 5:
         // Port 5 controls sounds
-			if( (in_value & 0x01) && !(l_port_out5 & 0x01) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_WALK1, 0);
-      if( (in_value & 0x02) && !(l_port_out5 & 0x02) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_WALK2, 0);
-      if( (in_value & 0x04) && !(l_port_out5 & 0x04) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_WALK3, 0);
-      if( (in_value & 0x08) && !(l_port_out5 & 0x08) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_WALK4, 0);
-      if( (in_value & 0x10) && !(l_port_out5 & 0x10) ) waveMixerPlayWaveFromResource(&l_wave_mixer_state, REF_WAV_UFO_HIT, 0);
-      l_port_out5 = in_value;
+			if( (in_value & 0x01) && !(state->port_out5 & 0x01) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_WALK1, 0);
+      if( (in_value & 0x02) && !(state->port_out5 & 0x02) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_WALK2, 0);
+      if( (in_value & 0x04) && !(state->port_out5 & 0x04) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_WALK3, 0);
+      if( (in_value & 0x08) && !(state->port_out5 & 0x08) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_WALK4, 0);
+      if( (in_value & 0x10) && !(state->port_out5 & 0x10) ) waveMixerPlayWaveFromResource(&state->wave_mixer, REF_WAV_UFO_HIT, 0);
+      state->port_out5 = in_value;
       break;
   }
 }
 
+#if defined(cpuI8080_SNAPSHOT) || defined(emuINVADERS_AUDIO_SYNC)
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Renders the whole video RAM to the screen
+/// @param in_state Machine state
+static void emuInvadersRenderVideoRAM(emuInvadersState* in_state)
+{
+#ifdef emuINVADERS_VSYNC_RENDERING
+	uint16_t column;
+
+	for (column = 0; column < emuINVADERS_SCREEN_WIDTH; column++)
+		in_state->dirty_video_columns[column] = 0xffffffff;
+
+	emuInvadersRenderDirtyVideoRAM(in_state);
+#else
+	const uint8_t* video_ram = emuInvadersInstanceGetVideoRAM(in_state);
+	uint16_t address;
+
+	for (address = 0; address < emuINVADERS_VIDEO_RAM_SIZE; address++)
+		emuInvadersRenderPixels(address, video_ram[address]);
+
+	in_state->rendered_byte_count += emuINVADERS_VIDEO_RAM_SIZE;
+#endif
+}
+#endif
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Renders the changed bytes of the video RAM (column by column or tile by tile) and clears the dirty bitmap
+/// @param in_state Machine state
+static void emuInvadersRenderDirtyVideoRAM(emuInvadersState* in_state)
+{
+	const uint8_t* video_ram = emuInvadersInstanceGetVideoRAM(in_state);
+#ifdef emuINVADERS_TILED_RENDERING
+	in_state->rendered_byte_count += emuInvadersRenderTiles(video_ram, in_state->dirty_video_columns);
+#else
+	uint16_t column;
+
+	for (column = 0; column < emuINVADERS_SCREEN_WIDTH; column++)
+	{
+		if (in_state->dirty_video_columns[column] != 0)
+		{
+			in_state->rendered_byte_count += emuInvadersRenderColumn(column, video_ram + column * emuINVADERS_VIDEO_COLUMN_SIZE, in_state->dirty_video_columns[column]);
+			in_state->dirty_video_columns[column] = 0;
+		}
+	}
+#endif
+}
+#endif
+
+#ifdef cpuI8080_PROFILER
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes profiler report of the displayed machine into the report file
+static void emuInvadersWriteProfilerReport(void)
+{
+	FILE* file = fopen(emuINVADERS_PROFILER_REPORT_FILE_NAME, "w");
+
+	if (file == sysNULL)
+		return;
+
+	cpuI8080ProfilerReport(&g_invaders_state.cpu, file);
+
+	fclose(file);
+}
+#endif
+
+#ifdef cpuI8080_TRACE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves instruction trace of the displayed machine into the trace file and restarts recording
+static void emuInvadersSaveTrace(void)
+{
+	cpuTraceSave(&l_trace, emuINVADERS_TRACE_FILE_NAME);
+	cpuTraceReset(&l_trace);
+}
+#endif
+
+#ifdef cpuI8080_SNAPSHOT
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves state of the playing sound channels. Sample pointers are saved as resource addresses.
+/// @param in_mixer Wave mixer state
+/// @param in_writer Snapshot writer
+static void emuInvadersSaveWaveMixer(waveMixerState* in_mixer, emuSnapshotWriter* in_writer)
+{
+	waveMixerChannelState* channel;
+	uint8_t i;
+
+	emuSnapshotWriteByte(in_writer, in_mixer->FirstActiveChannel);
+
+	for (i = 0; i < waveMIXER_CHANNEL_COUNT; i++)
+	{
+		channel = &in_mixer->ChannelState[i];
+
+		emuSnapshotWriteDWord(in_writer, channel->State);
+		emuSnapshotWriteDWord(in_writer, (uint32_t)channel->SamplesAddress);
+		emuSnapshotWriteDWord(in_writer, channel->SamplesCount);
+		emuSnapshotWriteDWord(in_writer, channel->SampleRate);
+		emuSnapshotWriteDWord(in_writer, channel->Position);
+		emuSnapshotWriteDWord(in_writer, channel->Phase);
+		emuSnapshotWriteByte(in_writer, channel->NextActiveChannel);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores state of the sound channels
+/// @param in_mixer Wave mixer state
+/// @param in_reader Snapshot reader (error is set when the channel list is inconsistent)
+static void emuInvadersLoadWaveMixer(waveMixerState* in_mixer, emuSnapshotReader* in_reader)
+{
+	waveMixerChannelState* channel;
+	uint8_t i;
+
+	in_mixer->FirstActiveChannel = emuSnapshotReadByte(in_reader);
+	if (in_mixer->FirstActiveChannel >= waveMIXER_CHANNEL_COUNT && in_mixer->FirstActiveChannel != waveMIXER_INVALID_CHANNEL)
+		in_reader->Error = true;
+
+	for (i = 0; i < waveMIXER_CHANNEL_COUNT; i++)
+	{
+		channel = &in_mixer->ChannelState[i];
+
+		channel->State = emuSnapshotReadDWord(in_reader);
+		channel->SamplesAddress = (sysResourceAddress)emuSnapshotReadDWord(in_reader);
+		channel->SamplesCount = emuSnapshotReadDWord(in_reader);
+		channel->SampleRate = emuSnapshotReadDWord(in_reader);
+		channel->Position = emuSnapshotReadDWord(in_reader);
+		channel->Phase = emuSnapshotReadDWord(in_reader);
+		channel->NextActiveChannel = emuSnapshotReadByte(in_reader);
+
+		if (channel->NextActiveChannel >= waveMIXER_CHANNEL_COUNT && channel->NextActiveChannel != waveMIXER_INVALID_CHANNEL)
+			in_reader->Error = true;
+
+		if ((channel->State & waveMIXER_CS_ACTIVE) != 0)
+		{
+			if (channel->Position >= channel->SamplesCount || channel->Phase > 0xffff || !waveMixerRestoreChannelSamples(channel))
+				in_reader->Error = true;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves state of the devices (output port latches, timing and sound channels)
+/// @param in_state Machine state
+/// @param in_writer Snapshot writer
+static void emuInvadersSaveDevices(emuInvadersState* in_state, emuSnapshotWriter* in_writer)
+{
+	// output port latches (inputs belong to the host)
+	emuSnapshotWriteByte(in_writer, in_state->port_out2);
+	emuSnapshotWriteByte(in_writer, in_state->port_out3);
+	emuSnapshotWriteByte(in_writer, in_state->port_out4hi);
+	emuSnapshotWriteByte(in_writer, in_state->port_out4lo);
+	emuSnapshotWriteByte(in_writer, in_state->port_out5);
+
+	// timing
+	emuSnapshotWriteWord(in_writer, in_state->current_scanline);
+	emuSnapshotWriteDWord(in_writer, in_state->cycles_per_frame);
+	emuSnapshotWriteDWord(in_writer, in_state->frame_count);
+
+	// audio
+	emuInvadersSaveWaveMixer(&in_state->wave_mixer, in_writer);
+	emuSnapshotWriteByte(in_writer, in_state->ufo_sound_channel);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores state of the devices
+/// @param in_state Machine state
+/// @param in_reader Snapshot reader
+static void emuInvadersLoadDevices(emuInvadersState* in_state, emuSnapshotReader* in_reader)
+{
+	// output port latches
+	in_state->port_out2 = emuSnapshotReadByte(in_reader);
+	in_state->port_out3 = emuSnapshotReadByte(in_reader);
+	in_state->port_out4hi = emuSnapshotReadByte(in_reader);
+	in_state->port_out4lo = emuSnapshotReadByte(in_reader);
+	in_state->port_out5 = emuSnapshotReadByte(in_reader);
+
+	// timing
+	in_state->current_scanline = emuSnapshotReadWord(in_reader);
+	in_state->cycles_per_frame = emuSnapshotReadDWord(in_reader);
+	in_state->frame_count = emuSnapshotReadDWord(in_reader);
+
+	// cycle counter restarts at the frame boundary
+	if (in_state->current_scanline == 0)
+		in_state->cycles_per_frame = 0;
+
+	emuInvadersScheduleFrame(in_state);
+
+	// audio
+	emuInvadersLoadWaveMixer(&in_state->wave_mixer, in_reader);
+	in_state->ufo_sound_channel = emuSnapshotReadByte(in_reader);
+}
+#endif
+
+#ifdef cpuI8080_DIRTY_PAGES
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Finishes the frame: collects the pages written during the frame and stores the frame in the rewind history
+/// @param in_state Machine state
+static void emuInvadersEndFrame(emuInvadersState* in_state)
+{
+#ifdef emuINVADERS_REWIND
+	uint8_t rewind_state[emuREWIND_MAX_STATE_SIZE];
+#endif
+
+	in_state->dirty_pages = *cpuI8080GetDirtyPages(&in_state->cpu);
+	cpuI8080ClearDirtyPages(&in_state->cpu);
+	cpuDirtyPagesFoldMirror(&in_state->dirty_pages, emuINVADERS_RAM_MIRROR, emuINVADERS_RAM_START, emuINVADERS_RAM_SIZE);
+
+#ifdef emuINVADERS_REWIND
+	if (in_state->rewind != sysNULL)
+		emuRewindPushFrame(in_state->rewind, &in_state->dirty_pages, rewind_state, emuInvadersSaveRewindState(in_state, rewind_state));
+#endif
+}
+#endif
+
+#ifdef emuINVADERS_REWIND
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves CPU and device state (everything except the memory) for the rewind history
+/// @param in_state Machine state
+/// @param out_buffer Buffer receiving the state (emuREWIND_MAX_STATE_SIZE bytes)
+/// @return Length of the state in bytes
+static uint16_t emuInvadersSaveRewindState(emuInvadersState* in_state, uint8_t* out_buffer)
+{
+	emuSnapshotWriter writer;
+
+	emuSnapshotWriteBeginMemory(&writer, out_buffer, emuREWIND_MAX_STATE_SIZE);
+
+	cpuI8080SaveState(&in_state->cpu, &writer);
+	emuInvadersSaveDevices(in_state, &writer);
+
+	emuSnapshotWriteEnd(&writer);
+
+	return (uint16_t)writer.Length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Rewinds the displayed machine, one frame is restored in every frame time
+static void emuInvadersRewindHalfFrame(void)
+{
+	l_rewind_half_frame = !l_rewind_half_frame;
+
+	if (l_rewind_half_frame && emuInvadersInstanceStepBack(&g_invaders_state))
+		guiRefreshScreen();
+}
+#endif
+
+#ifdef emuINVADERS_AUDIO_SYNC
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes audio clock synchronization. The emulation starts at the current position of the audio clock.
+static void emuInvadersAudioSyncInitialize(void)
+{
+	l_sync_reported_sample_count = halWavePlayerGetPlayedSampleCount();
+	l_sync_reported_timestamp = sysHighresTimerGetTimestamp();
+	l_sync_sample_position = l_sync_reported_sample_count;
+	l_sync_lag = 0;
+	l_sync_next_task_time = l_sync_reported_timestamp;
+	l_sync_skipped_frame_count = 0;
+	l_sync_screen_invalid = false;
+
+	l_sync_statistics.dropped_frames = 0;
+	l_sync_statistics.buffer_fill = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Updates the lag of the emulation behind the audio clock and checks if the next half frame is due
+/// @return True if the half frame must be emulated now (the lag is decreased by the half frame)
+static bool emuInvadersAudioSyncIsHalfFrameDue(void)
+{
+	uint32_t reported_sample_count;
+	uint32_t sample_position;
+	uint32_t extrapolation;
+	int32_t sample_delta;
+	uint32_t time_to_next_half_frame;
+
+	// the device position is updated only once per period by some drivers, it is extrapolated between the updates
+	reported_sample_count = halWavePlayerGetPlayedSampleCount();
+	if (reported_sample_count != l_sync_reported_sample_count)
+	{
+		l_sync_reported_sample_count = reported_sample_count;
+		l_sync_reported_timestamp = sysHighresTimerGetTimestamp();
+	}
+
+	extrapolation = (uint32_t)((uint64_t)sysHighresTimerGetTimeSince(l_sync_reported_timestamp) * halWAVEPLAYER_SAMPLE_RATE / 1000000);
+	if (extrapolation > emuINVADERS_AUDIO_SYNC_MAX_EXTRAPOLATION)
+		extrapolation = emuINVADERS_AUDIO_SYNC_MAX_EXTRAPOLATION;
+
+	// the estimated position may step back when the device reports its real position
+	sample_position = l_sync_reported_sample_count + extrapolation;
+	sample_delta = (int32_t)(sample_position - l_sync_sample_position);
+	l_sync_sample_position = sample_position;
+
+	if (sample_delta > emuINVADERS_AUDIO_SYNC_MAX_LAG / emuINVADERS_AUDIO_SYNC_SCALE)
+		sample_delta = emuINVADERS_AUDIO_SYNC_MAX_LAG / emuINVADERS_AUDIO_SYNC_SCALE;
+	if (sample_delta < -emuINVADERS_AUDIO_SYNC_MAX_LAG / emuINVADERS_AUDIO_SYNC_SCALE)
+		sample_delta = -emuINVADERS_AUDIO_SYNC_MAX_LAG / emuINVADERS_AUDIO_SYNC_SCALE;
+
+	// lag over the maximum catch-up is not emulated
+	l_sync_lag += sample_delta * emuINVADERS_AUDIO_SYNC_SCALE;
+	if (l_sync_lag > emuINVADERS_AUDIO_SYNC_MAX_LAG)
+		l_sync_lag = emuINVADERS_AUDIO_SYNC_MAX_LAG;
+	if (l_sync_lag < -emuINVADERS_AUDIO_SYNC_MAX_LAG)
+		l_sync_lag = -emuINVADERS_AUDIO_SYNC_MAX_LAG;
+
+	l_sync_statistics.buffer_fill = halWavePlayerGetQueuedSampleCount();
+
+	if (l_sync_lag >= halWAVEPLAYER_SAMPLE_RATE)
+	{
+		l_sync_lag -= halWAVEPLAYER_SAMPLE_RATE;
+		return true;
+	}
+
+	// estimated time of the next half frame
+	time_to_next_half_frame = (uint32_t)((uint64_t)(halWAVEPLAYER_SAMPLE_RATE - l_sync_lag) * (emuINVADERS_FRAME_TIME / 2) / halWAVEPLAYER_SAMPLE_RATE);
+	l_sync_next_task_time = sysHighresTimerGetTimestamp();
+	sysHighresTimerAddToTimestamp(&l_sync_next_task_time, time_to_next_half_frame);
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Selects rendering of the next frame. The frame is emulated without rendering while the emulation is
+/// more than a frame behind the audio clock, the whole screen is redrawn at the next rendered frame.
+/// @param in_rendering_skip_allowed False if the frame must be rendered
+static void emuInvadersAudioSyncBeginFrame(bool in_rendering_skip_allowed)
+{
+	// the second half of this frame and one more frame is already due
+	if (in_rendering_skip_allowed && l_sync_lag >= 3 * halWAVEPLAYER_SAMPLE_RATE && l_sync_skipped_frame_count < emuINVADERS_AUDIO_SYNC_MAX_FRAME_SKIP)
+	{
+		g_invaders_state.display_enabled = false;
+		l_sync_screen_invalid = true;
+		l_sync_skipped_frame_count++;
+		l_sync_statistics.dropped_frames++;
+	}
+	else
+	{
+		g_invaders_state.display_enabled = true;
+		l_sync_skipped_frame_count = 0;
+
+		if (l_sync_screen_invalid)
+		{
+			emuInvadersRenderVideoRAM(&g_invaders_state);
+			l_sync_screen_invalid = false;
+		}
+	}
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // User input handler
 //-----------------------------------------------------------------------------
@@ -438,38 +1371,38 @@ void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategor
 			// 1 player button
 			case sysVKC_1:
 				if(pressed)
-					l_port_in1 |= 0x04;
+					g_invaders_state.port_in1 |= 0x04;
 				else
-		      l_port_in1 &= ~0x04;
+		      g_invaders_state.port_in1 &= ~0x04;
 				break;
 
 			// 2 player button
 			case sysVKC_2:
 				if(pressed)
-					l_port_in1 |= 0x02;
+					g_invaders_state.port_in1 |= 0x02;
 				else
-					l_port_in1 &= ~0x02;
+					g_invaders_state.port_in1 &= ~0x02;
 				break;
 
 			// coin insert
 			case sysVKC_3:
 				if(pressed)
-					l_port_in1 |= 0x01;
+					g_invaders_state.port_in1 |= 0x01;
 				else
-					l_port_in1 &= ~0x01;
+					g_invaders_state.port_in1 &= ~0x01;
 				break;
 
 			// player 1&2 fire
 			case sysVKC_SPACE:
 				if(pressed)
 				{
-					l_port_in1 |= 0x10;
-					l_port_in2 |= 0x10;
+					g_invaders_state.port_in1 |= 0x10;
+					g_invaders_state.port_in2 |= 0x10;
 				}
 				else
 				{
-					l_port_in1 &= ~0x10;
-					l_port_in2 &= ~0x10;
+					g_invaders_state.port_in1 &= ~0x10;
+					g_invaders_state.port_in2 &= ~0x10;
 				}
 				break;
 
@@ -477,13 +1410,13 @@ void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategor
 			case sysVKC_RIGHT | sysVKC_SPECIAL_KEY_FLAG:
 				if(pressed)
 				{
-					l_port_in1 |= 0x40;
-					l_port_in2 |= 0x40;
+					g_invaders_state.port_in1 |= 0x40;
+					g_invaders_state.port_in2 |= 0x40;
 				}
 				else
 				{
-					l_port_in1 &= ~0x40;
-					l_port_in2 &= ~0x40;
+					g_invaders_state.port_in1 &= ~0x40;
+					g_invaders_state.port_in2 &= ~0x40;
 				}
 				break;
 
@@ -491,15 +1424,55 @@ void emuUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategor
 			case sysVKC_LEFT | sysVKC_SPECIAL_KEY_FLAG:
 				if(pressed)
 				{
-					l_port_in1 |= 0x20;
-					l_port_in2 |= 0x20;
+					g_invaders_state.port_in1 |= 0x20;
+					g_invaders_state.port_in2 |= 0x20;
 				}
 				else
 				{
-					l_port_in1 &= ~0x20;
-					l_port_in2 &= ~0x20;
+					g_invaders_state.port_in1 &= ~0x20;
+					g_invaders_state.port_in2 &= ~0x20;
 				}
 				break;
+
+#ifdef cpuI8080_PROFILER
+			// write profiler report
+			case sysVKC_F12:
+				if(pressed)
+					emuInvadersWriteProfilerReport();
+				break;
+#endif
+
+#ifdef emuINVADERS_REWIND
+			// rewind while the key is held
+			case sysVKC_F8:
+				l_rewind_requested = pressed;
+				break;
+#endif
+
+#ifdef cpuI8080_SNAPSHOT
+			// save machine state
+			case sysVKC_F9:
+				if(pressed)
+					emuInvadersInstanceSaveSnapshot(&g_invaders_state, emuINVADERS_SNAPSHOT_FILE_NAME);
+				break;
+
+			// restore machine state
+			case sysVKC_F10:
+				if(pressed)
+					emuInvadersInstanceLoadSnapshot(&g_invaders_state, emuINVADERS_SNAPSHOT_FILE_NAME);
+				break;
+#endif
+
+#ifdef cpuI8080_TRACE
+			// save instruction trace
+			case sysVKC_F11:
+				if(pressed)
+				{
+					cpuTraceStop(&l_trace, cpuTRACE_TRIGGER_USER, g_invaders_state.cpu.reg.pc);
+					emuInvadersSaveTrace();
+				}
+				break;
+#endif
 		}
 	}
 }
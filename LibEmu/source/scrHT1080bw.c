@@ -55,7 +55,7 @@ void emuHT1080EndScreenrefresh(void)
 /// @param in_video_memory_address Video memory address where the character is located for rendering
 void emuHT1080RenderCharacter(uint16_t in_video_memory_address)
 {
-	uint8_t character_to_display = g_video_ram[in_video_memory_address];
+	uint8_t character_to_display = g_ht1080_state.video_ram[in_video_memory_address];
 	const uint8_t* character_memory_pointer;
 	uint8_t character_row;
 	uint8_t pixel_byte;
@@ -222,6 +222,30 @@ void emuHT1080RenderCharacter(uint16_t in_video_memory_address)
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Renders the changed characters of the video memory row by row
+/// @param in_dirty_rows Changed characters of the character rows (bit n is column n of the row)
+void emuHT1080RenderDirtyCharacters(const uint64_t* in_dirty_rows)
+{
+	uint8_t row;
+	uint8_t column;
+	uint64_t dirty_columns;
+	uint16_t address;
+
+	for (row = 0; row < emuHT1080_SCREEN_HEIGHT_IN_CHARACTER; row++)
+	{
+		dirty_columns = in_dirty_rows[row];
+		address = row * emuHT1080_SCREEN_WIDTH_IN_CHARACTER;
+
+		// skip the unchanged characters of the row
+		for (column = 0; dirty_columns != 0; column++, dirty_columns >>= 1)
+		{
+			if ((dirty_columns & 1) != 0)
+				emuHT1080RenderCharacter(address + column);
+		}
+	}
+}
+
 
 #if 0
 void emuHT1080RenderScanLine(uint16_t in_line_index)
@@ -229,7 +253,7 @@ void emuHT1080RenderScanLine(uint16_t in_line_index)
 	int character_memory_row_index = in_line_index / emuHT1080_CHARACTER_HEIGHT;
 	int character_row_index = in_line_index % emuHT1080_CHARACTER_HEIGHT;
 	uint8_t* frame_buffer_pointer = &g_gui_frame_buffer[in_line_index * guiFRAME_BUFFER_ROW_LENGTH];
-	uint8_t* video_memory_pointer = &g_video_ram[character_memory_row_index * emuHT1080_SCREEN_WIDTH_IN_CHARACTER];
+	uint8_t* video_memory_pointer = &g_ht1080_state.video_ram[character_memory_row_index * emuHT1080_SCREEN_WIDTH_IN_CHARACTER];
 	uint16_t pixel_buffer;
 	uint8_t pixel_shift;
 	int column_index;
@@ -21,6 +21,32 @@
 /*****************************************************************************/
 #define emuINVADERS_PIXEL_COUNT 8
 
+#ifdef emuINVADERS_VSYNC_RENDERING
+// Pixel format of the column renderer (device format of the screen)
+#if guiCOLOR_DEPTH == 16
+#define emuINVADERS_PIXEL_RGB565
+#elif guiCOLOR_DEPTH == 24
+#define emuINVADERS_PIXEL_RGB888
+#elif guiCOLOR_DEPTH == 32
+#define emuINVADERS_PIXEL_XRGB8888
+#else
+#error Invalid color depth
+#endif
+#define emuINVADERS_PIXEL_SIZE (guiCOLOR_DEPTH / 8)
+
+#ifdef emuINVADERS_TILED_RENDERING
+#define emuINVADERS_TILE_BYTE_COUNT (emuINVADERS_TILE_SIZE / 8)		// video memory bytes of one column of a tile
+#endif
+
+// SIMD pixel expansion
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define emuINVADERS_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define emuINVADERS_NEON
+#include <arm_neon.h>
+#endif
+#endif
 
 #define SET_PIXEL(address, data, mask, color, background_pointer)  if((data & mask)!=0) { *address = color; }	else {  *address = drvResourceReadWord(background_pointer); }
 
@@ -38,6 +64,42 @@ static uint16_t l_red_pixel;
 static sysResourceAddress l_background_data;
 static guiSize l_background_size;
 
+#ifdef emuINVADERS_VSYNC_RENDERING
+// overlay and background in device format (RGB888 is stored as XRGB8888 and packed when it is rendered)
+#ifdef emuINVADERS_PIXEL_RGB565
+typedef uint16_t emuInvadersPixel;
+#else
+typedef uint32_t emuInvadersPixel;
+#endif
+
+static emuInvadersPixel l_overlay_pixels[2][emuINVADERS_SCREEN_HEIGHT];											// overlay color of the rows (white and green bottom area)
+#ifdef emuINVADERS_TILED_RENDERING
+static emuInvadersPixel l_background_pixels[emuINVADERS_SCREEN_HEIGHT][emuINVADERS_SCREEN_WIDTH];		// background of the rows
+static emuInvadersPixel l_overlay_column_masks[emuINVADERS_SCREEN_WIDTH];										// all ones when the column uses the green bottom overlay
+static emuInvadersPixel l_band_buffer[emuINVADERS_TILE_SIZE * emuINVADERS_SCREEN_WIDTH];				// rows of one band of tiles
+#else
+static emuInvadersPixel l_background_pixels[emuINVADERS_SCREEN_WIDTH][emuINVADERS_SCREEN_HEIGHT];		// background of the columns
+static emuInvadersPixel l_column_buffer[emuINVADERS_SCREEN_HEIGHT];
+#endif
+#endif
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static uint16_t emuInvadersGetPixelColor(guiCoordinate in_x, guiCoordinate in_y);
+static void emuInvadersRenderByte(uint16_t* in_pixel_buffer, uint8_t in_data, uint16_t in_pixel_color, sysResourceAddress in_background_data);
+#ifdef emuINVADERS_VSYNC_RENDERING
+static emuInvadersPixel emuInvadersRGB565ToPixel(uint16_t in_color);
+#ifdef emuINVADERS_TILED_RENDERING
+static void emuInvadersExpandTileRows(uint8_t* out_pixels, const uint8_t* in_tile_data, uint16_t in_x, uint16_t in_y);
+#ifdef emuINVADERS_PIXEL_RGB888
+static void emuInvadersPackPixels(uint8_t* out_pixels, const uint32_t* in_pixels, uint8_t in_pixel_count);
+#endif
+#else
+static void emuInvadersExpandColumn(uint8_t* out_pixels, const uint8_t* in_column_data, uint8_t in_first_byte, uint8_t in_byte_count, const emuInvadersPixel* in_overlay, const emuInvadersPixel* in_background);
+#endif
+#endif
+
 /*****************************************************************************/
 /* Function implementation                                                   */
 /*****************************************************************************/
@@ -78,6 +140,11 @@ static guiSize l_background_size;
 /// @brief Initializes invaders renderer
 void emuInvadersRendererInitialize(void)
 {
+#ifdef emuINVADERS_VSYNC_RENDERING
+	guiCoordinate x, y;
+	sysResourceAddress background_data;
+#endif
+
 	// cache pixel color
 	l_white_pixel = guiColorToRGB565(guiCOLOR_WHITE);
 	l_green_pixel = guiColorToRGB565(guiCOLOR_LIME);
@@ -86,6 +153,34 @@ void emuInvadersRendererInitialize(void)
 	// cache bitmap data
 	l_background_data = guiGetBitmapData(REF_BMP_BACKGROUND);
 	l_background_size = guiGetBitmapSize(REF_BMP_BACKGROUND);
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+	// convert overlay and background to the device format
+	for (y = 0; y < emuINVADERS_SCREEN_HEIGHT; y++)
+	{
+		l_overlay_pixels[0][y] = emuInvadersRGB565ToPixel(emuInvadersGetPixelColor(0, y));
+		l_overlay_pixels[1][y] = emuInvadersRGB565ToPixel(emuInvadersGetPixelColor(16, y));
+	}
+
+	for (x = 0; x < emuINVADERS_SCREEN_WIDTH; x++)
+	{
+		background_data = l_background_data + l_background_size.Width * sizeof(uint16_t) * emuINVADERS_SCREEN_TOP + (emuINVADERS_SCREEN_LEFT + x) * sizeof(uint16_t);
+
+		for (y = 0; y < emuINVADERS_SCREEN_HEIGHT; y++)
+		{
+#ifdef emuINVADERS_TILED_RENDERING
+			l_background_pixels[y][x] = emuInvadersRGB565ToPixel(drvResourceReadWord(background_data));
+#else
+			l_background_pixels[x][y] = emuInvadersRGB565ToPixel(drvResourceReadWord(background_data));
+#endif
+			background_data += l_background_size.Width * sizeof(uint16_t);
+		}
+
+#ifdef emuINVADERS_TILED_RENDERING
+		l_overlay_column_masks[x] = (x < 16 || x > 134) ? 0 : (emuInvadersPixel)~0;
+#endif
+	}
+#endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -93,8 +188,6 @@ void emuInvadersRendererInitialize(void)
 void emuInvadersRenderPixels(uint16_t in_memory_address, uint8_t in_data)
 {
 	guiCoordinate x, y;
-	uint16_t* pixel_buffer_address;
-	uint16_t pixel_color;
 	sysResourceAddress background_data;
 
 	x = in_memory_address / (emuINVADERS_SCREEN_HEIGHT / 8);
@@ -102,88 +195,522 @@ void emuInvadersRenderPixels(uint16_t in_memory_address, uint8_t in_data)
 
 	background_data = l_background_data + l_background_size.Width * sizeof(uint16_t) * (emuINVADERS_SCREEN_TOP + y) + (emuINVADERS_SCREEN_LEFT + x) * sizeof(uint16_t);
 
-	// pixel color
-	if(y < 32)
+	emuInvadersRenderByte(l_pixel_buffer, in_data, emuInvadersGetPixelColor(x, y), background_data);
+
+	guiBitblt(x + emuINVADERS_SCREEN_LEFT, y + emuINVADERS_SCREEN_TOP, 1, emuINVADERS_PIXEL_COUNT, 0, 0, 1, emuINVADERS_PIXEL_COUNT, l_pixel_buffer, 16);
+}
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+#ifdef emuINVADERS_TILED_RENDERING
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Renders the tiles of the screen which contain changed video memory bytes and clears their dirty bits.
+/// The screen is processed in horizontal bands of tiles. The columns of a dirty tile are transposed and expanded
+/// into the rows of the band buffer, consecutive dirty tiles of a band are copied to the screen by one bitblt.
+/// @param in_video_ram Video memory
+/// @param in_dirty_columns Changed bytes of the columns (bit n is byte n of the column)
+/// @return Number of rendered bytes
+uint32_t emuInvadersRenderTiles(const uint8_t* in_video_ram, uint32_t* in_dirty_columns)
+{
+	uint8_t tile_data[emuINVADERS_TILE_SIZE];
+	uint32_t band_mask;
+	uint32_t rendered_byte_count = 0;
+	guiCoordinate band_y;
+	uint16_t tile_x;
+	uint16_t run_x = 0;
+	uint16_t run_width;
+	uint16_t column;
+	int8_t band_byte;
+	uint8_t byte_index;
+	bool dirty;
+
+	// bands are processed from the top of the screen (last bytes of the columns)
+	for (band_byte = emuINVADERS_VIDEO_COLUMN_SIZE - emuINVADERS_TILE_BYTE_COUNT; band_byte >= 0; band_byte -= emuINVADERS_TILE_BYTE_COUNT)
+	{
+		band_mask = ((1ul << emuINVADERS_TILE_BYTE_COUNT) - 1) << band_byte;
+		band_y = emuINVADERS_SCREEN_HEIGHT - (band_byte + emuINVADERS_TILE_BYTE_COUNT) * 8;
+		run_width = 0;
+
+		// one step past the last tile flushes the last run
+		for (tile_x = 0; tile_x <= emuINVADERS_SCREEN_WIDTH; tile_x += emuINVADERS_TILE_SIZE)
+		{
+			dirty = false;
+			if (tile_x < emuINVADERS_SCREEN_WIDTH)
+			{
+				for (column = tile_x; column < tile_x + emuINVADERS_TILE_SIZE; column++)
+				{
+					if ((in_dirty_columns[column] & band_mask) != 0)
+						dirty = true;
+
+					in_dirty_columns[column] &= ~band_mask;
+				}
+			}
+
+			if (dirty)
+			{
+				// one byte of each column of the tile gives eight rows of the tile (top byte first)
+				for (byte_index = 0; byte_index < emuINVADERS_TILE_BYTE_COUNT; byte_index++)
+				{
+					for (column = 0; column < emuINVADERS_TILE_SIZE; column++)
+						tile_data[column] = in_video_ram[(tile_x + column) * emuINVADERS_VIDEO_COLUMN_SIZE + band_byte + emuINVADERS_TILE_BYTE_COUNT - 1 - byte_index];
+
+					emuInvadersExpandTileRows((uint8_t*)l_band_buffer + (byte_index * 8 * emuINVADERS_SCREEN_WIDTH + tile_x) * emuINVADERS_PIXEL_SIZE, tile_data, tile_x, band_y + byte_index * 8);
+				}
+
+				if (run_width == 0)
+					run_x = tile_x;
+
+				run_width += emuINVADERS_TILE_SIZE;
+				rendered_byte_count += emuINVADERS_TILE_SIZE * emuINVADERS_TILE_BYTE_COUNT;
+			}
+			else
+			{
+				if (run_width > 0)
+				{
+					guiBitblt(run_x + emuINVADERS_SCREEN_LEFT, band_y + emuINVADERS_SCREEN_TOP, run_width, emuINVADERS_TILE_SIZE, run_x, 0, emuINVADERS_SCREEN_WIDTH, emuINVADERS_TILE_SIZE, l_band_buffer, guiCOLOR_DEPTH);
+					run_width = 0;
+				}
+			}
+		}
+	}
+
+	return rendered_byte_count;
+}
+#else
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Renders the selected bytes of one screen column. Consecutive bytes are expanded into the column buffer
+/// in device format and copied to the screen by one bitblt.
+/// @param in_column Index of the column (x coordinate)
+/// @param in_column_data Video memory of the column (emuINVADERS_VIDEO_COLUMN_SIZE bytes, bottom to top)
+/// @param in_byte_mask Bytes to render (bit n selects byte n)
+/// @return Number of rendered bytes
+uint8_t emuInvadersRenderColumn(uint16_t in_column, const uint8_t* in_column_data, uint32_t in_byte_mask)
+{
+	const emuInvadersPixel* overlay;
+	guiCoordinate run_y;
+	uint16_t run_length;
+	uint8_t rendered_byte_count = 0;
+	int8_t byte_index;
+	int8_t first_byte_index;
+
+	overlay = l_overlay_pixels[(in_column < 16 || in_column > 134) ? 0 : 1];
+
+	// runs of the selected bytes are processed from the top of the screen (last byte of the column)
+	byte_index = emuINVADERS_VIDEO_COLUMN_SIZE - 1;
+	while (byte_index >= 0)
 	{
-		pixel_color = l_white_pixel;
+		if ((in_byte_mask & (1ul << byte_index)) == 0)
+		{
+			byte_index--;
+			continue;
+		}
+
+		first_byte_index = byte_index;
+		while (first_byte_index > 0 && (in_byte_mask & (1ul << (first_byte_index - 1))) != 0)
+			first_byte_index--;
+
+		run_y = emuINVADERS_SCREEN_HEIGHT - (byte_index + 1) * 8;
+		run_length = (byte_index - first_byte_index + 1) * emuINVADERS_PIXEL_COUNT;
+
+		emuInvadersExpandColumn((uint8_t*)l_column_buffer, in_column_data, first_byte_index, byte_index - first_byte_index + 1, overlay, l_background_pixels[in_column]);
+		guiBitblt(in_column + emuINVADERS_SCREEN_LEFT, run_y + emuINVADERS_SCREEN_TOP, 1, run_length, 0, 0, 1, run_length, l_column_buffer, guiCOLOR_DEPTH);
+
+		rendered_byte_count += byte_index - first_byte_index + 1;
+		byte_index = first_byte_index - 1;
+	}
+
+	return rendered_byte_count;
+}
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Renders scanline into line buffer and uses BitBlt to display it
+void emuInvadersRenderScanLine(uint16_t in_line_index)
+{
+	// do nothing
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets color of the pixels of the screen overlay
+/// @param in_x X coordinate of the pixels
+/// @param in_y Y coordinate of the first pixel (eight pixels have the same color)
+/// @return Pixel color in RGB565 format
+static uint16_t emuInvadersGetPixelColor(guiCoordinate in_x, guiCoordinate in_y)
+{
+	if(in_y < 32)
+	{
+		return l_white_pixel;
 	}
 	else
 	{
-		if(y < 64)
+		if(in_y < 64)
 		{
-			pixel_color = l_red_pixel;
+			return l_red_pixel;
 		}
 		else
 		{
-			if(y < 184)
+			if(in_y < 184)
 			{
-				pixel_color = l_white_pixel;
+				return l_white_pixel;
 			}
 			else
 			{
-				if(y < 240)
+				if(in_y < 240)
 				{
-					pixel_color = l_green_pixel;
+					return l_green_pixel;
 				}
 				else
 				{
-					if(x < 16 || x > 134)
+					if(in_x < 16 || in_x > 134)
 					{
-						pixel_color = l_white_pixel;
+						return l_white_pixel;
 					}
 					else
 					{
-						pixel_color = l_green_pixel;
+						return l_green_pixel;
 					}
 				}
 			}
 		}
 	}
+}
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Renders one byte of the video memory into eight vertical pixels (the MSB is the top pixel)
+/// @param in_pixel_buffer Pixel buffer
+/// @param in_data Video memory byte
+/// @param in_pixel_color Color of the set pixels
+/// @param in_background_data Resource address of the background bitmap pixel of the top pixel
+static void emuInvadersRenderByte(uint16_t* in_pixel_buffer, uint8_t in_data, uint16_t in_pixel_color, sysResourceAddress in_background_data)
+{
 	// process one byte (8 pixel)
-	pixel_buffer_address = &l_pixel_buffer[0];
-
-	SET_PIXEL(pixel_buffer_address, in_data, 0x80, pixel_color, background_data);
-	pixel_buffer_address++;
-	background_data += l_background_size.Width * sizeof(uint16_t);
-
-	SET_PIXEL(pixel_buffer_address, in_data, 0x40, pixel_color, background_data);
-	pixel_buffer_address++;
-	background_data += l_background_size.Width * sizeof(uint16_t);
-
-	SET_PIXEL(pixel_buffer_address, in_data, 0x20, pixel_color, background_data);
-	pixel_buffer_address++;
-	background_data += l_background_size.Width * sizeof(uint16_t);
-	
-	SET_PIXEL(pixel_buffer_address, in_data, 0x10, pixel_color, background_data);
-	pixel_buffer_address++;
-	background_data += l_background_size.Width * sizeof(uint16_t);
-	
-	SET_PIXEL(pixel_buffer_address, in_data, 0x08, pixel_color, background_data);
-	pixel_buffer_address++;
-	background_data += l_background_size.Width * sizeof(uint16_t);
-	
-	SET_PIXEL(pixel_buffer_address, in_data, 0x04, pixel_color, background_data);
-	pixel_buffer_address++;
-	background_data += l_background_size.Width * sizeof(uint16_t);
-	
-	SET_PIXEL(pixel_buffer_address, in_data, 0x02, pixel_color, background_data);
-	pixel_buffer_address++;
-	background_data += l_background_size.Width * sizeof(uint16_t);
-	
-	SET_PIXEL(pixel_buffer_address, in_data, 0x01, pixel_color, background_data);
+	SET_PIXEL(in_pixel_buffer, in_data, 0x80, in_pixel_color, in_background_data);
+	in_pixel_buffer++;
+	in_background_data += l_background_size.Width * sizeof(uint16_t);
 
-	guiBitblt(x + emuINVADERS_SCREEN_LEFT, y + emuINVADERS_SCREEN_TOP, 1, emuINVADERS_PIXEL_COUNT, 0, 0, 1, emuINVADERS_PIXEL_COUNT, l_pixel_buffer, 16);
+	SET_PIXEL(in_pixel_buffer, in_data, 0x40, in_pixel_color, in_background_data);
+	in_pixel_buffer++;
+	in_background_data += l_background_size.Width * sizeof(uint16_t);
+
+	SET_PIXEL(in_pixel_buffer, in_data, 0x20, in_pixel_color, in_background_data);
+	in_pixel_buffer++;
+	in_background_data += l_background_size.Width * sizeof(uint16_t);
+
+	SET_PIXEL(in_pixel_buffer, in_data, 0x10, in_pixel_color, in_background_data);
+	in_pixel_buffer++;
+	in_background_data += l_background_size.Width * sizeof(uint16_t);
+
+	SET_PIXEL(in_pixel_buffer, in_data, 0x08, in_pixel_color, in_background_data);
+	in_pixel_buffer++;
+	in_background_data += l_background_size.Width * sizeof(uint16_t);
+
+	SET_PIXEL(in_pixel_buffer, in_data, 0x04, in_pixel_color, in_background_data);
+	in_pixel_buffer++;
+	in_background_data += l_background_size.Width * sizeof(uint16_t);
+
+	SET_PIXEL(in_pixel_buffer, in_data, 0x02, in_pixel_color, in_background_data);
+	in_pixel_buffer++;
+	in_background_data += l_background_size.Width * sizeof(uint16_t);
+
+	SET_PIXEL(in_pixel_buffer, in_data, 0x01, in_pixel_color, in_background_data);
 }
 
+#ifdef emuINVADERS_VSYNC_RENDERING
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Converts RGB565 color to the pixel format of the column renderer
+/// @param in_color Color in RGB565 format
+/// @return Pixel in device format
+static emuInvadersPixel emuInvadersRGB565ToPixel(uint16_t in_color)
+{
+#ifdef emuINVADERS_PIXEL_RGB565
+	return in_color;
+#else
+	return ((uint32_t)(in_color & 0xf800) << 8) | ((uint32_t)(in_color & 0x07e0) << 5) | ((uint32_t)(in_color & 0x001f) << 3);
+#endif
+}
 
+#ifdef emuINVADERS_TILED_RENDERING
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Renders scanline into line buffer and uses BitBlt to display it
-void emuInvadersRenderScanLine(uint16_t in_line_index)
+/// @brief Expands one video memory byte of each column of a tile (one bit per pixel) into eight rows of device
+/// format pixels. The set pixels get the overlay color of the row and column, the cleared pixels get the
+/// background. The MSB of the bytes is the first (top) row.
+/// @param out_pixels First pixel of the first row in the band buffer
+/// @param in_tile_data Video memory bytes of the columns of the tile
+/// @param in_x X coordinate of the first column of the tile
+/// @param in_y Y coordinate of the first row
+static void emuInvadersExpandTileRows(uint8_t* out_pixels, const uint8_t* in_tile_data, uint16_t in_x, uint16_t in_y)
 {
-	// do nothing
+	const emuInvadersPixel* background;
+	const emuInvadersPixel* column_masks;
+	uint8_t* row_pixels;
+	uint8_t bit_index;
+	uint16_t y;
+#if defined(emuINVADERS_SSE2)
+	__m128i data;
+	__m128i bit_mask;
+	__m128i mask;
+	__m128i overlay;
+	uint8_t column;
+#ifdef emuINVADERS_PIXEL_RGB565
+	__m128i column_mask;
+#else
+	__m128i column_mask_low;
+	__m128i column_mask_high;
+	__m128i mask_low;
+	__m128i mask_high;
+#endif
+#elif defined(emuINVADERS_NEON)
+	uint16x8_t data;
+	uint16x8_t mask;
+	uint8_t column;
+#ifdef emuINVADERS_PIXEL_RGB565
+	uint16x8_t column_mask;
+	uint16x8_t overlay;
+#else
+	uint32x4_t column_mask_low;
+	uint32x4_t column_mask_high;
+	uint32x4_t overlay_low;
+	uint32x4_t overlay_high;
+#endif
+#else
+	emuInvadersPixel pixel_mask;
+	emuInvadersPixel overlay;
+	uint8_t column;
+#endif
+#if defined(emuINVADERS_PIXEL_RGB888)
+	uint32_t pixels[emuINVADERS_TILE_SIZE];
+#endif
+
+#if defined(emuINVADERS_SSE2) || defined(emuINVADERS_NEON)
+	// columns are processed in groups of eight, the bytes of the group are widened to 16 bit lanes once
+	for (column = 0; column < emuINVADERS_TILE_SIZE; column += emuINVADERS_PIXEL_COUNT)
+	{
+		column_masks = l_overlay_column_masks + in_x + column;
+
+#if defined(emuINVADERS_SSE2)
+		data = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(in_tile_data + column)), _mm_setzero_si128());
+#ifdef emuINVADERS_PIXEL_RGB565
+		column_mask = _mm_loadu_si128((const __m128i*)column_masks);
+#else
+		column_mask_low = _mm_loadu_si128((const __m128i*)column_masks);
+		column_mask_high = _mm_loadu_si128((const __m128i*)(column_masks + 4));
+#endif
+#else
+		data = vmovl_u8(vld1_u8(in_tile_data + column));
+#ifdef emuINVADERS_PIXEL_RGB565
+		column_mask = vld1q_u16(column_masks);
+#else
+		column_mask_low = vld1q_u32(column_masks);
+		column_mask_high = vld1q_u32(column_masks + 4);
+#endif
+#endif
+
+		for (bit_index = 0; bit_index < 8; bit_index++)
+		{
+			y = in_y + bit_index;
+			background = l_background_pixels[y] + in_x + column;
+			row_pixels = out_pixels + bit_index * emuINVADERS_SCREEN_WIDTH * emuINVADERS_PIXEL_SIZE + column * emuINVADERS_PIXEL_SIZE;
+
+#if defined(emuINVADERS_SSE2)
+			// lane n is all ones when the bit of the row is set in the byte of column n
+			bit_mask = _mm_set1_epi16(0x80 >> bit_index);
+			mask = _mm_cmpeq_epi16(_mm_and_si128(data, bit_mask), bit_mask);
+
+#ifdef emuINVADERS_PIXEL_RGB565
+			overlay = _mm_or_si128(_mm_and_si128(column_mask, _mm_set1_epi16((short)l_overlay_pixels[1][y])), _mm_andnot_si128(column_mask, _mm_set1_epi16((short)l_overlay_pixels[0][y])));
+			_mm_storeu_si128((__m128i*)row_pixels, _mm_or_si128(_mm_and_si128(mask, overlay), _mm_andnot_si128(mask, _mm_loadu_si128((const __m128i*)background))));
+#else
+			mask_low = _mm_unpacklo_epi16(mask, mask);
+			mask_high = _mm_unpackhi_epi16(mask, mask);
+
+#ifdef emuINVADERS_PIXEL_RGB888
+			row_pixels = (uint8_t*)(pixels + column);
+#endif
+			overlay = _mm_or_si128(_mm_and_si128(column_mask_low, _mm_set1_epi32((int)l_overlay_pixels[1][y])), _mm_andnot_si128(column_mask_low, _mm_set1_epi32((int)l_overlay_pixels[0][y])));
+			_mm_storeu_si128((__m128i*)row_pixels, _mm_or_si128(_mm_and_si128(mask_low, overlay), _mm_andnot_si128(mask_low, _mm_loadu_si128((const __m128i*)background))));
+			overlay = _mm_or_si128(_mm_and_si128(column_mask_high, _mm_set1_epi32((int)l_overlay_pixels[1][y])), _mm_andnot_si128(column_mask_high, _mm_set1_epi32((int)l_overlay_pixels[0][y])));
+			_mm_storeu_si128((__m128i*)(row_pixels + 16), _mm_or_si128(_mm_and_si128(mask_high, overlay), _mm_andnot_si128(mask_high, _mm_loadu_si128((const __m128i*)(background + 4)))));
+#ifdef emuINVADERS_PIXEL_RGB888
+			emuInvadersPackPixels(out_pixels + bit_index * emuINVADERS_SCREEN_WIDTH * emuINVADERS_PIXEL_SIZE + column * emuINVADERS_PIXEL_SIZE, pixels + column, emuINVADERS_PIXEL_COUNT);
+#endif
+#endif
+
+#else
+			// lane n is all ones when the bit of the row is set in the byte of column n
+			mask = vtstq_u16(data, vdupq_n_u16(0x80 >> bit_index));
+
+#ifdef emuINVADERS_PIXEL_RGB565
+			overlay = vbslq_u16(column_mask, vdupq_n_u16(l_overlay_pixels[1][y]), vdupq_n_u16(l_overlay_pixels[0][y]));
+			vst1q_u16((uint16_t*)row_pixels, vbslq_u16(mask, overlay, vld1q_u16(background)));
+#else
+#ifdef emuINVADERS_PIXEL_RGB888
+			row_pixels = (uint8_t*)(pixels + column);
+#endif
+			overlay_low = vbslq_u32(column_mask_low, vdupq_n_u32(l_overlay_pixels[1][y]), vdupq_n_u32(l_overlay_pixels[0][y]));
+			overlay_high = vbslq_u32(column_mask_high, vdupq_n_u32(l_overlay_pixels[1][y]), vdupq_n_u32(l_overlay_pixels[0][y]));
+			vst1q_u32((uint32_t*)row_pixels, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vreinterpret_s16_u16(vget_low_u16(mask)))), overlay_low, vld1q_u32(background)));
+			vst1q_u32((uint32_t*)(row_pixels + 16), vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vreinterpret_s16_u16(vget_high_u16(mask)))), overlay_high, vld1q_u32(background + 4)));
+#ifdef emuINVADERS_PIXEL_RGB888
+			emuInvadersPackPixels(out_pixels + bit_index * emuINVADERS_SCREEN_WIDTH * emuINVADERS_PIXEL_SIZE + column * emuINVADERS_PIXEL_SIZE, pixels + column, emuINVADERS_PIXEL_COUNT);
+#endif
+#endif
+#endif
+		}
+	}
+#else
+	// branch-free select, pixel_mask is all ones when the bit of the row is set in the byte of the column
+	column_masks = l_overlay_column_masks + in_x;
+
+	for (bit_index = 0; bit_index < 8; bit_index++)
+	{
+		y = in_y + bit_index;
+		background = l_background_pixels[y] + in_x;
+		row_pixels = out_pixels + bit_index * emuINVADERS_SCREEN_WIDTH * emuINVADERS_PIXEL_SIZE;
+
+		for (column = 0; column < emuINVADERS_TILE_SIZE; column++)
+		{
+			pixel_mask = (emuInvadersPixel)0 - (emuInvadersPixel)((in_tile_data[column] >> (7 - bit_index)) & 1);
+			overlay = (l_overlay_pixels[1][y] & column_masks[column]) | (l_overlay_pixels[0][y] & ~column_masks[column]);
+
+#if defined(emuINVADERS_PIXEL_RGB888)
+			pixels[column] = (overlay & pixel_mask) | (background[column] & ~pixel_mask);
+#else
+			((emuInvadersPixel*)row_pixels)[column] = (overlay & pixel_mask) | (background[column] & ~pixel_mask);
+#endif
+		}
+
+#if defined(emuINVADERS_PIXEL_RGB888)
+		emuInvadersPackPixels(row_pixels, pixels, emuINVADERS_TILE_SIZE);
+#endif
+	}
+#endif
+}
+
+#ifdef emuINVADERS_PIXEL_RGB888
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Packs XRGB8888 pixels to three bytes (blue, green, red)
+/// @param out_pixels Packed pixels
+/// @param in_pixels XRGB8888 pixels
+/// @param in_pixel_count Number of pixels
+static void emuInvadersPackPixels(uint8_t* out_pixels, const uint32_t* in_pixels, uint8_t in_pixel_count)
+{
+	uint8_t pixel_index;
+
+	for (pixel_index = 0; pixel_index < in_pixel_count; pixel_index++)
+	{
+		out_pixels[pixel_index * 3] = (uint8_t)in_pixels[pixel_index];
+		out_pixels[pixel_index * 3 + 1] = (uint8_t)(in_pixels[pixel_index] >> 8);
+		out_pixels[pixel_index * 3 + 2] = (uint8_t)(in_pixels[pixel_index] >> 16);
+	}
 }
+#endif
+#else
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Expands video memory bytes of a column (one bit per pixel) into device format pixels. The set pixels get
+/// the overlay color of the row, the cleared pixels get the background. Pixels are stored from the top of the
+/// screen, so the bytes are processed from the last one.
+/// @param out_pixels Pixel buffer (byte_count * 8 pixels)
+/// @param in_column_data Video memory of the column (bottom to top)
+/// @param in_first_byte Index of the first (bottom) byte to expand
+/// @param in_byte_count Number of bytes to expand
+/// @param in_overlay Overlay colors of the rows of the column
+/// @param in_background Background pixels of the column
+static void emuInvadersExpandColumn(uint8_t* out_pixels, const uint8_t* in_column_data, uint8_t in_first_byte, uint8_t in_byte_count, const emuInvadersPixel* in_overlay, const emuInvadersPixel* in_background)
+{
+	int8_t byte_index;
+	uint16_t y;
+	uint8_t data;
+#if defined(emuINVADERS_SSE2)
+	const __m128i bit_masks = _mm_set_epi16(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+	__m128i mask;
+#ifndef emuINVADERS_PIXEL_RGB565
+	__m128i mask_low;
+	__m128i mask_high;
+#endif
+#elif defined(emuINVADERS_NEON)
+	static const uint16_t bit_mask_values[emuINVADERS_PIXEL_COUNT] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	const uint16x8_t bit_masks = vld1q_u16(bit_mask_values);
+	uint16x8_t mask;
+#else
+	uint8_t bit_index;
+	emuInvadersPixel pixel_mask;
+#endif
+#if defined(emuINVADERS_PIXEL_RGB888)
+	uint32_t pixels[emuINVADERS_PIXEL_COUNT];
+	uint8_t pixel_index;
+#endif
 
+	for (byte_index = in_first_byte + in_byte_count - 1; byte_index >= in_first_byte; byte_index--)
+	{
+		data = in_column_data[byte_index];
+		y = emuINVADERS_SCREEN_HEIGHT - (byte_index + 1) * 8;
+
+#if defined(emuINVADERS_SSE2)
+		// lane n is all ones when bit 7-n is set
+		mask = _mm_and_si128(_mm_set1_epi16(data), bit_masks);
+		mask = _mm_cmpeq_epi16(mask, bit_masks);
+
+#if defined(emuINVADERS_PIXEL_RGB565)
+		_mm_storeu_si128((__m128i*)out_pixels, _mm_or_si128(_mm_and_si128(mask, _mm_loadu_si128((const __m128i*)(in_overlay + y))), _mm_andnot_si128(mask, _mm_loadu_si128((const __m128i*)(in_background + y)))));
+#else
+		mask_low = _mm_unpacklo_epi16(mask, mask);
+		mask_high = _mm_unpackhi_epi16(mask, mask);
+
+#if defined(emuINVADERS_PIXEL_RGB888)
+		_mm_storeu_si128((__m128i*)pixels, _mm_or_si128(_mm_and_si128(mask_low, _mm_loadu_si128((const __m128i*)(in_overlay + y))), _mm_andnot_si128(mask_low, _mm_loadu_si128((const __m128i*)(in_background + y)))));
+		_mm_storeu_si128((__m128i*)(pixels + 4), _mm_or_si128(_mm_and_si128(mask_high, _mm_loadu_si128((const __m128i*)(in_overlay + y + 4))), _mm_andnot_si128(mask_high, _mm_loadu_si128((const __m128i*)(in_background + y + 4)))));
+#else
+		_mm_storeu_si128((__m128i*)out_pixels, _mm_or_si128(_mm_and_si128(mask_low, _mm_loadu_si128((const __m128i*)(in_overlay + y))), _mm_andnot_si128(mask_low, _mm_loadu_si128((const __m128i*)(in_background + y)))));
+		_mm_storeu_si128((__m128i*)(out_pixels + 16), _mm_or_si128(_mm_and_si128(mask_high, _mm_loadu_si128((const __m128i*)(in_overlay + y + 4))), _mm_andnot_si128(mask_high, _mm_loadu_si128((const __m128i*)(in_background + y + 4)))));
+#endif
+#endif
+
+#elif defined(emuINVADERS_NEON)
+		// lane n is all ones when bit 7-n is set
+		mask = vtstq_u16(vdupq_n_u16(data), bit_masks);
+
+#if defined(emuINVADERS_PIXEL_RGB565)
+		vst1q_u16((uint16_t*)out_pixels, vbslq_u16(mask, vld1q_u16(in_overlay + y), vld1q_u16(in_background + y)));
+#else
+#if defined(emuINVADERS_PIXEL_RGB888)
+		vst1q_u32(pixels, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vreinterpret_s16_u16(vget_low_u16(mask)))), vld1q_u32(in_overlay + y), vld1q_u32(in_background + y)));
+		vst1q_u32(pixels + 4, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vreinterpret_s16_u16(vget_high_u16(mask)))), vld1q_u32(in_overlay + y + 4), vld1q_u32(in_background + y + 4)));
+#else
+		vst1q_u32((uint32_t*)out_pixels, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vreinterpret_s16_u16(vget_low_u16(mask)))), vld1q_u32(in_overlay + y), vld1q_u32(in_background + y)));
+		vst1q_u32((uint32_t*)(out_pixels + 16), vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vreinterpret_s16_u16(vget_high_u16(mask)))), vld1q_u32(in_overlay + y + 4), vld1q_u32(in_background + y + 4)));
+#endif
+#endif
+
+#else
+		// branch-free select, pixel_mask is all ones when the bit is set
+		for (bit_index = 0; bit_index < emuINVADERS_PIXEL_COUNT; bit_index++)
+		{
+			pixel_mask = (emuInvadersPixel)0 - (emuInvadersPixel)((data >> (7 - bit_index)) & 1);
+
+#if defined(emuINVADERS_PIXEL_RGB888)
+			pixels[bit_index] = (in_overlay[y + bit_index] & pixel_mask) | (in_background[y + bit_index] & ~pixel_mask);
+#else
+			((emuInvadersPixel*)out_pixels)[bit_index] = (in_overlay[y + bit_index] & pixel_mask) | (in_background[y + bit_index] & ~pixel_mask);
+#endif
+		}
+#endif
+
+#if defined(emuINVADERS_PIXEL_RGB888)
+		// pack to three bytes (blue, green, red)
+		for (pixel_index = 0; pixel_index < emuINVADERS_PIXEL_COUNT; pixel_index++)
+		{
+			out_pixels[pixel_index * 3] = (uint8_t)pixels[pixel_index];
+			out_pixels[pixel_index * 3 + 1] = (uint8_t)(pixels[pixel_index] >> 8);
+			out_pixels[pixel_index * 3 + 2] = (uint8_t)(pixels[pixel_index] >> 16);
+		}
+#endif
+
+		out_pixels += emuINVADERS_PIXEL_COUNT * emuINVADERS_PIXEL_SIZE;
+	}
+}
+#endif
+#endif
 
 #if 0
 /*****************************************************************************/
@@ -257,7 +784,7 @@ void emuInvadersRenderScanLine(uint8_t* in_destination_buffer, int8_t in_destina
 	red_pixel = guiColorToDeviceColor(guiCOLOR_RED);
 
 	// init pointers
-  invaders_video_mem = &g_cpu_ram[emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START + in_line_index * emuINVADERS_SCREEN_HEIGHT / 8];
+  invaders_video_mem = &g_invaders_state.ram[emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START + in_line_index * emuINVADERS_SCREEN_HEIGHT / 8];
 	line_buffer_address = &l_line_buffer[emuINVADERS_SCREEN_HEIGHT-1];
 
 	background_data += background_size.Width * sizeof(uint16_t) * (emuINVADERS_SCREEN_TOP + emuINVADERS_SCREEN_HEIGHT-1) + (emuINVADERS_SCREEN_LEFT + in_line_index) * sizeof(uint16_t);
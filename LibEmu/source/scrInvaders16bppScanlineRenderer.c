@@ -77,7 +77,7 @@ void emuInvadersRender16bppScanLine(uint8_t* in_destination_buffer, int8_t in_de
 	red_pixel = guiColorToDeviceColor(guiCOLOR_RED);
 
 	// init pointers
-  invaders_video_mem = &g_cpu_ram[emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START + in_line_index * emuINVADERS_SCREEN_HEIGHT / 8];
+  invaders_video_mem = &g_invaders_state.ram[emuINVADERS_VIDEO_RAM_START - emuINVADERS_RAM_START + in_line_index * emuINVADERS_SCREEN_HEIGHT / 8];
 	line_buffer_address = (uint16_t*)in_destination_buffer;
 	background_data = guiGetBitmapData(REF_BMP_BACKGROUND);
 	background_size = guiGetBitmapSize(REF_BMP_BACKGROUND);
@@ -28,7 +28,11 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Renders emulator statistics
-void emuDisplayStatistics(uint32_t in_cpu_clock, uint16_t in_frame_rate, uint16_t in_load)
+/// @param in_cpu_clock CPU clock (kHz)
+/// @param in_frame_rate Frame rate (1/10 Hz)
+/// @param in_load CPU load (1/10 %)
+/// @param in_rendered_bytes Average number of video RAM bytes rendered per frame
+void emuDisplayStatistics(uint32_t in_cpu_clock, uint16_t in_frame_rate, uint16_t in_load, uint16_t in_rendered_bytes)
 {
 	guiSize text_size;
 
@@ -52,4 +56,11 @@ void emuDisplayStatistics(uint32_t in_cpu_clock, uint16_t in_frame_rate, uint16_
 	text_size = guiGetTextExtent(buffer);
 
 	guiDrawText(0, guiSCREEN_HEIGHT - text_size.Height, buffer);
+
+	// rendered video RAM bytes
+	pos = strCopyConstString(buffer, STRING_BUFFER_LENGTH, 0, (sysConstString)"Render:");
+	pos = strWordToStringPos(buffer, STRING_BUFFER_LENGTH, pos, in_rendered_bytes, 4, 0, TS_RIGHT_ADJUSTMENT);
+	pos = strCopyConstString(buffer, STRING_BUFFER_LENGTH, pos, (sysConstString)" bytes/frame");
+
+	guiDrawText(0, guiSCREEN_HEIGHT - 2 * text_size.Height, buffer);
 }
@@ -347,14 +347,15 @@ void drvColorGraphicsBitBlt(guiCoordinate in_destination_x, guiCoordinate in_des
 			break;
 
 		case 16:
+			// the source width is the row length of the bitmap, the destination size is the copied area
 			row_byte_count = in_source_width * sizeof(uint16_t);
-			for(bitmap_y = 0; bitmap_y < in_source_height; bitmap_y++)
+			for(bitmap_y = 0; bitmap_y < in_destination_height; bitmap_y++)
 			{
-				source_pixel = (uint8_t*)in_source_bitmap + row_byte_count * bitmap_y;
+				source_pixel = (uint8_t*)in_source_bitmap + row_byte_count * (bitmap_y + in_source_y) + in_source_x * sizeof(uint16_t);
 				destination_pixel = (uint8_t*)g_gui_screen_pixels  + (bitmap_y + in_destination_y) * g_gui_screen_line_size  + in_destination_x * (guiCOLOR_DEPTH / 8);
 
 #if guiCOLOR_DEPTH == 24
-				for(bitmap_x = 0; bitmap_x < in_source_width; bitmap_x++)
+				for(bitmap_x = 0; bitmap_x < in_destination_width; bitmap_x++)
 				{
 					// color low byte
 					bitmap_data = *source_pixel++;
@@ -372,7 +373,7 @@ void drvColorGraphicsBitBlt(guiCoordinate in_destination_x, guiCoordinate in_des
 					*destination_pixel++ = red;
 				}
 #elif guiCOLOR_DEPTH == 16
-				for (bitmap_x = 0; bitmap_x < in_source_width; bitmap_x++)
+				for (bitmap_x = 0; bitmap_x < in_destination_width; bitmap_x++)
 				{
 					*((guiDeviceColor*)destination_pixel) = *((guiDeviceColor*)source_pixel);
 					source_pixel += 2;
@@ -383,5 +384,20 @@ void drvColorGraphicsBitBlt(guiCoordinate in_destination_x, guiCoordinate in_des
 #endif
 			}
 			break;
+
+#if guiCOLOR_DEPTH == 24
+		case 24:
+			// source is in device format
+			row_byte_count = in_source_width * 3;
+			for(bitmap_y = 0; bitmap_y < in_destination_height; bitmap_y++)
+			{
+				source_pixel = (uint8_t*)in_source_bitmap + row_byte_count * (bitmap_y + in_source_y) + in_source_x * 3;
+				destination_pixel = (uint8_t*)g_gui_screen_pixels  + (bitmap_y + in_destination_y) * g_gui_screen_line_size  + in_destination_x * (guiCOLOR_DEPTH / 8);
+
+				for(bitmap_x = 0; bitmap_x < in_destination_width * 3; bitmap_x++)
+					*destination_pixel++ = *source_pixel++;
+			}
+			break;
+#endif
 	}
 }
@@ -0,0 +1,35 @@
+/*****************************************************************************/
+/* Main loop event waiting HAL functions                                     */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __halEventLoop_h
+#define __halEventLoop_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <sysTypes.h>
+#include <sysHighresTimer.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+// Event sources which woke up the main loop
+#define halEVENT_LOOP_TIMER (1 << 0)
+#define halEVENT_LOOP_INPUT (1 << 1)
+#define halEVENT_LOOP_AUDIO (1 << 2)
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+void halEventLoopInitialize(void);
+void halEventLoopCleanup(void);
+uint8_t halEventLoopWait(sysHighresTimestamp in_timestamp);
+
+#endif
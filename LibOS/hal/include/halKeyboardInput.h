@@ -17,5 +17,6 @@
 void halKeyboardInputInitialize(void);
 void halKeyboardInputCleanup(void);
 void halKeyboardDispatchEvent(void);
+int halKeyboardInputGetFileDescriptor(void);
 
 #endif
@@ -0,0 +1,26 @@
+/*****************************************************************************/
+/* Null (headless) HAL functions for benchmark and test builds               */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __halNull_h
+#define __halNull_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <sysTypes.h>
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+void halHighresTimerInit(void);
+void halNullHighresTimerAdvance(uint32_t in_time_in_us);
+
+uint32_t halNullWavePlayerGetRenderedBufferCount(void);
+
+#endif
@@ -69,5 +69,13 @@ void halWavePlayerCleanUp(void);
 void halWavePlayerPlayBuffer(uint8_t in_buffer_index);
 uint8_t halWavePlayerGetFreeBufferIndex(void);
 halWavePlayerBufferType* halWaveGetBuffer(uint8_t in_buffer_index);
+uint32_t halWavePlayerGetPlayedSampleCount(void);
+uint32_t halWavePlayerGetQueuedSampleCount(void);
+
+// queue length and poll descriptors of the output device (Linux only)
+struct pollfd;
+void halWavePlayerSetBufferCount(uint8_t in_buffer_count);
+int halWavePlayerGetPollDescriptors(struct pollfd* out_descriptors, int in_max_count);
+bool halWavePlayerIsPollReady(struct pollfd* in_descriptors, int in_count);
 
 #endif
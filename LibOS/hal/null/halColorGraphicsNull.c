@@ -0,0 +1,84 @@
+/*****************************************************************************/
+/* Color graphics driver using in-memory framebuffer (no display)            */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <guiTypes.h>
+#include <guiColorGraphics.h>
+#include "sysConfig.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define halNULL_SCREEN_LINE_SIZE (guiSCREEN_WIDTH * guiCOLOR_DEPTH / 8)
+
+/*****************************************************************************/
+/* Global variables                                                          */
+/*****************************************************************************/
+void*	g_gui_screen_pixels;       // Pointer to the (device independent) bitmap data
+int   g_gui_screen_line_size;    // Size in bytes of a bitmap scanline
+
+/*****************************************************************************/
+/* Module global variables                                                   */
+/*****************************************************************************/
+static uint8_t l_screen_pixels[halNULL_SCREEN_LINE_SIZE * guiSCREEN_HEIGHT];
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initialize color graphics system
+void drvColorGraphicsInitialize(void)
+{
+	g_gui_screen_pixels = l_screen_pixels;
+	g_gui_screen_line_size = halNULL_SCREEN_LINE_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initialize color graphics display
+void drvGraphicsDisplayInitialize(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Refreshes screen content
+void drvColorGraphicsRefreshScreen(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Cleans-up color graphics system
+void drvColorGraphicsCleanup(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Converts system color to device color
+/// @param in_color System color to convert
+/// @return Device color
+guiDeviceColor guiColorToDeviceColor(guiColor in_color)
+{
+#if guiCOLOR_DEPTH == 24
+	return in_color;
+#elif guiCOLOR_DEPTH == 16
+	uint8_t r, g, b;
+
+	// RGB 565
+	r = (uint8_t)((in_color >> 19) & 0x1f);
+	g = (uint8_t)((in_color >> 10) & 0x3f);
+	b = (uint8_t)((in_color >> 3) & 0x1f);
+
+	return (r << 11) | (g << 5) | b;
+#else
+#error Invalid color depth
+#endif
+}
@@ -0,0 +1,74 @@
+/*****************************************************************************/
+/* High Resolution System timer (1us) virtual time hal driver                */
+/*                                                                           */
+/* Copyright (C) 2014-2015 Laszlo Arvai                                      */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <sysHighresTimer.h>
+#include <halNull.h>
+
+/*****************************************************************************/
+/* Module global variables                                                   */
+/*****************************************************************************/
+static sysHighresTimestamp l_virtual_time = 0;
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes high resolution timer
+void halHighresTimerInit(void)
+{
+	l_virtual_time = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Advances virtual time. Time is not changing without calling this function.
+/// @param in_time_in_us Time to add to the current virtual time
+void halNullHighresTimerAdvance(uint32_t in_time_in_us)
+{
+	l_virtual_time += in_time_in_us;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets timestamp of the high resolution timer
+/// @return timestamp value
+sysHighresTimestamp sysHighresTimerGetTimestamp(void)
+{
+	return l_virtual_time;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets ellapsed time in us since the timestamp
+/// @param in_timstamp Timestamp of the start time
+/// @return Time difference between current time and start time in us
+uint32_t sysHighresTimerGetTimeSince(sysHighresTimestamp in_timestamp)
+{
+	return (uint32_t)(l_virtual_time - in_timestamp);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds value to the high resolution timer timestamp
+/// @param in_timestamp Timestamp value to increase
+/// @param in_value_in_us
+void sysHighresTimerAddToTimestamp(sysHighresTimestamp* in_timestamp, uint32_t in_value_in_us)
+{
+	*in_timestamp += in_value_in_us;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sleeps until the given time. The virtual time jumps to the wake up time.
+/// @param in_timestamp Timestamp of the wake up time
+void sysHighresTimerSleepUntil(sysHighresTimestamp in_timestamp)
+{
+	if ((int32_t)(in_timestamp - l_virtual_time) > 0)
+		l_virtual_time = in_timestamp;
+}
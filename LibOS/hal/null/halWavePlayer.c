@@ -0,0 +1,115 @@
+/*****************************************************************************/
+/* Wave player (null driver, samples are discarded)                          */
+/*                                                                           */
+/* Copyright (C) 2015 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <halWavePlayer.h>
+#include <sysHighresTimer.h>
+#include <halNull.h>
+#include <sysConfig.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define halNULL_BUFFER_TIME ((uint32_t)((uint64_t)halWAVEPLAYER_BUFFER_LENGTH * 1000000 / halWAVEPLAYER_SAMPLE_RATE)) // playback time of one buffer in us
+
+/*****************************************************************************/
+/* Module global variables                                                   */
+/*****************************************************************************/
+static halWavePlayerBufferType l_buffer[halWAVEPLAYER_BUFFER_LENGTH];
+static sysHighresTimestamp l_buffer_timestamp;
+static uint32_t l_rendered_buffer_count;
+
+/*****************************************************************************/
+/* Function implentation                                                    */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Opens wave output device
+void halWavePlayerInitialize(void)
+{
+	l_buffer_timestamp = sysHighresTimerGetTimestamp();
+	l_rendered_buffer_count = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Closes wave output device
+void halWavePlayerCleanUp(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds the specified buffer to the playback queue
+/// @param in_buffer_index Buffer index to add to the queue
+void halWavePlayerPlayBuffer(uint8_t in_buffer_index)
+{
+	if (in_buffer_index != 0)
+		return;
+
+	// the buffer is 'played' at the pace of the (virtual) high resolution timer
+	sysHighresTimerAddToTimestamp(&l_buffer_timestamp, halNULL_BUFFER_TIME);
+	l_rendered_buffer_count++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets next free buffer index
+uint8_t halWavePlayerGetFreeBufferIndex(void)
+{
+	if (sysHighresTimerGetTimeSince(l_buffer_timestamp) >= halNULL_BUFFER_TIME)
+		return 0;
+	else
+		return halWAVEPLAYER_INVALID_BUFFER_INDEX;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets pointer to the wave data section of the given buffer
+/// @param in_buffer_index Index of the wave buffer
+/// @return Wave data pointer or null if index is invalid
+halWavePlayerBufferType* halWaveGetBuffer(uint8_t in_buffer_index)
+{
+	if (in_buffer_index == 0)
+		return l_buffer;
+	else
+		return sysNULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the samples played since initialization (audio clock)
+/// @return Number of played samples (wraps around)
+uint32_t halWavePlayerGetPlayedSampleCount(void)
+{
+	return l_rendered_buffer_count * halWAVEPLAYER_BUFFER_LENGTH - halWavePlayerGetQueuedSampleCount();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the samples waiting for playback
+/// @return Number of queued samples (the remaining part of the last buffer)
+uint32_t halWavePlayerGetQueuedSampleCount(void)
+{
+	uint32_t time_since;
+
+	if (l_rendered_buffer_count == 0)
+		return 0;
+
+	time_since = sysHighresTimerGetTimeSince(l_buffer_timestamp);
+	if (time_since >= halNULL_BUFFER_TIME)
+		return 0;
+
+	return (uint32_t)((uint64_t)(halNULL_BUFFER_TIME - time_since) * halWAVEPLAYER_SAMPLE_RATE / 1000000);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the buffers rendered since initialization
+/// @return Number of rendered buffers
+uint32_t halNullWavePlayerGetRenderedBufferCount(void)
+{
+	return l_rendered_buffer_count;
+}
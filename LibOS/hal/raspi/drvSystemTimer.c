@@ -12,7 +12,7 @@
 /*****************************************************************************/
 /* Includes                                                                  */
 /*****************************************************************************/
-#include <sys/time.h>
+#include <time.h>
 #include <sysTimer.h>
 #include <stdio.h>
 
@@ -27,15 +27,15 @@ void drvSystemTimerInitialize(void)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Gets system timer current value (current timestamp)
+/// @brief Gets system timer current value (current timestamp of the monotonic clock)
 /// @return System timer value
 sysTimeStamp sysTimerGetTimestamp(void)
 {
-	struct timeval te; 
+	struct timespec ts; 
 	sysTimeStamp milliseconds;
 	
-	gettimeofday(&te, NULL); // get current time
-	milliseconds = te.tv_sec * 1000LL + te.tv_usec / 1000; // caculate milliseconds
+	clock_gettime(CLOCK_MONOTONIC, &ts); // get current time
+	milliseconds = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000; // caculate milliseconds
 
 	return milliseconds;
 }
@@ -0,0 +1,216 @@
+/*****************************************************************************/
+/* Main loop event waiting (Linux epoll driver)                              */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <halEventLoop.h>
+#include <halKeyboardInput.h>
+#include <halWavePlayer.h>
+#include "sysConfig.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+// The last part of the wait is busy waiting (in us) as the wake up from the timer is late by the scheduling latency
+#ifndef halHIGHRES_TIMER_SPIN_MARGIN
+#define halHIGHRES_TIMER_SPIN_MARGIN 200
+#endif
+
+// Maximum number of ALSA poll descriptors
+#define halEVENT_LOOP_MAX_AUDIO_DESCRIPTOR_COUNT 4
+
+// Maximum number of events processed by one wait
+#define halEVENT_LOOP_MAX_EVENT_COUNT 8
+
+/*****************************************************************************/
+/* Module global variables                                                   */
+/*****************************************************************************/
+static int l_epoll_fd = -1;
+static int l_timer_fd = -1;
+static struct pollfd l_audio_descriptors[halEVENT_LOOP_MAX_AUDIO_DESCRIPTOR_COUNT];
+static int l_audio_descriptor_count = 0;
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static void halEventLoopAddDescriptor(int in_fd, uint32_t in_events, uint8_t in_source);
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Initializes event loop. Watches the keyboard, the audio device and the frame timer, so keyboard and
+/// wave player must be initialized first.
+void halEventLoopInitialize(void)
+{
+	int keyboard_fd;
+	int i;
+
+	l_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (l_epoll_fd == -1)
+	{
+		perror("Can't create epoll instance\n");
+		exit(1);
+	}
+
+	// frame deadline timer
+	l_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (l_timer_fd == -1)
+	{
+		perror("Can't create frame timer\n");
+		exit(1);
+	}
+
+	halEventLoopAddDescriptor(l_timer_fd, EPOLLIN, halEVENT_LOOP_TIMER);
+
+	// keyboard
+	keyboard_fd = halKeyboardInputGetFileDescriptor();
+	if (keyboard_fd != -1)
+		halEventLoopAddDescriptor(keyboard_fd, EPOLLIN, halEVENT_LOOP_INPUT);
+
+	// audio
+	l_audio_descriptor_count = halWavePlayerGetPollDescriptors(l_audio_descriptors, halEVENT_LOOP_MAX_AUDIO_DESCRIPTOR_COUNT);
+	for (i = 0; i < l_audio_descriptor_count; i++)
+		halEventLoopAddDescriptor(l_audio_descriptors[i].fd, l_audio_descriptors[i].events, halEVENT_LOOP_AUDIO);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Releases event loop resources
+void halEventLoopCleanup(void)
+{
+	if (l_timer_fd != -1)
+		close(l_timer_fd);
+
+	if (l_epoll_fd != -1)
+		close(l_epoll_fd);
+
+	l_timer_fd = -1;
+	l_epoll_fd = -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sleeps until keyboard input arrives, the audio device needs data or the given time is reached. Keyboard
+/// events are dispatched before return.
+/// @param in_timestamp Timestamp of the wake up time
+/// @return Event sources which ended the wait (halEVENT_LOOP_xxx flags)
+uint8_t halEventLoopWait(sysHighresTimestamp in_timestamp)
+{
+	struct epoll_event events[halEVENT_LOOP_MAX_EVENT_COUNT];
+	struct itimerspec timer_value;
+	uint64_t expiration_count;
+	int32_t time_left;
+	int event_count;
+	int timeout;
+	int i, j;
+	uint8_t sources = 0;
+	bool audio_event = false;
+
+	// arm the timer for the sleeping part of the wait (relative time as the timestamp is a truncated us counter)
+	timer_value.it_interval.tv_sec = 0;
+	timer_value.it_interval.tv_nsec = 0;
+
+	time_left = (int32_t)(in_timestamp - sysHighresTimerGetTimestamp());
+	if (time_left > halHIGHRES_TIMER_SPIN_MARGIN)
+	{
+		time_left -= halHIGHRES_TIMER_SPIN_MARGIN;
+
+		timer_value.it_value.tv_sec = time_left / 1000000;
+		timer_value.it_value.tv_nsec = (long)(time_left % 1000000) * 1000;
+
+		timeout = -1;
+	}
+	else
+	{
+		// only the busy waiting part is left, pending events are collected without sleep. The timer armed by an
+		// earlier wait is disarmed, it must not wake up a later wait too early.
+		timer_value.it_value.tv_sec = 0;
+		timer_value.it_value.tv_nsec = 0;
+
+		timeout = 0;
+	}
+
+	timerfd_settime(l_timer_fd, 0, &timer_value, NULL);
+
+	do
+	{
+		event_count = epoll_wait(l_epoll_fd, events, halEVENT_LOOP_MAX_EVENT_COUNT, timeout);
+	} while (event_count == -1 && errno == EINTR);
+
+	for (i = 0; i < event_count; i++)
+	{
+		switch ((uint8_t)events[i].data.u64)
+		{
+			case halEVENT_LOOP_TIMER:
+				if (read(l_timer_fd, &expiration_count, sizeof(expiration_count)) == sizeof(expiration_count))
+					sources |= halEVENT_LOOP_TIMER;
+				break;
+
+			case halEVENT_LOOP_INPUT:
+				halKeyboardDispatchEvent();
+				sources |= halEVENT_LOOP_INPUT;
+				break;
+
+			case halEVENT_LOOP_AUDIO:
+				for (j = 0; j < l_audio_descriptor_count; j++)
+				{
+					if (l_audio_descriptors[j].fd == (int)(events[i].data.u64 >> 32))
+						l_audio_descriptors[j].revents = (short)events[i].events;
+				}
+				audio_event = true;
+				break;
+		}
+	}
+
+	// the wave player checks and acknowledges the events of its descriptors
+	if (audio_event)
+	{
+		if (halWavePlayerIsPollReady(l_audio_descriptors, l_audio_descriptor_count))
+			sources |= halEVENT_LOOP_AUDIO;
+
+		for (j = 0; j < l_audio_descriptor_count; j++)
+			l_audio_descriptors[j].revents = 0;
+	}
+
+	// the rest of the time is busy waiting when only the deadline woke up the loop
+	if (sources == halEVENT_LOOP_TIMER || (timeout == 0 && sources == 0))
+	{
+		sysHighresTimerSleepUntil(in_timestamp);
+		sources |= halEVENT_LOOP_TIMER;
+	}
+
+	return sources;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds file descriptor to the watched descriptors
+/// @param in_fd File descriptor
+/// @param in_events Watched events (EPOLLxxx flags)
+/// @param in_source Event source of the descriptor (halEVENT_LOOP_xxx flag)
+static void halEventLoopAddDescriptor(int in_fd, uint32_t in_events, uint8_t in_source)
+{
+	struct epoll_event event;
+
+	// the source is stored in the low byte, the descriptor in the high dword
+	event.events = in_events;
+	event.data.u64 = ((uint64_t)(uint32_t)in_fd << 32) | in_source;
+
+	if (epoll_ctl(l_epoll_fd, EPOLL_CTL_ADD, in_fd, &event) != 0 && errno != EEXIST)
+		perror("Can't watch file descriptor\n");
+}
@@ -12,8 +12,19 @@
 /* Includes                                                                  */
 /*****************************************************************************/
 #include <stdio.h>
-#include <sys/time.h>
+#include <errno.h>
+#include <time.h>
 #include <sysHighresTimer.h>
+#include "sysConfig.h"
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+// The last part of the sleep is busy waiting (in us) as the wake up from the sleep is late by the scheduling latency
+#ifndef halHIGHRES_TIMER_SPIN_MARGIN
+#define halHIGHRES_TIMER_SPIN_MARGIN 200
+#endif
 
 /*****************************************************************************/
 /* Function implementation                                                   */
@@ -26,16 +37,16 @@ void halHighresTimerInit(void)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Gets timestamp of the high resolution timer
+/// @brief Gets timestamp of the high resolution timer (monotonic clock, it is not changed by the system time settings)
 /// @return timestamp value
 sysHighresTimestamp sysHighresTimerGetTimestamp(void)
 {
 	sysHighresTimestamp timestamp;
-	struct timeval tv;
+	struct timespec ts;
 	
-	gettimeofday(&tv, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 	
-	timestamp = ((sysHighresTimestamp)tv.tv_sec) * 1000000 + tv.tv_usec;
+	timestamp = ((sysHighresTimestamp)ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
 
 	return timestamp;
 }
@@ -60,4 +71,36 @@ uint32_t sysHighresTimerGetTimeSince(sysHighresTimestamp in_timestamp)
 void sysHighresTimerAddToTimestamp(sysHighresTimestamp* in_timestamp, uint32_t in_value_in_us)
 {
 	*in_timestamp += in_value_in_us;
-}
\ No newline at end of file
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sleeps until the given time. The thread sleeps until the spin margin before the given time then it
+/// busy waits for the rest of the time.
+/// @param in_timestamp Timestamp of the wake up time
+void sysHighresTimerSleepUntil(sysHighresTimestamp in_timestamp)
+{
+	struct timespec wakeup_time;
+	int32_t time_left;
+
+	clock_gettime(CLOCK_MONOTONIC, &wakeup_time);
+
+	time_left = (int32_t)(in_timestamp - (((sysHighresTimestamp)wakeup_time.tv_sec) * 1000000 + wakeup_time.tv_nsec / 1000));
+
+	if (time_left > halHIGHRES_TIMER_SPIN_MARGIN)
+	{
+		// absolute wake up time on the monotonic clock
+		time_left -= halHIGHRES_TIMER_SPIN_MARGIN;
+		wakeup_time.tv_sec += time_left / 1000000;
+		wakeup_time.tv_nsec += (long)(time_left % 1000000) * 1000;
+		if (wakeup_time.tv_nsec >= 1000000000)
+		{
+			wakeup_time.tv_nsec -= 1000000000;
+			wakeup_time.tv_sec++;
+		}
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup_time, NULL) == EINTR);
+	}
+
+	// busy wait
+	while ((int32_t)(in_timestamp - sysHighresTimerGetTimestamp()) > 0);
+}
@@ -369,6 +369,14 @@ void halKeyboardInputInitialize(void)
 	regfree(&kbd);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets file descriptor of the keyboard event device (for waiting on keyboard input)
+/// @return File descriptor or -1 if there is no keyboard
+int halKeyboardInputGetFileDescriptor(void)
+{
+	return keyboardFd;
+}
+
 void halKeyboardInputCleanup(void)
 {
 	if (keyboardFd != -1)
@@ -12,19 +12,53 @@
 /* Includes                                                                  */
 /*****************************************************************************/
 #include <alsa/asoundlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 #include <halWavePlayer.h>
 #include <sysConfig.h>
 
 /*****************************************************************************/
-/* Types                                                                     */
+/* Constants                                                                 */
 /*****************************************************************************/
 
+// Real-time priority of the ALSA writer thread (normal priority is used when it is not permitted)
+#ifndef halWAVEPLAYER_THREAD_PRIORITY
+#define halWAVEPLAYER_THREAD_PRIORITY 50
+#endif
+
+// Delay before the writer thread retries a write which is failed even after the recovery (in us)
+#define halWAVEPLAYER_RETRY_DELAY (halWAVEPLAYER_BUFFER_LENGTH * 1000000 / halWAVEPLAYER_SAMPLE_RATE)
+
+/*****************************************************************************/
+/* Local function prototypes                                                 */
+/*****************************************************************************/
+static void* halWavePlayerWriterThread(void* in_param);
+
 /*****************************************************************************/
 /* Module global variables                                                   */
 /*****************************************************************************/
 static snd_pcm_t *pcm_handle = NULL; // Our device handle 
 static const char *device_name = "default"; // The device name
-static int16_t l_buffer[halWAVEPLAYER_BUFFER_LENGTH];
+
+// Single producer (emulator thread), single consumer (writer thread) ring of the rendered buffers. The counters are
+// incremented by their owner thread only, the buffer index is the counter modulo the buffer count.
+static int16_t l_ring[halWAVEPLAYER_BUFFER_COUNT][halWAVEPLAYER_BUFFER_LENGTH];
+static atomic_uint l_ring_write_count;
+static atomic_uint l_ring_read_count;
+static atomic_uint l_ring_length;												// number of buffers used for queuing (latency)
+static sem_t l_ring_semaphore;													// number of buffers waiting for the writer thread
+
+// writer thread
+static pthread_t l_writer_thread;
+static atomic_bool l_writer_running;
+static int l_writer_event_fd = -1;											// signalled when a buffer is released by the writer
+
+// audio clock published by the writer thread
+static atomic_uint l_written_sample_count;
+static atomic_uint l_played_sample_count;
 
 /*****************************************************************************/
 /* Function implentation                                                    */
@@ -40,6 +74,8 @@ void halWavePlayerInitialize(void)
 	snd_pcm_uframes_t buffer_size = halWAVEPLAYER_BUFFER_LENGTH * sizeof(uint16_t);
 	snd_pcm_uframes_t period_size = buffer_size / 2;	
 	unsigned int sample_rate = halWAVEPLAYER_SAMPLE_RATE;
+	pthread_attr_t thread_attributes;
+	struct sched_param thread_priority;
 	
 	// Open the device 
 	if ((err = snd_pcm_open(&pcm_handle, device_name, SND_PCM_STREAM_PLAYBACK, 0)) < 0) 
@@ -142,6 +178,40 @@ void halWavePlayerInitialize(void)
 		fprintf(stderr,	"Cannot prepare audio interface for use (%s)\n", snd_strerror(err));
 		exit(1);
 	}	
+
+	////////////////
+	// Writer thread
+	atomic_init(&l_ring_write_count, 0);
+	atomic_init(&l_ring_read_count, 0);
+	atomic_init(&l_ring_length, halWAVEPLAYER_BUFFER_COUNT);
+	atomic_init(&l_written_sample_count, 0);
+	atomic_init(&l_played_sample_count, 0);
+	atomic_init(&l_writer_running, true);
+
+	if (sem_init(&l_ring_semaphore, 0, 0) != 0 || (l_writer_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+	{
+		fprintf(stderr, "Cannot create audio buffer queue\n");
+		exit(1);
+	}
+
+	// real-time scheduling is tried first
+	pthread_attr_init(&thread_attributes);
+	pthread_attr_setinheritsched(&thread_attributes, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&thread_attributes, SCHED_FIFO);
+	thread_priority.sched_priority = halWAVEPLAYER_THREAD_PRIORITY;
+	pthread_attr_setschedparam(&thread_attributes, &thread_priority);
+
+	err = pthread_create(&l_writer_thread, &thread_attributes, halWavePlayerWriterThread, NULL);
+	if (err != 0)
+		err = pthread_create(&l_writer_thread, NULL, halWavePlayerWriterThread, NULL);
+
+	pthread_attr_destroy(&thread_attributes);
+
+	if (err != 0)
+	{
+		fprintf(stderr, "Cannot start audio writer thread (%s)\n", strerror(err));
+		exit(1);
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -150,6 +220,15 @@ void halWavePlayerCleanUp(void)
 {
 	if (pcm_handle != NULL)
 	{
+		// stop writer thread
+		atomic_store(&l_writer_running, false);
+		sem_post(&l_ring_semaphore);
+		pthread_join(l_writer_thread, NULL);
+
+		sem_destroy(&l_ring_semaphore);
+		close(l_writer_event_fd);
+		l_writer_event_fd = -1;
+
 		snd_pcm_drop(pcm_handle);
 		snd_pcm_close(pcm_handle);
 	}
@@ -158,53 +237,187 @@ void halWavePlayerCleanUp(void)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Adds the specified buffer to the playback queue
+/// @brief Adds the specified buffer to the playback queue. It never blocks, the buffer is written to the device
+/// by the writer thread.
 /// @param in_buffer_index Buffer index to add to the queue
 void halWavePlayerPlayBuffer(uint8_t in_buffer_index)
 {
-	snd_pcm_sframes_t  frames_written;
-	
-	if (in_buffer_index != 0)
+	unsigned int write_count = atomic_load_explicit(&l_ring_write_count, memory_order_relaxed);
+
+	if (in_buffer_index != write_count % halWAVEPLAYER_BUFFER_COUNT)
 		return;
 
-	frames_written = snd_pcm_writei(pcm_handle, l_buffer, halWAVEPLAYER_BUFFER_LENGTH);
-	if (frames_written == -EPIPE) 
-	{
-		snd_pcm_prepare(pcm_handle);
-	}
+	// the buffer content is visible to the writer thread before the counter
+	atomic_store_explicit(&l_ring_write_count, write_count + 1, memory_order_release);
+	sem_post(&l_ring_semaphore);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Gets next free buffer index
 uint8_t halWavePlayerGetFreeBufferIndex(void)
 {
-	snd_pcm_sframes_t  frames_free;
-	
-	frames_free = snd_pcm_avail(pcm_handle);
-	if (frames_free > halWAVEPLAYER_BUFFER_LENGTH)
-		return 0;
-	
-	if (frames_free > 0)
+	unsigned int write_count = atomic_load_explicit(&l_ring_write_count, memory_order_relaxed);
+	unsigned int read_count = atomic_load_explicit(&l_ring_read_count, memory_order_acquire);
+
+	if (pcm_handle == NULL || write_count - read_count >= atomic_load_explicit(&l_ring_length, memory_order_relaxed))
 		return halWAVEPLAYER_INVALID_BUFFER_INDEX;
-	
-	if (frames_free == -EPIPE) 
-	{
-		snd_pcm_prepare(pcm_handle);
+
+	return (uint8_t)(write_count % halWAVEPLAYER_BUFFER_COUNT);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sets number of the buffers queued for playback. The latency is the length of the queued buffers plus
+/// the device buffer (two buffer lengths). It can be changed during playback.
+/// @param in_buffer_count Number of buffers (1..halWAVEPLAYER_BUFFER_COUNT)
+void halWavePlayerSetBufferCount(uint8_t in_buffer_count)
+{
+	if (in_buffer_count < 1)
+		in_buffer_count = 1;
+
+	if (in_buffer_count > halWAVEPLAYER_BUFFER_COUNT)
+		in_buffer_count = halWAVEPLAYER_BUFFER_COUNT;
+
+	atomic_store(&l_ring_length, in_buffer_count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the samples played since initialization (audio clock). It is updated by the writer
+/// thread after every written buffer.
+/// @return Number of played samples (wraps around)
+uint32_t halWavePlayerGetPlayedSampleCount(void)
+{
+	return atomic_load(&l_played_sample_count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the samples waiting for playback in the queue and in the device
+/// @return Number of queued samples
+uint32_t halWavePlayerGetQueuedSampleCount(void)
+{
+	unsigned int ring_sample_count;
+
+	ring_sample_count = (atomic_load(&l_ring_write_count) - atomic_load(&l_ring_read_count)) * halWAVEPLAYER_BUFFER_LENGTH;
+
+	return ring_sample_count + atomic_load(&l_written_sample_count) - atomic_load(&l_played_sample_count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets poll descriptor which is signalled when a queue buffer becomes free
+/// @param out_descriptors Descriptor array to fill
+/// @param in_max_count Number of entries in the array
+/// @return Number of descriptors
+int halWavePlayerGetPollDescriptors(struct pollfd* out_descriptors, int in_max_count)
+{
+	if (l_writer_event_fd == -1 || in_max_count < 1)
 		return 0;
-	}
-	
-	return halWAVEPLAYER_INVALID_BUFFER_INDEX;
+
+	out_descriptors[0].fd = l_writer_event_fd;
+	out_descriptors[0].events = POLLIN;
+	out_descriptors[0].revents = 0;
+
+	return 1;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Checks returned poll events of the descriptors and acknowledges the signal
+/// @param in_descriptors Descriptors with the returned events
+/// @param in_count Number of descriptors
+/// @return True if a buffer is released since the last check
+bool halWavePlayerIsPollReady(struct pollfd* in_descriptors, int in_count)
+{
+	uint64_t released_count;
+
+	if (in_count < 1 || (in_descriptors[0].revents & POLLIN) == 0)
+		return false;
+
+	return read(l_writer_event_fd, &released_count, sizeof(released_count)) == sizeof(released_count);
+}
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Gets pointer to the wave data section of the given buffer
 /// @param in_buffer_index Index of the wave buffer
 /// @return Wave data pointer or null if index is invalid
 halWavePlayerBufferType* halWaveGetBuffer(uint8_t in_buffer_index)
 {
-	if (in_buffer_index == 0)
-		return l_buffer;
+	if (in_buffer_index < halWAVEPLAYER_BUFFER_COUNT)
+		return l_ring[in_buffer_index];
 	else
 		return sysNULL;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Writes the queued buffers to the device. The thread blocks in the ALSA write while the device buffer is
+/// full and it waits for the emulator when the queue is empty. A buffer is released only when all of its frames are
+/// accepted by the device, failed writes are reported and retried.
+/// @param in_param Not used
+/// @return Not used
+static void* halWavePlayerWriterThread(void* in_param)
+{
+	unsigned int read_count;
+	int16_t* buffer;
+	snd_pcm_uframes_t frames_left;
+	snd_pcm_sframes_t frames_written;
+	snd_pcm_sframes_t delay;
+	uint64_t released_count = 1;
+	bool write_failed = false;
+	int err;
+
+	(void)in_param;
+
+	while (true)
+	{
+		// wait for a rendered buffer
+		while (sem_wait(&l_ring_semaphore) != 0 && errno == EINTR);
+
+		if (!atomic_load(&l_writer_running))
+			break;
+
+		read_count = atomic_load_explicit(&l_ring_read_count, memory_order_relaxed);
+		buffer = l_ring[read_count % halWAVEPLAYER_BUFFER_COUNT];
+
+		// write the whole buffer (underrun is recovered), only the accepted frames are counted
+		frames_left = halWAVEPLAYER_BUFFER_LENGTH;
+		while (frames_left > 0 && atomic_load(&l_writer_running))
+		{
+			frames_written = snd_pcm_writei(pcm_handle, buffer + halWAVEPLAYER_BUFFER_LENGTH - frames_left, frames_left);
+			if (frames_written < 0)
+			{
+				err = snd_pcm_recover(pcm_handle, (int)frames_written, 1);
+				if (err < 0)
+				{
+					// device is not usable, the rest of the buffer is written again later (reported once per failure)
+					if (!write_failed)
+						fprintf(stderr, "Cannot write audio device (%s)\n", snd_strerror(err));
+					write_failed = true;
+
+					usleep(halWAVEPLAYER_RETRY_DELAY);
+					snd_pcm_prepare(pcm_handle);
+				}
+			}
+			else
+			{
+				frames_left -= frames_written;
+				atomic_fetch_add(&l_written_sample_count, (unsigned int)frames_written);
+				write_failed = false;
+			}
+		}
+
+		// stopped while the buffer was retried
+		if (frames_left > 0)
+			break;
+
+		// audio clock
+		if (snd_pcm_delay(pcm_handle, &delay) < 0 || delay < 0)
+			delay = 0;
+		if ((snd_pcm_uframes_t)delay > 2 * halWAVEPLAYER_BUFFER_LENGTH)
+			delay = 2 * halWAVEPLAYER_BUFFER_LENGTH;
+		atomic_store(&l_played_sample_count, atomic_load(&l_written_sample_count) - (unsigned int)delay);
+
+		// release the buffer and wake up the emulator (the event is already pending when the counter is full)
+		atomic_store_explicit(&l_ring_read_count, read_count + 1, memory_order_release);
+		if (write(l_writer_event_fd, &released_count, sizeof(released_count)) != sizeof(released_count) && errno != EAGAIN)
+			fprintf(stderr, "Cannot signal released audio buffer (%s)\n", strerror(errno));
+	}
+
+	return NULL;
+}
+
@@ -36,6 +36,7 @@ static HANDLE l_waveout_event = NULL;
 static WaveOutBuffer l_waveout_buffer[halWAVEPLAYER_BUFFER_COUNT];
 static DWORD	l_thread_id			= 0;
 static HANDLE	l_thread_handle = NULL;
+static uint32_t l_written_sample_count = 0;
 
 /*****************************************************************************/
 /* Function implentation                                                    */
@@ -123,6 +124,8 @@ void halWavePlayerPlayBuffer(uint8_t in_buffer_index)
 
 	// write header
 	waveOutWrite(l_waveout_handle, &l_waveout_buffer[in_buffer_index].Header, sizeof(WAVEHDR));
+
+	l_written_sample_count += halWAVEPLAYER_BUFFER_LENGTH;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -169,3 +172,27 @@ halWavePlayerBufferType* halWaveGetBuffer(uint8_t in_buffer_index)
 		return sysNULL;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the samples played since initialization (audio clock)
+/// @return Number of played samples (wraps around)
+uint32_t halWavePlayerGetPlayedSampleCount(void)
+{
+	MMTIME position;
+
+	if (l_waveout_handle == NULL)
+		return 0;
+
+	position.wType = TIME_SAMPLES;
+	if (waveOutGetPosition(l_waveout_handle, &position, sizeof(position)) != MMSYSERR_NOERROR || position.wType != TIME_SAMPLES)
+		return l_written_sample_count;
+
+	return position.u.sample;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets number of the samples waiting for playback in the device
+/// @return Number of queued samples
+uint32_t halWavePlayerGetQueuedSampleCount(void)
+{
+	return l_written_sample_count - halWavePlayerGetPlayedSampleCount();
+}
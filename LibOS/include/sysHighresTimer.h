@@ -33,5 +33,6 @@ void halHighresTimerInitialize(void);
 sysHighresTimestamp sysHighresTimerGetTimestamp(void);
 uint32_t sysHighresTimerGetTimeSince(sysHighresTimestamp in_timestamp_in_us);
 void sysHighresTimerAddToTimestamp(sysHighresTimestamp* in_timestamp, uint32_t in_value_in_us);
+void sysHighresTimerSleepUntil(sysHighresTimestamp in_timestamp);
 
 #endif
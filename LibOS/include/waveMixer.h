@@ -26,6 +26,12 @@
 
 #define waveMIXER_CS_ACTIVE (1<<31)
 #define waveMIXER_CS_LOOP_ENABLED (1<<0)
+#define waveMIXER_CS_CACHED (1<<30)					// samples are played from the wave cache (set by the mixer)
+
+// Number of the cached wave resources (must be power of two)
+#ifndef waveMIXER_WAVE_CACHE_SIZE
+#define waveMIXER_WAVE_CACHE_SIZE 16
+#endif
 
 /*****************************************************************************/
 /* Types                                                                     */
@@ -34,10 +40,11 @@ typedef struct
 {
   uint32_t State;
   void* Samples;
+  sysResourceAddress SamplesAddress;	// resource address of the samples or of the wave when cached (Samples pointer can be restored from it)
   uint32_t SamplesCount;
   uint32_t SampleRate;
-  uint32_t Position;
-  uint32_t SampleRateAccumulator;
+  uint32_t Position;									// index of the current sample
+  uint32_t Phase;										// fractional part of the position (16 bit fixed point)
 	uint8_t NextActiveChannel;
 } waveMixerChannelState;
 
@@ -57,5 +64,11 @@ uint8_t waveMixerPlayWaveFromResource(waveMixerState* in_state, sysResourceAddre
 void waveMixerStopWave(waveMixerState* in_state, uint8_t in_channel_to_stop);
 
 void waveMixerRenderStream(waveMixerState* in_state, halWavePlayerBufferType* in_render_buffer, uint32_t in_sample_count);
+bool waveMixerRestoreChannelSamples(waveMixerChannelState* in_channel);
+
+#ifdef waveMIXER_WAVE_CACHE
+bool waveMixerWaveCacheAdd(sysResourceAddress in_resource_address);
+void waveMixerWaveCacheCleanup(void);
+#endif
 
 #endif
@@ -27,7 +27,6 @@
 /* Includes                                                                  */
 /*****************************************************************************/
 #include <sysMain.h>
-#include <halKeyboardInput.h>
 #include <sysUserInput.h>
 #include <emuInvaders.h>
 #include <sysVirtualKeyboardCodes.h>
@@ -48,7 +47,6 @@ int main(int argc, char* argv[])
 
 	while (!l_exit_requested)
 	{
-		halKeyboardDispatchEvent();
 		sysMainTask();
 	}
 	
@@ -14,18 +14,93 @@
 #include <waveMixer.h>
 #include <halWavePlayer.h>
 #include "sysConfig.h"
+#ifdef waveMIXER_WAVE_CACHE
+#include <stdlib.h>
+#endif
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+
+// Number of samples mixed in one block (channels are mixed one by one into the block)
+#ifndef waveMIXER_BLOCK_LENGTH
+#define waveMIXER_BLOCK_LENGTH 256
+#endif
+
+// Linear interpolation between the source samples (0: nearest sample)
+#ifndef waveMIXER_LINEAR_INTERPOLATION
+#define waveMIXER_LINEAR_INTERPOLATION 1
+#endif
+
+// Output sample range
+#ifndef halWAVEPLAYER_SAMPLE_MIN
+#define halWAVEPLAYER_SAMPLE_MIN -32768
+#endif
+#ifndef halWAVEPLAYER_SAMPLE_MAX
+#define halWAVEPLAYER_SAMPLE_MAX 32767
+#endif
+
+// Zero level of the 8 bit unsigned source samples
+#define waveMIXER_SAMPLE_ZERO_LEVEL 127
+
+// The resampler phase is 16.16 fixed point number of source samples
+#define waveMIXER_PHASE_SHIFT 16
+#define waveMIXER_PHASE_ONE (1ul << waveMIXER_PHASE_SHIFT)
+#define waveMIXER_PHASE_MASK (waveMIXER_PHASE_ONE - 1)
+
+// SIMD mixing needs 16 bit output and the scaled source samples must fit into 16 bit ((255 - 127) * multiplier <= 32767)
+#if !defined(drvWavePlayerBufferType) && halWAVEPLAYER_SAMPLE_MIN == -32768 && halWAVEPLAYER_SAMPLE_MAX == 32767 && halWAVEPLAYER_SAMPLE_MULTIPLIER < 256
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define waveMIXER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define waveMIXER_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+#ifdef waveMIXER_WAVE_CACHE
+/// Wave resource converted to the output sample rate (samples are scaled by halWAVEPLAYER_SAMPLE_MULTIPLIER)
+typedef struct
+{
+	sysResourceAddress ResourceAddress;
+	int16_t* Samples;											// sysNULL if the entry is empty
+	uint32_t SamplesCount;
+} waveMixerWaveCacheEntry;
+#endif
 
 /*****************************************************************************/
 /* Local function prototypes                                                 */
 /*****************************************************************************/
+static void waveMixerReadWaveHeader(sysResourceAddress in_resource_address, uint32_t* out_sample_rate, uint32_t* out_sample_count);
 static void drvWavePlayerUnlinkChannelFromPlay(waveMixerState* in_state, uint8_t in_channel);
+static bool waveMixerRenderChannel(waveMixerChannelState* in_channel, int32_t* in_mix_buffer, uint32_t in_sample_count);
+static uint32_t waveMixerGetRunLength(uint32_t in_source_sample_count, uint32_t in_phase, uint32_t in_phase_increment);
+static void waveMixerAddSamples(int32_t* in_mix_buffer, const uint8_t* in_samples, uint32_t in_sample_count);
+static void waveMixerAddResampledSamples(int32_t* in_mix_buffer, const uint8_t* in_samples, uint32_t in_phase, uint32_t in_phase_increment, uint32_t in_sample_count);
+static void waveMixerStoreBlock(halWavePlayerBufferType* in_render_buffer, const int32_t* in_mix_buffer, uint32_t in_sample_count);
+#ifdef waveMIXER_WAVE_CACHE
+static void waveMixerAddCachedSamples(int32_t* in_mix_buffer, const int16_t* in_samples, uint32_t in_sample_count);
+static waveMixerWaveCacheEntry* waveMixerWaveCacheFind(sysResourceAddress in_resource_address);
+#endif
+
+/*****************************************************************************/
+/* Module global variables                                                   */
+/*****************************************************************************/
+#ifdef waveMIXER_WAVE_CACHE
+static waveMixerWaveCacheEntry l_wave_cache[waveMIXER_WAVE_CACHE_SIZE];
+#endif
 
 /*****************************************************************************/
 /* Function implementation                                                   */
 /*****************************************************************************/
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Initializes wave mixer
+/// @brief Initializes wave mixer (stops all channels). The wave player is shared by the mixers and must be
+/// initialized separately.
 void waveMixerInitialize(waveMixerState* in_state)
 {
   uint8_t channel;
@@ -37,8 +112,6 @@ void waveMixerInitialize(waveMixerState* in_state)
     in_state->ChannelState[channel].State = 0;
 		in_state->ChannelState[channel].NextActiveChannel = waveMIXER_INVALID_CHANNEL;
   }
-
-	halWavePlayerInitialize();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -50,9 +123,12 @@ void waveMixerInitialize(waveMixerState* in_state)
 uint8_t waveMixerPlayWaveFromResource(waveMixerState* in_state, sysResourceAddress in_resouce_adress, uint32_t in_flags)
 {
 	uint8_t channel;
-	uint8_t format;
 	uint32_t sample_count;
 	uint32_t sample_rate;
+	waveMixerChannelState* channel_state;
+#ifdef waveMIXER_WAVE_CACHE
+	waveMixerWaveCacheEntry* cache_entry;
+#endif
 
 	// find idle channel
 	channel = 0;
@@ -60,46 +136,38 @@ uint8_t waveMixerPlayWaveFromResource(waveMixerState* in_state, sysResourceAddre
 	{
 		if((in_state->ChannelState[channel].State & waveMIXER_CS_ACTIVE) == 0)
 		{
-			// get wave information
-			format = drvResourceReadByte(in_resouce_adress);
-			in_resouce_adress++;
+			// idle channel found -> update channel info
+			channel_state = &in_state->ChannelState[channel];
 
-			// decode format
-			switch (format & waveWAVEPLAYER_SAMPLE_RATE_MASK)
+#ifdef waveMIXER_WAVE_CACHE
+			// looped playback is resampled from the source, the cached wave ends at the zero level and its length is rounded
+			cache_entry = ((in_flags & waveMIXER_CS_LOOP_ENABLED) == 0) ? waveMixerWaveCacheFind(in_resouce_adress) : sysNULL;
+			if(cache_entry != sysNULL)
 			{
-			case waveWAVEPLAYER_FORMAT_8000HZ:
-				sample_rate = 8000;
-				break;
-
-			case waveWAVEPLAYER_FORMAT_11025HZ:
-				sample_rate = 11025;
-				break;
-
-			case waveWAVEPLAYER_FORMAT_22050HZ:
-				sample_rate = 22050;
-				break;
-
-			case waveWAVEPLAYER_FORMAT_44100HZ:
-				sample_rate = 44100;
-				break;
-
-			default:
-				sample_rate = 44100;
-				break;
+				// play converted samples from the cache
+				channel_state->State = in_flags | waveMIXER_CS_ACTIVE | waveMIXER_CS_CACHED;
+				channel_state->Samples = cache_entry->Samples;
+				channel_state->SamplesAddress = in_resouce_adress;
+				channel_state->SamplesCount = cache_entry->SamplesCount;
+				channel_state->SampleRate = halWAVEPLAYER_SAMPLE_RATE;
+			}
+			else
+#endif
+			{
+				// play samples from the resource
+				waveMixerReadWaveHeader(in_resouce_adress, &sample_rate, &sample_count);
+				in_resouce_adress += 5;
+
+				channel_state->State = (in_flags & ~waveMIXER_CS_CACHED) | waveMIXER_CS_ACTIVE;
+				channel_state->Samples = drvGetResourcePhysicalAddress(in_resouce_adress);
+				channel_state->SamplesAddress = in_resouce_adress;
+				channel_state->SamplesCount = sample_count;
+				channel_state->SampleRate = sample_rate;
 			}
 
-			// get sample count
-			sample_count = drvResourceReadDWord(in_resouce_adress);
-			in_resouce_adress += 4;
-
-			// idle channel found -> update channel info
-			in_state->ChannelState[channel].State = in_flags | waveMIXER_CS_ACTIVE;
-			in_state->ChannelState[channel].Samples = drvGetResourcePhysicalAddress(in_resouce_adress );
-			in_state->ChannelState[channel].SamplesCount = sample_count;
-			in_state->ChannelState[channel].SampleRate = sample_rate;
-			in_state->ChannelState[channel].Position = 0;
-			in_state->ChannelState[channel].SampleRateAccumulator = 0;
-			in_state->ChannelState[channel].NextActiveChannel = in_state->FirstActiveChannel;
+			channel_state->Position = 0;
+			channel_state->Phase = 0;
+			channel_state->NextActiveChannel = in_state->FirstActiveChannel;
 			in_state->FirstActiveChannel = channel;
 
 			return channel;
@@ -127,78 +195,184 @@ void waveMixerStopWave(waveMixerState* in_state, uint8_t in_channel_to_stop)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Renders audio stream, mixes all active channels and resamples if needed
+/// @brief Renders audio stream, mixes all active channels and resamples if needed. The stream is rendered in
+/// blocks, every channel is mixed into the block in one pass then the block is clamped to the output range.
 /// @param in_channel_info Pointer to the mixel channel inormation array
 /// @param in_reder_buffer Buffer to render the stream
 /// @param in_sample_count Number of samples to render
 void waveMixerRenderStream(waveMixerState* in_state, halWavePlayerBufferType* in_render_buffer, uint32_t in_sample_count)
-{																																	  
+{
+	int32_t mix_buffer[waveMIXER_BLOCK_LENGTH];
+	uint32_t block_length;
+	uint32_t i;
 	uint8_t next_channel_index;
 	uint8_t current_channel_index;
-	int32_t sample_sum = 0;
 	waveMixerChannelState* current_channel;
 
-	// render the specified number of samples
 	while(in_sample_count > 0)
 	{
-		// render all channels
-	  sample_sum = 0;
+		block_length = (in_sample_count < waveMIXER_BLOCK_LENGTH) ? in_sample_count : waveMIXER_BLOCK_LENGTH;
+
+		for(i = 0; i < block_length; i++)
+			mix_buffer[i] = 0;
+
+		// mix all channels
 		current_channel_index = in_state->FirstActiveChannel;
 		while(current_channel_index != waveMIXER_INVALID_CHANNEL)
 		{
 			current_channel = &in_state->ChannelState[current_channel_index];
 			next_channel_index = current_channel->NextActiveChannel;
 
-			// calculate next sample pos
-			current_channel->SampleRateAccumulator += current_channel->SampleRate;
-
-			while(current_channel->SampleRateAccumulator >= halWAVEPLAYER_SAMPLE_RATE)
-			{
-				// next sample
-				current_channel->Position++;
-
-				// check for samples end
-				if(current_channel->Position >= current_channel->SamplesCount)
-				{
-					// all samples played -> check for loop flag
-					if((current_channel->State & waveMIXER_CS_LOOP_ENABLED) != 0)
-					{
-						// playback is looped -> restart
-						current_channel->Position = 0;
-					}
-					else
-					{
-						// no loopback enabled -> stop playback of this channel
-						current_channel->State &= ~waveMIXER_CS_ACTIVE;
-						next_channel_index = current_channel->NextActiveChannel;
-						drvWavePlayerUnlinkChannelFromPlay(in_state, current_channel_index);
-						break;
-					}
-				}
-
-				current_channel->SampleRateAccumulator -= halWAVEPLAYER_SAMPLE_RATE;
-			}
-
-			// check if channel is still active
-			if((current_channel->State & waveMIXER_CS_ACTIVE) != 0)
+			if(!waveMixerRenderChannel(current_channel, mix_buffer, block_length))
 			{
-				// sum sample
-				sample_sum += *(((uint8_t*)(current_channel->Samples)) + current_channel->Position) - 127;
+				// all samples played -> stop playback of this channel
+				current_channel->State &= ~waveMIXER_CS_ACTIVE;
+				drvWavePlayerUnlinkChannelFromPlay(in_state, current_channel_index);
 			}
 
-			// next active channel
 			current_channel_index = next_channel_index;
 		}
 
-		// store sample
-		*in_render_buffer = sample_sum * halWAVEPLAYER_SAMPLE_MULTIPLIER + halWAVEPLAYER_SAMPLE_OFFSET;
-		in_render_buffer++;
+		waveMixerStoreBlock(in_render_buffer, mix_buffer, block_length);
 
-		// next rendered sample
-		in_sample_count--;
-  }
+		in_render_buffer += block_length;
+		in_sample_count -= block_length;
+	}
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Restores sample pointer of the channel from the saved resource address (used when the channel state is
+/// loaded from a snapshot)
+/// @param in_channel Channel to restore
+/// @return True if success, false if the cached wave of the channel is not available
+bool waveMixerRestoreChannelSamples(waveMixerChannelState* in_channel)
+{
+#ifdef waveMIXER_WAVE_CACHE
+	waveMixerWaveCacheEntry* cache_entry;
+
+	if((in_channel->State & waveMIXER_CS_CACHED) != 0)
+	{
+		cache_entry = waveMixerWaveCacheFind(in_channel->SamplesAddress);
+		if(cache_entry == sysNULL || cache_entry->SamplesCount != in_channel->SamplesCount)
+			return false;
+
+		in_channel->Samples = cache_entry->Samples;
+
+		return true;
+	}
+#else
+	if((in_channel->State & waveMIXER_CS_CACHED) != 0)
+		return false;
+#endif
+
+	in_channel->Samples = drvGetResourcePhysicalAddress(in_channel->SamplesAddress);
+
+	return true;
+}
+
+#ifdef waveMIXER_WAVE_CACHE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Converts wave resource to the output sample rate and stores it in the wave cache. Later playback of the
+/// wave only adds the cached samples to the mix. The tail of the wave is interpolated towards the zero level and its
+/// length is rounded to the output samples, therefore the cache is used only when the wave is not looped.
+/// @param in_resource_address Resource address of the wave
+/// @return True if the wave is cached, false if the cache is full or there is not enough memory
+bool waveMixerWaveCacheAdd(sysResourceAddress in_resource_address)
+{
+	waveMixerWaveCacheEntry* cache_entry;
+	waveMixerChannelState channel;
+	int32_t mix_buffer[waveMIXER_BLOCK_LENGTH];
+	uint32_t cached_sample_count;
+	uint32_t block_length;
+	uint32_t pos;
+	uint32_t i;
+	int32_t sample;
+	uint32_t index;
+	uint32_t probe;
+
+	if(waveMixerWaveCacheFind(in_resource_address) != sysNULL)
+		return true;
+
+	// find empty entry
+	index = ((uint32_t)in_resource_address * 2654435761u) & (waveMIXER_WAVE_CACHE_SIZE - 1);
+	for(probe = 0; probe < waveMIXER_WAVE_CACHE_SIZE; probe++)
+	{
+		if(l_wave_cache[index].Samples == sysNULL)
+			break;
+
+		index = (index + 1) & (waveMIXER_WAVE_CACHE_SIZE - 1);
+	}
+
+	if(probe == waveMIXER_WAVE_CACHE_SIZE)
+		return false;
+
+	// the samples are rendered by the same resampler as the uncached playback
+	channel.State = waveMIXER_CS_ACTIVE;
+	waveMixerReadWaveHeader(in_resource_address, &channel.SampleRate, &channel.SamplesCount);
+	channel.SamplesAddress = in_resource_address + 5;
+	channel.Samples = drvGetResourcePhysicalAddress(channel.SamplesAddress);
+	channel.Position = 0;
+	channel.Phase = 0;
+
+	if(channel.SamplesCount == 0)
+		return false;
+
+	cached_sample_count = waveMixerGetRunLength(channel.SamplesCount, 0, (uint32_t)(((uint64_t)channel.SampleRate << waveMIXER_PHASE_SHIFT) / halWAVEPLAYER_SAMPLE_RATE));
+	if(cached_sample_count == 0)
+		return false;
+
+	cache_entry = &l_wave_cache[index];
+	cache_entry->Samples = (int16_t*)malloc(cached_sample_count * sizeof(int16_t));
+	if(cache_entry->Samples == sysNULL)
+		return false;
+
+	cache_entry->ResourceAddress = in_resource_address;
+	cache_entry->SamplesCount = cached_sample_count;
+
+	pos = 0;
+	while(pos < cached_sample_count)
+	{
+		block_length = cached_sample_count - pos;
+		if(block_length > waveMIXER_BLOCK_LENGTH)
+			block_length = waveMIXER_BLOCK_LENGTH;
+
+		for(i = 0; i < block_length; i++)
+			mix_buffer[i] = 0;
+
+		waveMixerRenderChannel(&channel, mix_buffer, block_length);
+
+		for(i = 0; i < block_length; i++)
+		{
+			sample = mix_buffer[i];
+
+			if(sample < -32768)
+				sample = -32768;
+
+			if(sample > 32767)
+				sample = 32767;
+
+			cache_entry->Samples[pos + i] = (int16_t)sample;
+		}
+
+		pos += block_length;
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Releases all cached waves. Channels playing cached waves must be stopped.
+void waveMixerWaveCacheCleanup(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < waveMIXER_WAVE_CACHE_SIZE; i++)
+	{
+		free(l_wave_cache[i].Samples);
+		l_wave_cache[i].Samples = sysNULL;
+	}
+}
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Unlinks (stops playback) of the selected channel from the play list of channel
@@ -229,3 +403,325 @@ static void drvWavePlayerUnlinkChannelFromPlay(waveMixerState* in_state, uint8_t
 
 	in_state->ChannelState[in_channel].NextActiveChannel = waveMIXER_INVALID_CHANNEL;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Mixes samples of one channel into the mix buffer. The samples are processed in runs, the inner loops
+/// have no end of samples check.
+/// @param in_channel Channel to render
+/// @param in_mix_buffer Mix buffer
+/// @param in_sample_count Number of samples to mix
+/// @return False if all samples of the (not looped) channel are played
+static bool waveMixerRenderChannel(waveMixerChannelState* in_channel, int32_t* in_mix_buffer, uint32_t in_sample_count)
+{
+	const uint8_t* samples = (const uint8_t*)in_channel->Samples;
+	uint32_t phase_increment = (uint32_t)(((uint64_t)in_channel->SampleRate << waveMIXER_PHASE_SHIFT) / halWAVEPLAYER_SAMPLE_RATE);
+	uint32_t run_length;
+	uint32_t phase;
+	int32_t sample;
+	int32_t next_sample;
+
+	while(in_sample_count > 0)
+	{
+#ifdef waveMIXER_WAVE_CACHE
+		if((in_channel->State & waveMIXER_CS_CACHED) != 0)
+		{
+			// cached samples are at the output sample rate
+			run_length = in_channel->SamplesCount - in_channel->Position;
+			if(run_length > in_sample_count)
+				run_length = in_sample_count;
+
+			waveMixerAddCachedSamples(in_mix_buffer, (const int16_t*)in_channel->Samples + in_channel->Position, run_length);
+		}
+		else
+#endif
+		{
+			// number of output samples which can be rendered from the buffer (interpolation reads the next sample as well)
+			run_length = waveMixerGetRunLength(in_channel->SamplesCount - in_channel->Position - waveMIXER_LINEAR_INTERPOLATION, in_channel->Phase, phase_increment);
+			if(run_length > in_sample_count)
+				run_length = in_sample_count;
+
+			if(run_length > 0)
+			{
+				if(phase_increment == waveMIXER_PHASE_ONE && in_channel->Phase == 0)
+					waveMixerAddSamples(in_mix_buffer, samples + in_channel->Position, run_length);
+				else
+					waveMixerAddResampledSamples(in_mix_buffer, samples + in_channel->Position, in_channel->Phase, phase_increment, run_length);
+			}
+			else
+			{
+				// the last source sample is interpolated towards the first sample (looped) or the zero level
+				sample = samples[in_channel->Position];
+				if((in_channel->State & waveMIXER_CS_LOOP_ENABLED) != 0)
+					next_sample = samples[0];
+				else
+					next_sample = waveMIXER_SAMPLE_ZERO_LEVEL;
+
+				sample = ((sample - waveMIXER_SAMPLE_ZERO_LEVEL) << 8) + (((next_sample - sample) * (int32_t)in_channel->Phase) >> (waveMIXER_PHASE_SHIFT - 8));
+				*in_mix_buffer += (sample * halWAVEPLAYER_SAMPLE_MULTIPLIER) >> 8;
+
+				run_length = 1;
+			}
+		}
+
+		// advance position
+		phase = in_channel->Phase + run_length * phase_increment;
+		in_channel->Position += phase >> waveMIXER_PHASE_SHIFT;
+		in_channel->Phase = phase & waveMIXER_PHASE_MASK;
+
+		in_mix_buffer += run_length;
+		in_sample_count -= run_length;
+
+		// check for samples end
+		if(in_channel->Position >= in_channel->SamplesCount)
+		{
+			// all samples played -> check for loop flag
+			if((in_channel->State & waveMIXER_CS_LOOP_ENABLED) == 0)
+				return false;
+
+			// playback is looped -> restart
+			in_channel->Position %= in_channel->SamplesCount;
+		}
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Calculates number of the output samples until the phase reaches the given source sample
+/// @param in_source_sample_count Number of available source samples (from the current position)
+/// @param in_phase Fractional part of the current position
+/// @param in_phase_increment Phase increment of one output sample
+/// @return Number of output samples
+static uint32_t waveMixerGetRunLength(uint32_t in_source_sample_count, uint32_t in_phase, uint32_t in_phase_increment)
+{
+	uint64_t phase_left;
+
+	if((int32_t)in_source_sample_count <= 0 || in_phase_increment == 0)
+		return 0;
+
+	phase_left = ((uint64_t)in_source_sample_count << waveMIXER_PHASE_SHIFT) - in_phase;
+
+	return (uint32_t)((phase_left + in_phase_increment - 1) / in_phase_increment);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds source samples to the mix buffer (source and output sample rates are the same)
+/// @param in_mix_buffer Mix buffer
+/// @param in_samples Source samples
+/// @param in_sample_count Number of samples to add
+static void waveMixerAddSamples(int32_t* in_mix_buffer, const uint8_t* in_samples, uint32_t in_sample_count)
+{
+	uint32_t i = 0;
+
+#if defined(waveMIXER_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i zero_level = _mm_set1_epi16(waveMIXER_SAMPLE_ZERO_LEVEL);
+	const __m128i multiplier = _mm_set1_epi16(halWAVEPLAYER_SAMPLE_MULTIPLIER);
+	__m128i samples;
+	__m128i scaled;
+
+	for(; i + 8 <= in_sample_count; i += 8)
+	{
+		// 8 bit unsigned -> 16 bit scaled -> 32 bit
+		samples = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(in_samples + i)), zero);
+		scaled = _mm_mullo_epi16(_mm_sub_epi16(samples, zero_level), multiplier);
+
+		_mm_storeu_si128((__m128i*)(in_mix_buffer + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(in_mix_buffer + i)), _mm_srai_epi32(_mm_unpacklo_epi16(scaled, scaled), 16)));
+		_mm_storeu_si128((__m128i*)(in_mix_buffer + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(in_mix_buffer + i + 4)), _mm_srai_epi32(_mm_unpackhi_epi16(scaled, scaled), 16)));
+	}
+#elif defined(waveMIXER_NEON)
+	const int16x8_t zero_level = vdupq_n_s16(waveMIXER_SAMPLE_ZERO_LEVEL);
+	int16x8_t scaled;
+
+	for(; i + 8 <= in_sample_count; i += 8)
+	{
+		// 8 bit unsigned -> 16 bit scaled -> 32 bit
+		scaled = vmulq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in_samples + i))), zero_level), halWAVEPLAYER_SAMPLE_MULTIPLIER);
+
+		vst1q_s32(in_mix_buffer + i, vaddq_s32(vld1q_s32(in_mix_buffer + i), vmovl_s16(vget_low_s16(scaled))));
+		vst1q_s32(in_mix_buffer + i + 4, vaddq_s32(vld1q_s32(in_mix_buffer + i + 4), vmovl_s16(vget_high_s16(scaled))));
+	}
+#endif
+
+	for(; i < in_sample_count; i++)
+		in_mix_buffer[i] += (in_samples[i] - waveMIXER_SAMPLE_ZERO_LEVEL) * halWAVEPLAYER_SAMPLE_MULTIPLIER;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds resampled source samples to the mix buffer. All the source samples read by the phase (including the
+/// next sample of the interpolation) must be available.
+/// @param in_mix_buffer Mix buffer
+/// @param in_samples Source samples
+/// @param in_phase Fractional position of the first output sample
+/// @param in_phase_increment Phase increment of one output sample
+/// @param in_sample_count Number of samples to add
+static void waveMixerAddResampledSamples(int32_t* in_mix_buffer, const uint8_t* in_samples, uint32_t in_phase, uint32_t in_phase_increment, uint32_t in_sample_count)
+{
+	uint32_t i;
+	const uint8_t* source;
+	int32_t sample;
+
+	for(i = 0; i < in_sample_count; i++)
+	{
+		source = in_samples + (in_phase >> waveMIXER_PHASE_SHIFT);
+
+#if waveMIXER_LINEAR_INTERPOLATION
+		// sample value in 1/256 units
+		sample = ((source[0] - waveMIXER_SAMPLE_ZERO_LEVEL) << 8) + (((source[1] - source[0]) * (int32_t)(in_phase & waveMIXER_PHASE_MASK)) >> (waveMIXER_PHASE_SHIFT - 8));
+		in_mix_buffer[i] += (sample * halWAVEPLAYER_SAMPLE_MULTIPLIER) >> 8;
+#else
+		sample = source[0] - waveMIXER_SAMPLE_ZERO_LEVEL;
+		in_mix_buffer[i] += sample * halWAVEPLAYER_SAMPLE_MULTIPLIER;
+#endif
+
+		in_phase += in_phase_increment;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Converts mixed samples to the output format (offset is added, samples are clamped)
+/// @param in_render_buffer Output buffer
+/// @param in_mix_buffer Mix buffer
+/// @param in_sample_count Number of samples to store
+static void waveMixerStoreBlock(halWavePlayerBufferType* in_render_buffer, const int32_t* in_mix_buffer, uint32_t in_sample_count)
+{
+	uint32_t i = 0;
+	int32_t sample;
+
+#if defined(waveMIXER_SSE2)
+	const __m128i offset = _mm_set1_epi32(halWAVEPLAYER_SAMPLE_OFFSET);
+	__m128i low;
+	__m128i high;
+
+	for(; i + 8 <= in_sample_count; i += 8)
+	{
+		low = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(in_mix_buffer + i)), offset);
+		high = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(in_mix_buffer + i + 4)), offset);
+
+		_mm_storeu_si128((__m128i*)(in_render_buffer + i), _mm_packs_epi32(low, high));
+	}
+#elif defined(waveMIXER_NEON)
+	const int32x4_t offset = vdupq_n_s32(halWAVEPLAYER_SAMPLE_OFFSET);
+
+	for(; i + 8 <= in_sample_count; i += 8)
+	{
+		vst1q_s16(in_render_buffer + i, vcombine_s16(vqmovn_s32(vaddq_s32(vld1q_s32(in_mix_buffer + i), offset)), vqmovn_s32(vaddq_s32(vld1q_s32(in_mix_buffer + i + 4), offset))));
+	}
+#endif
+
+	for(; i < in_sample_count; i++)
+	{
+		sample = in_mix_buffer[i] + halWAVEPLAYER_SAMPLE_OFFSET;
+
+		if(sample < halWAVEPLAYER_SAMPLE_MIN)
+			sample = halWAVEPLAYER_SAMPLE_MIN;
+
+		if(sample > halWAVEPLAYER_SAMPLE_MAX)
+			sample = halWAVEPLAYER_SAMPLE_MAX;
+
+		in_render_buffer[i] = (halWavePlayerBufferType)sample;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Reads format and length of the wave resource
+/// @param in_resource_address Resource address of the wave
+/// @param out_sample_rate Sample rate of the wave
+/// @param out_sample_count Number of samples
+static void waveMixerReadWaveHeader(sysResourceAddress in_resource_address, uint32_t* out_sample_rate, uint32_t* out_sample_count)
+{
+	uint8_t format;
+
+	// get wave information
+	format = drvResourceReadByte(in_resource_address);
+	in_resource_address++;
+
+	// decode format
+	switch (format & waveWAVEPLAYER_SAMPLE_RATE_MASK)
+	{
+	case waveWAVEPLAYER_FORMAT_8000HZ:
+		*out_sample_rate = 8000;
+		break;
+
+	case waveWAVEPLAYER_FORMAT_11025HZ:
+		*out_sample_rate = 11025;
+		break;
+
+	case waveWAVEPLAYER_FORMAT_22050HZ:
+		*out_sample_rate = 22050;
+		break;
+
+	case waveWAVEPLAYER_FORMAT_44100HZ:
+		*out_sample_rate = 44100;
+		break;
+
+	default:
+		*out_sample_rate = 44100;
+		break;
+	}
+
+	// get sample count
+	*out_sample_count = drvResourceReadDWord(in_resource_address);
+}
+
+#ifdef waveMIXER_WAVE_CACHE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Adds cached (already resampled and scaled) samples to the mix buffer
+/// @param in_mix_buffer Mix buffer
+/// @param in_samples Cached samples
+/// @param in_sample_count Number of samples to add
+static void waveMixerAddCachedSamples(int32_t* in_mix_buffer, const int16_t* in_samples, uint32_t in_sample_count)
+{
+	uint32_t i = 0;
+
+#if defined(waveMIXER_SSE2)
+	__m128i samples;
+
+	for(; i + 8 <= in_sample_count; i += 8)
+	{
+		samples = _mm_loadu_si128((const __m128i*)(in_samples + i));
+
+		_mm_storeu_si128((__m128i*)(in_mix_buffer + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(in_mix_buffer + i)), _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16)));
+		_mm_storeu_si128((__m128i*)(in_mix_buffer + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(in_mix_buffer + i + 4)), _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16)));
+	}
+#elif defined(waveMIXER_NEON)
+	int16x8_t samples;
+
+	for(; i + 8 <= in_sample_count; i += 8)
+	{
+		samples = vld1q_s16(in_samples + i);
+
+		vst1q_s32(in_mix_buffer + i, vaddq_s32(vld1q_s32(in_mix_buffer + i), vmovl_s16(vget_low_s16(samples))));
+		vst1q_s32(in_mix_buffer + i + 4, vaddq_s32(vld1q_s32(in_mix_buffer + i + 4), vmovl_s16(vget_high_s16(samples))));
+	}
+#endif
+
+	for(; i < in_sample_count; i++)
+		in_mix_buffer[i] += in_samples[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Finds cached wave
+/// @param in_resource_address Resource address of the wave
+/// @return Cache entry of the wave or sysNULL if the wave is not cached
+static waveMixerWaveCacheEntry* waveMixerWaveCacheFind(sysResourceAddress in_resource_address)
+{
+	uint32_t index;
+	uint32_t probe;
+
+	// open addressing with linear probing, the resource address is hashed by multiplication
+	index = ((uint32_t)in_resource_address * 2654435761u) & (waveMIXER_WAVE_CACHE_SIZE - 1);
+	for(probe = 0; probe < waveMIXER_WAVE_CACHE_SIZE; probe++)
+	{
+		if(l_wave_cache[index].Samples == sysNULL)
+			return sysNULL;
+
+		if(l_wave_cache[index].ResourceAddress == in_resource_address)
+			return &l_wave_cache[index];
+
+		index = (index + 1) & (waveMIXER_WAVE_CACHE_SIZE - 1);
+	}
+
+	return sysNULL;
+}
+#endif
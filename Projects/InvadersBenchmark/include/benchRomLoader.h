@@ -0,0 +1,23 @@
+/*****************************************************************************/
+/* Space Invaders ROM loader for the headless benchmark                      */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __benchRomLoader_h
+#define __benchRomLoader_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <sysTypes.h>
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+bool benchLoadRom(const char* in_file_name);
+
+#endif
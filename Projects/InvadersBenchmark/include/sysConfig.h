@@ -0,0 +1,45 @@
+/*****************************************************************************/
+/* Configuration for headless Linux benchmark application                    */
+/*                                                                           */
+/* Copyright (C) 2015 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+#ifndef __sysConfig_h
+#define __sysConfig_h
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <sysTypes.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+///////////////////////////////////////////////////////////////////////////////
+// GUI Config
+#define guiSCREEN_WIDTH 240
+#define guiSCREEN_HEIGHT 320
+
+#define guiCOLOR_DEPTH 24
+
+#define guiemuZOOM 1
+#define guiemuBACKGROUND_COLOR 0x00000000
+#define guiemuFOREGROUND_COLOR 0xffffffff
+#define emuINVADERS_VSYNC_RENDERING						// video RAM changes are rendered once per frame at vsync
+#define emuINVADERS_RUNTIME_ROM								// ROM image is loaded from file (g_cpu_rom is not const)
+
+///////////////////////////////////////////////////////////////////////////////
+// Wave config
+#define halWAVEPLAYER_SAMPLE_RATE 44100
+#define halWAVEPLAYER_SAMPLE_OFFSET 0
+#define halWAVEPLAYER_SAMPLE_MULTIPLIER 64
+#define waveMIXER_WAVE_CACHE											// sounds are converted to the output sample rate at initialization
+
+///////////////////////////////////////////////////////////////////////////////
+// Resource config
+typedef int sysResourceAddress;
+
+#endif
@@ -0,0 +1,509 @@
+/*****************************************************************************/
+/* Headless Space Invaders emulator throughput benchmark                     */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sysUserInput.h>
+#include <halNull.h>
+#include <emuInvaders.h>
+#include <guiColorGraphics.h>
+#include <emuBatch.h>
+#include <benchRomLoader.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define benchDEFAULT_EMULATED_SECONDS 60
+#define benchHALF_FRAME_TIME (1000000 / emuINVADERS_FRAME_RATE / 2) // half frame time in us
+#define benchBATCH_FRAME_COUNT emuINVADERS_FRAME_RATE // frames stepped by one batch (one second)
+#define benchSNAPSHOT_FILE_NAME "InvadersBenchmarkSnapshot.bin"
+#define benchSNAPSHOT_CHECK_FRAME_COUNT (10 * emuINVADERS_FRAME_RATE) // frames emulated after restoring the snapshot
+#define benchREWIND_CHECK_FRAME_COUNT (2 * emuINVADERS_FRAME_RATE) // frames emulated and rewound by the rewind check
+#define benchREDRAW_FRAME_COUNT 1000 // full screen redraws of the renderer measurement
+
+/*****************************************************************************/
+/* Function prototypes                                                       */
+/*****************************************************************************/
+void sysInitialization(void);
+void sysCleanup(void);
+
+/*****************************************************************************/
+/* Module local variables                                                    */
+/*****************************************************************************/
+#ifdef emuINVADERS_VSYNC_RENDERING
+static uint16_t l_line_buffer[emuINVADERS_SCREEN_HEIGHT];
+#endif
+#ifdef cpuI8080_BLOCK_CACHE
+static cpuI8080ExecMode l_exec_mode = cpuI8080_EXEC_INTERPRETER;
+static cpuI8080BlockCache l_block_cache;
+static const char* l_exec_mode_names[] = { "interpreter", "block", "differential" };
+#endif
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets monotonic wall clock time
+/// @return Time in ns
+static uint64_t benchGetTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef cpuI8080_BLOCK_CACHE
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Sets CPU execution mode from its name
+/// @param in_name Name of the mode
+/// @return True if the name is valid
+static bool benchSetExecMode(const char* in_name)
+{
+	uint32_t i;
+
+	for (i = 0; i < sizeof(l_exec_mode_names) / sizeof(l_exec_mode_names[0]); i++)
+	{
+		if (strcmp(in_name, l_exec_mode_names[i]) == 0)
+		{
+			l_exec_mode = (cpuI8080ExecMode)i;
+			return true;
+		}
+	}
+
+	fprintf(stderr, "Unknown execution mode: %s\n", in_name);
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Displays block cache statistics
+/// @param in_caches Block caches of the instances
+/// @param in_cache_count Number of caches
+static void benchPrintBlockStatistics(const cpuI8080BlockCache* in_caches, uint32_t in_cache_count)
+{
+	uint64_t cached = 0;
+	uint64_t invalidated = 0;
+	uint64_t compared = 0;
+	uint64_t mismatch = 0;
+	uint32_t i;
+
+	for (i = 0; i < in_cache_count; i++)
+	{
+		cached += in_caches[i].cached_block_count;
+		invalidated += in_caches[i].invalidated_page_count;
+		compared += in_caches[i].compared_block_count;
+		mismatch += in_caches[i].mismatch_count;
+	}
+
+	printf("Exec mode:          %s\n", l_exec_mode_names[l_exec_mode]);
+	printf("Cached blocks:      %llu (%llu page invalidations)\n", (unsigned long long)cached, (unsigned long long)invalidated);
+
+	if (l_exec_mode == cpuI8080_EXEC_DIFFERENTIAL)
+		printf("Compared blocks:    %llu (%llu mismatches)\n", (unsigned long long)compared, (unsigned long long)mismatch);
+}
+#endif
+
+#ifdef cpuI8080_SNAPSHOT
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Saves the displayed machine, restores it into a new instance and runs both machines. The machines
+/// must continue identically.
+/// @return True if the snapshot is saved and restored correctly
+static bool benchSnapshotRoundTrip(void)
+{
+	emuInvadersState* restored;
+	uint64_t save_time;
+	uint64_t load_time;
+	bool identical;
+	bool success;
+	FILE* file;
+	long file_length = 0;
+
+	restored = (emuInvadersState*)calloc(1, sizeof(emuInvadersState));
+	if (restored == sysNULL)
+		return false;
+
+	emuInvadersInstanceInitialize(restored);
+
+	save_time = benchGetTime();
+	success = emuInvadersInstanceSaveSnapshot(&g_invaders_state, benchSNAPSHOT_FILE_NAME);
+	save_time = benchGetTime() - save_time;
+
+	load_time = benchGetTime();
+	success = success && emuInvadersInstanceLoadSnapshot(restored, benchSNAPSHOT_FILE_NAME);
+	load_time = benchGetTime() - load_time;
+
+	file = fopen(benchSNAPSHOT_FILE_NAME, "rb");
+	if (file != sysNULL)
+	{
+		fseek(file, 0, SEEK_END);
+		file_length = ftell(file);
+		fclose(file);
+	}
+
+	// run both machines
+	if (success)
+	{
+		g_invaders_state.display_enabled = false;
+		emuInvadersInstanceStep(&g_invaders_state, benchSNAPSHOT_CHECK_FRAME_COUNT);
+		emuInvadersInstanceStep(restored, benchSNAPSHOT_CHECK_FRAME_COUNT);
+	}
+
+	identical = success && memcmp(restored->ram, g_invaders_state.ram, emuINVADERS_RAM_SIZE) == 0 && restored->cpu.reg.pc == g_invaders_state.cpu.reg.pc &&
+		restored->cpu.cycles == g_invaders_state.cpu.cycles && restored->frame_count == g_invaders_state.frame_count;
+
+	printf("Snapshot:           %ld bytes, saved in %.1f us, restored in %.1f us, %s\n", file_length, save_time / 1e3, load_time / 1e3,
+		success ? (identical ? "restored machine is identical" : "restored machine is DIFFERENT") : "FAILED");
+
+	free(restored);
+
+	return identical;
+}
+#endif
+
+#ifdef emuINVADERS_REWIND
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Runs the displayed machine for some frames, steps back the same number of frames and runs the frames
+/// again. The rewound machine must be identical to the starting state and the frames must be emulated identically.
+/// @return True if the rewind history works correctly
+static bool benchRewindRoundTrip(void)
+{
+	emuInvadersState* start;
+	emuInvadersState* end;
+	emuRewindState* rewind = g_invaders_state.rewind;
+	uint32_t frame_count = rewind->FrameCount;
+	uint32_t used_bytes = emuRewindGetUsedBytes(rewind);
+	uint64_t rewind_time;
+	uint32_t i;
+	bool identical;
+
+	start = (emuInvadersState*)malloc(sizeof(emuInvadersState));
+	end = (emuInvadersState*)malloc(sizeof(emuInvadersState));
+	if (start == sysNULL || end == sysNULL)
+	{
+		free(start);
+		free(end);
+		return false;
+	}
+
+	g_invaders_state.display_enabled = false;
+
+	// run and rewind
+	*start = g_invaders_state;
+	emuInvadersInstanceStep(&g_invaders_state, benchREWIND_CHECK_FRAME_COUNT);
+	*end = g_invaders_state;
+
+	rewind_time = benchGetTime();
+	for (i = 0; i < benchREWIND_CHECK_FRAME_COUNT; i++)
+		emuInvadersInstanceStepBack(&g_invaders_state);
+	rewind_time = benchGetTime() - rewind_time;
+
+	identical = memcmp(start->ram, g_invaders_state.ram, emuINVADERS_RAM_SIZE) == 0 && start->cpu.reg.pc == g_invaders_state.cpu.reg.pc &&
+		start->cpu.cycles == g_invaders_state.cpu.cycles && start->frame_count == g_invaders_state.frame_count;
+
+	// emulate the rewound frames again
+	emuInvadersInstanceStep(&g_invaders_state, benchREWIND_CHECK_FRAME_COUNT);
+
+	identical = identical && memcmp(end->ram, g_invaders_state.ram, emuINVADERS_RAM_SIZE) == 0 && end->cpu.reg.pc == g_invaders_state.cpu.reg.pc &&
+		end->cpu.cycles == g_invaders_state.cpu.cycles && end->frame_count == g_invaders_state.frame_count;
+
+	printf("Rewind history:     %u frames in %u bytes (%.0f bytes/frame, %u KB buffer)\n", frame_count, used_bytes,
+		(frame_count > 0) ? (double)used_bytes / frame_count : 0.0, (unsigned)((rewind->RingSize + emuINVADERS_RAM_SIZE) / 1024));
+	printf("Rewind:             %u frames stepped back in %.1f us, %s\n", benchREWIND_CHECK_FRAME_COUNT, rewind_time / 1e3,
+		identical ? "rewound machine is identical" : "rewound machine is DIFFERENT");
+
+	free(start);
+	free(end);
+
+	return identical;
+}
+#endif
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Measures full screen redraw of the final video memory by the scanline renderer (one screen column is
+/// rendered into a line buffer and copied by bitblt) and by the vsync renderer of the build (column or tiled)
+static void benchMeasureRendering(void)
+{
+	const uint8_t* video_ram = emuInvadersInstanceGetVideoRAM(&g_invaders_state);
+	uint64_t scanline_time;
+	uint64_t vsync_time;
+	uint32_t frame;
+	uint16_t column;
+#ifdef emuINVADERS_TILED_RENDERING
+	uint32_t dirty_columns[emuINVADERS_SCREEN_WIDTH];
+#endif
+
+	scanline_time = benchGetTime();
+	for (frame = 0; frame < benchREDRAW_FRAME_COUNT; frame++)
+	{
+		for (column = 0; column < emuINVADERS_SCREEN_WIDTH; column++)
+		{
+			emuInvadersRender16bppScanLine((uint8_t*)&l_line_buffer[emuINVADERS_SCREEN_HEIGHT - 1], -1, column);
+			guiBitblt(column + emuINVADERS_SCREEN_LEFT, emuINVADERS_SCREEN_TOP, 1, emuINVADERS_SCREEN_HEIGHT, 0, 0, 1, emuINVADERS_SCREEN_HEIGHT, l_line_buffer, 16);
+		}
+	}
+	scanline_time = benchGetTime() - scanline_time;
+
+	vsync_time = benchGetTime();
+	for (frame = 0; frame < benchREDRAW_FRAME_COUNT; frame++)
+	{
+#ifdef emuINVADERS_TILED_RENDERING
+		for (column = 0; column < emuINVADERS_SCREEN_WIDTH; column++)
+			dirty_columns[column] = 0xffffffff;
+
+		emuInvadersRenderTiles(video_ram, dirty_columns);
+#else
+		for (column = 0; column < emuINVADERS_SCREEN_WIDTH; column++)
+			emuInvadersRenderColumn(column, video_ram + column * emuINVADERS_VIDEO_COLUMN_SIZE, 0xffffffff);
+#endif
+	}
+	vsync_time = benchGetTime() - vsync_time;
+
+#ifdef emuINVADERS_TILED_RENDERING
+	printf("Screen redraw:      scanline %.1f us, tiled (%ux%u) %.1f us\n", scanline_time / 1e3 / benchREDRAW_FRAME_COUNT, emuINVADERS_TILE_SIZE, emuINVADERS_TILE_SIZE, vsync_time / 1e3 / benchREDRAW_FRAME_COUNT);
+#else
+	printf("Screen redraw:      scanline %.1f us, column %.1f us\n", scanline_time / 1e3 / benchREDRAW_FRAME_COUNT, vsync_time / 1e3 / benchREDRAW_FRAME_COUNT);
+#endif
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Batch step function of the Invaders instances
+static void benchInstanceStep(void* in_instance, uint32_t in_frame_count)
+{
+	emuInvadersInstanceStep((emuInvadersState*)in_instance, in_frame_count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Runs independent emulator instances on a thread pool as fast as possible
+/// @param in_emulated_seconds Emulated time of each instance
+/// @param in_instance_count Number of instances
+/// @param in_thread_count Number of worker threads (in addition to the main thread)
+/// @return Exit code
+static int benchRunInstances(uint32_t in_emulated_seconds, uint32_t in_instance_count, uint32_t in_thread_count)
+{
+	emuBatchState batch;
+	emuInvadersState* states;
+	halWavePlayerBufferType* audio_buffers;
+	void** instances;
+	uint32_t i;
+	uint32_t second;
+	uint64_t start_time;
+	uint64_t run_time;
+	uint64_t instruction_count = 0;
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+	uint64_t idle_skipped_cycles = 0;
+#endif
+	double run_time_in_sec;
+	bool identical = true;
+#ifdef cpuI8080_BLOCK_CACHE
+	cpuI8080BlockCache* caches;
+
+	caches = (cpuI8080BlockCache*)calloc(in_instance_count, sizeof(cpuI8080BlockCache));
+	if (caches == sysNULL)
+	{
+		fprintf(stderr, "Can't allocate %u instances\n", in_instance_count);
+		return 1;
+	}
+#endif
+
+	states = (emuInvadersState*)calloc(in_instance_count, sizeof(emuInvadersState));
+	audio_buffers = (halWavePlayerBufferType*)calloc((size_t)in_instance_count * benchBATCH_FRAME_COUNT * emuINVADERS_AUDIO_SAMPLES_PER_FRAME, sizeof(halWavePlayerBufferType));
+	instances = (void**)calloc(in_instance_count, sizeof(void*));
+
+	if (states == sysNULL || audio_buffers == sysNULL || instances == sysNULL || !emuBatchInitialize(&batch, in_thread_count))
+	{
+		fprintf(stderr, "Can't allocate %u instances\n", in_instance_count);
+		return 1;
+	}
+
+	for (i = 0; i < in_instance_count; i++)
+	{
+		emuInvadersInstanceInitialize(&states[i]);
+		states[i].audio_buffer = &audio_buffers[(size_t)i * benchBATCH_FRAME_COUNT * emuINVADERS_AUDIO_SAMPLES_PER_FRAME];
+		states[i].audio_buffer_length = benchBATCH_FRAME_COUNT * emuINVADERS_AUDIO_SAMPLES_PER_FRAME;
+		instances[i] = &states[i];
+#ifdef cpuI8080_BLOCK_CACHE
+		cpuI8080SetExecMode(&states[i].cpu, l_exec_mode, &caches[i]);
+#endif
+	}
+
+	start_time = benchGetTime();
+
+	for (second = 0; second < in_emulated_seconds; second++)
+		emuBatchRun(&batch, instances, in_instance_count, benchBATCH_FRAME_COUNT, benchInstanceStep);
+
+	run_time = benchGetTime() - start_time;
+
+	emuBatchCleanup(&batch);
+
+	// all instances received the same input, their state must be the same
+	for (i = 0; i < in_instance_count; i++)
+	{
+		instruction_count += states[i].cpu.instruction_count;
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+		idle_skipped_cycles += states[i].cpu.idle_skipped_cycles;
+#endif
+
+		if (memcmp(states[i].ram, states[0].ram, emuINVADERS_RAM_SIZE) != 0 || states[i].audio_sample_count != states[0].audio_sample_count ||
+				memcmp(states[i].audio_buffer, states[0].audio_buffer, states[0].audio_sample_count * sizeof(halWavePlayerBufferType)) != 0)
+			identical = false;
+	}
+
+	// display results
+	run_time_in_sec = run_time / 1e9;
+
+	printf("Instances:          %u (%u worker threads + main thread)\n", in_instance_count, in_thread_count);
+	printf("Emulated time:      %u s per instance\n", in_emulated_seconds);
+	printf("Wall time:          %.3f s (%.1fx realtime)\n", run_time_in_sec, (double)in_emulated_seconds * in_instance_count / run_time_in_sec);
+	printf("Emulated clock:     %.2f MHz total\n", (double)in_emulated_seconds * in_instance_count * emuINVADERS_CPU_CLOCK / run_time_in_sec / 1e6);
+	printf("Frame rate:         %.1f frames/s total\n", (double)in_emulated_seconds * in_instance_count * emuINVADERS_FRAME_RATE / run_time_in_sec);
+	printf("Instructions:       %llu\n", (unsigned long long)instruction_count);
+	printf("Instruction time:   %.2f ns/instruction\n", (instruction_count > 0) ? (double)run_time / instruction_count : 0.0);
+	printf("Instance states:    %s\n", identical ? "identical" : "DIFFERENT");
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+	printf("Idle cycles:        %llu skipped (%.1f%%)\n", (unsigned long long)idle_skipped_cycles, 100.0 * idle_skipped_cycles / ((double)in_emulated_seconds * in_instance_count * emuINVADERS_CPU_CLOCK));
+#endif
+#ifdef cpuI8080_BLOCK_CACHE
+	benchPrintBlockStatistics(caches, in_instance_count);
+	free(caches);
+#endif
+
+	free(instances);
+	free(audio_buffers);
+	free(states);
+
+	return identical ? 0 : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Main entrance function of the benchmark
+/// Usage: InvadersBenchmark <rom file> [emulated seconds] [instances] [worker threads] [interpreter|block|differential]
+int main(int argc, char* argv[])
+{
+	uint32_t emulated_seconds = benchDEFAULT_EMULATED_SECONDS;
+	uint32_t instance_count = 0;
+	uint32_t thread_count = 0;
+	uint32_t half_frame_count;
+	uint32_t half_frame_index;
+	uint32_t instruction_count;
+#ifdef emuINVADERS_AUDIO_SYNC
+	emuInvadersSyncStatistics sync_statistics;
+#endif
+	uint64_t emulated_cycles;
+	uint64_t start_time;
+	uint64_t run_time;
+	double run_time_in_sec;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <rom file> [emulated seconds] [instances] [worker threads] [interpreter|block|differential]\n", argv[0]);
+		return 1;
+	}
+
+	if (argc > 2)
+		emulated_seconds = (uint32_t)atoi(argv[2]);
+
+	if (argc > 3)
+		instance_count = (uint32_t)atoi(argv[3]);
+
+	if (argc > 4)
+		thread_count = (uint32_t)atoi(argv[4]);
+
+#ifdef cpuI8080_BLOCK_CACHE
+	if (argc > 5 && !benchSetExecMode(argv[5]))
+		return 1;
+#endif
+
+	if (emulated_seconds == 0 || !benchLoadRom(argv[1]))
+		return 1;
+
+	sysInitialization();
+
+#ifdef cpuI8080_BLOCK_CACHE
+	cpuI8080SetExecMode(&g_invaders_state.cpu, l_exec_mode, &l_block_cache);
+#endif
+
+	// multiple instance mode
+	if (instance_count > 0)
+		return benchRunInstances(emulated_seconds, instance_count, thread_count);
+
+	// run emulator as fast as possible, virtual time is advanced by half frame time when the task has nothing to do
+	half_frame_count = emulated_seconds * emuINVADERS_FRAME_RATE * 2;
+
+	start_time = benchGetTime();
+
+	for (half_frame_index = 0; half_frame_index < half_frame_count; half_frame_index++)
+	{
+		halNullHighresTimerAdvance(benchHALF_FRAME_TIME);
+		while (emuInvadersTask());
+	}
+
+	run_time = benchGetTime() - start_time;
+
+	instruction_count = emuInvadersGetInstructionCount();
+
+#ifdef emuINVADERS_VSYNC_RENDERING
+	benchMeasureRendering();
+#endif
+
+	sysCleanup();
+
+	// display results
+	run_time_in_sec = run_time / 1e9;
+	emulated_cycles = (uint64_t)emulated_seconds * emuINVADERS_CPU_CLOCK;
+
+	printf("Emulated time:      %u s (%u frames)\n", emulated_seconds, half_frame_count / 2);
+	printf("Wall time:          %.3f s (%.1fx realtime)\n", run_time_in_sec, emulated_seconds / run_time_in_sec);
+	printf("Emulated clock:     %.2f MHz\n", emulated_cycles / run_time_in_sec / 1e6);
+	printf("Frame rate:         %.1f frames/s\n", half_frame_count / 2 / run_time_in_sec);
+	printf("Instructions:       %u\n", instruction_count);
+	printf("Instruction time:   %.2f ns/instruction\n", (instruction_count > 0) ? (double)run_time / instruction_count : 0.0);
+	printf("Audio buffers:      %u\n", halNullWavePlayerGetRenderedBufferCount());
+	printf("Rendered bytes:     %u (%.1f bytes/frame)\n", g_invaders_state.rendered_byte_count, (half_frame_count >= 2) ? (double)g_invaders_state.rendered_byte_count / (half_frame_count / 2) : 0.0);
+#ifdef emuINVADERS_AUDIO_SYNC
+	emuInvadersGetSyncStatistics(&sync_statistics);
+	printf("Dropped frames:     %u (buffer fill %u samples)\n", sync_statistics.dropped_frames, sync_statistics.buffer_fill);
+#endif
+#ifdef cpuI8080_IDLE_LOOP_SKIP
+	printf("Idle cycles:        %u skipped (%.1f%%)\n", g_invaders_state.cpu.idle_skipped_cycles, 100.0 * g_invaders_state.cpu.idle_skipped_cycles / emulated_cycles);
+#endif
+#ifdef cpuI8080_BLOCK_CACHE
+	benchPrintBlockStatistics(&l_block_cache, 1);
+#endif
+#ifdef cpuI8080_PROFILER
+	printf("\n");
+	cpuI8080ProfilerReport(&g_invaders_state.cpu, stdout);
+#endif
+#ifdef emuINVADERS_REWIND
+	if (!benchRewindRoundTrip())
+		return 1;
+#endif
+#ifdef cpuI8080_SNAPSHOT
+	if (!benchSnapshotRoundTrip())
+		return 1;
+#endif
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief User input handler (no input in headless mode)
+void sysUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategory in_event_category, sysUserInputEventType in_event_type, uint32_t in_event_param)
+{
+}
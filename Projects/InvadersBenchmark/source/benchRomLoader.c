@@ -0,0 +1,55 @@
+/*****************************************************************************/
+/* Space Invaders ROM loader for the headless benchmark                      */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdio.h>
+#include <emuInvaders.h>
+#include <benchRomLoader.h>
+
+/*****************************************************************************/
+/* Global variables                                                          */
+/*****************************************************************************/
+
+// ROM memory (invaders.h, invaders.g, invaders.f, invaders.e concatenated)
+unsigned char g_cpu_rom[emuINVADERS_ROM_SIZE];
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Loads ROM content from binary file
+/// @param in_file_name Name of the ROM image file
+/// @return True if ROM was loaded successfully
+bool benchLoadRom(const char* in_file_name)
+{
+	FILE* rom_file;
+	size_t length;
+
+	rom_file = fopen(in_file_name, "rb");
+	if (rom_file == NULL)
+	{
+		fprintf(stderr, "Cannot open ROM file: %s\n", in_file_name);
+		return false;
+	}
+
+	length = fread(g_cpu_rom, 1, emuINVADERS_ROM_SIZE, rom_file);
+	fclose(rom_file);
+
+	if (length != emuINVADERS_ROM_SIZE)
+	{
+		fprintf(stderr, "Invalid ROM file size: %s (%d bytes expected)\n", in_file_name, emuINVADERS_ROM_SIZE);
+		return false;
+	}
+
+	return true;
+}
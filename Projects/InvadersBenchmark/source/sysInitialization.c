@@ -0,0 +1,43 @@
+/*****************************************************************************/
+/* System initialization function for headless benchmark                     */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <guiColorGraphics.h>
+#include <halWavePlayer.h>
+#include <waveMixer.h>
+#include <halNull.h>
+#include <emuInvaders.h>
+#include "sysConfig.h"
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief System initialization function
+void sysInitialization(void)
+{
+	halHighresTimerInit();
+	guiColorGraphicsInitialize();
+	emuInvadersInitialize();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Cleans up system
+void sysCleanup(void)
+{
+	halWavePlayerCleanUp();
+#ifdef waveMIXER_WAVE_CACHE
+	waveMixerWaveCacheCleanup();
+#endif
+	guiColorGraphicsCleanup();
+}
@@ -32,12 +32,25 @@
 #define guiemuZOOM 1
 #define guiemuBACKGROUND_COLOR 0x00000000
 #define guiemuFOREGROUND_COLOR 0xffffffff
+#define emuINVADERS_VSYNC_RENDERING						// video RAM changes are rendered once per frame at vsync
 
 ///////////////////////////////////////////////////////////////////////////////
 // Wave config
 #define halWAVEPLAYER_SAMPLE_RATE 44100
 #define halWAVEPLAYER_SAMPLE_OFFSET 0
 #define halWAVEPLAYER_SAMPLE_MULTIPLIER 64
+#define halWAVEPLAYER_BUFFER_LENGTH 512						// samples per buffer (the device buffer is two buffers long)
+#define halWAVEPLAYER_BUFFER_COUNT 4							// maximum number of buffers queued for the writer thread
+#define halWAVEPLAYER_THREAD_PRIORITY 50					// real-time priority of the writer thread
+#define waveMIXER_WAVE_CACHE											// sounds are converted to the output sample rate at initialization
+
+///////////////////////////////////////////////////////////////////////////////
+// Timing config
+#define sysMAIN_LOOP_SLEEP 1								// main loop sleeps until input, audio refill or the next half frame (0: busy wait)
+#define halHIGHRES_TIMER_SPIN_MARGIN 200		// end of the sleep is busy waiting to compensate wake up latency (in us)
+#define emuINVADERS_AUDIO_SYNC								// emulation speed follows the played samples of the audio device
+#define emuINVADERS_AUDIO_SYNC_MAX_CATCH_UP 4		// maximum lag behind the audio clock (in frames)
+#define emuINVADERS_AUDIO_SYNC_MAX_FRAME_SKIP 3	// maximum number of consecutive frames without rendering
 
 ///////////////////////////////////////////////////////////////////////////////
 // Resource config
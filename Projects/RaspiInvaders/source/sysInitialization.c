@@ -14,7 +14,9 @@
 #include <sysUserInput.h>
 #include <guiColorGraphics.h>
 #include <halWavePlayer.h>
+#include <waveMixer.h>
 #include <halKeyboardInput.h>
+#include <halEventLoop.h>
 #include <sysHighresTimer.h>
 #include "sysConfig.h"
 
@@ -31,12 +33,21 @@ void sysInitialization(void)
 	halKeyboardInputInitialize();
 	guiColorGraphicsInitialize();
 	emuInvadersInitialize();
+#if sysMAIN_LOOP_SLEEP
+	halEventLoopInitialize();
+#endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @brief Cleans up system
 void sysCleanup(void)
 {
+#if sysMAIN_LOOP_SLEEP
+	halEventLoopCleanup();
+#endif
 	halWavePlayerCleanUp();
+#ifdef waveMIXER_WAVE_CACHE
+	waveMixerWaveCacheCleanup();
+#endif
 	halKeyboardInputCleanup();
 }
\ No newline at end of file
@@ -1,9 +1,22 @@
 #include <sysUserInput.h>
+#include <sysHighresTimer.h>
+#include <halEventLoop.h>
+#include <halKeyboardInput.h>
 #include <emuInvaders.h>
+#include "sysConfig.h"
 
 void sysMainTask(void)
 {
+#if sysMAIN_LOOP_SLEEP
+	if (!emuInvadersTask())
+	{
+		// nothing to emulate until keyboard input, audio buffer refill or the next half frame
+		halEventLoopWait(emuInvadersGetNextTaskTime());
+	}
+#else
+	halKeyboardDispatchEvent();
 	emuInvadersTask();
+#endif
 }
 
 void drvUserInputEventHandler(uint8_t in_device_number, sysUserInputEventCategory in_event_category, sysUserInputEventType in_event_type, uint32_t in_event_param)
@@ -0,0 +1,162 @@
+/*****************************************************************************/
+/* Offline decoder of the binary instruction trace files                     */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <cpuTrace.h>
+#include <cpuI8080.h>
+#include <cpuZ80.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define trdecTEXT_LENGTH 32
+
+// magic number of the files written on a host with different byte order
+#define trdecSWAPPED_FILE_MAGIC 0x54524345
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+typedef uint8_t (*trdecDisassembler)(const uint8_t* in_code, uint16_t in_address, char* out_text);
+
+/*****************************************************************************/
+/* Module global variables                                                   */
+/*****************************************************************************/
+static const char* l_cpu_names[] = { "unknown", "i8080", "Z80" };
+static const char* l_trigger_names[] = { "none (saved while recording)", "breakpoint", "illegal opcode", "user request" };
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Prints one record
+/// @param in_record Record to print
+/// @param in_disassembler Disassembler of the traced CPU
+/// @param in_index_registers True if IX and IY are printed
+static void trdecPrintRecord(const cpuTraceRecord* in_record, trdecDisassembler in_disassembler, bool in_index_registers)
+{
+	char text[trdecTEXT_LENGTH];
+	uint8_t length;
+	uint8_t i;
+
+	length = in_disassembler(in_record->Code, in_record->PC, text);
+
+	printf("%12llu  %04X  ", (unsigned long long)in_record->Cycles, in_record->PC);
+	for (i = 0; i < cpuTRACE_CODE_LENGTH; i++)
+		printf((i < length) ? "%02X " : "   ", in_record->Code[i]);
+
+	printf(" %-18s AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X", text, in_record->AF, in_record->BC, in_record->DE, in_record->HL, in_record->SP);
+	if (in_index_registers)
+		printf(" IX=%04X IY=%04X", in_record->IX, in_record->IY);
+	printf(" IE=%X\n", in_record->InterruptEnable);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Main entrance function of the trace decoder
+/// Usage: TraceDecoder trace_file [record_count]
+int main(int argc, char* argv[])
+{
+	FILE* trace_file;
+	cpuTraceFileHeader header;
+	cpuTraceRecord record;
+	trdecDisassembler disassembler;
+	long file_length;
+	uint32_t record_count;
+	uint32_t first_record;
+	uint32_t i;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: TraceDecoder trace_file [record_count]\n");
+		return 1;
+	}
+
+	trace_file = fopen(argv[1], "rb");
+	if (trace_file == NULL)
+	{
+		fprintf(stderr, "Can't open file: %s\n", argv[1]);
+		return 1;
+	}
+
+	// check header
+	if (fread(&header, sizeof(header), 1, trace_file) != 1 || (header.Magic != cpuTRACE_FILE_MAGIC && header.Magic != trdecSWAPPED_FILE_MAGIC))
+	{
+		fprintf(stderr, "Invalid trace file: %s\n", argv[1]);
+		fclose(trace_file);
+		return 1;
+	}
+
+	if (header.Magic == trdecSWAPPED_FILE_MAGIC)
+	{
+		fprintf(stderr, "Trace file is written on a host with different byte order: %s\n", argv[1]);
+		fclose(trace_file);
+		return 1;
+	}
+
+	if (header.Version != cpuTRACE_FILE_VERSION || header.RecordSize != sizeof(cpuTraceRecord))
+	{
+		fprintf(stderr, "Unsupported trace file version: %u\n", header.Version);
+		fclose(trace_file);
+		return 1;
+	}
+
+	switch (header.CPUType)
+	{
+		case cpuTRACE_CPU_I8080:
+			disassembler = cpuI8080Disassemble;
+			break;
+
+		case cpuTRACE_CPU_Z80:
+			disassembler = cpuZ80Disassemble;
+			break;
+
+		default:
+			fprintf(stderr, "Unknown CPU type: %u\n", header.CPUType);
+			fclose(trace_file);
+			return 1;
+	}
+
+	// select records to print
+	fseek(trace_file, 0, SEEK_END);
+	file_length = ftell(trace_file);
+	record_count = (uint32_t)((file_length - (long)sizeof(header)) / sizeof(cpuTraceRecord));
+
+	first_record = 0;
+	if (argc > 2 && (uint32_t)atol(argv[2]) < record_count)
+		first_record = record_count - (uint32_t)atol(argv[2]);
+
+	fseek(trace_file, (long)(sizeof(header) + first_record * sizeof(cpuTraceRecord)), SEEK_SET);
+
+	printf("CPU:        %s\n", l_cpu_names[header.CPUType]);
+	printf("Records:    %u\n", record_count);
+	printf("Trigger:    %s", (header.Trigger < sizeof(l_trigger_names) / sizeof(l_trigger_names[0])) ? l_trigger_names[header.Trigger] : "unknown");
+	if (header.Trigger != cpuTRACE_TRIGGER_NONE)
+		printf(" at %04X", header.TriggerAddress);
+	printf("\n\n");
+
+	// decode records
+	for (i = first_record; i < record_count; i++)
+	{
+		if (fread(&record, sizeof(record), 1, trace_file) != 1)
+			break;
+
+		trdecPrintRecord(&record, disassembler, header.CPUType == cpuTRACE_CPU_Z80);
+	}
+
+	fclose(trace_file);
+
+	return 0;
+}
@@ -32,12 +32,14 @@
 #define guiemuZOOM 1
 #define guiemuBACKGROUND_COLOR 0x00000000
 #define guiemuFOREGROUND_COLOR 0xffffffff
+#define emuINVADERS_VSYNC_RENDERING						// video RAM changes are rendered once per frame at vsync
 
 ///////////////////////////////////////////////////////////////////////////////
 // Wave config
 #define halWAVEPLAYER_SAMPLE_RATE 44100
 #define halWAVEPLAYER_SAMPLE_OFFSET 0
 #define halWAVEPLAYER_SAMPLE_MULTIPLIER 64
+#define waveMIXER_WAVE_CACHE											// sounds are converted to the output sample rate at initialization
 
 ///////////////////////////////////////////////////////////////////////////////
 // Resource config
@@ -14,6 +14,7 @@
 #include <sysUserInput.h>
 #include <guiColorGraphics.h>
 #include <halWavePlayer.h>
+#include <waveMixer.h>
 #include <sysHighresTimer.h>
 #include "sysConfig.h"
 
@@ -36,4 +37,7 @@ void sysInitialization(void)
 void sysCleanup(void)
 {
 	halWavePlayerCleanUp();
+#ifdef waveMIXER_WAVE_CACHE
+	waveMixerWaveCacheCleanup();
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,427 @@
+/*****************************************************************************/
+/* Z80 CPU emulator conformance (CP/M instruction exerciser) and speed test  */
+/*                                                                           */
+/* Copyright (C) 2016 Laszlo Arvai                                           */
+/* All rights reserved.                                                      */
+/*                                                                           */
+/* This software may be modified and distributed under the terms             */
+/* of the GNU General Public License.  See the LICENSE file for details.     */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Includes                                                                  */
+/*****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <cpuZ80.h>
+
+/*****************************************************************************/
+/* Constants                                                                 */
+/*****************************************************************************/
+#define z80exMEMORY_SIZE 65536
+
+// CP/M layout
+#define z80exCPM_WARM_BOOT_ADDRESS 0x0000
+#define z80exCPM_BDOS_ENTRY_ADDRESS 0x0005
+#define z80exCPM_BDOS_ADDRESS 0xfe00
+#define z80exCPM_TPA_ADDRESS 0x0100
+
+// BDOS functions
+#define z80exBDOS_CONSOLE_OUTPUT 2
+#define z80exBDOS_PRINT_STRING 9
+
+// speed test layout
+#define z80exSPEED_CODE_ADDRESS 0x8000
+#define z80exSPEED_DATA_ADDRESS 0xc000
+#define z80exSPEED_BLOCK_REPEAT 32
+#define z80exSPEED_CYCLES (200*1000*1000)	// emulated cycles per opcode group
+
+#define z80exEXECUTE_SLICE 100000		// cycles executed by one cpuExecute call
+
+#define z80exTRACE_FILE_NAME "Z80ExerciserTrace.bin"
+#define z80exTRACE_RECORD_COUNT 65536
+
+/*****************************************************************************/
+/* Types                                                                     */
+/*****************************************************************************/
+
+// opcode group speed test description
+typedef struct
+{
+	const char* Name;
+	const uint8_t* Code;
+	uint16_t CodeLength;
+} z80exOpcodeGroup;
+
+/*****************************************************************************/
+/* Module global variables                                                   */
+/*****************************************************************************/
+static uint8_t l_memory[z80exMEMORY_SIZE];
+static cpuZ80State l_cpu;
+static bool l_exit_requested;
+static int l_exit_skipped_cycles;
+
+#ifdef cpuZ80_PROFILER
+static cpuProfilerState l_profiler;
+#endif
+
+#ifdef cpuZ80_TRACE
+static cpuTraceBuffer l_trace;
+static cpuTraceRecord l_trace_records[z80exTRACE_RECORD_COUNT];
+#endif
+
+// exerciser console output analysis
+static char l_output_line[256];
+static int l_output_line_length;
+static int l_test_ok_count;
+static int l_test_error_count;
+
+// opcode group instruction mixes (IX, IY and HL points to the data area)
+static const uint8_t l_main_group[] =
+{
+	0x78,							// ld a,b
+	0x81,							// add a,c
+	0x14,							// inc d
+	0x1d,							// dec e
+	0x57,							// ld d,a
+	0xa5,							// and l
+	0xf6, 0x5a,				// or 5ah
+	0xa8,							// xor b
+	0x77,							// ld (hl),a
+	0x46,							// ld b,(hl)
+	0x23,							// inc hl
+	0x2b,							// dec hl
+	0xc5,							// push bc
+	0xc1,							// pop bc
+	0x07,							// rlca
+	0x2f							// cpl
+};
+
+static const uint8_t l_alu_group[] =
+{
+	0x80,							// add a,b
+	0x89,							// adc a,c
+	0x92,							// sub d
+	0x9b,							// sbc a,e
+	0x0c,							// inc c
+	0x15,							// dec d
+	0xc6, 0x11,				// add a,11h
+	0xbc,							// cp h
+	0x20, 0x00,				// jr nz,$+2
+	0xb7,							// or a
+	0x28, 0x00				// jr z,$+2
+};
+
+static const uint8_t l_cb_group[] =
+{
+	0xcb, 0x00,				// rlc b
+	0xcb, 0x09,				// rrc c
+	0xcb, 0x22,				// sla d
+	0xcb, 0x3b,				// srl e
+	0xcb, 0x5f,				// bit 3,a
+	0xcb, 0xe0,				// set 4,b
+	0xcb, 0xa0,				// res 4,b
+	0xcb, 0x16,				// rl (hl)
+	0xcb, 0x7e				// bit 7,(hl)
+};
+
+static const uint8_t l_ed_group[] =
+{
+	0xed, 0x44,				// neg
+	0xed, 0x47,				// ld i,a
+	0xed, 0x57,				// ld a,i
+	0xed, 0x56,				// im 1
+	0xed, 0x43, 0x10, 0xc0, // ld (c010h),bc
+	0xed, 0x4b, 0x10, 0xc0, // ld bc,(c010h)
+	0xed, 0x53, 0x12, 0xc0, // ld (c012h),de
+	0xed, 0x5b, 0x12, 0xc0, // ld de,(c012h)
+	0xed, 0x78				// in a,(c)
+};
+
+static const uint8_t l_xx_group[] =
+{
+	0xdd, 0x7e, 0x01,	// ld a,(ix+1)
+	0xdd, 0x77, 0x02,	// ld (ix+2),a
+	0xdd, 0x23,				// inc ix
+	0xdd, 0x2b,				// dec ix
+	0xfd, 0x46, 0x03,	// ld b,(iy+3)
+	0xfd, 0x86, 0x04,	// add a,(iy+4)
+	0xdd, 0x34, 0x05,	// inc (ix+5)
+	0xdd, 0xe5,				// push ix
+	0xdd, 0xe1,				// pop ix
+	0xfd, 0x36, 0x06, 0x55 // ld (iy+6),55h
+};
+
+static const uint8_t l_xxcb_group[] =
+{
+	0xdd, 0xcb, 0x01, 0x46, // bit 0,(ix+1)
+	0xdd, 0xcb, 0x02, 0xce, // set 1,(ix+2)
+	0xdd, 0xcb, 0x02, 0x8e, // res 1,(ix+2)
+	0xfd, 0xcb, 0x03, 0x06, // rlc (iy+3)
+	0xfd, 0xcb, 0x04, 0x3e, // srl (iy+4)
+	0xfd, 0xcb, 0x05, 0x7e	// bit 7,(iy+5)
+};
+
+static const uint8_t l_block_group[] =
+{
+	0x21, 0x00, 0xc0,	// ld hl,c000h
+	0x11, 0x00, 0xd0,	// ld de,d000h
+	0x01, 0x00, 0x04,	// ld bc,400h
+	0xed, 0xb0,				// ldir
+	0x2b,							// dec hl
+	0x1b,							// dec de
+	0x01, 0x00, 0x04,	// ld bc,400h
+	0xed, 0xb8,				// lddr
+	0x3e, 0x5a,				// ld a,5ah
+	0x01, 0x00, 0x04,	// ld bc,400h
+	0xed, 0xb1				// cpir
+};
+
+static const z80exOpcodeGroup l_opcode_groups[] =
+{
+	{ "main",  l_main_group, sizeof(l_main_group) },
+	{ "ALU",   l_alu_group,  sizeof(l_alu_group) },
+	{ "CB",    l_cb_group,   sizeof(l_cb_group) },
+	{ "ED",    l_ed_group,   sizeof(l_ed_group) },
+	{ "DD/FD", l_xx_group,   sizeof(l_xx_group) },
+	{ "DDCB",  l_xxcb_group, sizeof(l_xxcb_group) },
+	{ "Block", l_block_group, sizeof(l_block_group) }
+};
+
+/*****************************************************************************/
+/* Function implementation                                                   */
+/*****************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Gets monotonic wall clock time
+/// @return Time in ns
+static uint64_t z80exGetTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Processes one character of the exerciser console output
+/// @param in_char Character to print
+static void z80exConsoleOutput(char in_char)
+{
+	putchar(in_char);
+
+	if (in_char == '\n' || in_char == '\r')
+	{
+		// check test result
+		l_output_line[l_output_line_length] = '\0';
+
+		if (strstr(l_output_line, "ERROR") != NULL)
+			l_test_error_count++;
+		else
+			if (l_output_line_length >= 2 && strcmp(l_output_line + l_output_line_length - 2, "OK") == 0)
+				l_test_ok_count++;
+
+		l_output_line_length = 0;
+	}
+	else
+	{
+		if (l_output_line_length < sizeof(l_output_line) - 1)
+			l_output_line[l_output_line_length++] = in_char;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Handles ED FE patch instruction (BDOS call and warm boot)
+/// @param R CPU registers
+void cpuZ80Patch(register cpuZ80State *R)
+{
+	uint16_t address;
+
+	switch ((uint16_t)(R->PC.W - 2))
+	{
+		case z80exCPM_WARM_BOOT_ADDRESS:
+			// stay at warm boot address and end execution
+			l_exit_requested = true;
+			l_exit_skipped_cycles = R->ICyclesRequested - R->ICount;
+			R->PC.W = z80exCPM_WARM_BOOT_ADDRESS;
+			R->ICount = R->ICyclesRequested;
+			break;
+
+		case z80exCPM_BDOS_ADDRESS:
+			switch (R->BC.B.l)
+			{
+				case z80exBDOS_CONSOLE_OUTPUT:
+					z80exConsoleOutput((char)R->DE.B.l);
+					break;
+
+				case z80exBDOS_PRINT_STRING:
+					address = R->DE.W;
+					while (l_memory[address] != '$')
+						z80exConsoleOutput((char)l_memory[address++]);
+					break;
+			}
+			break;
+	}
+
+	fflush(stdout);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Runs CP/M instruction exerciser (zexdoc.com, zexall.com)
+/// @param in_file_name Name of the CP/M executable
+/// @return True if all tests are passed
+static bool z80exRunExerciser(const char* in_file_name)
+{
+	FILE* com_file;
+	size_t length;
+	uint64_t start_time;
+	uint64_t run_time;
+	uint64_t cycles = 0;
+
+	// load program
+	memset(l_memory, 0, sizeof(l_memory));
+
+	com_file = fopen(in_file_name, "rb");
+	if (com_file == NULL)
+	{
+		fprintf(stderr, "Cannot open file: %s\n", in_file_name);
+		return false;
+	}
+
+	length = fread(&l_memory[z80exCPM_TPA_ADDRESS], 1, z80exCPM_BDOS_ADDRESS - z80exCPM_TPA_ADDRESS, com_file);
+	fclose(com_file);
+
+	if (length == 0)
+	{
+		fprintf(stderr, "Invalid file: %s\n", in_file_name);
+		return false;
+	}
+
+	// warm boot: ED FE
+	l_memory[z80exCPM_WARM_BOOT_ADDRESS + 0] = 0xed;
+	l_memory[z80exCPM_WARM_BOOT_ADDRESS + 1] = 0xfe;
+
+	// BDOS entry: jp BDOS (address is used as top of the TPA)
+	l_memory[z80exCPM_BDOS_ENTRY_ADDRESS + 0] = 0xc3;
+	l_memory[z80exCPM_BDOS_ENTRY_ADDRESS + 1] = z80exCPM_BDOS_ADDRESS & 0xff;
+	l_memory[z80exCPM_BDOS_ENTRY_ADDRESS + 2] = z80exCPM_BDOS_ADDRESS >> 8;
+
+	// BDOS: ED FE, ret
+	l_memory[z80exCPM_BDOS_ADDRESS + 0] = 0xed;
+	l_memory[z80exCPM_BDOS_ADDRESS + 1] = 0xfe;
+	l_memory[z80exCPM_BDOS_ADDRESS + 2] = 0xc9;
+
+	// start program
+	cpuReset(&l_cpu);
+	l_cpu.PC.W = z80exCPM_TPA_ADDRESS;
+	l_cpu.SP.W = z80exCPM_BDOS_ADDRESS;
+
+	l_exit_requested = false;
+	l_output_line_length = 0;
+	l_test_ok_count = 0;
+	l_test_error_count = 0;
+
+	start_time = z80exGetTime();
+
+	while (!l_exit_requested)
+		cycles += cpuExecute(&l_cpu, z80exEXECUTE_SLICE);
+
+	run_time = z80exGetTime() - start_time;
+	cycles -= l_exit_skipped_cycles;
+
+	printf("\n");
+	printf("Exerciser result:   %d passed, %d failed\n", l_test_ok_count, l_test_error_count);
+	printf("Exerciser speed:    %.2f MHz, %.2f Minstructions/s (%.3f s)\n", cycles * 1e3 / run_time, l_cpu.InstructionCount * 1e3 / run_time, run_time / 1e9);
+
+	return l_test_error_count == 0 && l_test_ok_count > 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Measures instruction execution speed of the given opcode group
+/// @param in_group Opcode group description
+static void z80exRunOpcodeGroupSpeed(const z80exOpcodeGroup* in_group)
+{
+	uint16_t address;
+	int i;
+	uint64_t start_time;
+	uint64_t run_time;
+	uint64_t cycles = 0;
+
+	memset(l_memory, 0, sizeof(l_memory));
+
+	// generate code: repeated instruction block followed by jp to the beginning
+	address = z80exSPEED_CODE_ADDRESS;
+	for (i = 0; i < z80exSPEED_BLOCK_REPEAT; i++)
+	{
+		memcpy(&l_memory[address], in_group->Code, in_group->CodeLength);
+		address += in_group->CodeLength;
+	}
+
+	l_memory[address++] = 0xc3;
+	l_memory[address++] = z80exSPEED_CODE_ADDRESS & 0xff;
+	l_memory[address++] = z80exSPEED_CODE_ADDRESS >> 8;
+
+	// set up registers
+	cpuReset(&l_cpu);
+	l_cpu.PC.W = z80exSPEED_CODE_ADDRESS;
+	l_cpu.SP.W = 0xff00;
+	l_cpu.HL.W = z80exSPEED_DATA_ADDRESS;
+	l_cpu.IX.W = z80exSPEED_DATA_ADDRESS;
+	l_cpu.IY.W = z80exSPEED_DATA_ADDRESS + 0x10;
+
+	start_time = z80exGetTime();
+
+	while (cycles < z80exSPEED_CYCLES)
+		cycles += cpuExecute(&l_cpu, z80exEXECUTE_SLICE);
+
+	run_time = z80exGetTime() - start_time;
+
+	printf("  %-6s %8.2f Minstructions/s %8.2f MHz %7.2f ns/instruction\n", in_group->Name, l_cpu.InstructionCount * 1e3 / run_time, cycles * 1e3 / run_time, (double)run_time / l_cpu.InstructionCount);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Main entrance function of the Z80 exerciser
+/// Usage: Z80Exerciser [zexdoc.com|zexall.com]
+int main(int argc, char* argv[])
+{
+	bool success = true;
+	int i;
+
+	// flat 64k RAM
+	cpuZ80MemoryMapReset(&l_cpu);
+	cpuZ80MapMemory(&l_cpu, 0, z80exMEMORY_SIZE, l_memory, l_memory);
+
+#ifdef cpuZ80_PROFILER
+	cpuProfilerReset(&l_profiler);
+	cpuZ80AttachProfiler(&l_cpu, &l_profiler);
+#endif
+
+#ifdef cpuZ80_TRACE
+	cpuTraceInitialize(&l_trace, l_trace_records, z80exTRACE_RECORD_COUNT);
+	cpuZ80AttachTrace(&l_cpu, &l_trace);
+#endif
+
+	// conformance test
+	if (argc > 1)
+		success = z80exRunExerciser(argv[1]);
+
+	// speed test
+	printf("Opcode group speed:\n");
+	for (i = 0; i < sizeof(l_opcode_groups) / sizeof(l_opcode_groups[0]); i++)
+		z80exRunOpcodeGroupSpeed(&l_opcode_groups[i]);
+
+#ifdef cpuZ80_PROFILER
+	printf("\n");
+	cpuZ80ProfilerReport(&l_cpu, stdout);
+#endif
+
+#ifdef cpuZ80_TRACE
+	cpuTraceStop(&l_trace, cpuTRACE_TRIGGER_USER, l_cpu.PC.W);
+	cpuTraceSave(&l_trace, z80exTRACE_FILE_NAME);
+#endif
+
+	return success ? 0 : 1;
+}